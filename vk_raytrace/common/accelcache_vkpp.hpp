@@ -0,0 +1,196 @@
+/* Copyright (c) 2014-2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <array>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+/**
+# class nvvkpp::AccelerationCache
+
+Storing serialized acceleration structures in a file, to avoid rebuilding them at each start.
+
+- Entries are blobs written by `vkCmdCopyAccelerationStructureToMemoryKHR`, indexed by a 64-bit key
+- The file is discarded when it was written with another driver (driver UUID)
+- The blobs still have to be validated with `vkGetDeviceAccelerationStructureCompatibilityKHR`
+- Only the entries found or stored since the load are written back, so the blobs of models that
+  are no longer loaded are evicted. The file never grows past `setMaxSize` bytes of blobs.
+
+~~~~ C++
+nvvkpp::AccelerationCache cache;
+cache.load(getCachePath("accel_cache.bin"), driverUUID);
+if(const auto* blob = cache.find(key))
+  // deserialize the blob
+else
+  cache.store(key, std::move(serialized));
+cache.save();
+~~~~
+*/
+
+namespace nvvkpp {
+
+struct AccelerationCache
+{
+  using DriverUUID = std::array<uint8_t, VK_UUID_SIZE>;
+
+  //--------------------------------------------------------------------------------------------------
+  // Reading all entries of the file, the cache stays empty if the file is missing, invalid
+  // or was written by another driver
+  //
+  void load(const std::string& filename, const DriverUUID& driverUUID)
+  {
+    m_filename   = filename;
+    m_driverUUID = driverUUID;
+    m_entries.clear();
+    m_used.clear();
+    m_size  = 0;
+    m_dirty = false;
+
+    std::ifstream file(filename, std::ios::binary);
+    if(!file.is_open())
+      return;
+
+    uint32_t   magic{0}, version{0}, count{0};
+    DriverUUID uuid{};
+    file.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+    file.read(reinterpret_cast<char*>(&version), sizeof(version));
+    file.read(reinterpret_cast<char*>(uuid.data()), uuid.size());
+    file.read(reinterpret_cast<char*>(&count), sizeof(count));
+    if(!file || magic != s_magic || version != s_version || uuid != m_driverUUID)
+      return;
+
+    for(uint32_t i = 0; i < count; i++)
+    {
+      uint64_t key{0}, size{0};
+      file.read(reinterpret_cast<char*>(&key), sizeof(key));
+      file.read(reinterpret_cast<char*>(&size), sizeof(size));
+      std::vector<uint8_t> blob(size);
+      file.read(reinterpret_cast<char*>(blob.data()), size);
+      if(!file)
+      {
+        m_entries.clear();  // Truncated file
+        m_size = 0;
+        return;
+      }
+      m_size += blob.size();
+      m_entries[key] = std::move(blob);
+    }
+  }
+
+  // Return the blob stored with `key`, or nullptr
+  const std::vector<uint8_t>* find(uint64_t key)
+  {
+    auto it = m_entries.find(key);
+    if(it == m_entries.end())
+      return nullptr;
+    m_used.insert(key);
+    return &it->second;
+  }
+
+  // Add or replace the blob of `key`, unless the cache would exceed its maximum size
+  void store(uint64_t key, std::vector<uint8_t>&& blob)
+  {
+    auto   it      = m_entries.find(key);
+    size_t oldSize = it != m_entries.end() ? it->second.size() : 0;
+    if(m_size - oldSize + blob.size() > m_maxSize)
+      return;
+    m_size         = m_size - oldSize + blob.size();
+    m_entries[key] = std::move(blob);
+    m_used.insert(key);
+    m_dirty = true;
+  }
+
+  // Maximum total size of the blobs, in bytes
+  void setMaxSize(size_t maxSize) { m_maxSize = maxSize; }
+
+  //--------------------------------------------------------------------------------------------------
+  // Writing back the entries used since the load, if any was added or is now stale
+  //
+  void save()
+  {
+    if(m_filename.empty())
+      return;
+
+    // Evicting the entries that were not used by this run
+    for(auto it = m_entries.begin(); it != m_entries.end();)
+    {
+      if(m_used.count(it->first) != 0)
+      {
+        ++it;
+        continue;
+      }
+      m_size -= it->second.size();
+      it      = m_entries.erase(it);
+      m_dirty = true;
+    }
+    if(!m_dirty)
+      return;
+
+    std::ofstream file(m_filename, std::ios::binary | std::ios::trunc);
+    if(!file.is_open())
+      return;
+
+    uint32_t magic   = s_magic;
+    uint32_t version = s_version;
+    uint32_t count   = static_cast<uint32_t>(m_entries.size());
+    file.write(reinterpret_cast<const char*>(&magic), sizeof(magic));
+    file.write(reinterpret_cast<const char*>(&version), sizeof(version));
+    file.write(reinterpret_cast<const char*>(m_driverUUID.data()), m_driverUUID.size());
+    file.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    for(const auto& e : m_entries)
+    {
+      uint64_t size = e.second.size();
+      file.write(reinterpret_cast<const char*>(&e.first), sizeof(e.first));
+      file.write(reinterpret_cast<const char*>(&size), sizeof(size));
+      file.write(reinterpret_cast<const char*>(e.second.data()), size);
+    }
+    m_dirty = false;
+  }
+
+  // True once a cache file was given with load()
+  bool isEnabled() const { return !m_filename.empty(); }
+
+private:
+  static constexpr uint32_t s_magic{0x53415643};  // 'CVAS'
+  static constexpr uint32_t s_version{1};
+
+  std::string                                        m_filename;
+  DriverUUID                                         m_driverUUID{};
+  std::unordered_map<uint64_t, std::vector<uint8_t>> m_entries;
+  std::unordered_set<uint64_t>                       m_used;  // Keys found or stored since load
+  size_t                                             m_size{0};
+  size_t                                             m_maxSize{size_t(256) << 20};
+  bool                                               m_dirty{false};
+};
+
+}  // namespace nvvkpp
@@ -80,8 +80,8 @@ struct TextureDedicated : public ImageDedicated
 
 struct AccelerationDedicated
 {
-  vk::AccelerationStructureNV accel;
-  vk::DeviceMemory            allocation;
+  vk::AccelerationStructureKHR accel;
+  BufferDedicated              buffer;  // Storage backing the acceleration structure
 };
 
 
@@ -126,6 +126,10 @@ public:
     vk::MemoryAllocateInfo memAlloc;
     memAlloc.setAllocationSize(memReqs.size);
     memAlloc.setMemoryTypeIndex(getMemoryType(memReqs.memoryTypeBits, memUsage_));
+    // Buffers queried with vkGetBufferDeviceAddress need memory allocated with the matching flag
+    vk::MemoryAllocateFlagsInfo memFlagInfo(vk::MemoryAllocateFlagBits::eDeviceAddress);
+    if(info_.usage & vk::BufferUsageFlagBits::eShaderDeviceAddress)
+      memAlloc.setPNext(&memFlagInfo);
     resultBuffer.allocation = AllocateMemory(memAlloc);
     checkMemory(resultBuffer.allocation);
 
@@ -277,32 +281,23 @@ public:
 
   //--------------------------------------------------------------------------------------------------
   // Create the acceleration structure
+  // - The size must be set in `accel_`, the backing buffer is created and set by this function
+  // - Acceleration structures built with host commands must be in host-visible memory
   //
-  AccelerationDedicated createAcceleration(vk::AccelerationStructureCreateInfoNV& accel_)
+  AccelerationDedicated createAcceleration(
+      vk::AccelerationStructureCreateInfoKHR& accel_,
+      const vk::MemoryPropertyFlags           memUsage_ = vk::MemoryPropertyFlagBits::eDeviceLocal)
   {
     AccelerationDedicated resultAccel;
-    // 1. Create the acceleration structure
-    resultAccel.accel = m_device.createAccelerationStructureNV(accel_);
+    // 1. Allocate the buffer holding the acceleration structure
+    resultAccel.buffer = createBuffer(accel_.size,
+                                      vk::BufferUsageFlagBits::eAccelerationStructureStorageKHR
+                                          | vk::BufferUsageFlagBits::eShaderDeviceAddress,
+                                      memUsage_);
 
-    // 2. Find memory requirements
-    vk::AccelerationStructureMemoryRequirementsInfoNV memInfo;
-    memInfo.accelerationStructure = resultAccel.accel;
-    vk::MemoryRequirements2 memReqs =
-        m_device.getAccelerationStructureMemoryRequirementsNV(memInfo);
-
-    // 3. Allocate memory
-    vk::MemoryAllocateInfo memAlloc;
-    memAlloc.setAllocationSize(memReqs.memoryRequirements.size);
-    memAlloc.setMemoryTypeIndex(getMemoryType(memReqs.memoryRequirements.memoryTypeBits,
-                                              vk::MemoryPropertyFlagBits::eDeviceLocal));
-    resultAccel.allocation = AllocateMemory(memAlloc);
-
-    // 4. Bind memory with acceleration structure
-    vk::BindAccelerationStructureMemoryInfoNV bind;
-    bind.setAccelerationStructure(resultAccel.accel);
-    bind.setMemory(resultAccel.allocation);
-    bind.setMemoryOffset(0);
-    m_device.bindAccelerationStructureMemoryNV(bind);
+    // 2. Create the acceleration structure in the buffer
+    accel_.setBuffer(resultAccel.buffer.buffer);
+    resultAccel.accel = m_device.createAccelerationStructureKHR(accel_);
 
     return resultAccel;
   }
@@ -337,8 +332,8 @@ public:
 
   void destroy(AccelerationDedicated& a_)
   {
-    m_device.destroyAccelerationStructureNV(a_.accel);
-    m_device.freeMemory(a_.allocation);
+    m_device.destroyAccelerationStructureKHR(a_.accel);
+    destroy(a_.buffer);
   }
 
   void destroy(TextureDedicated& t_)
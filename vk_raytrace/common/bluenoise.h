@@ -0,0 +1,155 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// Tileable blue-noise mask of size x size, generated with the void-and-cluster method
+// (Ulichney, "The void-and-cluster method for dither array generation")
+// - Returns the rank of each pixel, mapped to (0,1): (rank + 0.5) / (size * size)
+// - The energy of a pixel is the sum of Gaussians centered on the set pixels, with toroidal
+//   distances so the mask tiles
+// - After the initial pattern, the pixels are set one by one in the largest void
+//
+inline std::vector<float> generateBlueNoise(uint32_t size, uint32_t seed, float sigma = 1.5f)
+{
+  const uint32_t count = size * size;
+
+  // Gaussian of each toroidal offset
+  std::vector<float> gaussian(count);
+  for(uint32_t y = 0; y < size; y++)
+  {
+    for(uint32_t x = 0; x < size; x++)
+    {
+      float dx = static_cast<float>(std::min(x, size - x));
+      float dy = static_cast<float>(std::min(y, size - y));
+      gaussian[y * size + x] = std::exp(-(dx * dx + dy * dy) / (2.f * sigma * sigma));
+    }
+  }
+
+  std::vector<uint8_t> pattern(count, 0);
+  std::vector<float>   energy(count, 0.f);
+  auto toggle = [&](uint32_t p, bool set) {
+    pattern[p]     = set ? 1 : 0;
+    const float s  = set ? 1.f : -1.f;
+    uint32_t    px = p % size, py = p / size;
+    for(uint32_t y = 0; y < size; y++)
+    {
+      const float* g = &gaussian[((y + size - py) % size) * size];
+      for(uint32_t x = 0; x < size; x++)
+        energy[y * size + x] += s * g[(x + size - px) % size];
+    }
+  };
+  // Tightest cluster: set pixel of highest energy. Largest void: empty pixel of lowest energy.
+  auto tightestCluster = [&]() {
+    uint32_t best = 0;
+    float    e    = -1.f;
+    for(uint32_t p = 0; p < count; p++)
+      if(pattern[p] && energy[p] > e)
+        e = energy[p], best = p;
+    return best;
+  };
+  auto largestVoid = [&]() {
+    uint32_t best = 0;
+    float    e    = std::numeric_limits<float>::max();
+    for(uint32_t p = 0; p < count; p++)
+      if(!pattern[p] && energy[p] < e)
+        e = energy[p], best = p;
+    return best;
+  };
+
+  // Initial pattern: 10% of random pixels, moved from the clusters to the voids until stable
+  std::mt19937                            gen(seed);
+  std::uniform_int_distribution<uint32_t> dis(0, count - 1);
+  const uint32_t                          initialCount = std::max(count / 10, 1u);
+  for(uint32_t i = 0; i < initialCount;)
+  {
+    uint32_t p = dis(gen);
+    if(!pattern[p])
+    {
+      toggle(p, true);
+      i++;
+    }
+  }
+  for(uint32_t iteration = 0; iteration < count; iteration++)
+  {
+    uint32_t cluster = tightestCluster();
+    toggle(cluster, false);
+    uint32_t hole = largestVoid();
+    toggle(hole, true);
+    if(hole == cluster)
+      break;
+  }
+  const std::vector<uint8_t> initialPattern = pattern;
+  const std::vector<float>   initialEnergy  = energy;
+
+  // Ranks of the initial pattern: removing the tightest clusters first
+  std::vector<float> ranks(count);
+  for(uint32_t rank = initialCount; rank-- > 0;)
+  {
+    uint32_t p = tightestCluster();
+    toggle(p, false);
+    ranks[p] = static_cast<float>(rank);
+  }
+
+  // Ranks of the other pixels: filling the largest voids first
+  pattern = initialPattern;
+  energy  = initialEnergy;
+  for(uint32_t rank = initialCount; rank < count; rank++)
+  {
+    uint32_t p = largestVoid();
+    toggle(p, true);
+    ranks[p] = static_cast<float>(rank);
+  }
+
+  for(auto& r : ranks)
+    r = (r + 0.5f) / count;
+  return ranks;
+}
+
+//-----------------------------------------------------------------------------
+// `layers` independent blue-noise masks interleaved per pixel (all layers of pixel 0, then
+// pixel 1, ...), read from `filename` when it was generated with the same parameters, otherwise
+// generated and written to it
+//
+inline std::vector<float> loadBlueNoise(const std::string& filename, uint32_t size, uint32_t layers)
+{
+  const uint32_t magic   = 0x494f4e42;  // 'BNOI'
+  const uint32_t version = 1;
+  const uint32_t count   = size * size;
+
+  std::vector<float> noise(count * layers);
+  std::ifstream      in(filename, std::ios::binary);
+  if(in.is_open())
+  {
+    uint32_t header[4] = {0, 0, 0, 0};
+    in.read(reinterpret_cast<char*>(header), sizeof(header));
+    if(in && header[0] == magic && header[1] == version && header[2] == size && header[3] == layers)
+    {
+      in.read(reinterpret_cast<char*>(noise.data()), noise.size() * sizeof(float));
+      if(in)
+        return noise;
+    }
+  }
+
+  for(uint32_t layer = 0; layer < layers; layer++)
+  {
+    std::vector<float> mask = generateBlueNoise(size, layer + 1);
+    for(uint32_t p = 0; p < count; p++)
+      noise[p * layers + layer] = mask[p];
+  }
+
+  std::ofstream out(filename, std::ios::binary);
+  if(out.is_open())
+  {
+    const uint32_t header[4] = {magic, version, size, layers};
+    out.write(reinterpret_cast<const char*>(header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(noise.data()), noise.size() * sizeof(float));
+  }
+  return noise;
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <string>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+// Directory of the files generated at run time, relative to the working directory (src), next
+// to media. It is ignored by git and can be deleted at any time.
+#define CACHE_DIRECTORY "../cache"
+
+//-----------------------------------------------------------------------------
+// Path of the cache file `name`, creating the cache directory when it does not exist yet
+//
+inline std::string getCachePath(const std::string& name)
+{
+#ifdef _WIN32
+  _mkdir(CACHE_DIRECTORY);
+#else
+  mkdir(CACHE_DIRECTORY, 0755);
+#endif
+  return std::string(CACHE_DIRECTORY) + "/" + name;
+}
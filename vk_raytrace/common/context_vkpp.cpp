@@ -36,7 +36,7 @@
 
 // See: https://github.com/KhronosGroup/Vulkan-Hpp#extensions--per-device-function-pointers
 VULKAN_HPP_DEFAULT_DISPATCH_LOADER_DYNAMIC_STORAGE;
-static_assert(VK_HEADER_VERSION >= 126, "Vulkan version need 1.1.126.0 or greater");
+static_assert(VK_HEADER_VERSION >= 162, "Vulkan version need 1.2.162.0 or greater");
 
 namespace nvvkpp {
 
@@ -61,7 +61,7 @@ struct DebugUtil
   void setObjectName(const vk::RenderPass& object, const char* name)              { setObjectName(object, name, vk::ObjectType::eRenderPass); }
   void setObjectName(const vk::ShaderModule& object, const char* name)            { setObjectName(object, name, vk::ObjectType::eShaderModule); }
   void setObjectName(const vk::Pipeline& object, const char* name)                { setObjectName(object, name, vk::ObjectType::ePipeline); }
-  void setObjectName(const vk::AccelerationStructureNV& object, const char* name) { setObjectName(object, name, vk::ObjectType::eAccelerationStructureNV); }
+  void setObjectName(const vk::AccelerationStructureKHR& object, const char* name){ setObjectName(object, name, vk::ObjectType::eAccelerationStructureKHR); }
   void setObjectName(const vk::DescriptorSetLayout& object, const char* name)     { setObjectName(object, name, vk::ObjectType::eDescriptorSetLayout); }
   void setObjectName(const vk::DescriptorSet& object, const char* name)           { setObjectName(object, name, vk::ObjectType::eDescriptorSet); }
   void setObjectName(const vk::Semaphore& object, const char* name)               { setObjectName(object, name, vk::ObjectType::eSemaphore); }
@@ -125,10 +125,10 @@ inline vk::WriteDescriptorSet createWrite(vk::DescriptorSet
   return {ds, binding.binding, arrayElement, binding.descriptorCount, binding.descriptorType, info};
 }
 
-inline vk::WriteDescriptorSet createWrite(vk::DescriptorSet                                    ds,
-                                          const vk::DescriptorSetLayoutBinding&                binding,
-                                          const vk::WriteDescriptorSetAccelerationStructureNV* info,
-                                          uint32_t                                             arrayElement = 0)
+inline vk::WriteDescriptorSet createWrite(vk::DescriptorSet                                     ds,
+                                          const vk::DescriptorSetLayoutBinding&                 binding,
+                                          const vk::WriteDescriptorSetAccelerationStructureKHR* info,
+                                          uint32_t                                              arrayElement = 0)
 {
   vk::WriteDescriptorSet res(ds, binding.binding, arrayElement, binding.descriptorCount, binding.descriptorType);
   res.setPNext(info);
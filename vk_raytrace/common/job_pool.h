@@ -0,0 +1,147 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// Fixed set of threads running the jobs of one batch at a time
+// - run() hands out the jobs in order to the first free thread, the calling thread being thread 0,
+//   and returns once all of them are done
+// - Each job gets the index of the thread running it, to use the resources owned by that thread
+// - The time each thread spent in the jobs of the last batch is kept, in microseconds
+// - A job throwing, for instance a vk::SystemError, cancels the jobs not started yet; run()
+//   rethrows the exception on the calling thread once all threads are done
+//
+class JobPool
+{
+public:
+  using Job = std::function<void(uint32_t job, uint32_t thread)>;
+
+  explicit JobPool(uint32_t threadCount)
+      : m_busyTimes(std::max(threadCount, 1u), 0.f)
+      , m_jobCounts(std::max(threadCount, 1u), 0)
+      , m_errors(std::max(threadCount, 1u))
+  {
+    for(uint32_t t = 1; t < m_busyTimes.size(); t++)
+      m_threads.emplace_back(&JobPool::work, this, t);
+  }
+
+  ~JobPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_quit = true;
+    }
+    m_start.notify_all();
+    for(auto& thread : m_threads)
+      thread.join();
+  }
+
+  JobPool(const JobPool&) = delete;
+  JobPool& operator=(const JobPool&) = delete;
+
+  uint32_t threadCount() const { return static_cast<uint32_t>(m_busyTimes.size()); }
+
+  // Running `jobCount` jobs on the first `threadLimit` threads
+  void run(uint32_t jobCount, const Job& job, uint32_t threadLimit = ~0u)
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_job         = &job;
+      m_jobCount    = jobCount;
+      m_threadLimit = std::max(threadLimit, 1u);
+      m_nextJob     = 0;
+      m_working     = static_cast<uint32_t>(m_threads.size());
+      m_batch++;
+    }
+    m_start.notify_all();
+    runJobs(0);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this] { return m_working == 0; });
+    m_job = nullptr;
+    for(auto& error : m_errors)
+    {
+      if(error)
+      {
+        std::exception_ptr first = error;
+        std::fill(m_errors.begin(), m_errors.end(), nullptr);
+        std::rethrow_exception(first);
+      }
+    }
+  }
+
+  const std::vector<float>&    busyTimes() const { return m_busyTimes; }
+  const std::vector<uint32_t>& jobCounts() const { return m_jobCounts; }
+
+private:
+  void work(uint32_t thread)
+  {
+    uint64_t batch = 0;
+    for(;;)
+    {
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_start.wait(lock, [&] { return m_quit || m_batch != batch; });
+        if(m_quit)
+          return;
+        batch = m_batch;
+      }
+      runJobs(thread);
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_working--;
+      }
+      m_done.notify_one();
+    }
+  }
+
+  void runJobs(uint32_t thread)
+  {
+    m_busyTimes[thread] = 0.f;
+    m_jobCounts[thread] = 0;
+    if(thread >= m_threadLimit)
+      return;
+
+    const auto start = std::chrono::high_resolution_clock::now();
+    try
+    {
+      for(uint32_t j = m_nextJob++; j < m_jobCount; j = m_nextJob++)
+      {
+        (*m_job)(j, thread);
+        m_jobCounts[thread]++;
+      }
+    }
+    catch(...)
+    {
+      m_errors[thread] = std::current_exception();
+      m_nextJob        = m_jobCount;  // No other job starts
+    }
+    const std::chrono::duration<float, std::micro> elapsed =
+        std::chrono::high_resolution_clock::now() - start;
+    m_busyTimes[thread] = elapsed.count();
+  }
+
+  std::vector<std::thread>        m_threads;  // Threads 1 and up
+  std::vector<float>              m_busyTimes;
+  std::vector<uint32_t>           m_jobCounts;
+  std::vector<std::exception_ptr> m_errors;  // Thrown by the jobs of each thread in the batch
+
+  std::mutex              m_mutex;
+  std::condition_variable m_start;
+  std::condition_variable m_done;
+  bool                    m_quit{false};
+  uint64_t                m_batch{0};
+  uint32_t                m_working{0};  // Threads 1 and up still in the batch
+
+  const Job*            m_job{nullptr};
+  uint32_t              m_jobCount{0};
+  uint32_t              m_threadLimit{1};
+  std::atomic<uint32_t> m_nextJob{0};
+};
@@ -0,0 +1,126 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <glm/glm.hpp>
+#include <limits>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// Cluster of triangles consecutive in the index buffer, with the bounds culling it as a whole.
+// The layout is the one read by the shaders, see shaders/cluster_cull.comp
+//
+struct MeshCluster
+{
+  glm::vec3 bbMin;
+  uint32_t  firstIndex;  // In the indices of the mesh
+  glm::vec3 bbMax;
+  uint32_t  indexCount;
+  glm::vec3 coneAxis;    // Average normal of the triangles
+  float     coneCutoff;  // Sine of the widest angle between the axis and a normal, 1 without cone
+  glm::vec3 center;      // Bounding sphere of the vertices
+  float     radius;
+};
+
+//-----------------------------------------------------------------------------
+// Splitting a triangle mesh in clusters of at most `maxVertices` distinct vertices and
+// `maxTriangles` triangles
+// - The triangles are taken in the order of the indices, which is left unchanged: the primitive
+//   index of a triangle stays the same for the shaders and the light list
+// - The normal cone bounds the geometric normals of the counter-clockwise triangles. Clusters
+//   with normals spread over a half space or more have no cone.
+// TVert must have a `glm::vec3 pos` member
+//
+template <class TVert>
+void buildClusters(const std::vector<TVert>&    vertices,
+                   const std::vector<uint32_t>& indices,
+                   uint32_t                     maxVertices,
+                   uint32_t                     maxTriangles,
+                   std::vector<MeshCluster>&    clusters)
+{
+  clusters.clear();
+  if(maxVertices < 3 || maxTriangles == 0)
+    return;
+
+  // Cluster in which each vertex was last added, to count the distinct vertices
+  std::vector<uint32_t> vertexCluster(vertices.size(), std::numeric_limits<uint32_t>::max());
+  uint32_t              clusterVertices = 0;
+  for(size_t i = 0; i + 2 < indices.size(); i += 3)
+  {
+    // Distinct vertices of the triangle not in the current cluster yet
+    uint32_t added = 0;
+    if(!clusters.empty())
+    {
+      const uint32_t current = static_cast<uint32_t>(clusters.size() - 1);
+      for(uint32_t k = 0; k < 3; k++)
+      {
+        const uint32_t v      = indices[i + k];
+        const bool     repeat = (k > 0 && v == indices[i]) || (k > 1 && v == indices[i + 1]);
+        added += vertexCluster[v] != current && !repeat ? 1 : 0;
+      }
+    }
+    if(clusters.empty() || clusterVertices + added > maxVertices
+       || clusters.back().indexCount >= 3 * maxTriangles)
+    {
+      MeshCluster cluster{};
+      cluster.firstIndex = static_cast<uint32_t>(i);
+      clusters.push_back(cluster);
+      clusterVertices = 0;
+    }
+
+    const uint32_t current = static_cast<uint32_t>(clusters.size() - 1);
+    for(uint32_t k = 0; k < 3; k++)
+    {
+      if(vertexCluster[indices[i + k]] != current)
+      {
+        vertexCluster[indices[i + k]] = current;
+        clusterVertices++;
+      }
+    }
+    clusters.back().indexCount += 3;
+  }
+
+  for(auto& cluster : clusters)
+  {
+    const uint32_t lastIndex = cluster.firstIndex + cluster.indexCount;
+
+    cluster.bbMin = glm::vec3(std::numeric_limits<float>::max());
+    cluster.bbMax = glm::vec3(-std::numeric_limits<float>::max());
+    for(uint32_t i = cluster.firstIndex; i < lastIndex; i++)
+    {
+      cluster.bbMin = glm::min(cluster.bbMin, vertices[indices[i]].pos);
+      cluster.bbMax = glm::max(cluster.bbMax, vertices[indices[i]].pos);
+    }
+    cluster.center = (cluster.bbMin + cluster.bbMax) * 0.5f;
+    cluster.radius = 0.f;
+    for(uint32_t i = cluster.firstIndex; i < lastIndex; i++)
+      cluster.radius = std::max(cluster.radius, glm::length(vertices[indices[i]].pos - cluster.center));
+
+    // Normal cone, ignoring the degenerate triangles
+    std::vector<glm::vec3> normals;
+    glm::vec3              sum(0.f);
+    for(uint32_t i = cluster.firstIndex; i < lastIndex; i += 3)
+    {
+      const glm::vec3& p0     = vertices[indices[i + 0]].pos;
+      const glm::vec3  normal = glm::cross(vertices[indices[i + 1]].pos - p0, vertices[indices[i + 2]].pos - p0);
+      const float      length = glm::length(normal);
+      if(length > 0.f)
+      {
+        normals.push_back(normal / length);
+        sum += normals.back();
+      }
+    }
+    cluster.coneAxis   = glm::vec3(0.f, 0.f, 1.f);
+    cluster.coneCutoff = 1.f;
+    if(normals.empty() || glm::length(sum) <= 0.f)
+      continue;
+    const glm::vec3 axis   = glm::normalize(sum);
+    float           minDot = 1.f;
+    for(const auto& normal : normals)
+      minDot = std::min(minDot, glm::dot(axis, normal));
+    if(minDot > 0.f)
+    {
+      cluster.coneAxis   = axis;
+      cluster.coneCutoff = std::sqrt(1.f - minDot * minDot);
+    }
+  }
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <algorithm>
+#include <glm/glm.hpp>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// Simplify a triangle mesh by vertex clustering
+// - The bounding box is divided in `gridSize` cells along its largest extent
+// - All vertices of a cell are merged into one, placed at their average position and
+//   keeping the other attributes of the first vertex found
+// - Triangles collapsing in less than 3 cells are removed
+// TVert must have a `glm::vec3 pos` member
+//
+template <class TVert>
+void simplifyMesh(const std::vector<TVert>&    inVertices,
+                  const std::vector<uint32_t>& inIndices,
+                  uint32_t                     gridSize,
+                  std::vector<TVert>&          outVertices,
+                  std::vector<uint32_t>&       outIndices)
+{
+  outVertices.clear();
+  outIndices.clear();
+  if(inVertices.empty() || gridSize == 0)
+    return;
+
+  glm::vec3 bbMin(std::numeric_limits<float>::max());
+  glm::vec3 bbMax(-std::numeric_limits<float>::max());
+  for(const auto& v : inVertices)
+  {
+    bbMin = glm::min(bbMin, v.pos);
+    bbMax = glm::max(bbMax, v.pos);
+  }
+  const glm::vec3 extent   = bbMax - bbMin;
+  const float     cellSize = std::max(std::max(extent.x, extent.y), extent.z) / gridSize;
+  if(cellSize <= 0.f)
+    return;
+
+  // Cell of each vertex, and the simplified vertex created for each cell
+  std::unordered_map<uint64_t, uint32_t> cellToVertex;
+  std::vector<uint32_t>                  remap(inVertices.size());
+  std::vector<uint32_t>                  cellCount;
+  for(size_t i = 0; i < inVertices.size(); i++)
+  {
+    glm::uvec3 cell = glm::min(glm::uvec3((inVertices[i].pos - bbMin) / cellSize), glm::uvec3(gridSize - 1));
+    uint64_t   key  = (uint64_t(cell.x) << 42) | (uint64_t(cell.y) << 21) | uint64_t(cell.z);
+
+    auto it = cellToVertex.find(key);
+    if(it == cellToVertex.end())
+    {
+      it = cellToVertex.emplace(key, static_cast<uint32_t>(outVertices.size())).first;
+      outVertices.push_back(inVertices[i]);
+      cellCount.push_back(1);
+    }
+    else
+    {
+      outVertices[it->second].pos += inVertices[i].pos;
+      cellCount[it->second]++;
+    }
+    remap[i] = it->second;
+  }
+  for(size_t i = 0; i < outVertices.size(); i++)
+  {
+    outVertices[i].pos /= static_cast<float>(cellCount[i]);
+  }
+
+  // Keeping the triangles still having 3 distinct vertices
+  for(size_t i = 0; i + 2 < inIndices.size(); i += 3)
+  {
+    uint32_t a = remap[inIndices[i + 0]];
+    uint32_t b = remap[inIndices[i + 1]];
+    uint32_t c = remap[inIndices[i + 2]];
+    if(a != b && b != c && a != c)
+    {
+      outIndices.push_back(a);
+      outIndices.push_back(b);
+      outIndices.push_back(c);
+    }
+  }
+}
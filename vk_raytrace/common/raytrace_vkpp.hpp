@@ -33,24 +33,45 @@ This class does not implement all what you need to do raytracing, but
 helps creating the BLAS and TLAS, which then can be used by different
 raytracing usage.
 
+It is using the `VK_KHR_acceleration_structure` extension: acceleration structures live in
+buffers, and all inputs (vertices, indices, instances, scratch) are referenced by device address.
+
 # Setup and Usage
 ~~~~ C++
 m_rtBuilder.setup(device, memoryAllocator, queueIndex);
-// Create array of vk::GeometryNV 
+// Create array of RaytracingBuilder::BlasInput, one per BLAS
 m_rtBuilder.buildBlas(allBlas);
 // Create array of RaytracingBuilder::instance
 m_rtBuilder.buildTlas(instances);
 // Retrieve the acceleration structure
-const vk::AccelerationStructureNV& tlas = m.rtBuilder.getAccelerationStructure() 
+const vk::AccelerationStructureKHR& tlas = m.rtBuilder.getAccelerationStructure()
 ~~~~
+
+# Host builds
+When the device supports `accelerationStructureHostCommands`, calling `setHostBuild(true)` makes
+`buildBlas` build the BLAS on the CPU. Each BLAS is a `VK_KHR_deferred_host_operations` operation,
+and a pool of worker threads joins them. The results are then cloned into device-local memory.
+Host builds need `BlasInput::asHostGeometry`, the same geometries referencing host memory.
+
+# Cache
+After `setCache(filename, driverUUID)`, the BLAS having a `BlasInput::cacheKey` are serialized
+to the file once built (and compacted, with `eAllowCompaction`). The next runs deserialize them
+instead of building, when the key, build flags and driver match.
 */
 
 
+#include <atomic>
+#include <exception>
 #include <mutex>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
 #include <vulkan/vulkan.hpp>
 
+#include "accelcache_vkpp.hpp"
 #include "commands_vkpp.hpp"
 #include "debug_util_vkpp.hpp"
+#include "utilities_vkpp.hpp"
 
 
 #if defined(ALLOC_DEDICATED)
@@ -63,23 +84,6 @@ const vk::AccelerationStructureNV& tlas = m.rtBuilder.getAccelerationStructure()
 
 #include "glm/glm.hpp"
 
-// See https://www.khronos.org/registry/vulkan/specs/1.1-extensions/html/chap33.html#acceleration-structure
-struct VkGeometryInstanceNV
-{
-  /// Transform matrix, containing only the top 3 rows
-  float transform[12];
-  /// Instance index
-  uint32_t instanceId : 24;
-  /// Visibility mask
-  uint32_t mask : 8;
-  /// Index of the hit group which will be invoked when a ray hits the instance
-  uint32_t hitGroupId : 24;
-  /// Instance flags, such as culling
-  uint32_t flags : 8;
-  /// Opaque handle of the bottom-level acceleration structure
-  uint64_t accelerationStructureHandle;
-};
-
 namespace nvvkpp {
 struct RaytracingBuilder
 {
@@ -118,15 +122,39 @@ struct RaytracingBuilder
 #endif
   }
 
+  //--------------------------------------------------------------------------------------------------
+  // Building the BLAS on the CPU, when the device supports host acceleration structure commands
+  // - nbThreads is the size of the worker pool, 0 uses all hardware threads
+  //
+  void setHostBuild(bool enable, uint32_t nbThreads = 0)
+  {
+    m_hostBuild        = enable;
+    m_hostBuildThreads = nbThreads > 0 ? nbThreads : std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  // Inputs used to build one Bottom-level acceleration structure.
+  // There are as many range infos as geometries, the range tells how many primitives
+  // of the geometry are used and where they start.
+  struct BlasInput
+  {
+    std::vector<vk::AccelerationStructureGeometryKHR>       asGeometry;
+    std::vector<vk::AccelerationStructureBuildRangeInfoKHR> asBuildRangeInfo;
+    // Same geometries as asGeometry, but with host addresses, only used by host builds.
+    // The memory must stay valid until buildBlas returns
+    std::vector<vk::AccelerationStructureGeometryKHR> asHostGeometry;
+    // Hash of the geometry content, used to find the BLAS in the cache. 0: never cached
+    uint64_t cacheKey{0};
+  };
+
   // This is an instance of a BLAS
   struct Instance
   {
-    uint32_t                    blasId{0};      // Index of the BLAS in m_blas
-    uint32_t                    instanceId{0};  // Instance Index (gl_InstanceID)
-    uint32_t                    hitGroupId{0};  // Hit group index in the SBT
-    uint32_t                    mask{0xFF};     // Visibility mask, will be AND-ed with ray mask
-    vk::GeometryInstanceFlagsNV flags{vk::GeometryInstanceFlagBitsNV::eTriangleCullDisable};
-    glm::mat4                   transform{glm::mat4(1)};  // Identity
+    uint32_t                     blasId{0};      // Index of the BLAS in m_blas
+    uint32_t                     instanceId{0};  // Instance Index (gl_InstanceCustomIndexEXT)
+    uint32_t                     hitGroupId{0};  // Hit group index in the SBT
+    uint32_t                     mask{0xFF};     // Visibility mask, will be AND-ed with ray mask
+    vk::GeometryInstanceFlagsKHR flags{vk::GeometryInstanceFlagBitsKHR::eTriangleFacingCullDisable};
+    glm::mat4                    transform{glm::mat4(1)};  // Identity
   };
 
 
@@ -141,132 +169,118 @@ struct RaytracingBuilder
     }
     m_alloc.destroy(m_tlas.as);
     m_alloc.destroy(m_instBuffer);
+    m_alloc.destroy(m_tlasUpdateScratch);
   }
 
   // Returning the constructed top-level acceleration structure
-  const vk::AccelerationStructureNV& getAccelerationStructure() { return m_tlas.as.accel; }
+  const vk::AccelerationStructureKHR& getAccelerationStructure() const { return m_tlas.as.accel; }
 
   //--------------------------------------------------------------------------------------------------
-  // Create all the BLAS from the vector of vectors of vk::GeometryNV
-  // - There will be one BLAS per vector of vk::GeometryNV
-  // - There will be as many BLAS there are items in the geoms vector
+  // Create all the BLAS from the vector of BlasInput
+  // - There will be one BLAS per input-vector entry
+  // - There will be as many BLAS there are items in the input vector
   // - The resulting BLAS are stored in m_blas
+  // - BLAS found in the cache (see setCache) are deserialized instead of being built
+  // - With eAllowCompaction, the BLAS are compacted after the build
   //
-  void buildBlas(const std::vector<std::vector<vk::GeometryNV>>& geoms,
-                 vk::BuildAccelerationStructureFlagsNV           flags =
-                     vk::BuildAccelerationStructureFlagBitsNV::ePreferFastTrace)
+  void buildBlas(const std::vector<BlasInput>&          input,
+                 vk::BuildAccelerationStructureFlagsKHR flags =
+                     vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace)
   {
-    m_blas.resize(geoms.size());
-
-    vk::DeviceSize maxScratch{0};
+    m_blas.resize(input.size());
 
-    // Iterate over the groups of geometries, creating one BLAS for each group
-    for(size_t i = 0; i < geoms.size(); i++)
+    // Host builds are possible only if all inputs have their geometry in host memory
+    bool hostBuild = m_hostBuild;
+    for(size_t i = 0; i < input.size(); i++)
     {
-      Blas& blas{m_blas[i]};
+      m_blas[i].input = input[i];
+      m_blas[i].flags = flags;
+      hostBuild       = hostBuild && input[i].asHostGeometry.size() == input[i].asGeometry.size();
+    }
 
-      // Set the geometries that will be part of the BLAS
-      blas.asInfo.setGeometryCount(static_cast<uint32_t>(geoms[i].size()));
-      blas.asInfo.setPGeometries(geoms[i].data());
-      blas.asInfo.flags = flags;
-      vk::AccelerationStructureCreateInfoNV createinfo{0, blas.asInfo};
+    std::vector<uint32_t> toBuild = loadBlasFromCache();
+    if(toBuild.empty())
+      return;
 
-      // Create an acceleration structure identifier and allocate memory to store the
-      // resulting structure data
-      blas.as = m_alloc.createAcceleration(createinfo);
-      m_debug.setObjectName(blas.as.accel, (std::string("Blas" + std::to_string(i)).c_str()));
+    if(hostBuild)
+      buildBlasOnHost(toBuild);
+    else
+      buildBlasOnDevice(toBuild);
 
-      // Estimate the amount of scratch memory required to build the BLAS, and update the
-      // size of the scratch buffer that will be allocated to sequentially build all BLASes
-      vk::AccelerationStructureMemoryRequirementsInfoNV memoryRequirementsInfo{
-          vk::AccelerationStructureMemoryRequirementsTypeNV::eBuildScratch, blas.as.accel};
-      vk::DeviceSize scratchSize =
-          m_device.getAccelerationStructureMemoryRequirementsNV(memoryRequirementsInfo)
-              .memoryRequirements.size;
+    if(flags & vk::BuildAccelerationStructureFlagBitsKHR::eAllowCompaction)
+      compactBlas(toBuild);
 
-      maxScratch = std::max(maxScratch, scratchSize);
-    }
+    saveBlasToCache(toBuild);
+  }
 
-    // Allocate the scratch buffers holding the temporary data of the acceleration structure builder
-    nvvkBuffer scratchBuffer =
-        m_alloc.createBuffer(maxScratch, vk::BufferUsageFlagBits::eRayTracingNV);
+  //--------------------------------------------------------------------------------------------------
+  // Storing the serialized BLAS in `filename` and reusing them in the next runs
+  // - driverUUID is VkPhysicalDeviceIDProperties::driverUUID, the file is ignored when it changes
+  // - Only the BLAS with a BlasInput::cacheKey are stored
+  //
+  void setCache(const std::string& filename, const AccelerationCache::DriverUUID& driverUUID)
+  {
+    m_cache.load(filename, driverUUID);
+  }
+
+  //--------------------------------------------------------------------------------------------------
+  // Refit the BLAS from updated buffers
+  //
+  void updateBlas(uint32_t blasIdx)
+  {
+    Blas& blas = m_blas[blasIdx];
+
+    // Compute the amount of scratch memory required by the AS builder to update the BLAS
+    vk::AccelerationStructureBuildGeometryInfoKHR buildInfo = getBlasBuildInfo(blas);
+    vk::AccelerationStructureBuildSizesInfoKHR    sizeInfo  = getBuildSizes(buildInfo, blas);
+    // Allocate the scratch buffer
+    nvvkBuffer scratchBuffer = createScratchBuffer(sizeInfo.updateScratchSize);
+
+    // Update the acceleration structure. Note the eUpdate mode, and the existing BLAS being
+    // passed as source and destination: it is updated in place
+    buildInfo.setMode(vk::BuildAccelerationStructureModeKHR::eUpdate);
+    buildInfo.setSrcAccelerationStructure(blas.as.accel);
+    buildInfo.setDstAccelerationStructure(blas.as.accel);
+    buildInfo.scratchData.setDeviceAddress(m_device.getBufferAddress({scratchBuffer.buffer}));
 
-    // Create a command buffer containing all the BLAS builds
     nvvkpp::SingleCommandBuffer genCmdBuf(m_device, m_queueIndex);
     vk::CommandBuffer           cmdBuf = genCmdBuf.createCommandBuffer();
-    for(auto& blas : m_blas)
-    {
-      cmdBuf.buildAccelerationStructureNV(blas.asInfo, nullptr, 0, VK_FALSE, blas.as.accel, nullptr,
-                                          scratchBuffer.buffer, 0);
-      // Since the scratch buffer is reused across builds, we need a barrier to ensure one build
-      // is finished before starting the next one
-      vk::MemoryBarrier barrier(vk::AccessFlagBits::eAccelerationStructureWriteNV,
-                                vk::AccessFlagBits::eAccelerationStructureReadNV);
-      cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eAccelerationStructureBuildNV,
-                             vk::PipelineStageFlagBits::eAccelerationStructureBuildNV,
-                             vk::DependencyFlags(), {barrier}, {}, {});
-    }
+
+    const vk::AccelerationStructureBuildRangeInfoKHR* pRangeInfo = blas.input.asBuildRangeInfo.data();
+    cmdBuf.buildAccelerationStructuresKHR(1, &buildInfo, &pRangeInfo);
 
     genCmdBuf.flushCommandBuffer(cmdBuf);
     m_alloc.destroy(scratchBuffer);
-    m_alloc.flushStaging();
   }
 
   //--------------------------------------------------------------------------------------------------
-  // Refit the BLAS from updated buffers
+  // Return the device address of a BLAS, this is what the TLAS instances are referencing
   //
-  void updateBlas(uint32_t blasIdx)
+  vk::DeviceAddress getBlasDeviceAddress(uint32_t blasId)
   {
-      Blas& blas = m_blas[blasIdx];
-
-      // Compute the amount of scratch memory required by the AS builder to update the TLAS
-      vk::AccelerationStructureMemoryRequirementsInfoNV memoryRequirementsInfo{
-          vk::AccelerationStructureMemoryRequirementsTypeNV::eUpdateScratch, blas.as.accel };
-      vk::DeviceSize scratchSize =
-          m_device.getAccelerationStructureMemoryRequirementsNV(memoryRequirementsInfo)
-          .memoryRequirements.size;
-      // Allocate the scratch buffer
-      nvvkBuffer scratchBuffer =
-          m_alloc.createBuffer(scratchSize, vk::BufferUsageFlagBits::eRayTracingNV);
-
-      // Update the instance buffer on the device side and build the TLAS
-      nvvkpp::SingleCommandBuffer genCmdBuf(m_device, m_queueIndex);
-      vk::CommandBuffer           cmdBuf = genCmdBuf.createCommandBuffer();
-
-
-      // Update the acceleration structure. Note the VK_TRUE parameter to trigger the update,
-      // and the existing BLAS being passed and updated in place
-      cmdBuf.buildAccelerationStructureNV(blas.asInfo, nullptr, 0, VK_TRUE, blas.as.accel,
-          blas.as.accel, scratchBuffer.buffer, 0);
-
-      genCmdBuf.flushCommandBuffer(cmdBuf);
-      m_alloc.destroy(scratchBuffer);
+    return m_device.getAccelerationStructureAddressKHR({m_blas[blasId].as.accel});
   }
 
   //--------------------------------------------------------------------------------------------------
-  // Convert an Instance object into a VkGeometryInstanceNV
+  // Convert an Instance object into a vk::AccelerationStructureInstanceKHR
 
-  VkGeometryInstanceNV instanceToVkGeometryInstanceNV(const Instance& instance)
+  vk::AccelerationStructureInstanceKHR instanceToVkGeometryInstanceKHR(const Instance& instance)
   {
-    Blas& blas{m_blas[instance.blasId]};
-    // For each BLAS, fetch the acceleration structure handle that will allow the builder to
-    // directly access it from the device
-    uint64_t asHandle = 0;
-    m_device.getAccelerationStructureHandleNV(blas.as.accel, sizeof(uint64_t), &asHandle);
-
-    VkGeometryInstanceNV gInst{};
+    vk::AccelerationStructureInstanceKHR gInst{};
     // The matrices for the instance transforms are row-major, instead of column-major in the
     // rest of the application
     glm::mat4 transp = glm::transpose(instance.transform);
     // The gInst.transform value only contains 12 values, corresponding to a 4x3 matrix, hence
     // saving the last row that is anyway always (0,0,0,1). Since the matrix is row-major,
     // we simply copy the first 12 values of the original 4x4 matrix
-    memcpy(gInst.transform, &transp, sizeof(gInst.transform));
-    gInst.instanceId                  = instance.instanceId;
-    gInst.mask                        = instance.mask;
-    gInst.hitGroupId                  = instance.hitGroupId;
-    gInst.flags                       = static_cast<uint32_t>(instance.flags);
-    gInst.accelerationStructureHandle = asHandle;
+    memcpy(&gInst.transform, &transp, sizeof(gInst.transform));
+    gInst.setInstanceCustomIndex(instance.instanceId);
+    gInst.setMask(instance.mask);
+    gInst.setInstanceShaderBindingTableRecordOffset(instance.hitGroupId);
+    gInst.setFlags(static_cast<VkGeometryInstanceFlagsKHR>(instance.flags));
+    // For each BLAS, fetch the acceleration structure address that will allow the builder to
+    // directly access it from the device
+    gInst.setAccelerationStructureReference(getBlasDeviceAddress(instance.blasId));
 
     return gInst;
   }
@@ -276,61 +290,62 @@ struct RaytracingBuilder
   // - See struct of Instance
   // - The resulting TLAS will be stored in m_tlas
   //
-  void buildTlas(const std::vector<Instance>&          instances,
-                 vk::BuildAccelerationStructureFlagsNV flags =
-                     vk::BuildAccelerationStructureFlagBitsNV::ePreferFastTrace)
+  void buildTlas(const std::vector<Instance>&           instances,
+                 vk::BuildAccelerationStructureFlagsKHR flags =
+                     vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace)
   {
-    // Set the instance count required to determine how much memory the TLAS will use
-    m_tlas.asInfo.instanceCount = static_cast<uint32_t>(instances.size());
-    m_tlas.asInfo.flags         = flags;
-    vk::AccelerationStructureCreateInfoNV accelerationStructureInfo{0, m_tlas.asInfo};
-    // Create the acceleration structure object and allocate the memory required to hold the TLAS data
-    m_tlas.as = m_alloc.createAcceleration(accelerationStructureInfo);
-    m_debug.setObjectName(m_tlas.as.accel, "Tlas");
-
-    // Compute the amount of scratch memory required by the acceleration structure builder
-    vk::AccelerationStructureMemoryRequirementsInfoNV memoryRequirementsInfo{
-        vk::AccelerationStructureMemoryRequirementsTypeNV::eBuildScratch, m_tlas.as.accel};
-    vk::DeviceSize scratchSize =
-        m_device.getAccelerationStructureMemoryRequirementsNV(memoryRequirementsInfo)
-            .memoryRequirements.size;
-
-    // Allocate the scratch memory
-    nvvkBuffer scratchBuffer =
-        m_alloc.createBuffer(scratchSize, vk::BufferUsageFlagBits::eRayTracingNV);
+    m_tlas.flags         = flags;
+    m_tlas.instanceCount = static_cast<uint32_t>(instances.size());
 
     // For each instance, build the corresponding instance descriptor
-    std::vector<VkGeometryInstanceNV> geometryInstances;
+    std::vector<vk::AccelerationStructureInstanceKHR> geometryInstances;
     geometryInstances.reserve(instances.size());
     for(const auto& inst : instances)
     {
-      geometryInstances.push_back(instanceToVkGeometryInstanceNV(inst));
+      geometryInstances.push_back(instanceToVkGeometryInstanceKHR(inst));
     }
 
     // Building the TLAS
     nvvkpp::SingleCommandBuffer genCmdBuf(m_device, m_queueIndex);
     vk::CommandBuffer           cmdBuf = genCmdBuf.createCommandBuffer();
 
-    // Create a buffer holding the actual instance data for use by the AS builder
-    VkDeviceSize instanceDescsSizeInBytes = instances.size() * sizeof(VkGeometryInstanceNV);
-
     // Allocate the instance buffer and copy its contents from host to device memory
-    m_instBuffer =
-        m_alloc.createBuffer(cmdBuf, geometryInstances, vk::BufferUsageFlagBits::eRayTracingNV);
+    m_instBuffer = m_alloc.createBuffer(cmdBuf, geometryInstances,
+                                        vk::BufferUsageFlagBits::eShaderDeviceAddress
+                                            | vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR);
     m_debug.setObjectName(m_instBuffer.buffer, "TLASInstances");
 
     // Make sure the copy of the instance buffer are copied before triggering the
     // acceleration structure build
     vk::MemoryBarrier barrier(vk::AccessFlagBits::eTransferWrite,
-                              vk::AccessFlagBits::eAccelerationStructureWriteNV);
+                              vk::AccessFlagBits::eAccelerationStructureWriteKHR);
     cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
-                           vk::PipelineStageFlagBits::eAccelerationStructureBuildNV,
+                           vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR,
                            vk::DependencyFlags(), {barrier}, {}, {});
 
+    // Query the sizes needed for the TLAS holding all instances
+    vk::AccelerationStructureGeometryKHR          topGeometry = getTlasGeometry();
+    vk::AccelerationStructureBuildGeometryInfoKHR buildInfo   = getTlasBuildInfo(topGeometry);
+    vk::AccelerationStructureBuildSizesInfoKHR    sizeInfo =
+        m_device.getAccelerationStructureBuildSizesKHR(vk::AccelerationStructureBuildTypeKHR::eDevice,
+                                                       buildInfo, m_tlas.instanceCount);
+
+    // Create the acceleration structure object and allocate the memory required to hold the TLAS data
+    vk::AccelerationStructureCreateInfoKHR createInfo;
+    createInfo.setType(vk::AccelerationStructureTypeKHR::eTopLevel);
+    createInfo.setSize(sizeInfo.accelerationStructureSize);
+    m_tlas.as = m_alloc.createAcceleration(createInfo);
+    m_debug.setObjectName(m_tlas.as.accel, "Tlas");
+
+    // Allocate the scratch memory
+    nvvkBuffer scratchBuffer = createScratchBuffer(sizeInfo.buildScratchSize);
 
     // Build the TLAS
-    cmdBuf.buildAccelerationStructureNV(m_tlas.asInfo, m_instBuffer.buffer, 0, VK_FALSE,
-                                        m_tlas.as.accel, nullptr, scratchBuffer.buffer, 0);
+    buildInfo.setDstAccelerationStructure(m_tlas.as.accel);
+    buildInfo.scratchData.setDeviceAddress(m_device.getBufferAddress({scratchBuffer.buffer}));
+    vk::AccelerationStructureBuildRangeInfoKHR        rangeInfo{m_tlas.instanceCount, 0, 0, 0};
+    const vk::AccelerationStructureBuildRangeInfoKHR* pRangeInfo = &rangeInfo;
+    cmdBuf.buildAccelerationStructuresKHR(1, &buildInfo, &pRangeInfo);
 
     genCmdBuf.flushCommandBuffer(cmdBuf);
 
@@ -344,7 +359,24 @@ struct RaytracingBuilder
   //
   void updateTlasMatrices(const std::vector<Instance>& instances)
   {
-    VkDeviceSize bufferSize = instances.size() * sizeof(VkGeometryInstanceNV);
+    std::vector<uint32_t> all(instances.size());
+    for(uint32_t i = 0; i < static_cast<uint32_t>(all.size()); i++)
+    {
+      all[i] = i;
+    }
+    updateTlasInstances(instances, all);
+  }
+
+  //--------------------------------------------------------------------------------------------------
+  // Refit the TLAS after some instances changed (matrix, blasId, mask, ...)
+  // - Only the `changed` instances, in increasing order, are uploaded to the instance buffer
+  //
+  void updateTlasInstances(const std::vector<Instance>& instances, const std::vector<uint32_t>& changed)
+  {
+    if(changed.empty())
+      return;
+
+    VkDeviceSize bufferSize = changed.size() * sizeof(vk::AccelerationStructureInstanceKHR);
     // Create a staging buffer on the host to upload the new instance data
     nvvkBuffer stagingBuffer =
         m_alloc.createBuffer(bufferSize, vk::BufferUsageFlagBits::eTransferSrc,
@@ -356,42 +388,54 @@ struct RaytracingBuilder
 #endif
         );
 
-    // Copy the instance data into the staging buffer
-    auto* gInst = reinterpret_cast<VkGeometryInstanceNV*>(m_alloc.map(stagingBuffer));
-    for(int i = 0; i < instances.size(); i++)
+    // Copy the changed instances into the staging buffer, consecutive instances are merged
+    // in a single copy region
+    std::vector<vk::BufferCopy> regions;
+    auto* gInst = reinterpret_cast<vk::AccelerationStructureInstanceKHR*>(m_alloc.map(stagingBuffer));
+    for(size_t i = 0; i < changed.size(); i++)
     {
-      gInst[i] = instanceToVkGeometryInstanceNV(instances[i]);
+      gInst[i] = instanceToVkGeometryInstanceKHR(instances[changed[i]]);
+
+      const vk::DeviceSize instSize = sizeof(vk::AccelerationStructureInstanceKHR);
+      if(i > 0 && changed[i] == changed[i - 1] + 1)
+        regions.back().size += instSize;
+      else
+        regions.emplace_back(i * instSize, changed[i] * instSize, instSize);
     }
     m_alloc.unmap(stagingBuffer);
 
     // Compute the amount of scratch memory required by the AS builder to update the TLAS
-    vk::AccelerationStructureMemoryRequirementsInfoNV memoryRequirementsInfo{
-        vk::AccelerationStructureMemoryRequirementsTypeNV::eUpdateScratch, m_tlas.as.accel};
-    vk::DeviceSize scratchSize =
-        m_device.getAccelerationStructureMemoryRequirementsNV(memoryRequirementsInfo)
-            .memoryRequirements.size;
+    vk::AccelerationStructureGeometryKHR          topGeometry = getTlasGeometry();
+    vk::AccelerationStructureBuildGeometryInfoKHR buildInfo   = getTlasBuildInfo(topGeometry);
+    vk::AccelerationStructureBuildSizesInfoKHR    sizeInfo =
+        m_device.getAccelerationStructureBuildSizesKHR(vk::AccelerationStructureBuildTypeKHR::eDevice,
+                                                       buildInfo, m_tlas.instanceCount);
     // Allocate the scratch buffer
-    nvvkBuffer scratchBuffer =
-        m_alloc.createBuffer(scratchSize, vk::BufferUsageFlagBits::eRayTracingNV);
+    nvvkBuffer scratchBuffer = createScratchBuffer(sizeInfo.updateScratchSize);
 
     // Update the instance buffer on the device side and build the TLAS
     nvvkpp::SingleCommandBuffer genCmdBuf(m_device, m_queueIndex);
     vk::CommandBuffer           cmdBuf = genCmdBuf.createCommandBuffer();
 
-    cmdBuf.copyBuffer(stagingBuffer.buffer, m_instBuffer.buffer, vk::BufferCopy(0, 0, bufferSize));
+    cmdBuf.copyBuffer(stagingBuffer.buffer, m_instBuffer.buffer, regions);
 
     // Make sure the copy of the instance buffer are copied before triggering the
     // acceleration structure build
     vk::MemoryBarrier barrier(vk::AccessFlagBits::eTransferWrite,
-                              vk::AccessFlagBits::eAccelerationStructureWriteNV);
+                              vk::AccessFlagBits::eAccelerationStructureWriteKHR);
     cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
-                           vk::PipelineStageFlagBits::eAccelerationStructureBuildNV,
+                           vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR,
                            vk::DependencyFlags(), {barrier}, {}, {});
 
-    // Update the acceleration structure. Note the VK_TRUE parameter to trigger the update,
-    // and the existing TLAS being passed and updated in place
-    cmdBuf.buildAccelerationStructureNV(m_tlas.asInfo, m_instBuffer.buffer, 0, VK_TRUE,
-                                        m_tlas.as.accel, m_tlas.as.accel, scratchBuffer.buffer, 0);
+    // Update the acceleration structure. Note the eUpdate mode, and the existing TLAS being
+    // passed as source and destination: it is updated in place
+    buildInfo.setMode(vk::BuildAccelerationStructureModeKHR::eUpdate);
+    buildInfo.setSrcAccelerationStructure(m_tlas.as.accel);
+    buildInfo.setDstAccelerationStructure(m_tlas.as.accel);
+    buildInfo.scratchData.setDeviceAddress(m_device.getBufferAddress({scratchBuffer.buffer}));
+    vk::AccelerationStructureBuildRangeInfoKHR        rangeInfo{m_tlas.instanceCount, 0, 0, 0};
+    const vk::AccelerationStructureBuildRangeInfoKHR* pRangeInfo = &rangeInfo;
+    cmdBuf.buildAccelerationStructuresKHR(1, &buildInfo, &pRangeInfo);
     genCmdBuf.flushCommandBuffer(cmdBuf);
 
 
@@ -399,23 +443,551 @@ struct RaytracingBuilder
     m_alloc.destroy(stagingBuffer);
   }
 
+  //--------------------------------------------------------------------------------------------------
+  // Same as above, recorded in `cmdBuf` instead of being submitted and waited for
+  // - The instance records are written with vkCmdUpdateBuffer, without staging buffer
+  // - The update scratch buffer is kept for the next calls, the barriers order its reuse
+  //
+  void updateTlasInstances(const vk::CommandBuffer&     cmdBuf,
+                           const std::vector<Instance>& instances,
+                           const std::vector<uint32_t>& changed)
+  {
+    if(changed.empty())
+      return;
+
+    vk::AccelerationStructureGeometryKHR          topGeometry = getTlasGeometry();
+    vk::AccelerationStructureBuildGeometryInfoKHR buildInfo   = getTlasBuildInfo(topGeometry);
+    if(!m_tlasUpdateScratch.buffer)
+    {
+      vk::AccelerationStructureBuildSizesInfoKHR sizeInfo =
+          m_device.getAccelerationStructureBuildSizesKHR(vk::AccelerationStructureBuildTypeKHR::eDevice,
+                                                         buildInfo, m_tlas.instanceCount);
+      m_tlasUpdateScratch = createScratchBuffer(sizeInfo.updateScratchSize);
+      m_debug.setObjectName(m_tlasUpdateScratch.buffer, "TLASUpdateScratch");
+    }
+
+    // The previous frames may still trace against the TLAS or update it
+    vk::MemoryBarrier before(vk::AccessFlagBits::eAccelerationStructureReadKHR
+                                 | vk::AccessFlagBits::eAccelerationStructureWriteKHR,
+                             vk::AccessFlagBits::eTransferWrite | vk::AccessFlagBits::eAccelerationStructureWriteKHR);
+    cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands,
+                           vk::PipelineStageFlagBits::eTransfer | vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR,
+                           vk::DependencyFlags(), {before}, {}, {});
+
+    for(uint32_t i : changed)
+    {
+      const vk::AccelerationStructureInstanceKHR inst = instanceToVkGeometryInstanceKHR(instances[i]);
+      cmdBuf.updateBuffer(m_instBuffer.buffer, i * sizeof(inst), sizeof(inst), &inst);
+    }
+
+    vk::MemoryBarrier barrier(vk::AccessFlagBits::eTransferWrite,
+                              vk::AccessFlagBits::eAccelerationStructureWriteKHR);
+    cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                           vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR,
+                           vk::DependencyFlags(), {barrier}, {}, {});
+
+    buildInfo.setMode(vk::BuildAccelerationStructureModeKHR::eUpdate);
+    buildInfo.setSrcAccelerationStructure(m_tlas.as.accel);
+    buildInfo.setDstAccelerationStructure(m_tlas.as.accel);
+    buildInfo.scratchData.setDeviceAddress(m_device.getBufferAddress({m_tlasUpdateScratch.buffer}));
+    vk::AccelerationStructureBuildRangeInfoKHR        rangeInfo{m_tlas.instanceCount, 0, 0, 0};
+    const vk::AccelerationStructureBuildRangeInfoKHR* pRangeInfo = &rangeInfo;
+    cmdBuf.buildAccelerationStructuresKHR(1, &buildInfo, &pRangeInfo);
+
+    // The rest of the frame traces rays against the updated TLAS
+    vk::MemoryBarrier after(vk::AccessFlagBits::eAccelerationStructureWriteKHR,
+                            vk::AccessFlagBits::eAccelerationStructureReadKHR);
+    cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR,
+                           vk::PipelineStageFlagBits::eAllCommands, vk::DependencyFlags(), {after}, {}, {});
+  }
 
 private:
   // Bottom-level acceleration structure
   struct Blas
   {
-    nvvkAccel                       as;
-    vk::AccelerationStructureInfoNV asInfo{vk::AccelerationStructureTypeNV::eBottomLevel};
-    vk::GeometryNV                  geometry;
+    nvvkAccel                              as;
+    BlasInput                              input;
+    vk::BuildAccelerationStructureFlagsKHR flags;
   };
 
   // Top-level acceleration structure
   struct Tlas
   {
-    nvvkAccel                       as;
-    vk::AccelerationStructureInfoNV asInfo{vk::AccelerationStructureTypeNV::eTopLevel};
+    nvvkAccel                              as;
+    uint32_t                               instanceCount{0};
+    vk::BuildAccelerationStructureFlagsKHR flags;
   };
 
+  //--------------------------------------------------------------------------------------------------
+  // Build the BLAS `ids` of m_blas on the device, one after the other with a shared scratch buffer
+  //
+  void buildBlasOnDevice(const std::vector<uint32_t>& ids)
+  {
+    vk::DeviceSize maxScratch{0};
+
+    // Iterate over the groups of geometries, creating one BLAS for each group
+    for(uint32_t i : ids)
+    {
+      Blas& blas{m_blas[i]};
+
+      // Set the geometries that will be part of the BLAS and query the sizes needed to build it
+      vk::AccelerationStructureBuildGeometryInfoKHR buildInfo = getBlasBuildInfo(blas);
+      vk::AccelerationStructureBuildSizesInfoKHR    sizeInfo  = getBuildSizes(buildInfo, blas);
+
+      // Create an acceleration structure identifier and allocate memory to store the
+      // resulting structure data
+      vk::AccelerationStructureCreateInfoKHR createInfo;
+      createInfo.setType(vk::AccelerationStructureTypeKHR::eBottomLevel);
+      createInfo.setSize(sizeInfo.accelerationStructureSize);
+      blas.as = m_alloc.createAcceleration(createInfo);
+      m_debug.setObjectName(blas.as.accel, (std::string("Blas" + std::to_string(i)).c_str()));
+
+      // Update the size of the scratch buffer that will be allocated to sequentially build all
+      // BLASes, keeping enough room to later refit them
+      maxScratch = std::max(maxScratch, sizeInfo.buildScratchSize);
+      maxScratch = std::max(maxScratch, sizeInfo.updateScratchSize);
+    }
+
+    // Allocate the scratch buffers holding the temporary data of the acceleration structure builder
+    nvvkBuffer        scratchBuffer  = createScratchBuffer(maxScratch);
+    vk::DeviceAddress scratchAddress = m_device.getBufferAddress({scratchBuffer.buffer});
+
+    // Create a command buffer containing all the BLAS builds
+    nvvkpp::SingleCommandBuffer genCmdBuf(m_device, m_queueIndex);
+    vk::CommandBuffer           cmdBuf = genCmdBuf.createCommandBuffer();
+    for(uint32_t i : ids)
+    {
+      Blas&                                         blas      = m_blas[i];
+      vk::AccelerationStructureBuildGeometryInfoKHR buildInfo = getBlasBuildInfo(blas);
+      buildInfo.setDstAccelerationStructure(blas.as.accel);
+      buildInfo.scratchData.setDeviceAddress(scratchAddress);
+
+      const vk::AccelerationStructureBuildRangeInfoKHR* pRangeInfo = blas.input.asBuildRangeInfo.data();
+      cmdBuf.buildAccelerationStructuresKHR(1, &buildInfo, &pRangeInfo);
+
+      // Since the scratch buffer is reused across builds, we need a barrier to ensure one build
+      // is finished before starting the next one
+      vk::MemoryBarrier barrier(vk::AccessFlagBits::eAccelerationStructureWriteKHR,
+                                vk::AccessFlagBits::eAccelerationStructureReadKHR);
+      cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR,
+                             vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR,
+                             vk::DependencyFlags(), {barrier}, {}, {});
+    }
+
+    genCmdBuf.flushCommandBuffer(cmdBuf);
+    m_alloc.destroy(scratchBuffer);
+    m_alloc.flushStaging();
+  }
+
+  //--------------------------------------------------------------------------------------------------
+  // Build the BLAS `ids` of m_blas on the CPU
+  // - Each BLAS is built in host-visible memory by its own deferred operation
+  // - A pool of worker threads joins the deferred operations until they are all complete. An
+  //   exception thrown in a worker, such as a vk::SystemError, is rethrown once they are all joined
+  // - The results are cloned in device-local acceleration structures, which are the ones
+  //   referenced by the TLAS and refitted by updateBlas
+  //
+  void buildBlasOnHost(const std::vector<uint32_t>& ids)
+  {
+    const size_t nbBlas = ids.size();
+
+    std::vector<nvvkAccel>                                     hostAs(nbBlas);
+    std::vector<std::vector<uint8_t>>                          scratch(nbBlas);
+    std::vector<vk::DeferredOperationKHR>                      ops(nbBlas);
+    std::vector<vk::AccelerationStructureBuildGeometryInfoKHR> buildInfos(nbBlas);
+    std::vector<const vk::AccelerationStructureBuildRangeInfoKHR*> rangeInfos(nbBlas);
+    std::vector<std::atomic<bool>>                                 complete(nbBlas);
+    std::vector<bool>                                              failed(nbBlas, false);
+
+    // Start all builds, the parameters must stay valid until the operations complete
+    for(size_t i = 0; i < nbBlas; i++)
+    {
+      Blas& blas    = m_blas[ids[i]];
+      buildInfos[i] = getBlasBuildInfo(blas, true);
+
+      // Host and device acceleration structures must be compatible for the clone: sizes are
+      // queried for both build types
+      vk::AccelerationStructureBuildSizesInfoKHR sizeInfo =
+          getBuildSizes(buildInfos[i], blas, vk::AccelerationStructureBuildTypeKHR::eHostOrDevice);
+      vk::AccelerationStructureCreateInfoKHR createInfo;
+      createInfo.setType(vk::AccelerationStructureTypeKHR::eBottomLevel);
+      createInfo.setSize(sizeInfo.accelerationStructureSize);
+      hostAs[i] = m_alloc.createAcceleration(createInfo, vk::MemoryPropertyFlagBits::eHostVisible
+                                                             | vk::MemoryPropertyFlagBits::eHostCoherent);
+      blas.as   = m_alloc.createAcceleration(createInfo);
+      m_debug.setObjectName(blas.as.accel, (std::string("Blas" + std::to_string(ids[i])).c_str()));
+
+      scratch[i].resize(sizeInfo.buildScratchSize);
+      buildInfos[i].setDstAccelerationStructure(hostAs[i].accel);
+      buildInfos[i].scratchData.setHostAddress(scratch[i].data());
+      rangeInfos[i] = blas.input.asBuildRangeInfo.data();
+
+      ops[i] = m_device.createDeferredOperationKHR();
+      vk::Result result =
+          m_device.buildAccelerationStructuresKHR(ops[i], 1, &buildInfos[i], &rangeInfos[i]);
+      switch(result)
+      {
+        case vk::Result::eOperationDeferredKHR:  // Joined by the workers below
+          complete[i] = false;
+          break;
+        case vk::Result::eSuccess:  // The implementation completed the work immediately
+        case vk::Result::eOperationNotDeferredKHR:
+          complete[i] = true;
+          break;
+        default:  // Nothing was deferred, the build failed
+          complete[i] = true;
+          failed[i]   = true;
+          break;
+      }
+    }
+
+    // Each worker joins every pending operation until they are all complete or have no more
+    // work for this thread. A join that throws ends the operation for all workers.
+    std::vector<std::exception_ptr> errors(std::max(m_hostBuildThreads, 1u));
+    auto worker = [&](uint32_t thread) {
+      std::vector<bool> threadDone(nbBlas, false);
+      bool              working = true;
+      while(working)
+      {
+        working = false;
+        for(size_t i = 0; i < nbBlas; i++)
+        {
+          if(complete[i] || threadDone[i])
+            continue;
+          working = true;
+          vk::Result result;
+          try
+          {
+            result = m_device.deferredOperationJoinKHR(ops[i]);
+          }
+          catch(...)
+          {
+            if(!errors[thread])
+              errors[thread] = std::current_exception();
+            result = vk::Result::eErrorUnknown;
+          }
+          switch(result)
+          {
+            case vk::Result::eSuccess:
+              complete[i] = true;
+              break;
+            case vk::Result::eThreadDoneKHR:
+              threadDone[i] = true;
+              break;
+            case vk::Result::eThreadIdleKHR:  // Work may become available later
+              std::this_thread::yield();
+              break;
+            default:  // Join error: stop joining, the operation result is checked below
+              complete[i] = true;
+              break;
+          }
+        }
+      }
+    };
+
+    std::vector<std::thread> pool;
+    for(uint32_t t = 1; t < m_hostBuildThreads; t++)
+    {
+      try
+      {
+        pool.emplace_back(worker, t);
+      }
+      catch(const std::system_error&)  // Out of threads: the ones started do the work
+      {
+        break;
+      }
+    }
+    worker(0);  // The calling thread is part of the pool
+    for(auto& t : pool)
+    {
+      t.join();
+    }
+
+    bool success = true;
+    for(size_t i = 0; i < nbBlas; i++)
+    {
+      // The result of an operation that was never deferred is the one returned by the build
+      success = success && !failed[i]
+                && m_device.getDeferredOperationResultKHR(ops[i]) == vk::Result::eSuccess;
+      m_device.destroyDeferredOperationKHR(ops[i]);
+    }
+    for(auto& error : errors)
+    {
+      if(error)
+      {
+        std::rethrow_exception(error);
+      }
+    }
+    if(!success)
+    {
+      throw std::runtime_error("failed to build acceleration structures on the host");
+    }
+
+    // Copy the host-built BLAS in device memory
+    nvvkpp::SingleCommandBuffer genCmdBuf(m_device, m_queueIndex);
+    vk::CommandBuffer           cmdBuf = genCmdBuf.createCommandBuffer();
+    for(size_t i = 0; i < nbBlas; i++)
+    {
+      cmdBuf.copyAccelerationStructureKHR(
+          {hostAs[i].accel, m_blas[ids[i]].as.accel, vk::CopyAccelerationStructureModeKHR::eClone});
+    }
+    genCmdBuf.flushCommandBuffer(cmdBuf);
+
+    for(size_t i = 0; i < nbBlas; i++)
+    {
+      m_alloc.destroy(hostAs[i]);
+      m_blas[ids[i]].input.asHostGeometry.clear();  // The host memory is no longer referenced
+    }
+  }
+
+  //--------------------------------------------------------------------------------------------------
+  // Query a property (compacted or serialization size) of the BLAS `ids`
+  //
+  std::vector<vk::DeviceSize> queryBlasProperties(const std::vector<uint32_t>& ids, vk::QueryType type)
+  {
+    const uint32_t nbQueries = static_cast<uint32_t>(ids.size());
+    vk::QueryPool  queryPool = m_device.createQueryPool({{}, type, nbQueries});
+
+    std::vector<vk::AccelerationStructureKHR> accels;
+    for(uint32_t i : ids)
+    {
+      accels.push_back(m_blas[i].as.accel);
+    }
+
+    nvvkpp::SingleCommandBuffer genCmdBuf(m_device, m_queueIndex);
+    vk::CommandBuffer           cmdBuf = genCmdBuf.createCommandBuffer();
+    cmdBuf.resetQueryPool(queryPool, 0, nbQueries);
+    cmdBuf.writeAccelerationStructuresPropertiesKHR(accels, type, queryPool, 0);
+    genCmdBuf.flushCommandBuffer(cmdBuf);
+
+    std::vector<vk::DeviceSize> values(nbQueries);
+    m_device.getQueryPoolResults(queryPool, 0, nbQueries, values.size() * sizeof(vk::DeviceSize),
+                                 values.data(), sizeof(vk::DeviceSize),
+                                 vk::QueryResultFlagBits::eWait | vk::QueryResultFlagBits::e64);
+    m_device.destroyQueryPool(queryPool);
+    return values;
+  }
+
+  //--------------------------------------------------------------------------------------------------
+  // Replace the BLAS `ids` by a compacted copy, they must be built with eAllowCompaction
+  //
+  void compactBlas(const std::vector<uint32_t>& ids)
+  {
+    std::vector<vk::DeviceSize> compactSizes =
+        queryBlasProperties(ids, vk::QueryType::eAccelerationStructureCompactedSizeKHR);
+
+    std::vector<nvvkAccel>      cleanupAs;
+    nvvkpp::SingleCommandBuffer genCmdBuf(m_device, m_queueIndex);
+    vk::CommandBuffer           cmdBuf = genCmdBuf.createCommandBuffer();
+    for(size_t i = 0; i < ids.size(); i++)
+    {
+      Blas& blas = m_blas[ids[i]];
+      vk::AccelerationStructureCreateInfoKHR createInfo;
+      createInfo.setType(vk::AccelerationStructureTypeKHR::eBottomLevel);
+      createInfo.setSize(compactSizes[i]);
+      nvvkAccel compactAs = m_alloc.createAcceleration(createInfo);
+      m_debug.setObjectName(compactAs.accel, (std::string("Blas" + std::to_string(ids[i])).c_str()));
+
+      cmdBuf.copyAccelerationStructureKHR(
+          {blas.as.accel, compactAs.accel, vk::CopyAccelerationStructureModeKHR::eCompact});
+      cleanupAs.push_back(blas.as);
+      blas.as = compactAs;
+    }
+    genCmdBuf.flushCommandBuffer(cmdBuf);
+
+    for(auto& as : cleanupAs)
+    {
+      m_alloc.destroy(as);
+    }
+  }
+
+  //--------------------------------------------------------------------------------------------------
+  // Key of a BLAS in the cache: content of the geometry and build flags, 0 when not cacheable
+  //
+  uint64_t getBlasCacheKey(const Blas& blas) const
+  {
+    if(blas.input.cacheKey == 0)
+      return 0;
+    VkBuildAccelerationStructureFlagsKHR flags = static_cast<VkBuildAccelerationStructureFlagsKHR>(blas.flags);
+    uint64_t key = nvvkpp::util::hashBytes(&blas.input.cacheKey, sizeof(blas.input.cacheKey));
+    return nvvkpp::util::hashBytes(&flags, sizeof(flags), key);
+  }
+
+  //--------------------------------------------------------------------------------------------------
+  // Deserialize the BLAS of m_blas found in the cache, returning the ones that must be built
+  // - A blob is used only if the device reports it compatible, otherwise the BLAS is rebuilt
+  //
+  std::vector<uint32_t> loadBlasFromCache()
+  {
+    std::vector<uint32_t>   toBuild;
+    std::vector<nvvkBuffer> stagingBuffers;
+
+    nvvkpp::SingleCommandBuffer genCmdBuf(m_device, m_queueIndex);
+    vk::CommandBuffer           cmdBuf = genCmdBuf.createCommandBuffer();
+    for(uint32_t i = 0; i < static_cast<uint32_t>(m_blas.size()); i++)
+    {
+      // Serialized header: driver UUID, compatibility UUID, serialized size, deserialized size, ...
+      const size_t                headerSize = 2 * VK_UUID_SIZE + 3 * sizeof(uint64_t);
+      const uint64_t              key        = m_cache.isEnabled() ? getBlasCacheKey(m_blas[i]) : 0;
+      const std::vector<uint8_t>* blob       = key != 0 ? m_cache.find(key) : nullptr;
+      if(blob == nullptr || blob->size() < headerSize
+         || m_device.getAccelerationStructureCompatibilityKHR({blob->data()})
+                != vk::AccelerationStructureCompatibilityKHR::eCompatible)
+      {
+        toBuild.push_back(i);
+        continue;
+      }
+
+      uint64_t deserializedSize{0};
+      memcpy(&deserializedSize, blob->data() + 2 * VK_UUID_SIZE + sizeof(uint64_t), sizeof(uint64_t));
+      vk::AccelerationStructureCreateInfoKHR createInfo;
+      createInfo.setType(vk::AccelerationStructureTypeKHR::eBottomLevel);
+      createInfo.setSize(deserializedSize);
+      m_blas[i].as = m_alloc.createAcceleration(createInfo);
+      m_debug.setObjectName(m_blas[i].as.accel, (std::string("Blas" + std::to_string(i)).c_str()));
+
+      // The blob is read by the device from a host-visible buffer
+      nvvkBuffer staging = m_alloc.createBuffer(
+          blob->size(), vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress,
+          vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+      memcpy(m_alloc.map(staging), blob->data(), blob->size());
+      m_alloc.unmap(staging);
+      stagingBuffers.push_back(staging);
+
+      vk::CopyMemoryToAccelerationStructureInfoKHR copyInfo;
+      copyInfo.src.setDeviceAddress(m_device.getBufferAddress({staging.buffer}));
+      copyInfo.setDst(m_blas[i].as.accel);
+      copyInfo.setMode(vk::CopyAccelerationStructureModeKHR::eDeserialize);
+      cmdBuf.copyMemoryToAccelerationStructureKHR(copyInfo);
+    }
+    genCmdBuf.flushCommandBuffer(cmdBuf);
+
+    for(auto& b : stagingBuffers)
+    {
+      m_alloc.destroy(b);
+    }
+    return toBuild;
+  }
+
+  //--------------------------------------------------------------------------------------------------
+  // Serialize the BLAS `ids` in the cache and write the cache file
+  //
+  void saveBlasToCache(const std::vector<uint32_t>& ids)
+  {
+    if(!m_cache.isEnabled())
+      return;
+
+    std::vector<uint32_t> cacheIds;
+    for(uint32_t i : ids)
+    {
+      if(getBlasCacheKey(m_blas[i]) != 0)
+        cacheIds.push_back(i);
+    }
+    if(cacheIds.empty())
+    {
+      m_cache.save();  // Still evicting the stale entries
+      return;
+    }
+
+    std::vector<vk::DeviceSize> serializedSizes =
+        queryBlasProperties(cacheIds, vk::QueryType::eAccelerationStructureSerializationSizeKHR);
+
+    // Copy all BLAS in host-visible buffers
+    std::vector<nvvkBuffer>     readbackBuffers;
+    nvvkpp::SingleCommandBuffer genCmdBuf(m_device, m_queueIndex);
+    vk::CommandBuffer           cmdBuf = genCmdBuf.createCommandBuffer();
+    for(size_t i = 0; i < cacheIds.size(); i++)
+    {
+      nvvkBuffer readback = m_alloc.createBuffer(
+          serializedSizes[i], vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress,
+          vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+      readbackBuffers.push_back(readback);
+
+      vk::CopyAccelerationStructureToMemoryInfoKHR copyInfo;
+      copyInfo.setSrc(m_blas[cacheIds[i]].as.accel);
+      copyInfo.dst.setDeviceAddress(m_device.getBufferAddress({readback.buffer}));
+      copyInfo.setMode(vk::CopyAccelerationStructureModeKHR::eSerialize);
+      cmdBuf.copyAccelerationStructureToMemoryKHR(copyInfo);
+    }
+    genCmdBuf.flushCommandBuffer(cmdBuf);
+
+    for(size_t i = 0; i < cacheIds.size(); i++)
+    {
+      const uint8_t*       data = static_cast<const uint8_t*>(m_alloc.map(readbackBuffers[i]));
+      std::vector<uint8_t> blob(data, data + serializedSizes[i]);
+      m_alloc.unmap(readbackBuffers[i]);
+      m_alloc.destroy(readbackBuffers[i]);
+      m_cache.store(getBlasCacheKey(m_blas[cacheIds[i]]), std::move(blob));
+    }
+    m_cache.save();
+  }
+
+  //--------------------------------------------------------------------------------------------------
+  // Build information of a BLAS, the destination and scratch are left to the caller
+  //
+  vk::AccelerationStructureBuildGeometryInfoKHR getBlasBuildInfo(const Blas& blas,
+                                                                 bool        host = false) const
+  {
+    const auto& geometry = host ? blas.input.asHostGeometry : blas.input.asGeometry;
+
+    vk::AccelerationStructureBuildGeometryInfoKHR buildInfo;
+    buildInfo.setType(vk::AccelerationStructureTypeKHR::eBottomLevel);
+    buildInfo.setFlags(blas.flags);
+    buildInfo.setMode(vk::BuildAccelerationStructureModeKHR::eBuild);
+    buildInfo.setGeometryCount(static_cast<uint32_t>(geometry.size()));
+    buildInfo.setPGeometries(geometry.data());
+    return buildInfo;
+  }
+
+  // Sizes of the BLAS and of its scratch buffers, for the number of primitives of each geometry
+  vk::AccelerationStructureBuildSizesInfoKHR getBuildSizes(
+      const vk::AccelerationStructureBuildGeometryInfoKHR& buildInfo,
+      const Blas&                                          blas,
+      vk::AccelerationStructureBuildTypeKHR buildType = vk::AccelerationStructureBuildTypeKHR::eDevice) const
+  {
+    std::vector<uint32_t> maxPrimCount(blas.input.asBuildRangeInfo.size());
+    for(size_t i = 0; i < blas.input.asBuildRangeInfo.size(); i++)
+    {
+      maxPrimCount[i] = blas.input.asBuildRangeInfo[i].primitiveCount;
+    }
+    return m_device.getAccelerationStructureBuildSizesKHR(buildType, buildInfo, maxPrimCount);
+  }
+
+  // The TLAS has a single geometry: the array of instances stored in m_instBuffer
+  vk::AccelerationStructureGeometryKHR getTlasGeometry() const
+  {
+    vk::AccelerationStructureGeometryInstancesDataKHR instancesData;
+    instancesData.setArrayOfPointers(VK_FALSE);
+    if(m_instBuffer.buffer)
+    {
+      instancesData.data.setDeviceAddress(m_device.getBufferAddress({m_instBuffer.buffer}));
+    }
+
+    vk::AccelerationStructureGeometryKHR topGeometry;
+    topGeometry.setGeometryType(vk::GeometryTypeKHR::eInstances);
+    topGeometry.geometry.setInstances(instancesData);
+    return topGeometry;
+  }
+
+  vk::AccelerationStructureBuildGeometryInfoKHR getTlasBuildInfo(
+      const vk::AccelerationStructureGeometryKHR& topGeometry) const
+  {
+    vk::AccelerationStructureBuildGeometryInfoKHR buildInfo;
+    buildInfo.setType(vk::AccelerationStructureTypeKHR::eTopLevel);
+    buildInfo.setFlags(m_tlas.flags);
+    buildInfo.setMode(vk::BuildAccelerationStructureModeKHR::eBuild);
+    buildInfo.setGeometryCount(1);
+    buildInfo.setPGeometries(&topGeometry);
+    return buildInfo;
+  }
+
+  // Scratch buffers are accessed by device address while building
+  nvvkBuffer createScratchBuffer(vk::DeviceSize size)
+  {
+    return m_alloc.createBuffer(size, vk::BufferUsageFlagBits::eStorageBuffer
+                                          | vk::BufferUsageFlagBits::eShaderDeviceAddress);
+  }
+
   //--------------------------------------------------------------------------------------------------
   // Vector containing all the BLASes built and referenced by the TLAS
   std::vector<Blas> m_blas;
@@ -423,10 +995,19 @@ private:
   Tlas m_tlas;
   // Instance buffer containing the matrices and BLAS ids
   nvvkBuffer m_instBuffer;
+  // Scratch of the TLAS updates recorded in the frame command buffers
+  nvvkBuffer m_tlasUpdateScratch;
 
   vk::Device m_device;
   uint32_t   m_queueIndex{0};
 
+  // Building the BLAS on the CPU
+  bool     m_hostBuild{false};
+  uint32_t m_hostBuildThreads{1};
+
+  // Serialized BLAS of the previous runs
+  AccelerationCache m_cache;
+
   nvvkAllocator     m_alloc;
   nvvkpp::DebugUtil m_debug;
 };
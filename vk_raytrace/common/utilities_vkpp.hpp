@@ -50,6 +50,29 @@ inline vk::ClearColorValue clearColor(const glm::vec4& v = glm::vec4(0.f, 0.f, 0
   return result;
 }
 
+/**
+**align_up**: round up `x` to the next multiple of the power of two alignment `a`.
+*/
+template <class integral>
+constexpr integral align_up(integral x, size_t a) noexcept
+{
+  return integral((x + (integral(a) - 1)) & ~integral(a - 1));
+}
+
+/**
+**hashBytes**: 64-bit FNV-1a hash of `size` bytes, chained with a previous hash using `seed`.
+*/
+inline uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 14695981039346656037ull)
+{
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  uint64_t       hash  = seed;
+  for(size_t i = 0; i < size; i++)
+  {
+    hash = (hash ^ bytes[i]) * 1099511628211ull;
+  }
+  return hash;
+}
+
 /** 
 **createShaderModule**: create a shader module from SPIR-V code.
 */
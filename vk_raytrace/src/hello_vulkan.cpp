@@ -25,6 +25,10 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <random>
 #include <sstream>
 #include <vulkan/vulkan.hpp>
 
@@ -33,15 +37,21 @@
 #include "glm/gtx/transform.hpp"
 
 
+#include "bluenoise.h"
+#include "cache_dir.h"
 #include "descriptorsets_vkpp.hpp"
 #include "hello_vulkan.h"
 #include "manipulator.h"
+#include "mesh_simplify.h"
 #include "obj_loader.h"
 #include "pipeline_vkpp.hpp"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "commands_vkpp.hpp"
 #include "renderpass_vkpp.hpp"
+#include "shaders/lights.h"
+#include "shaders/shading.h"
+#include "shaders/sobol.h"
 #include "stb_image.h"
 #include "utilities_vkpp.hpp"
 
@@ -52,6 +62,7 @@ struct CameraMatrices
   glm::mat4 proj;
   glm::mat4 viewInverse;
   glm::mat4 projInverse;
+  glm::mat4 prevViewProj;  // View-projection of the previous frame, for the reprojection
 };
 
 // OBJ representation of a vertex
@@ -83,7 +94,10 @@ void HelloVulkan::init(const vk::Device&         device,
   m_physicalDevice = physicalDevice;
   m_queueIndex     = queueFamily;
   m_size           = size;
+  m_windowSize     = size;
   m_debug.setup(m_device);
+  // The visibility buffer reads gl_PrimitiveID in the fragment shader
+  m_visibilitySupported = physicalDevice.getFeatures().geometryShader == VK_TRUE;
 }
 
 //--------------------------------------------------------------------------------------------------
@@ -91,7 +105,7 @@ void HelloVulkan::init(const vk::Device&         device,
 //
 void HelloVulkan::updateUniformBuffer()
 {
-  const float aspectRatio = m_size.width / static_cast<float>(m_size.height);
+  const float aspectRatio = m_windowSize.width / static_cast<float>(m_windowSize.height);
 
   CameraMatrices ubo = {};
   ubo.view           = CameraManip.getMatrix();
@@ -99,6 +113,8 @@ void HelloVulkan::updateUniformBuffer()
   ubo.proj[1][1] *= -1;  // Inverting Y for Vulkan
   ubo.viewInverse = glm::inverse(ubo.view);
   ubo.projInverse = glm::inverse(ubo.proj);
+  ubo.prevViewProj = m_prevViewProj;
+  m_prevViewProj   = ubo.proj * ubo.view;
 # if defined(ALLOC_DEDICATED)
   void* data = m_device.mapMemory(m_cameraMat.allocation, 0, sizeof(ubo));
   memcpy(data, &ubo, sizeof(ubo));
@@ -123,24 +139,32 @@ void HelloVulkan::createDescriptorSetLayout()
   uint32_t nbTxt = static_cast<uint32_t>(m_textures.size());
   uint32_t nbObj = static_cast<uint32_t>(m_objModel.size());
 
+  // The wavefront path tracer reads the scene from its compute stages
   // Camera matrices (binding = 0)
   m_descSetLayoutBind.emplace_back(
-      vkDS(0, vkDT::eUniformBuffer, 1, vkSS::eVertex | vkSS::eRaygenNV));
+      vkDS(0, vkDT::eUniformBuffer, 1, vkSS::eVertex | vkSS::eRaygenKHR | vkSS::eCompute));
   // Materials (binding = 1)
   m_descSetLayoutBind.emplace_back(
-      vkDS(1, vkDT::eStorageBuffer, nbObj, vkSS::eVertex | vkSS::eFragment | vkSS::eClosestHitNV));
+      vkDS(1, vkDT::eStorageBuffer, nbObj,
+           vkSS::eVertex | vkSS::eFragment | vkSS::eRaygenKHR | vkSS::eClosestHitKHR
+               | vkSS::eCompute));
   // Scene description (binding = 2)
   m_descSetLayoutBind.emplace_back(  //
-      vkDS(2, vkDT::eStorageBuffer, 1, vkSS::eVertex | vkSS::eFragment | vkSS::eClosestHitNV));
+      vkDS(2, vkDT::eStorageBuffer, 1,
+           vkSS::eVertex | vkSS::eFragment | vkSS::eClosestHitKHR | vkSS::eCompute));
   // Textures (binding = 3)
   m_descSetLayoutBind.emplace_back(
-      vkDS(3, vkDT::eCombinedImageSampler, nbTxt, vkSS::eFragment | vkSS::eClosestHitNV));
+      vkDS(3, vkDT::eCombinedImageSampler, nbTxt,
+           vkSS::eFragment | vkSS::eClosestHitKHR | vkSS::eCompute));
   // Storing vertices (binding = 4)
   m_descSetLayoutBind.emplace_back(  //
-      vkDS(4, vkDT::eStorageBuffer, nbObj, vkSS::eClosestHitNV));
+      vkDS(4, vkDT::eStorageBuffer, nbObj, vkSS::eClosestHitKHR | vkSS::eCompute));
   // Storing indices (binding = 5)
   m_descSetLayoutBind.emplace_back(  //
-      vkDS(5, vkDT::eStorageBuffer, nbObj, vkSS::eClosestHitNV));
+      vkDS(5, vkDT::eStorageBuffer, nbObj, vkSS::eClosestHitKHR | vkSS::eCompute));
+  // Light index of the emissive triangles (binding = 6)
+  m_descSetLayoutBind.emplace_back(  //
+      vkDS(6, vkDT::eStorageBuffer, 1, vkSS::eClosestHitKHR | vkSS::eCompute));
 
   m_descSetLayout = nvvkpp::util::createDescriptorSetLayout(m_device, m_descSetLayoutBind);
   m_descPool      = nvvkpp::util::createDescriptorPool(m_device, m_descSetLayoutBind, 1);
@@ -159,6 +183,8 @@ void HelloVulkan::updateDescriptorSet()
   writes.emplace_back(nvvkpp::util::createWrite(m_descSet, m_descSetLayoutBind[0], &dbiUnif));
   vk::DescriptorBufferInfo dbiSceneDesc{m_sceneDesc.buffer, 0, VK_WHOLE_SIZE};
   writes.emplace_back(nvvkpp::util::createWrite(m_descSet, m_descSetLayoutBind[2], &dbiSceneDesc));
+  vk::DescriptorBufferInfo dbiLightPrim{m_lightPrimBuffer.buffer, 0, VK_WHOLE_SIZE};
+  writes.emplace_back(nvvkpp::util::createWrite(m_descSet, m_descSetLayoutBind[6], &dbiLightPrim));
 
   // All material buffers, 1 buffer per OBJ
   std::vector<vk::DescriptorBufferInfo> dbiMat;
@@ -167,8 +193,11 @@ void HelloVulkan::updateDescriptorSet()
   for(size_t i = 0; i < m_objModel.size(); ++i)
   {
     dbiMat.push_back({m_objModel[i].matColorBuffer.buffer, 0, VK_WHOLE_SIZE});
-    dbiVert.push_back({m_objModel[i].vertexBuffer.buffer, 0, VK_WHOLE_SIZE});
-    dbiIdx.push_back({m_objModel[i].indexBuffer.buffer, 0, VK_WHOLE_SIZE});
+    const ObjModel& model = m_objModel[i];
+    dbiVert.push_back({m_vertexBuffer.buffer, model.firstVertex * sizeof(Vertex),
+                       model.nbVertices * sizeof(Vertex)});
+    dbiIdx.push_back({m_indexBuffer.buffer, model.firstIndex * sizeof(uint32_t),
+                      model.nbIndices * sizeof(uint32_t)});
   }
   writes.emplace_back(nvvkpp::util::createWrite(m_descSet, m_descSetLayoutBind[1], dbiMat.data()));
   writes.emplace_back(nvvkpp::util::createWrite(m_descSet, m_descSetLayoutBind[4], dbiVert.data()));
@@ -207,26 +236,57 @@ void HelloVulkan::createGraphicsPipeline(const vk::RenderPass& renderPass)
   m_pipelineLayout = m_device.createPipelineLayout(pipelineLayoutCreateInfo);
 
   // Creating the Pipeline
+  auto setVertexInput = [](nvvkpp::GraphicsPipelineGenerator& generator) {
+    generator.vertexInputState.bindingDescriptions   = {{0, sizeof(Vertex)}};
+    generator.vertexInputState.attributeDescriptions = {
+        {0, 0, vk::Format::eR32G32B32Sfloat, offsetof(Vertex, pos)},
+        {1, 0, vk::Format::eR32G32B32Sfloat, offsetof(Vertex, nrm)},
+        {2, 0, vk::Format::eR32G32B32Sfloat, offsetof(Vertex, color)},
+        {3, 0, vk::Format::eR32G32Sfloat, offsetof(Vertex, texCoord)},
+        {4, 0, vk::Format::eR32Sint, offsetof(Vertex, matID)}};
+  };
   nvvkpp::GraphicsPipelineGenerator gpb(m_device, m_pipelineLayout, m_offscreenRenderPass);
   gpb.depthStencilState = {true};
   gpb.addShader(nvvkpp::util::readFile("shaders/vert_shader.vert.spv"), vkSS::eVertex);
   gpb.addShader(nvvkpp::util::readFile("shaders/frag_shader.frag.spv"), vkSS::eFragment);
-  gpb.vertexInputState.bindingDescriptions   = {{0, sizeof(Vertex)}};
-  gpb.vertexInputState.attributeDescriptions = {
-      {0, 0, vk::Format::eR32G32B32Sfloat, offsetof(Vertex, pos)},
-      {1, 0, vk::Format::eR32G32B32Sfloat, offsetof(Vertex, nrm)},
-      {2, 0, vk::Format::eR32G32B32Sfloat, offsetof(Vertex, color)},
-      {3, 0, vk::Format::eR32G32Sfloat, offsetof(Vertex, texCoord)},
-      {4, 0, vk::Format::eR32Sint, offsetof(Vertex, matID)}};
+  setVertexInput(gpb);
 
   m_graphicsPipeline = gpb.create();
   m_debug.setObjectName(m_graphicsPipeline, "Graphics");
+
+  // G-buffer of the hybrid renderer, with the three attachments of m_gbufferRenderPass. Both faces
+  // are drawn, like the rays see them.
+  nvvkpp::GraphicsPipelineGenerator gbufferGen(m_device, m_pipelineLayout, m_gbufferRenderPass);
+  gbufferGen.depthStencilState = {true};
+  gbufferGen.rasterizationState.setCullMode(vk::CullModeFlagBits::eNone);
+  gbufferGen.colorBlendState.blendAttachmentStates.resize(3);
+  gbufferGen.addShader(nvvkpp::util::readFile("shaders/vert_shader.vert.spv"), vkSS::eVertex);
+  gbufferGen.addShader(nvvkpp::util::readFile("shaders/gbuffer.frag.spv"), vkSS::eFragment);
+  setVertexInput(gbufferGen);
+
+  m_gbufferPipeline = gbufferGen.create();
+  m_debug.setObjectName(m_gbufferPipeline, "G-buffer");
+
+  // Visibility buffer, shaded by the resolve
+  if(m_visibilitySupported)
+  {
+    nvvkpp::GraphicsPipelineGenerator visibilityGen(m_device, m_pipelineLayout, m_visibilityRenderPass);
+    visibilityGen.depthStencilState = {true};
+    visibilityGen.addShader(nvvkpp::util::readFile("shaders/vert_shader.vert.spv"), vkSS::eVertex);
+    visibilityGen.addShader(nvvkpp::util::readFile("shaders/visibility.frag.spv"), vkSS::eFragment);
+    setVertexInput(visibilityGen);
+
+    m_visibilityPipeline = visibilityGen.create();
+    m_debug.setObjectName(m_visibilityPipeline, "Visibility");
+  }
 }
 
-uint32_t HelloVulkan::loadObject(const std::string& filename)
+//--------------------------------------------------------------------------------------------------
+// Loading the OBJ file and setting up all buffers
+// - With maxLodLevels > 1, simplified versions of the mesh are added as the next models, see updateLods
+//
+uint32_t HelloVulkan::loadObject(const std::string& filename, uint32_t maxLodLevels)
 {
-    using vkBU = vk::BufferUsageFlagBits;
-
     ObjLoader<Vertex> loader;
     loader.loadModel(filename);
     
@@ -238,31 +298,192 @@ uint32_t HelloVulkan::loadObject(const std::string& filename)
         m.specular = glm::pow(m.specular, glm::vec3(2.2f));
     }
 
-    ObjModel model;
-    model.nbIndices = static_cast<uint32_t>(loader.m_indices.size());
-    model.nbVertices = static_cast<uint32_t>(loader.m_vertices.size());
+    const uint32_t lodBase   = static_cast<uint32_t>(m_objModel.size());
+    const uint32_t txtOffset = static_cast<uint32_t>(m_textures.size());
 
     // Create the buffers on Device and copy vertices, indices and materials
     nvvkpp::SingleCommandBuffer cmdBufGet(m_device, m_queueIndex);
     vk::CommandBuffer           cmdBuf = cmdBufGet.createCommandBuffer();
-    model.vertexBuffer =
-        m_alloc.createBuffer(cmdBuf, loader.m_vertices, vkBU::eVertexBuffer | vkBU::eStorageBuffer);
-    model.indexBuffer =
-        m_alloc.createBuffer(cmdBuf, loader.m_indices, vkBU::eIndexBuffer | vkBU::eStorageBuffer);
-    model.matColorBuffer = m_alloc.createBuffer(cmdBuf, loader.m_materials, vkBU::eStorageBuffer);
+    addObjModel(cmdBuf, loader.m_vertices, loader.m_indices, loader.m_materials, lodBase, txtOffset);
+
+    // Emissive triangles, sampled directly by the path tracer. Lights are not simplified: the
+    // triangles hit must be the ones in the light list.
+    ObjModel& model = m_objModel[lodBase];
+    for(size_t i = 0; i + 2 < loader.m_indices.size(); i += 3)
+    {
+      const Vertex&    v0       = loader.m_vertices[loader.m_indices[i + 0]];
+      const glm::vec3& emission = loader.m_materials[v0.matID].emission;
+      if(emission == glm::vec3(0))
+        continue;
+      ObjModel::Emitter emitter;
+      emitter.v0        = v0.pos;
+      emitter.v1        = loader.m_vertices[loader.m_indices[i + 1]].pos;
+      emitter.v2        = loader.m_vertices[loader.m_indices[i + 2]].pos;
+      emitter.emission  = emission;
+      emitter.primitive = static_cast<uint32_t>(i / 3);
+      model.emitters.push_back(emitter);
+    }
+    if(!model.emitters.empty())
+      maxLodLevels = 1;
+
+    // Level of details: each level is simplified from the original mesh, on a coarser grid than
+    // the previous one, and kept only if it removes enough triangles
+    std::vector<Vertex>   lodVertices;
+    std::vector<uint32_t> lodIndices;
+    size_t                lodTriangles = loader.m_indices.size() / 3;
+    for(uint32_t gridSize = 128; gridSize >= 2 && m_objModel.size() - lodBase < maxLodLevels; gridSize /= 2)
+    {
+      simplifyMesh(loader.m_vertices, loader.m_indices, gridSize, lodVertices, lodIndices);
+      if(lodIndices.empty() || lodIndices.size() / 3 > lodTriangles * 3 / 4)
+        continue;
+      lodTriangles = lodIndices.size() / 3;
+      addObjModel(cmdBuf, lodVertices, lodIndices, loader.m_materials, lodBase, txtOffset);
+    }
+    for(uint32_t i = lodBase; i < m_objModel.size(); i++)
+    {
+      m_objModel[i].lodLevels = static_cast<uint32_t>(m_objModel.size()) - lodBase;
+    }
+
     // Creates all textures found
     createTextureImages(cmdBuf, loader.m_textures);
     cmdBufGet.flushCommandBuffer(cmdBuf);
     m_alloc.flushStaging();
 
+    return lodBase;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Material class shared by all the triangles of a mesh, selecting its specialized closest hit
+// shader. Emitters need the light lookup and mirrors the reflections, so any of them in a mix
+// of materials makes it emissive or generic.
+//
+static uint32_t meshHitGroup(const std::vector<Vertex>& vertices, const std::vector<MatrialObj>& materials)
+{
+  std::vector<bool> used(materials.size(), false);
+  for(const auto& v : vertices)
+  {
+    used[v.matID] = true;
+  }
+
+  bool emissive = false, anyMirror = false, allMirror = true, anyTexture = false, allTexture = true;
+  for(size_t i = 0; i < materials.size(); i++)
+  {
+    if(!used[i])
+      continue;
+    const bool mirror   = materials[i].illum == 3;
+    const bool textured = materials[i].textureID >= 0;
+    emissive   = emissive || materials[i].emission != glm::vec3(0);
+    anyMirror  = anyMirror || mirror;
+    allMirror  = allMirror && mirror;
+    anyTexture = anyTexture || textured;
+    allTexture = allTexture && textured;
+  }
+
+  if(emissive)
+    return HIT_GROUP_EMISSIVE;
+  if(allMirror)
+    return HIT_GROUP_MIRROR;
+  if(anyMirror)
+    return HIT_GROUP_GENERIC;
+  if(allTexture)
+    return HIT_GROUP_TEXTURED;
+  return anyTexture ? HIT_GROUP_GENERIC : HIT_GROUP_DIFFUSE;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Creating the device buffers of one model and adding it to m_objModel
+//
+void HelloVulkan::addObjModel(const vk::CommandBuffer&       cmdBuf,
+                              const std::vector<Vertex>&     vertices,
+                              const std::vector<uint32_t>&   indices,
+                              const std::vector<MatrialObj>& materials,
+                              uint32_t                       lodBase,
+                              uint32_t                       txtOffset)
+{
+    using vkBU = vk::BufferUsageFlagBits;
+
+    ObjModel model;
+    model.nbIndices = static_cast<uint32_t>(indices.size());
+    model.nbVertices = static_cast<uint32_t>(vertices.size());
+    model.txtOffset  = txtOffset;
+    model.lodBase    = lodBase;
+    model.hitGroup   = meshHitGroup(vertices, materials);
+
+    // The vertices and indices go to the shared buffers of createGeometryBuffers
+    model.matColorBuffer = m_alloc.createBuffer(cmdBuf, materials, vkBU::eStorageBuffer);
+
     std::string objNb = std::to_string(m_objModel.size());
-    m_debug.setObjectName(model.vertexBuffer.buffer, (std::string("vertex_" + objNb).c_str()));
-    m_debug.setObjectName(model.indexBuffer.buffer, (std::string("index_" + objNb).c_str()));
     m_debug.setObjectName(model.matColorBuffer.buffer, (std::string("mat_" + objNb).c_str()));
 
-    m_objModel.emplace_back(model);
+    // Bounding box, for the culling of the raster, and bounding sphere, used to compute the
+    // projected size of the instances
+    glm::vec3 bbMin(std::numeric_limits<float>::max());
+    glm::vec3 bbMax(-std::numeric_limits<float>::max());
+    for(const auto& v : vertices)
+    {
+      bbMin = glm::min(bbMin, v.pos);
+      bbMax = glm::max(bbMax, v.pos);
+    }
+    model.bbMin  = bbMin;
+    model.bbMax  = bbMax;
+    model.center = (bbMin + bbMax) * 0.5f;
+    for(const auto& v : vertices)
+    {
+      model.radius = std::max(model.radius, glm::length(v.pos - model.center));
+    }
+    buildClusters(vertices, indices, CLUSTER_MAX_VERTICES, CLUSTER_MAX_TRIANGLES, model.clusters);
+
+    // Keeping the geometry on the host for the shared buffers and the BLAS builds
+    const uint8_t* vertexData = reinterpret_cast<const uint8_t*>(vertices.data());
+    model.hostVertices.assign(vertexData, vertexData + vertices.size() * sizeof(Vertex));
+    model.hostIndices = indices;
+
+    m_objModel.emplace_back(std::move(model));
+}
+
+//--------------------------------------------------------------------------------------------------
+// Suballocating the geometry of all the models into m_vertexBuffer and m_indexBuffer, once they
+// are all loaded. Each model starts at an offset aligned for the storage buffer descriptors, the
+// hit shaders seeing the geometry of each model on its own.
+//
+void HelloVulkan::createGeometryBuffers()
+{
+  using vkBU = vk::BufferUsageFlagBits;
+
+  const vk::DeviceSize alignment =
+      m_physicalDevice.getProperties().limits.minStorageBufferOffsetAlignment;
+  uint32_t vertexStep = 1;
+  while((vertexStep * sizeof(Vertex)) % alignment != 0)
+    vertexStep++;
+  const uint32_t indexStep =
+      static_cast<uint32_t>(std::max<vk::DeviceSize>(alignment / sizeof(uint32_t), 1));
+
+  std::vector<uint8_t>  vertices;
+  std::vector<uint32_t> indices;
+  for(auto& model : m_objModel)
+  {
+    model.firstVertex = static_cast<uint32_t>(vertices.size() / sizeof(Vertex));
+    model.firstIndex  = static_cast<uint32_t>(indices.size());
+    vertices.insert(vertices.end(), model.hostVertices.begin(), model.hostVertices.end());
+    indices.insert(indices.end(), model.hostIndices.begin(), model.hostIndices.end());
+    const uint32_t vertexCount = (model.nbVertices + vertexStep - 1) / vertexStep * vertexStep;
+    vertices.resize((model.firstVertex + vertexCount) * sizeof(Vertex));
+    indices.resize(model.firstIndex + (model.nbIndices + indexStep - 1) / indexStep * indexStep);
+  }
 
-    return static_cast<uint32_t>(m_objModel.size() - 1);
+  // Also inputs of the BLAS builder, referenced by device address
+  const vk::BufferUsageFlags rtUsage =
+      vkBU::eShaderDeviceAddress | vkBU::eAccelerationStructureBuildInputReadOnlyKHR;
+  nvvkpp::SingleCommandBuffer cmdGen(m_device, m_queueIndex);
+  auto                        cmdBuf = cmdGen.createCommandBuffer();
+  m_vertexBuffer =
+      m_alloc.createBuffer(cmdBuf, vertices, vkBU::eVertexBuffer | vkBU::eStorageBuffer | rtUsage);
+  m_indexBuffer =
+      m_alloc.createBuffer(cmdBuf, indices, vkBU::eIndexBuffer | vkBU::eStorageBuffer | rtUsage);
+  cmdGen.flushCommandBuffer(cmdBuf);
+  m_alloc.flushStaging();
+  m_debug.setObjectName(m_vertexBuffer.buffer, "vertices");
+  m_debug.setObjectName(m_indexBuffer.buffer, "indices");
 }
 
 void HelloVulkan::addInstance(uint32_t objIndex, glm::mat4 transform)
@@ -271,7 +492,7 @@ void HelloVulkan::addInstance(uint32_t objIndex, glm::mat4 transform)
     instance.objIndex = objIndex;
     instance.transform = transform;
     instance.transformIT = glm::inverseTranspose(transform);
-    instance.txtOffset = objIndex; // Pipeline is set up with EXACTLY one texture per obj
+    instance.txtOffset = m_objModel[objIndex].txtOffset;
     m_objInstance.emplace_back(instance);
 }
 
@@ -317,6 +538,42 @@ void HelloVulkan::createSceneDescriptionBuffer()
   m_debug.setObjectName(m_sceneDesc.buffer, "sceneDesc");
 }
 
+//--------------------------------------------------------------------------------------------------
+// Indirect draw of one instance: its model in the shared buffers, and the instance index as
+// gl_InstanceIndex for the shaders to find its transformation and materials
+//
+static vk::DrawIndexedIndirectCommand drawCommand(const HelloVulkan::ObjModel& model, uint32_t instance)
+{
+  return {model.nbIndices, 1, model.firstIndex, static_cast<int32_t>(model.firstVertex), instance};
+}
+
+//--------------------------------------------------------------------------------------------------
+// Creating the indirect draws of all instances, changed by updateLods when an instance switches
+// to another level of detail
+//
+void HelloVulkan::createIndirectBuffer()
+{
+  std::vector<vk::DrawIndexedIndirectCommand> commands;
+  for(uint32_t i = 0; i < static_cast<uint32_t>(m_objInstance.size()); i++)
+    commands.push_back(drawCommand(m_objModel[m_objInstance[i].objIndex], i));
+
+  nvvkpp::SingleCommandBuffer cmdGen(m_device, m_queueIndex);
+  auto                        cmdBuf = cmdGen.createCommandBuffer();
+  // Also read by the culling
+  m_indirectBuffer = m_alloc.createBuffer(cmdBuf, commands,
+                                          vk::BufferUsageFlagBits::eIndirectBuffer
+                                              | vk::BufferUsageFlagBits::eStorageBuffer);
+  cmdGen.flushCommandBuffer(cmdBuf);
+  m_alloc.flushStaging();
+  m_debug.setObjectName(m_indirectBuffer.buffer, "indirectDraws");
+  const vk::PhysicalDeviceFeatures features = m_physicalDevice.getFeatures();
+  m_multiDrawIndirect                     = features.multiDrawIndirect == VK_TRUE;
+  // The instance index of drawCommand is its firstInstance: without the feature, the instances
+  // are drawn one by one with drawIndexed, and the culling is not available
+  m_indirectSupported = features.drawIndirectFirstInstance == VK_TRUE;
+  m_indirectRaster    = m_indirectRaster && m_indirectSupported;
+}
+
 //--------------------------------------------------------------------------------------------------
 // Creating all textures and samplers
 //
@@ -398,11 +655,12 @@ void HelloVulkan::destroyResources()
   m_device.destroy(m_descSetLayout);
   m_alloc.destroy(m_cameraMat);
   m_alloc.destroy(m_sceneDesc);
+  m_alloc.destroy(m_vertexBuffer);
+  m_alloc.destroy(m_indexBuffer);
+  m_alloc.destroy(m_indirectBuffer);
 
   for(auto& m : m_objModel)
   {
-    m_alloc.destroy(m.vertexBuffer);
-    m_alloc.destroy(m.indexBuffer);
     m_alloc.destroy(m.matColorBuffer);
   }
 
@@ -418,9 +676,46 @@ void HelloVulkan::destroyResources()
   m_device.destroy(m_postDescSetLayout);
   m_alloc.destroy(m_offscreenColor);
   m_alloc.destroy(m_offscreenDepth);
+  m_alloc.destroy(m_varianceImage);
+  m_alloc.destroy(m_normalDepthImage);
+  m_alloc.destroy(m_albedoImage);
+  m_alloc.destroy(m_motionImage);
+  m_alloc.destroy(m_prevNormalDepthImage);
+  m_alloc.destroy(m_historyColorImage);
+  m_alloc.destroy(m_historyAlbedoImage);
+  m_alloc.destroy(m_historyStatsImage);
+  m_alloc.destroy(m_upscaledImage);
   m_device.destroy(m_offscreenRenderPass);
   m_device.destroy(m_offscreenFramebuffer);
 
+  //#Hybrid
+  m_device.destroy(m_gbufferPipeline);
+  m_alloc.destroy(m_gbufferPosition);
+  m_alloc.destroy(m_gbufferNormal);
+  m_alloc.destroy(m_gbufferMaterial);
+  m_device.destroy(m_gbufferRenderPass);
+  m_device.destroy(m_gbufferFramebuffer);
+
+  //#Visibility buffer
+  m_device.destroy(m_visibilityPipeline);
+  m_alloc.destroy(m_visibilityImage);
+  m_device.destroy(m_visibilityRenderPass);
+  m_device.destroy(m_visibilityFramebuffer);
+  m_device.destroy(m_visibilityDescPool);
+  m_device.destroy(m_visibilityDescSetLayout);
+  m_device.destroy(m_resolvePipeline);
+  m_device.destroy(m_resolvePipelineLayout);
+  for(auto& pool : m_fragmentPools)
+    m_device.destroy(pool);
+
+  //#Parallel recording
+  m_jobPool.reset();
+  for(auto& pools : m_recordPools)
+  {
+    for(auto& pool : pools)
+      m_device.destroy(pool.pool);
+  }
+
   m_device.destroy(m_rtDescPool);
   m_device.destroy(m_rtDescSetLayout);
 
@@ -430,10 +725,75 @@ void HelloVulkan::destroyResources()
   m_device.destroy(m_rtPipeline);
   m_device.destroy(m_rtPipelineLayout);
   m_alloc.destroy(m_rtSBTBuffer);
+  m_alloc.destroy(m_rayStatsBuffer);
+  for(auto& readback : m_rayStatsReadbacks)
+    m_alloc.destroy(readback);
+  m_alloc.destroy(m_lightBuffer);
+  m_alloc.destroy(m_lightBvhBuffer);
+  m_alloc.destroy(m_lightPrimBuffer);
+  m_alloc.destroy(m_sobolBuffer);
+  m_alloc.destroy(m_blueNoiseBuffer);
+  m_alloc.destroy(m_wavefrontBuffer);
+  m_alloc.destroy(m_wavefrontCounters);
+  for(auto& readback : m_wavefrontReadbacks)
+    m_alloc.destroy(readback);
+  destroyDenoiseImages();
 #if defined(ALLOC_DMA)
   m_dmaAllocator.deinit();
 #endif
 
+  //#Denoiser
+  m_device.destroy(m_denoiseDescPool);
+  m_device.destroy(m_denoiseDescSetLayout);
+  m_device.destroy(m_temporalPipeline);
+  m_device.destroy(m_atrousPipeline);
+  m_device.destroy(m_denoisePipelineLayout);
+
+  //#Dynamic resolution
+  m_device.destroy(m_upscaleDescPool);
+  m_device.destroy(m_upscaleDescSetLayout);
+  m_device.destroy(m_upscalePipeline);
+  m_device.destroy(m_upscalePipelineLayout);
+
+  //#Sparse primary rays
+  m_device.destroy(m_interleavePipeline);
+  m_device.destroy(m_interleavePipelineLayout);
+
+  //#Culling
+  destroyHizImage();
+  m_alloc.destroy(m_boundsBuffer);
+  m_alloc.destroy(m_clusterBuffer);
+  m_alloc.destroy(m_modelClusterBuffer);
+  m_alloc.destroy(m_visibleDrawBuffer);
+  m_alloc.destroy(m_cullStatsBuffer);
+  for(auto& readback : m_cullStatsReadbacks)
+    m_alloc.destroy(readback);
+  m_device.destroy(m_cullDescPool);
+  m_device.destroy(m_cullDescSetLayout);
+  m_device.destroy(m_hizDescSetLayout);
+  m_device.destroy(m_cullPipeline);
+  m_device.destroy(m_clusterCullPipeline);
+  m_device.destroy(m_hizPipeline);
+  m_device.destroy(m_cullPipelineLayout);
+  m_device.destroy(m_hizPipelineLayout);
+  for(auto& pool : m_cullPools)
+    m_device.destroy(pool);
+
+  //#Wavefront
+  m_device.destroy(m_wavefrontDescPool);
+  m_device.destroy(m_wavefrontDescSetLayout);
+  for(auto& pipeline : m_wavefrontPipelines)
+    m_device.destroy(pipeline);
+  m_device.destroy(m_wavefrontTracePipeline);
+  m_alloc.destroy(m_wavefrontSBTBuffer);
+  m_device.destroy(m_wavefrontPipelineLayout);
+  for(auto& pool : m_timestampPools)
+    m_device.destroy(pool);
+  for(auto& pool : m_frameTimerPools)
+    m_device.destroy(pool);
+  for(auto& pool : m_tilePools)
+    m_device.destroy(pool);
+
   //Animation
   m_device.destroy(m_compDescPool);
   m_device.destroy(m_compDescSetLayout);
@@ -446,33 +806,92 @@ void HelloVulkan::destroyResources()
 //
 void HelloVulkan::rasterize(const vk::CommandBuffer& cmdBuf)
 {
-  using vkPBP = vk::PipelineBindPoint;
-  using vkSS  = vk::ShaderStageFlagBits;
-  vk::DeviceSize offset{0};
+  const auto start = std::chrono::high_resolution_clock::now();
 
   m_debug.beginLabel(cmdBuf, "Rasterize");
 
+  // The fragment shader invocations are counted in the pool reset by cullInstances
+  const vk::QueryPool fragments = fragmentPool();
+  if(fragments)
+    cmdBuf.beginQuery(fragments, 0, vk::QueryControlFlags());
+  rasterizeRange(cmdBuf, 0, static_cast<uint32_t>(m_objInstance.size()));
+  if(fragments)
+    cmdBuf.endQuery(fragments, 0);
+  m_debug.endLabel(cmdBuf);
+
+  const std::chrono::duration<float, std::micro> elapsed =
+      std::chrono::high_resolution_clock::now() - start;
+  m_rasterRecordTime = elapsed.count();
+}
+
+//--------------------------------------------------------------------------------------------------
+// Recording the draws first .. first+count-1 of rasterize() with all their state, also as a
+// secondary command buffer of rasterizeParallel
+//
+void HelloVulkan::rasterizeRange(const vk::CommandBuffer& cmdBuf, uint32_t first, uint32_t count)
+{
   // Dynamic Viewport
   cmdBuf.setViewport(0, {vk::Viewport(0, 0, (float)m_size.width, (float)m_size.height, 0, 1)});
   cmdBuf.setScissor(0, {{{0, 0}, {m_size.width, m_size.height}}});
 
+  // Shading each fragment, or only writing its triangle for the resolve of rasterizeVisibility
+  cmdBuf.bindPipeline(vk::PipelineBindPoint::eGraphics,
+                      m_visibilityBuffer ? m_visibilityPipeline : m_graphicsPipeline);
+  drawInstances(cmdBuf, m_indirectRaster && m_gpuCulling, first, count);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Drawing all triangles with the bound graphics pipeline, from the geometry shared by all the
+// models. When culled, the draws are the ones kept by cullInstances, compacted or with the culled
+// ones left empty, or the clusters kept.
+// Only the draws first .. first+count-1 are recorded. The draws counted on the device cannot be
+// split: all of them are recorded with the range starting at 0.
+//
+void HelloVulkan::drawInstances(const vk::CommandBuffer& cmdBuf, bool culled, uint32_t first, uint32_t count)
+{
+  using vkPBP = vk::PipelineBindPoint;
+  using vkSS  = vk::ShaderStageFlagBits;
+  vk::DeviceSize offset{0};
+  if(culled && m_drawIndirectCount && first > 0)
+    return;
 
-  // Drawing all triangles
-  cmdBuf.bindPipeline(vkPBP::eGraphics, m_graphicsPipeline);
   cmdBuf.bindDescriptorSets(vkPBP::eGraphics, m_pipelineLayout, 0, {m_descSet}, {});
-  for(int i = 0; i < m_objInstance.size(); ++i)
+  cmdBuf.pushConstants<ObjPushConstant>(m_pipelineLayout, vkSS::eVertex | vkSS::eFragment, 0,
+                                        m_pushConstant);
+  cmdBuf.bindVertexBuffers(0, 1, &m_vertexBuffer.buffer, &offset);
+  cmdBuf.bindIndexBuffer(m_indexBuffer.buffer, 0, vk::IndexType::eUint32);
+  const uint32_t   drawCount = static_cast<uint32_t>(m_objInstance.size());
+  const uint32_t   last      = first + std::min(count, drawCount - std::min(first, drawCount));
+  const uint32_t   stride    = sizeof(vk::DrawIndexedIndirectCommand);
+  const vk::Buffer draws     = culled ? m_visibleDrawBuffer.buffer : m_indirectBuffer.buffer;
+  if(culled && clusterDraws())
   {
-    auto& inst                = m_objInstance[i];
-    auto& model               = m_objModel[inst.objIndex];
-    m_pushConstant.instanceId = i;  // Telling which instance is drawn
-    cmdBuf.pushConstants<ObjPushConstant>(m_pipelineLayout, vkSS::eVertex | vkSS::eFragment, 0,
-                                          m_pushConstant);
-
-    cmdBuf.bindVertexBuffers(0, 1, &model.vertexBuffer.buffer, &offset);
-    cmdBuf.bindIndexBuffer(model.indexBuffer.buffer, 0, vk::IndexType::eUint32);
-    cmdBuf.drawIndexed(model.nbIndices, 1, 0, 0, 0);
+    cmdBuf.drawIndexedIndirectCountKHR(draws, 0, m_cullStatsBuffer.buffer,
+                                       CULL_STAT_DRAWS * sizeof(uint32_t), m_clusterDrawCount, stride);
+  }
+  else if(culled && m_drawIndirectCount)
+  {
+    cmdBuf.drawIndexedIndirectCountKHR(draws, 0, m_cullStatsBuffer.buffer,
+                                       CULL_STAT_DRAWS * sizeof(uint32_t), drawCount, stride);
+  }
+  else if(m_indirectRaster && m_multiDrawIndirect)
+  {
+    if(last > first)
+      cmdBuf.drawIndexedIndirect(draws, first * stride, last - first, stride);
+  }
+  else if(m_indirectRaster)
+  {
+    for(uint32_t i = first; i < last; i++)
+      cmdBuf.drawIndexedIndirect(draws, i * stride, 1, stride);
+  }
+  else
+  {
+    for(uint32_t i = first; i < last; i++)
+    {
+      const ObjModel& model = m_objModel[m_objInstance[i].objIndex];
+      cmdBuf.drawIndexed(model.nbIndices, 1, model.firstIndex, static_cast<int32_t>(model.firstVertex), i);
+    }
   }
-  m_debug.endLabel(cmdBuf);
 }
 
 //--------------------------------------------------------------------------------------------------
@@ -480,11 +899,21 @@ void HelloVulkan::rasterize(const vk::CommandBuffer& cmdBuf)
 //
 void HelloVulkan::resize(const vk::Extent2D& size)
 {
-  m_size = size;
+  m_windowSize        = size;
+  m_size.width        = std::max(1u, static_cast<uint32_t>(size.width * m_renderScale + 0.5f));
+  m_size.height       = std::max(1u, static_cast<uint32_t>(size.height * m_renderScale + 0.5f));
+  m_framesSinceResize = 0;
+  resetTiles();
   resetFrame();
   createOffscreenRender();
   updatePostDescriptorSet();
   updateRtDescriptorSet();
+  updateDenoiseDescriptorSets();
+  updateUpscaleDescriptorSet();
+  updateCullDescriptorSets();
+  updateVisibilityDescriptorSet();
+  createWavefrontBuffers();
+  updateWavefrontDescriptorSet();
 }
 
 
@@ -500,12 +929,22 @@ void HelloVulkan::createOffscreenRender()
 {
   m_alloc.destroy(m_offscreenColor);
   m_alloc.destroy(m_offscreenDepth);
+  m_alloc.destroy(m_varianceImage);
+  m_alloc.destroy(m_normalDepthImage);
+  m_alloc.destroy(m_albedoImage);
+  m_alloc.destroy(m_motionImage);
+  m_alloc.destroy(m_prevNormalDepthImage);
+  m_alloc.destroy(m_historyColorImage);
+  m_alloc.destroy(m_historyAlbedoImage);
+  m_alloc.destroy(m_historyStatsImage);
+  m_alloc.destroy(m_upscaledImage);
 
   // Creating the color image
   auto colorCreateInfo = nvvkpp::image::create2DInfo(m_size, m_offscreenColorFormat,
                                                      vk::ImageUsageFlagBits::eColorAttachment
                                                          | vk::ImageUsageFlagBits::eSampled
-                                                         | vk::ImageUsageFlagBits::eStorage);
+                                                         | vk::ImageUsageFlagBits::eStorage
+                                                         | vk::ImageUsageFlagBits::eTransferSrc);
   m_offscreenColor     = m_alloc.createImage(colorCreateInfo);
 
 
@@ -513,11 +952,53 @@ void HelloVulkan::createOffscreenRender()
       nvvkpp::image::create2DDescriptor(m_device, m_offscreenColor.image, vk::SamplerCreateInfo{},
                                         m_offscreenColorFormat, vk::ImageLayout::eGeneral);
 
-  // Creating the depth buffer
+  // Convergence of each pixel, written by the ray generation and shown by the post-process
+  auto varianceCreateInfo = nvvkpp::image::create2DInfo(m_size, vk::Format::eR32G32B32A32Sfloat,
+                                                        vk::ImageUsageFlagBits::eSampled
+                                                            | vk::ImageUsageFlagBits::eStorage
+                                                            | vk::ImageUsageFlagBits::eTransferSrc);
+  m_varianceImage = m_alloc.createImage(varianceCreateInfo);
+  m_varianceImage.descriptor =
+      nvvkpp::image::create2DDescriptor(m_device, m_varianceImage.image, vk::SamplerCreateInfo{},
+                                        vk::Format::eR32G32B32A32Sfloat, vk::ImageLayout::eGeneral);
+  m_debug.setObjectName(m_varianceImage.image, "variance");
+
+  // Primary hits written by the ray generation for the denoiser and the reprojection
+  m_normalDepthImage = createStorageImage(vk::Format::eR32G32B32A32Sfloat,
+                                          vk::ImageUsageFlagBits::eTransferSrc, "normalDepth");
+  m_albedoImage = createStorageImage(vk::Format::eR16G16B16A16Sfloat,
+                                     vk::ImageUsageFlagBits::eTransferSrc, "albedo");
+  m_motionImage = createStorageImage(vk::Format::eR32G32B32A32Sfloat, {}, "motion");
+  m_prevNormalDepthImage = createStorageImage(vk::Format::eR32G32B32A32Sfloat,
+                                              vk::ImageUsageFlagBits::eTransferDst, "prevNormalDepth");
+
+  // Previous frame, copied by raytrace() when the camera moved
+  m_historyColorImage  = createStorageImage(m_offscreenColorFormat,
+                                            vk::ImageUsageFlagBits::eTransferDst, "historyColor");
+  m_historyAlbedoImage = createStorageImage(vk::Format::eR16G16B16A16Sfloat,
+                                            vk::ImageUsageFlagBits::eTransferDst, "historyAlbedo");
+  m_historyStatsImage  = createStorageImage(vk::Format::eR32G32B32A32Sfloat,
+                                            vk::ImageUsageFlagBits::eTransferDst, "historyStats");
+  createDenoiseImages();
+
+  // The rendered image upscaled to the window
+  auto upscaledCreateInfo = nvvkpp::image::create2DInfo(m_windowSize, vk::Format::eR32G32B32A32Sfloat,
+                                                        vk::ImageUsageFlagBits::eSampled
+                                                            | vk::ImageUsageFlagBits::eStorage);
+  m_upscaledImage = m_alloc.createImage(upscaledCreateInfo);
+  m_upscaledImage.descriptor =
+      nvvkpp::image::create2DDescriptor(m_device, m_upscaledImage.image, vk::SamplerCreateInfo{},
+                                        vk::Format::eR32G32B32A32Sfloat, vk::ImageLayout::eGeneral);
+  m_debug.setObjectName(m_upscaledImage.image, "upscaled");
+
+  // Creating the depth buffer, sampled by the HiZ build
   auto depthCreateInfo =
       nvvkpp::image::create2DInfo(m_size, m_offscreenDepthFormat,
-                                  vk::ImageUsageFlagBits::eDepthStencilAttachment);
+                                  vk::ImageUsageFlagBits::eDepthStencilAttachment
+                                      | vk::ImageUsageFlagBits::eSampled);
   m_offscreenDepth = m_alloc.createImage(depthCreateInfo);
+  m_offscreenDepth.descriptor.sampler     = m_device.createSampler(vk::SamplerCreateInfo{});
+  m_offscreenDepth.descriptor.imageLayout = vk::ImageLayout::eDepthStencilReadOnlyOptimal;
 
   vk::ImageViewCreateInfo depthStencilView;
   depthStencilView.setViewType(vk::ImageViewType::e2D);
@@ -532,6 +1013,10 @@ void HelloVulkan::createOffscreenRender()
     auto                        cmdBuf = genCmdBuf.createCommandBuffer();
     nvvkpp::image::setImageLayout(cmdBuf, m_offscreenColor.image, vk::ImageLayout::eUndefined,
                                   vk::ImageLayout::eGeneral);
+    nvvkpp::image::setImageLayout(cmdBuf, m_varianceImage.image, vk::ImageLayout::eUndefined,
+                                  vk::ImageLayout::eGeneral);
+    nvvkpp::image::setImageLayout(cmdBuf, m_upscaledImage.image, vk::ImageLayout::eUndefined,
+                                  vk::ImageLayout::eGeneral);
     nvvkpp::image::setImageLayout(cmdBuf, m_offscreenDepth.image, vk::ImageAspectFlagBits::eDepth,
                                   vk::ImageLayout::eUndefined,
                                   vk::ImageLayout::eDepthStencilAttachmentOptimal);
@@ -562,6 +1047,30 @@ void HelloVulkan::createOffscreenRender()
   info.setHeight(m_size.height);
   info.setLayers(1);
   m_offscreenFramebuffer = m_device.createFramebuffer(info);
+
+  createHizImage();
+  createGBuffer();
+  createVisibilityImage();
+}
+
+//--------------------------------------------------------------------------------------------------
+// Image of the size of the rendering, read and written by the shaders in the general layout
+//
+nvvkTexture HelloVulkan::createStorageImage(vk::Format format, vk::ImageUsageFlags usage, const char* name)
+{
+  auto        createInfo = nvvkpp::image::create2DInfo(m_size, format,
+                                                vk::ImageUsageFlagBits::eStorage | usage);
+  nvvkTexture texture    = m_alloc.createImage(createInfo);
+  texture.descriptor = nvvkpp::image::create2DDescriptor(m_device, texture.image, vk::SamplerCreateInfo{},
+                                                         format, vk::ImageLayout::eGeneral);
+  m_debug.setObjectName(texture.image, name);
+
+  nvvkpp::SingleCommandBuffer genCmdBuf(m_device, m_queueIndex);
+  auto                        cmdBuf = genCmdBuf.createCommandBuffer();
+  nvvkpp::image::setImageLayout(cmdBuf, texture.image, vk::ImageLayout::eUndefined,
+                                vk::ImageLayout::eGeneral);
+  genCmdBuf.flushCommandBuffer(cmdBuf);
+  return texture;
 }
 
 //--------------------------------------------------------------------------------------------------
@@ -570,7 +1079,8 @@ void HelloVulkan::createOffscreenRender()
 void HelloVulkan::createPostPipeline(const vk::RenderPass& renderPass)
 {
   // Push constants in the fragment shader
-  vk::PushConstantRange pushConstantRanges = {vk::ShaderStageFlagBits::eFragment, 0, sizeof(float)};
+  vk::PushConstantRange pushConstantRanges = {vk::ShaderStageFlagBits::eFragment, 0,
+                                              sizeof(PostPushConstant)};
 
   // Creating the pipeline layout
   vk::PipelineLayoutCreateInfo pipelineLayoutCreateInfo;
@@ -602,6 +1112,9 @@ void HelloVulkan::createPostDescriptor()
   using vkSS = vk::ShaderStageFlagBits;
 
   m_postDescSetLayoutBind.emplace_back(vkDS(0, vkDT::eCombinedImageSampler, 1, vkSS::eFragment));
+  m_postDescSetLayoutBind.emplace_back(vkDS(1, vkDT::eCombinedImageSampler, 1, vkSS::eFragment));
+  m_postDescSetLayoutBind.emplace_back(vkDS(2, vkDT::eCombinedImageSampler, 1, vkSS::eFragment));
+  m_postDescSetLayoutBind.emplace_back(vkDS(3, vkDT::eCombinedImageSampler, 1, vkSS::eFragment));
   m_postDescSetLayout = nvvkpp::util::createDescriptorSetLayout(m_device, m_postDescSetLayoutBind);
   m_postDescPool      = nvvkpp::util::createDescriptorPool(m_device, m_postDescSetLayoutBind);
   m_postDescSet = nvvkpp::util::createDescriptorSet(m_device, m_postDescPool, m_postDescSetLayout);
@@ -613,25 +1126,37 @@ void HelloVulkan::createPostDescriptor()
 //
 void HelloVulkan::updatePostDescriptorSet()
 {
-  vk::WriteDescriptorSet writeDescriptorSets =
-      nvvkpp::util::createWrite(m_postDescSet, m_postDescSetLayoutBind[0],
-                                &m_offscreenColor.descriptor);
+  std::vector<vk::WriteDescriptorSet> writeDescriptorSets;
+  writeDescriptorSets.emplace_back(nvvkpp::util::createWrite(m_postDescSet, m_postDescSetLayoutBind[0],
+                                                             &m_offscreenColor.descriptor));
+  writeDescriptorSets.emplace_back(nvvkpp::util::createWrite(m_postDescSet, m_postDescSetLayoutBind[1],
+                                                             &m_varianceImage.descriptor));
+  writeDescriptorSets.emplace_back(nvvkpp::util::createWrite(m_postDescSet, m_postDescSetLayoutBind[2],
+                                                             &m_denoisedImage.descriptor));
+  writeDescriptorSets.emplace_back(nvvkpp::util::createWrite(m_postDescSet, m_postDescSetLayoutBind[3],
+                                                             &m_upscaledImage.descriptor));
   m_device.updateDescriptorSets(writeDescriptorSets, nullptr);
 }
 
 //--------------------------------------------------------------------------------------------------
-// Draw a full screen quad with the attached image
+// Draw a full screen quad with the attached image, or with the output of the denoiser, upscaled
+// by upscale() when the rendering is smaller than the window
 //
-void HelloVulkan::drawPost(vk::CommandBuffer cmdBuf)
+void HelloVulkan::drawPost(vk::CommandBuffer cmdBuf, bool denoised)
 {
   m_debug.beginLabel(cmdBuf, "Post");
 
-  cmdBuf.setViewport(0, {vk::Viewport(0, 0, (float)m_size.width, (float)m_size.height, 0, 1)});
-  cmdBuf.setScissor(0, {{{0, 0}, {m_size.width, m_size.height}}});
-
-  auto aspectRatio = static_cast<float>(m_size.width) / static_cast<float>(m_size.height);
-  cmdBuf.pushConstants<float>(m_postPipelineLayout, vk::ShaderStageFlagBits::eFragment, 0,
-                              aspectRatio);
+  cmdBuf.setViewport(0, {vk::Viewport(0, 0, (float)m_windowSize.width, (float)m_windowSize.height, 0, 1)});
+  cmdBuf.setScissor(0, {{{0, 0}, {m_windowSize.width, m_windowSize.height}}});
+
+  PostPushConstant pushConstant;
+  pushConstant.aspectRatio =
+      static_cast<float>(m_windowSize.width) / static_cast<float>(m_windowSize.height);
+  pushConstant.showConvergence = m_showConvergence ? 1 : 0;
+  pushConstant.denoised        = denoised ? 1 : 0;
+  pushConstant.upscaled        = m_size != m_windowSize && m_edgeAwareUpscale ? 1 : 0;
+  cmdBuf.pushConstants<PostPushConstant>(m_postPipelineLayout, vk::ShaderStageFlagBits::eFragment,
+                                         0, pushConstant);
   cmdBuf.bindPipeline(vk::PipelineBindPoint::eGraphics, m_postPipeline);
   cmdBuf.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_postPipelineLayout, 0,
                             m_postDescSet, {});
@@ -640,37 +1165,90 @@ void HelloVulkan::drawPost(vk::CommandBuffer cmdBuf)
   m_debug.endLabel(cmdBuf);
 }
 
+//--------------------------------------------------------------------------------------------------
+// Querying the ray tracing pipeline properties (SBT handle size and alignment, recursion depth)
+// and initializing the acceleration structure builder
+//
 void HelloVulkan::initRayTracing()
 {
-  auto properties = m_physicalDevice.getProperties2<vk::PhysicalDeviceProperties2,
-                                                    vk::PhysicalDeviceRayTracingPropertiesNV>();
-  m_rtProperties  = properties.get<vk::PhysicalDeviceRayTracingPropertiesNV>();
+  auto properties =
+      m_physicalDevice.getProperties2<vk::PhysicalDeviceProperties2,
+                                      vk::PhysicalDeviceRayTracingPipelinePropertiesKHR>();
+  m_rtProperties = properties.get<vk::PhysicalDeviceRayTracingPipelinePropertiesKHR>();
 #if defined(ALLOC_DEDICATED)
   m_rtBuilder.setup(m_device, m_physicalDevice, m_queueIndex);
 #elif defined(ALLOC_DMA)
   m_rtBuilder.setup(m_device, m_dmaAllocator, m_queueIndex);
 #endif
+
+  // Building the BLAS on the CPU, in parallel, when the device supports it
+  auto features = m_physicalDevice.getFeatures2<vk::PhysicalDeviceFeatures2,
+                                                vk::PhysicalDeviceAccelerationStructureFeaturesKHR>();
+  m_rtHostBuild = features.get<vk::PhysicalDeviceAccelerationStructureFeaturesKHR>()
+                      .accelerationStructureHostCommands
+                  == VK_TRUE;
+  m_rtBuilder.setHostBuild(m_rtHostBuild);
+
+  // Reusing the BLAS of the previous runs, as long as the driver is the same
+  auto idProperties = m_physicalDevice.getProperties2<vk::PhysicalDeviceProperties2,
+                                                      vk::PhysicalDeviceIDProperties>();
+  m_rtBuilder.setCache(getCachePath("accel_cache.bin"),
+                       idProperties.get<vk::PhysicalDeviceIDProperties>().driverUUID);
 }
 
-vk::GeometryNV HelloVulkan::objectToVkGeometryNV(const ObjModel& model)
+//--------------------------------------------------------------------------------------------------
+// Converting an OBJ model into the ray tracing geometry used to build the BLAS
+// - The vertex and index buffers are referenced by device address
+// - For host builds, the same geometry also references the host copy of the model
+//
+nvvkpp::RaytracingBuilder::BlasInput HelloVulkan::objectToVkGeometryKHR(const ObjModel& model)
 {
-  vk::GeometryTrianglesNV triangles;
-  triangles.setVertexData(model.vertexBuffer.buffer);
-  triangles.setVertexOffset(0);  // Start at the beginning of the buffer
-  triangles.setVertexCount(model.nbVertices);
-  triangles.setVertexStride(sizeof(Vertex));
+  vk::DeviceAddress vertexAddress =
+      m_device.getBufferAddress({m_vertexBuffer.buffer}) + model.firstVertex * sizeof(Vertex);
+  vk::DeviceAddress indexAddress =
+      m_device.getBufferAddress({m_indexBuffer.buffer}) + model.firstIndex * sizeof(uint32_t);
+
+  vk::AccelerationStructureGeometryTrianglesDataKHR triangles;
   triangles.setVertexFormat(vk::Format::eR32G32B32Sfloat);  // 3xfloat32 for vertices
-  triangles.setIndexData(model.indexBuffer.buffer);
-  triangles.setIndexOffset(0 * sizeof(uint32_t));
-  triangles.setIndexCount(model.nbIndices);
+  triangles.vertexData.setDeviceAddress(vertexAddress);
+  triangles.setVertexStride(sizeof(Vertex));
+  triangles.setMaxVertex(model.nbVertices - 1);  // Highest vertex index, not the count
   triangles.setIndexType(vk::IndexType::eUint32);  // 32-bit indices
-  vk::GeometryDataNV geoData;
-  geoData.setTriangles(triangles);
-  vk::GeometryNV geometry;
-  geometry.setGeometry(geoData);
+  triangles.indexData.setDeviceAddress(indexAddress);
+
+  vk::AccelerationStructureGeometryKHR geometry;
+  geometry.setGeometryType(vk::GeometryTypeKHR::eTriangles);
+  geometry.geometry.setTriangles(triangles);
   // Consider the geometry opaque for optimization
-  geometry.setFlags(vk::GeometryFlagBitsNV::eOpaque);
-  return geometry;
+  geometry.setFlags(vk::GeometryFlagBitsKHR::eOpaque);
+
+  // The entire index buffer is used, starting at the beginning of the buffer
+  vk::AccelerationStructureBuildRangeInfoKHR rangeInfo;
+  rangeInfo.setPrimitiveCount(model.nbIndices / 3);
+  rangeInfo.setPrimitiveOffset(0);
+  rangeInfo.setFirstVertex(0);
+  rangeInfo.setTransformOffset(0);
+
+  nvvkpp::RaytracingBuilder::BlasInput input;
+  input.asGeometry.emplace_back(geometry);
+  input.asBuildRangeInfo.emplace_back(rangeInfo);
+
+  // The content of the mesh identifies the BLAS in the cache
+  if(!model.hostVertices.empty())
+  {
+    input.cacheKey = nvvkpp::util::hashBytes(model.hostVertices.data(), model.hostVertices.size());
+    input.cacheKey = nvvkpp::util::hashBytes(model.hostIndices.data(),
+                                             model.hostIndices.size() * sizeof(uint32_t), input.cacheKey);
+  }
+
+  if(m_rtHostBuild && !model.hostVertices.empty())
+  {
+    triangles.vertexData.setHostAddress(model.hostVertices.data());
+    triangles.indexData.setHostAddress(model.hostIndices.data());
+    geometry.geometry.setTriangles(triangles);
+    input.asHostGeometry.emplace_back(geometry);
+  }
+  return input;
 }
 
 void HelloVulkan::createBottomLevelAS()
@@ -679,12 +1257,23 @@ void HelloVulkan::createBottomLevelAS()
   m_blas.reserve(m_objModel.size());
   for(size_t i = 0; i < m_objModel.size(); i++)
   {
-    auto geo = objectToVkGeometryNV(m_objModel[i]);
     // We could add more geometry in each BLAS, but we add only one for now
-    m_blas.push_back({geo});
+    m_blas.push_back(objectToVkGeometryKHR(m_objModel[i]));
+  }
+  m_rtBuilder.buildBlas(m_blas, vk::BuildAccelerationStructureFlagBitsKHR::eAllowUpdate
+                                    | vk::BuildAccelerationStructureFlagBitsKHR::eAllowCompaction
+                                    | vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastBuild);
+
+  // The host geometry is no longer referenced
+  for(auto& model : m_objModel)
+  {
+    model.hostVertices = {};
+    model.hostIndices  = {};
+  }
+  for(auto& blas : m_blas)
+  {
+    blas.asHostGeometry.clear();
   }
-  m_rtBuilder.buildBlas(m_blas, vk::BuildAccelerationStructureFlagBitsNV::eAllowUpdate
-                                    | vk::BuildAccelerationStructureFlagBitsNV::ePreferFastBuild);
 }
 
 void HelloVulkan::createTopLevelAS()
@@ -694,14 +1283,208 @@ void HelloVulkan::createTopLevelAS()
   {
     nvvkpp::RaytracingBuilder::Instance rayInst;
     rayInst.transform  = m_objInstance[i].transform;  // Position of the instance
-    rayInst.instanceId = i;                           // gl_InstanceID
+    rayInst.instanceId = i;                           // gl_InstanceCustomIndexEXT
     rayInst.blasId     = m_objInstance[i].objIndex;
-    rayInst.hitGroupId = 0;
-    rayInst.flags      = vk::GeometryInstanceFlagBitsNV::eTriangleCullDisable;
+    rayInst.mask       = m_objInstance[i].mask;       // Visibility categories (RAY_MASK_*)
+    rayInst.hitGroupId = HIT_GROUP_GENERIC;          // Set below, one SBT hit record per group
+    rayInst.flags      = vk::GeometryInstanceFlagBitsKHR::eTriangleFacingCullDisable;
     m_tlas.emplace_back(rayInst);
   }
-  m_rtBuilder.buildTlas(m_tlas, vk::BuildAccelerationStructureFlagBitsNV::ePreferFastTrace
-                                    | vk::BuildAccelerationStructureFlagBitsNV::eAllowUpdate);
+  setHitGroups(m_specializedHitGroups);
+  m_rtBuilder.buildTlas(m_tlas, vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace
+                                    | vk::BuildAccelerationStructureFlagBitsKHR::eAllowUpdate);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Selecting the hit group of each instance. The rays are traced with a zero SBT stride, so the
+// hit group is the SBT record of the instance. The levels of detail of a mesh share its
+// materials: changing level keeps the group. Once the TLAS is built, the changed instances are
+// refitted.
+//
+void HelloVulkan::setHitGroups(bool specialized)
+{
+  std::vector<uint32_t> changed;
+  std::fill(std::begin(m_hitGroupInstances), std::end(m_hitGroupInstances), 0);
+  for(uint32_t i = 0; i < static_cast<uint32_t>(m_tlas.size()); i++)
+  {
+    const uint32_t group =
+        specialized ? m_objModel[m_objInstance[i].objIndex].hitGroup : HIT_GROUP_GENERIC;
+    m_hitGroupInstances[group]++;
+    if(group != m_tlas[i].hitGroupId)
+    {
+      m_tlas[i].hitGroupId = group;
+      changed.push_back(i);
+    }
+  }
+  m_specializedHitGroups = specialized;
+  if(m_rtBuilder.getAccelerationStructure() && !changed.empty())
+  {
+    m_rtBuilder.updateTlasInstances(m_tlas, changed);
+    resetFrame();
+  }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Selecting the level of detail of each instance from the fraction of the screen height covered
+// by its bounding sphere: one level coarser each time the coverage halves below m_lodCoverage.
+// Only the instances changing level are updated in the scene description and the TLAS. The
+// updates are recorded in the frame command buffer, before any pass reading them.
+//
+void HelloVulkan::updateLods(const vk::CommandBuffer& cmdBuf)
+{
+  const glm::vec3 eye        = glm::inverse(CameraManip.getMatrix())[3];
+  const float     tanHalfFov = tanf(glm::radians(65.0f) * 0.5f);  // Same as updateUniformBuffer
+
+  // The TLAS instances are created in the order of m_objInstance, see createTopLevelAS
+  assert(m_tlas.size() == m_objInstance.size());
+
+  std::vector<uint32_t> changed;
+  for(uint32_t i = 0; i < static_cast<uint32_t>(m_objInstance.size()); i++)
+  {
+    assert(m_tlas[i].instanceId == i);
+    ObjInstance&    inst = m_objInstance[i];
+    const ObjModel& base = m_objModel[m_objModel[inst.objIndex].lodBase];
+    if(base.lodLevels <= 1)
+      continue;
+
+    uint32_t level = 0;
+    if(m_useLod)
+    {
+      const glm::vec3 center = glm::vec3(inst.transform * glm::vec4(base.center, 1.f));
+      const float     scale  = std::max(std::max(glm::length(glm::vec3(inst.transform[0])),
+                                                 glm::length(glm::vec3(inst.transform[1]))),
+                                        glm::length(glm::vec3(inst.transform[2])));
+      const float distance = std::max(glm::length(center - eye), 1e-4f);
+      const float coverage = base.radius * scale / (distance * tanHalfFov);
+      const float coarser  = log2f(m_lodCoverage / std::max(coverage, 1e-8f));
+      level                = coarser <= 0.f ? 0 : std::min(static_cast<uint32_t>(coarser), base.lodLevels - 1);
+    }
+
+    const uint32_t objIndex = base.lodBase + level;
+    if(objIndex != inst.objIndex)
+    {
+      inst.objIndex    = objIndex;
+      m_tlas[i].blasId = objIndex;
+      changed.push_back(i);
+    }
+  }
+  if(changed.empty())
+    return;
+
+  // The previous frames may still read the scene description and the draws
+  vk::MemoryBarrier before(vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eIndirectCommandRead,
+                           vk::AccessFlagBits::eTransferWrite);
+  cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands, vk::PipelineStageFlagBits::eTransfer,
+                         vk::DependencyFlags(), {before}, {}, {});
+
+  // The hit shaders fetch the geometry of the selected level through the scene description
+  for(uint32_t i : changed)
+  {
+    cmdBuf.updateBuffer(m_sceneDesc.buffer, i * sizeof(ObjInstance) + offsetof(ObjInstance, objIndex),
+                        sizeof(uint32_t), &m_objInstance[i].objIndex);
+    // The raster draws the geometry of that level
+    const vk::DrawIndexedIndirectCommand command =
+        drawCommand(m_objModel[m_objInstance[i].objIndex], i);
+    cmdBuf.updateBuffer(m_indirectBuffer.buffer, i * sizeof(command), sizeof(command), &command);
+  }
+
+  vk::MemoryBarrier after(vk::AccessFlagBits::eTransferWrite,
+                          vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eIndirectCommandRead);
+  cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eAllCommands,
+                         vk::DependencyFlags(), {after}, {}, {});
+
+  m_rtBuilder.updateTlasInstances(cmdBuf, m_tlas, changed);
+  resetFrame();
+}
+
+//--------------------------------------------------------------------------------------------------
+// Gathering the emissive triangles of all instances in world space, with the CDF and the light
+// BVH used to pick them, and the light index of each emissive triangle for the closest hit
+// - The instances are not expected to move, the light list is only built once
+// - Must be called before createSceneDescriptionBuffer, it sets ObjInstance::lightOffset
+//
+void HelloVulkan::createLightBuffer()
+{
+  std::vector<lights::LightTriangle> lightList;
+  std::vector<uint32_t>              lightPrim;  // Entry of each light in primToLight
+  std::vector<int32_t>               primToLight;
+  for(auto& inst : m_objInstance)
+  {
+    const ObjModel& model = m_objModel[inst.objIndex];
+    if(model.emitters.empty())
+      continue;
+    inst.lightOffset = static_cast<int>(primToLight.size());
+    primToLight.resize(primToLight.size() + model.nbIndices / 3, -1);
+    for(const auto& e : model.emitters)
+    {
+      lights::LightTriangle light{};
+      light.v0       = glm::vec3(inst.transform * glm::vec4(e.v0, 1));
+      light.v1       = glm::vec3(inst.transform * glm::vec4(e.v1, 1));
+      light.v2       = glm::vec3(inst.transform * glm::vec4(e.v2, 1));
+      light.emission = e.emission;
+      lightList.push_back(light);
+      lightPrim.push_back(inst.lightOffset + e.primitive);
+    }
+  }
+  if(lights::buildLightCdf(lightList) <= 0.f)
+    lightList.clear();
+
+  // The light BVH reorders the triangles
+  std::vector<lights::LightBvhNode> nodes;
+  std::vector<uint32_t>             order = lights::buildLightBvh(lightList, nodes);
+  for(size_t i = 0; i < order.size(); i++)
+    primToLight[lightPrim[order[i]]] = static_cast<int32_t>(i);
+  m_rtPushConstants.lightCount = static_cast<int>(lightList.size());
+
+  // The storage buffers cannot be empty
+  if(lightList.empty())
+    lightList.resize(1);
+  if(nodes.empty())
+    nodes.resize(1);
+  if(primToLight.empty())
+    primToLight.resize(1, -1);
+  using vkBU = vk::BufferUsageFlagBits;
+  nvvkpp::SingleCommandBuffer genCmdBuf(m_device, m_queueIndex);
+  vk::CommandBuffer           cmdBuf = genCmdBuf.createCommandBuffer();
+  m_lightBuffer     = m_alloc.createBuffer(cmdBuf, lightList, vkBU::eStorageBuffer);
+  m_lightBvhBuffer  = m_alloc.createBuffer(cmdBuf, nodes, vkBU::eStorageBuffer);
+  m_lightPrimBuffer = m_alloc.createBuffer(cmdBuf, primToLight, vkBU::eStorageBuffer);
+  genCmdBuf.flushCommandBuffer(cmdBuf);
+  m_alloc.flushStaging();
+  m_debug.setObjectName(m_lightBuffer.buffer, "lights");
+  m_debug.setObjectName(m_lightBvhBuffer.buffer, "lightBvh");
+  m_debug.setObjectName(m_lightPrimBuffer.buffer, "lightPrim");
+}
+
+//--------------------------------------------------------------------------------------------------
+// Generating the direction numbers of the Sobol sequence used by the ray generation shader
+//
+void HelloVulkan::createSobolBuffer()
+{
+  nvvkpp::SingleCommandBuffer genCmdBuf(m_device, m_queueIndex);
+  vk::CommandBuffer           cmdBuf = genCmdBuf.createCommandBuffer();
+  m_sobolBuffer = m_alloc.createBuffer(cmdBuf, sobol::sobolDirections(),
+                                       vk::BufferUsageFlagBits::eStorageBuffer);
+  genCmdBuf.flushCommandBuffer(cmdBuf);
+  m_alloc.flushStaging();
+  m_debug.setObjectName(m_sobolBuffer.buffer, "sobol");
+}
+
+//--------------------------------------------------------------------------------------------------
+// Loading the blue-noise masks of the ray generation shader. Generating them takes a few
+// seconds, so they are stored in blue_noise.bin of the cache directory and only regenerated when the
+// file is missing or was made with other dimensions.
+//
+void HelloVulkan::createBlueNoiseBuffer()
+{
+  std::vector<float> noise = loadBlueNoise(getCachePath("blue_noise.bin"), BLUE_NOISE_SIZE, BLUE_NOISE_LAYERS);
+
+  nvvkpp::SingleCommandBuffer genCmdBuf(m_device, m_queueIndex);
+  vk::CommandBuffer           cmdBuf = genCmdBuf.createCommandBuffer();
+  m_blueNoiseBuffer = m_alloc.createBuffer(cmdBuf, noise, vk::BufferUsageFlagBits::eStorageBuffer);
+  genCmdBuf.flushCommandBuffer(cmdBuf);
+  m_alloc.flushStaging();
+  m_debug.setObjectName(m_blueNoiseBuffer.buffer, "blueNoise");
 }
 
 void HelloVulkan::createRtDescriptorSet()
@@ -710,28 +1493,76 @@ void HelloVulkan::createRtDescriptorSet()
   using vkSS   = vk::ShaderStageFlagBits;
   using vkDSLB = vk::DescriptorSetLayoutBinding;
 
-  // Top-level acceleration structure, usable by both the ray generation and the closest hit (to
-  // shoot shadow rays)
+  // Top-level acceleration structure, only the ray generation shader traces rays. The images of
+  // the pixels are also written by the reconstruction of the sparse primary rays.
+  m_rtDescSetLayoutBind.emplace_back(
+      vkDSLB(0, vkDT::eAccelerationStructureKHR, 1, vkSS::eRaygenKHR));  // TLAS
   m_rtDescSetLayoutBind.emplace_back(
-      vkDSLB(0, vkDT::eAccelerationStructureNV, 1, vkSS::eRaygenNV | vkSS::eClosestHitNV));  // TLAS
+      vkDSLB(1, vkDT::eStorageImage, 1, vkSS::eRaygenKHR | vkSS::eCompute));  // Output image
   m_rtDescSetLayoutBind.emplace_back(
-      vkDSLB(1, vkDT::eStorageImage, 1, vkSS::eRaygenNV));  // Output image
+      vkDSLB(2, vkDT::eStorageBuffer, 1, vkSS::eRaygenKHR));  // Ray counters
+  m_rtDescSetLayoutBind.emplace_back(
+      vkDSLB(3, vkDT::eStorageImage, 1, vkSS::eRaygenKHR | vkSS::eCompute));  // Per-pixel variance
+  m_rtDescSetLayoutBind.emplace_back(
+      vkDSLB(4, vkDT::eStorageBuffer, 1, vkSS::eRaygenKHR));  // Emissive triangles
+  m_rtDescSetLayoutBind.emplace_back(
+      vkDSLB(5, vkDT::eStorageBuffer, 1, vkSS::eRaygenKHR));  // Light BVH
+  m_rtDescSetLayoutBind.emplace_back(
+      vkDSLB(6, vkDT::eStorageBuffer, 1, vkSS::eRaygenKHR));  // Sobol directions
+  m_rtDescSetLayoutBind.emplace_back(
+      vkDSLB(7, vkDT::eStorageBuffer, 1, vkSS::eRaygenKHR));  // Blue-noise masks
+  // Primary hits: normal and depth, albedo, motion
+  for(uint32_t binding = 8; binding <= 10; binding++)
+    m_rtDescSetLayoutBind.emplace_back(
+        vkDSLB(binding, vkDT::eStorageImage, 1, vkSS::eRaygenKHR | vkSS::eCompute));
+  // Previous frame for the reprojection: surfaces, color, albedo, statistics
+  for(uint32_t binding = 11; binding <= 14; binding++)
+    m_rtDescSetLayoutBind.emplace_back(
+        vkDSLB(binding, vkDT::eStorageImage, 1, vkSS::eRaygenKHR | vkSS::eCompute));
+  // G-buffer of the hybrid renderer: position, normal, material
+  for(uint32_t binding = 15; binding <= 17; binding++)
+    m_rtDescSetLayoutBind.emplace_back(vkDSLB(binding, vkDT::eStorageImage, 1, vkSS::eRaygenKHR));
 
   m_rtDescPool      = nvvkpp::util::createDescriptorPool(m_device, m_rtDescSetLayoutBind);
   m_rtDescSetLayout = nvvkpp::util::createDescriptorSetLayout(m_device, m_rtDescSetLayoutBind);
   m_rtDescSet       = m_device.allocateDescriptorSets({m_rtDescPool, 1, &m_rtDescSetLayout})[0];
 
-  vk::WriteDescriptorSetAccelerationStructureNV descASInfo;
+  vk::WriteDescriptorSetAccelerationStructureKHR descASInfo;
   descASInfo.setAccelerationStructureCount(1);
   descASInfo.setPAccelerationStructures(&m_rtBuilder.getAccelerationStructure());
   vk::DescriptorImageInfo imageInfo{
       {}, m_offscreenColor.descriptor.imageView, vk::ImageLayout::eGeneral};
+  vk::DescriptorImageInfo varianceInfo{
+      {}, m_varianceImage.descriptor.imageView, vk::ImageLayout::eGeneral};
+
+  // Ray counters, copied each frame to the host-visible buffer of the frame before being cleared
+  const vk::DeviceSize statsSize = RAY_STAT_COUNT * sizeof(uint32_t);
+  m_rayStatsBuffer               = m_alloc.createBuffer(statsSize,
+                                          vk::BufferUsageFlagBits::eStorageBuffer
+                                              | vk::BufferUsageFlagBits::eTransferSrc
+                                              | vk::BufferUsageFlagBits::eTransferDst);
+  m_debug.setObjectName(m_rayStatsBuffer.buffer, "rayStats");
+  vk::DescriptorBufferInfo statsInfo{m_rayStatsBuffer.buffer, 0, VK_WHOLE_SIZE};
+  vk::DescriptorBufferInfo lightsInfo{m_lightBuffer.buffer, 0, VK_WHOLE_SIZE};
+  vk::DescriptorBufferInfo lightBvhInfo{m_lightBvhBuffer.buffer, 0, VK_WHOLE_SIZE};
+  vk::DescriptorBufferInfo sobolInfo{m_sobolBuffer.buffer, 0, VK_WHOLE_SIZE};
+  vk::DescriptorBufferInfo blueNoiseInfo{m_blueNoiseBuffer.buffer, 0, VK_WHOLE_SIZE};
 
   std::vector<vk::WriteDescriptorSet> writes;
   writes.emplace_back(
       nvvkpp::util::createWrite(m_rtDescSet, m_rtDescSetLayoutBind[0], &descASInfo));
   writes.emplace_back(nvvkpp::util::createWrite(m_rtDescSet, m_rtDescSetLayoutBind[1], &imageInfo));
+  writes.emplace_back(nvvkpp::util::createWrite(m_rtDescSet, m_rtDescSetLayoutBind[2], &statsInfo));
+  writes.emplace_back(
+      nvvkpp::util::createWrite(m_rtDescSet, m_rtDescSetLayoutBind[3], &varianceInfo));
+  writes.emplace_back(nvvkpp::util::createWrite(m_rtDescSet, m_rtDescSetLayoutBind[4], &lightsInfo));
+  writes.emplace_back(
+      nvvkpp::util::createWrite(m_rtDescSet, m_rtDescSetLayoutBind[5], &lightBvhInfo));
+  writes.emplace_back(nvvkpp::util::createWrite(m_rtDescSet, m_rtDescSetLayoutBind[6], &sobolInfo));
+  writes.emplace_back(
+      nvvkpp::util::createWrite(m_rtDescSet, m_rtDescSetLayoutBind[7], &blueNoiseInfo));
   m_device.updateDescriptorSets(static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+  updateRtDescriptorSet();
 }
 
 //--------------------------------------------------------------------------------------------------
@@ -742,10 +1573,25 @@ void HelloVulkan::updateRtDescriptorSet()
 {
   using vkDT = vk::DescriptorType;
 
-  // (1) Output buffer
+  // (1) Output buffer, (3) per-pixel variance, (8-10) primary hits for the denoiser,
+  // (11-14) previous frame for the reprojection, (15-17) G-buffer of the hybrid renderer
   vk::DescriptorImageInfo imageInfo{
       {}, m_offscreenColor.descriptor.imageView, vk::ImageLayout::eGeneral};
-  vk::WriteDescriptorSet wds{m_rtDescSet, 1, 0, 1, vkDT::eStorageImage, &imageInfo};
+  vk::DescriptorImageInfo varianceInfo{
+      {}, m_varianceImage.descriptor.imageView, vk::ImageLayout::eGeneral};
+  std::vector<vk::WriteDescriptorSet> wds;
+  wds.emplace_back(m_rtDescSet, 1, 0, 1, vkDT::eStorageImage, &imageInfo);
+  wds.emplace_back(m_rtDescSet, 3, 0, 1, vkDT::eStorageImage, &varianceInfo);
+  wds.emplace_back(m_rtDescSet, 8, 0, 1, vkDT::eStorageImage, &m_normalDepthImage.descriptor);
+  wds.emplace_back(m_rtDescSet, 9, 0, 1, vkDT::eStorageImage, &m_albedoImage.descriptor);
+  wds.emplace_back(m_rtDescSet, 10, 0, 1, vkDT::eStorageImage, &m_motionImage.descriptor);
+  wds.emplace_back(m_rtDescSet, 11, 0, 1, vkDT::eStorageImage, &m_prevNormalDepthImage.descriptor);
+  wds.emplace_back(m_rtDescSet, 12, 0, 1, vkDT::eStorageImage, &m_historyColorImage.descriptor);
+  wds.emplace_back(m_rtDescSet, 13, 0, 1, vkDT::eStorageImage, &m_historyAlbedoImage.descriptor);
+  wds.emplace_back(m_rtDescSet, 14, 0, 1, vkDT::eStorageImage, &m_historyStatsImage.descriptor);
+  wds.emplace_back(m_rtDescSet, 15, 0, 1, vkDT::eStorageImage, &m_gbufferPosition.descriptor);
+  wds.emplace_back(m_rtDescSet, 16, 0, 1, vkDT::eStorageImage, &m_gbufferNormal.descriptor);
+  wds.emplace_back(m_rtDescSet, 17, 0, 1, vkDT::eStorageImage, &m_gbufferMaterial.descriptor);
   m_device.updateDescriptorSets(wds, nullptr);
 }
 
@@ -759,21 +1605,21 @@ void HelloVulkan::createRtPipeline()
   std::vector<vk::PipelineShaderStageCreateInfo> stages;
 
   // Raygen
-  vk::RayTracingShaderGroupCreateInfoNV rg{vk::RayTracingShaderGroupTypeNV::eGeneral,
-                                           VK_SHADER_UNUSED_NV, VK_SHADER_UNUSED_NV,
-                                           VK_SHADER_UNUSED_NV, VK_SHADER_UNUSED_NV};
-  stages.push_back({{}, vk::ShaderStageFlagBits::eRaygenNV, raygenSM, "main"});
+  vk::RayTracingShaderGroupCreateInfoKHR rg{vk::RayTracingShaderGroupTypeKHR::eGeneral,
+                                            VK_SHADER_UNUSED_KHR, VK_SHADER_UNUSED_KHR,
+                                            VK_SHADER_UNUSED_KHR, VK_SHADER_UNUSED_KHR};
+  stages.push_back({{}, vk::ShaderStageFlagBits::eRaygenKHR, raygenSM, "main"});
   rg.setGeneralShader(static_cast<uint32_t>(stages.size() - 1));
   m_rtShaderGroups.push_back(rg);
 
   // Miss group
-  vk::RayTracingShaderGroupCreateInfoNV mg{vk::RayTracingShaderGroupTypeNV::eGeneral,
-                                           VK_SHADER_UNUSED_NV, VK_SHADER_UNUSED_NV,
-                                           VK_SHADER_UNUSED_NV, VK_SHADER_UNUSED_NV};
+  vk::RayTracingShaderGroupCreateInfoKHR mg{vk::RayTracingShaderGroupTypeKHR::eGeneral,
+                                            VK_SHADER_UNUSED_KHR, VK_SHADER_UNUSED_KHR,
+                                            VK_SHADER_UNUSED_KHR, VK_SHADER_UNUSED_KHR};
   // Default miss shader
   vk::ShaderModule missSM =
       nvvkpp::util::createShaderModule(m_device, nvvkpp::util::readFile("shaders/raytrace.rmiss.spv"));
-  stages.push_back({{}, vk::ShaderStageFlagBits::eMissNV, missSM, "main"});
+  stages.push_back({{}, vk::ShaderStageFlagBits::eMissKHR, missSM, "main"});
   mg.setGeneralShader(static_cast<uint32_t>(stages.size() - 1));
   m_rtShaderGroups.push_back(mg);
 
@@ -782,34 +1628,36 @@ void HelloVulkan::createRtPipeline()
   vk::ShaderModule shadowmissSM =
       nvvkpp::util::createShaderModule(m_device, //
           nvvkpp::util::readFile("shaders/raytraceShadow.rmiss.spv"));
-  stages.push_back({ {}, vk::ShaderStageFlagBits::eMissNV, shadowmissSM, "main" });
+  stages.push_back({ {}, vk::ShaderStageFlagBits::eMissKHR, shadowmissSM, "main" });
   mg.setGeneralShader(static_cast<uint32_t>(stages.size() - 1));
   m_rtShaderGroups.push_back(mg);
 
-  // Hit Group - Closest Hit + AnyHit
-  vk::RayTracingShaderGroupCreateInfoNV hg{vk::RayTracingShaderGroupTypeNV::eTrianglesHitGroup,
-                                           VK_SHADER_UNUSED_NV, VK_SHADER_UNUSED_NV,
-                                           VK_SHADER_UNUSED_NV, VK_SHADER_UNUSED_NV};
+  // Hit Groups - Closest Hit + AnyHit
+  vk::RayTracingShaderGroupCreateInfoKHR hg{vk::RayTracingShaderGroupTypeKHR::eTrianglesHitGroup,
+                                            VK_SHADER_UNUSED_KHR, VK_SHADER_UNUSED_KHR,
+                                            VK_SHADER_UNUSED_KHR, VK_SHADER_UNUSED_KHR};
 
-  // Closest hit
+  // Closest hit, one group per material class in the order of HIT_GROUP_*, the class being the
+  // specialization constant 0 of the shader
   vk::ShaderModule chitSM =
       nvvkpp::util::createShaderModule(m_device, nvvkpp::util::readFile("shaders/raytrace.rchit.spv"));
-  stages.push_back({{}, vk::ShaderStageFlagBits::eClosestHitNV, chitSM, "main"});
-  hg.setClosestHitShader(static_cast<uint32_t>(stages.size() - 1));
-  m_rtShaderGroups.push_back(hg);
-
-  // Path tracing closest hit
-  vk::ShaderModule pathChitSM =
-      nvvkpp::util::createShaderModule(m_device, nvvkpp::util::readFile("shaders/pathtrace.rchit.spv"));
-  stages.push_back({ {}, vk::ShaderStageFlagBits::eClosestHitNV, pathChitSM, "main" });
-  hg.setClosestHitShader(static_cast<uint32_t>(stages.size() - 1));
-  m_rtShaderGroups.push_back(hg);
+  int                        hitGroups[HIT_GROUP_COUNT];
+  vk::SpecializationMapEntry hitGroupEntry{0, 0, sizeof(int)};
+  vk::SpecializationInfo     hitGroupInfo[HIT_GROUP_COUNT];
+  for(int group = 0; group < HIT_GROUP_COUNT; group++)
+  {
+    hitGroups[group]    = group;
+    hitGroupInfo[group] = {1, &hitGroupEntry, sizeof(int), &hitGroups[group]};
+    stages.push_back({{}, vk::ShaderStageFlagBits::eClosestHitKHR, chitSM, "main", &hitGroupInfo[group]});
+    hg.setClosestHitShader(static_cast<uint32_t>(stages.size() - 1));
+    m_rtShaderGroups.push_back(hg);
+  }
 
   vk::PipelineLayoutCreateInfo pipelineLayoutCreateInfo;
   // Push constant: we want to be able to update constants used by the shaders
-  vk::PushConstantRange pushConstant{vk::ShaderStageFlagBits::eRaygenNV
-                                         | vk::ShaderStageFlagBits::eClosestHitNV
-                                         | vk::ShaderStageFlagBits::eMissNV,
+  vk::PushConstantRange pushConstant{vk::ShaderStageFlagBits::eRaygenKHR
+                                         | vk::ShaderStageFlagBits::eClosestHitKHR
+                                         | vk::ShaderStageFlagBits::eMissKHR,
                                      0, sizeof(RtPushConstant)};
   pipelineLayoutCreateInfo.setPushConstantRangeCount(1);
   pipelineLayoutCreateInfo.setPPushConstantRanges(&pushConstant);
@@ -820,50 +1668,94 @@ void HelloVulkan::createRtPipeline()
   m_rtPipelineLayout = m_device.createPipelineLayout(pipelineLayoutCreateInfo);
 
   // Assemble the shader stages and recursion depth info into the ray tracing pipeline
-  vk::RayTracingPipelineCreateInfoNV rayPipelineInfo;
+  vk::RayTracingPipelineCreateInfoKHR rayPipelineInfo;
   rayPipelineInfo.setStageCount(static_cast<uint32_t>(stages.size()));  // Stages are shaders
   rayPipelineInfo.setPStages(stages.data());
   rayPipelineInfo.setGroupCount(static_cast<uint32_t>(
       m_rtShaderGroups.size()));  // 1-raygen, n-miss, n-(hit[+anyhit+intersect])
   rayPipelineInfo.setPGroups(m_rtShaderGroups.data());
-  rayPipelineInfo.setMaxRecursionDepth(8);  // Ray depth
+  // The paths are traced iteratively in the ray generation shader, the hit shaders never trace rays
+  rayPipelineInfo.setMaxPipelineRayRecursionDepth(1);
   rayPipelineInfo.setLayout(m_rtPipelineLayout);
-  m_rtPipeline = m_device.createRayTracingPipelineNV({}, rayPipelineInfo);
+  m_rtPipeline = m_device.createRayTracingPipelineKHR({}, {}, rayPipelineInfo).value;
 
   m_device.destroy(raygenSM);
   m_device.destroy(missSM);
   m_device.destroy(shadowmissSM);
   m_device.destroy(chitSM);
-  m_device.destroy(pathChitSM);
 }
 
+//--------------------------------------------------------------------------------------------------
+// The Shader Binding Table (SBT)
+// - getting all shader handles and writing them in a SBT buffer
+// - Each group (raygen, miss, hit) starts at a multiple of shaderGroupBaseAlignment and
+//   the handles inside a group are spaced by the aligned handle size
+//
 void HelloVulkan::createRtShaderBindingTable()
 {
   auto groupCount =
-      static_cast<uint32_t>(m_rtShaderGroups.size());               // 3 shaders: raygen, miss, chit
+      static_cast<uint32_t>(m_rtShaderGroups.size());               // raygen, 2 miss, HIT_GROUP_COUNT chit
   uint32_t groupHandleSize = m_rtProperties.shaderGroupHandleSize;  // Size of a program identifier
+  uint32_t groupSizeAligned =
+      nvvkpp::util::align_up(groupHandleSize, m_rtProperties.shaderGroupHandleAlignment);
+  uint32_t baseAlignment = m_rtProperties.shaderGroupBaseAlignment;
 
   // Fetch all the shader handles used in the pipeline, so that they can be written in the SBT
-  uint32_t             sbtSize = groupCount * groupHandleSize;
-  std::vector<uint8_t> shaderHandleStorage(sbtSize);
-  m_device.getRayTracingShaderGroupHandlesNV(m_rtPipeline, 0, groupCount, sbtSize,
-                                             shaderHandleStorage.data());
-  // Write the handles in the SBT
-  nvvkpp::SingleCommandBuffer genCmdBuf(m_device, m_queueIndex);
-  vk::CommandBuffer           cmdBuf = genCmdBuf.createCommandBuffer();
-
-  m_rtSBTBuffer =
-      m_alloc.createBuffer(cmdBuf, shaderHandleStorage, vk::BufferUsageFlagBits::eRayTracingNV);
+  uint32_t             dataSize = groupCount * groupHandleSize;
+  std::vector<uint8_t> shaderHandleStorage(dataSize);
+  m_device.getRayTracingShaderGroupHandlesKHR(m_rtPipeline, 0, groupCount, dataSize,
+                                              shaderHandleStorage.data());
+
+  // Group layout: raygen, then the miss shaders, then the hit groups. The hit records are indexed
+  // by the hitGroupId of the TLAS instances, see setHitGroups
+  const uint32_t missCount = 2;
+  const uint32_t hitCount  = groupCount - 1 - missCount;
+  m_rgenRegion.setStride(nvvkpp::util::align_up(groupSizeAligned, baseAlignment));
+  m_rgenRegion.setSize(m_rgenRegion.stride);  // The raygen size must be equal to its stride
+  m_missRegion.setStride(groupSizeAligned);
+  m_missRegion.setSize(nvvkpp::util::align_up(missCount * groupSizeAligned, baseAlignment));
+  m_hitRegion.setStride(groupSizeAligned);
+  m_hitRegion.setSize(nvvkpp::util::align_up(hitCount * groupSizeAligned, baseAlignment));
+  m_callRegion = vk::StridedDeviceAddressRegionKHR();
+
+  // Write the handles in the SBT, the buffer stays host visible
+  vk::DeviceSize sbtSize = m_rgenRegion.size + m_missRegion.size + m_hitRegion.size;
+  m_rtSBTBuffer          = m_alloc.createBuffer(sbtSize,
+                                       vk::BufferUsageFlagBits::eShaderBindingTableKHR
+                                           | vk::BufferUsageFlagBits::eShaderDeviceAddress,
+                                       vk::MemoryPropertyFlagBits::eHostVisible
+                                           | vk::MemoryPropertyFlagBits::eHostCoherent);
   m_debug.setObjectName(m_rtSBTBuffer.buffer, "SBT");
 
+  auto*    pSBT      = reinterpret_cast<uint8_t*>(m_alloc.map(m_rtSBTBuffer));
+  auto     getHandle = [&](uint32_t i) { return shaderHandleStorage.data() + i * groupHandleSize; };
+  uint32_t handleIdx = 0;
+  // Raygen
+  memcpy(pSBT, getHandle(handleIdx++), groupHandleSize);
+  // Miss
+  uint8_t* pData = pSBT + m_rgenRegion.size;
+  for(uint32_t c = 0; c < missCount; c++)
+  {
+    memcpy(pData + c * m_missRegion.stride, getHandle(handleIdx++), groupHandleSize);
+  }
+  // Hit
+  pData = pSBT + m_rgenRegion.size + m_missRegion.size;
+  for(uint32_t c = 0; c < hitCount; c++)
+  {
+    memcpy(pData + c * m_hitRegion.stride, getHandle(handleIdx++), groupHandleSize);
+  }
+  m_alloc.unmap(m_rtSBTBuffer);
 
-  genCmdBuf.flushCommandBuffer(cmdBuf);
-
-  m_alloc.flushStaging();
+  // The regions are referencing the SBT buffer by device address
+  vk::DeviceAddress sbtAddress = m_device.getBufferAddress({m_rtSBTBuffer.buffer});
+  m_rgenRegion.setDeviceAddress(sbtAddress);
+  m_missRegion.setDeviceAddress(sbtAddress + m_rgenRegion.size);
+  m_hitRegion.setDeviceAddress(sbtAddress + m_rgenRegion.size + m_missRegion.size);
 }
 
 void HelloVulkan::raytrace(const vk::CommandBuffer& cmdBuf, const glm::vec4& clearColor)
 {
+  const bool tiled = m_tiledRendering && m_frame < m_tilePools.size() && !m_tileFrames.empty();
   updateFrame();
   m_debug.beginLabel(cmdBuf, "Ray trace");
   // Initializing push constant values
@@ -871,48 +1763,1817 @@ void HelloVulkan::raytrace(const vk::CommandBuffer& cmdBuf, const glm::vec4& cle
   m_rtPushConstants.lightPosition  = m_pushConstant.lightPosition;
   m_rtPushConstants.lightIntensity = m_pushConstant.lightIntensity;
   m_rtPushConstants.lightType      = m_pushConstant.lightType;
+  // The tiles restart their accumulation on their own, without the reconstruction
+  m_rtPushConstants.interleave      = tiled ? 1 : m_interleave;
+  m_rtPushConstants.interleaveFrame = m_interleaveFrame++;
+  m_rtPushConstants.hybrid     = m_hybrid ? 1 : 0;
+
+  // Adaptive sampling: the budget of the frame goes to the pixels which were not converged in the
+  // last completed frame, once all pixels had their warm-up samples (same test as raytrace.rgen).
+  // A pixel is only converged after ADAPTIVE_MIN_SAMPLES samples. The tiles are already limited
+  // by their time budget: they only skip the converged pixels.
+  m_rtPushConstants.samplesPerPixel = m_samplesPerPixel;
+  if(m_rtPushConstants.adaptiveSampling != 0)
+  {
+    m_activePixels = m_rayStatCounts[RAY_STAT_ACTIVE_PIXELS];
+    if(!tiled && m_rtPushConstants.frameCounter >= m_rtPushConstants.warmupFrames
+       && m_activePixels > 0)
+    {
+      uint64_t budget = uint64_t(m_samplesPerPixel) * m_size.width * m_size.height;
+      uint64_t spp    = std::max<uint64_t>(budget / m_activePixels, m_samplesPerPixel);
+      m_rtPushConstants.samplesPerPixel =
+          static_cast<int>(std::min<uint64_t>(spp, 16 * uint64_t(m_samplesPerPixel)));
+    }
+  }
+
+  // Ray counters: keeping the values of the previous frame and starting again from 0
+  if(m_rtPushConstants.rayStats != 0 || m_rtPushConstants.adaptiveSampling != 0)
+  {
+    cmdBuf.copyBuffer(m_rayStatsBuffer.buffer, m_rayStatsReadbacks[m_frame].buffer,
+                      vk::BufferCopy(0, 0, RAY_STAT_COUNT * sizeof(uint32_t)));
+    m_rayStatsCopied[m_frame] = true;
+    vk::MemoryBarrier copyBarrier(vk::AccessFlagBits::eTransferRead, vk::AccessFlagBits::eTransferWrite);
+    cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer,
+                           vk::DependencyFlags(), {copyBarrier}, {}, {});
+    cmdBuf.fillBuffer(m_rayStatsBuffer.buffer, 0, VK_WHOLE_SIZE, 0);
+    vk::MemoryBarrier fillBarrier(vk::AccessFlagBits::eTransferWrite,
+                                  vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite);
+    cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                           vk::PipelineStageFlagBits::eRayTracingShaderKHR, vk::DependencyFlags(),
+                           {fillBarrier}, {}, {});
+  }
 
-  cmdBuf.bindPipeline(vk::PipelineBindPoint::eRayTracingNV, m_rtPipeline);
-  cmdBuf.bindDescriptorSets(vk::PipelineBindPoint::eRayTracingNV, m_rtPipelineLayout, 0,
+  // Keeping the surfaces of the previous frame, and its accumulation when the camera moved, since
+  // this frame overwrites them while reprojecting
+  {
+    vk::MemoryBarrier toTransfer(vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eTransferRead);
+    cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eRayTracingShaderKHR
+                               | vk::PipelineStageFlagBits::eComputeShader
+                               | vk::PipelineStageFlagBits::eFragmentShader,
+                           vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags(), {toTransfer},
+                           {}, {});
+    vk::ImageCopy region;
+    region.setSrcSubresource({vk::ImageAspectFlagBits::eColor, 0, 0, 1});
+    region.setDstSubresource({vk::ImageAspectFlagBits::eColor, 0, 0, 1});
+    region.setExtent({m_size.width, m_size.height, 1});
+    auto copy = [&](const nvvkTexture& src, const nvvkTexture& dst) {
+      cmdBuf.copyImage(src.image, vk::ImageLayout::eGeneral, dst.image, vk::ImageLayout::eGeneral,
+                       {region});
+    };
+    copy(m_normalDepthImage, m_prevNormalDepthImage);
+    if(m_rtPushConstants.reproject != 0)
+    {
+      copy(m_offscreenColor, m_historyColorImage);
+      copy(m_albedoImage, m_historyAlbedoImage);
+      copy(m_varianceImage, m_historyStatsImage);
+    }
+    vk::MemoryBarrier fromTransfer(vk::AccessFlagBits::eTransferRead | vk::AccessFlagBits::eTransferWrite,
+                                   vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite);
+    cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                           vk::PipelineStageFlagBits::eRayTracingShaderKHR
+                               | vk::PipelineStageFlagBits::eComputeShader,
+                           vk::DependencyFlags(), {fromTransfer}, {}, {});
+  }
+
+  // The hybrid renderer rasterizes the primary surfaces first, timed on their own
+  beginTimestamps(cmdBuf);
+  if(m_hybrid)
+  {
+    rasterizeGBuffer(cmdBuf);
+    writeTimestamp(cmdBuf, kGBufferTimestamp);
+  }
+
+  cmdBuf.bindPipeline(vk::PipelineBindPoint::eRayTracingKHR, m_rtPipeline);
+  cmdBuf.bindDescriptorSets(vk::PipelineBindPoint::eRayTracingKHR, m_rtPipelineLayout, 0,
                             {m_rtDescSet, m_descSet}, {});
   cmdBuf.pushConstants<RtPushConstant>(m_rtPipelineLayout,
-                                       vk::ShaderStageFlagBits::eRaygenNV
-                                           | vk::ShaderStageFlagBits::eClosestHitNV
-                                           | vk::ShaderStageFlagBits::eMissNV,
+                                       vk::ShaderStageFlagBits::eRaygenKHR
+                                           | vk::ShaderStageFlagBits::eClosestHitKHR
+                                           | vk::ShaderStageFlagBits::eMissKHR,
                                        0, m_rtPushConstants);
-  vk::DeviceSize progSize = m_rtProperties.shaderGroupHandleSize;  // Size of a program identifier
-  vk::DeviceSize rayGenOffset   = 0u * progSize;  // Start at the beginning of m_sbtBuffer
-  vk::DeviceSize missOffset     = 1u * progSize;  // Jump over raygen
-  vk::DeviceSize missStride     = progSize;
-  vk::DeviceSize hitGroupOffset = 3u * progSize;  // Jump over the previous shaders
-  vk::DeviceSize hitGroupStride = progSize;
-  // m_sbtBuffer holds all the shader handles: raygen, n-miss, hit...
-  cmdBuf.traceRaysNV(m_rtSBTBuffer.buffer, rayGenOffset,                    //
-                     m_rtSBTBuffer.buffer, missOffset, missStride,          //
-                     m_rtSBTBuffer.buffer, hitGroupOffset, hitGroupStride,  //
-                     m_rtSBTBuffer.buffer, 0, 0,                            //
-                     m_size.width, m_size.height,                           //
-                     1);                                                    // depth
+
+  // m_rtSBTBuffer holds all the shader handles: raygen, n-miss, hit...
+  if(tiled)
+    traceTiles(cmdBuf);
+  else
+    cmdBuf.traceRaysKHR(m_rgenRegion, m_missRegion, m_hitRegion, m_callRegion,  //
+                        m_size.width, m_size.height,                            //
+                        1);                                                     // depth
+  if(!tiled)
+    reconstructInterleaved(cmdBuf);
+  writeTimestamp(cmdBuf, -1);
 
   m_debug.endLabel(cmdBuf);
 }
 
-void HelloVulkan::updateFrame()
+//--------------------------------------------------------------------------------------------------
+// Starting the frame of swapchain image `frame`, after AppBase::prepareFrame waited for its fence:
+// the counters and timestamps written by the previous frame of the image can be read. The
+// readbacks and the timestamp pool of an image are created when first used.
+//
+void HelloVulkan::beginFrame(uint32_t frame)
 {
-    static glm::mat4 refCamera;
-    glm::mat4 currentCam = CameraManip.getMatrix();
-
+  using vkMP = vk::MemoryPropertyFlagBits;
+  m_frame    = frame;
+  while(m_rayStatsReadbacks.size() <= frame)
+  {
+    m_rayStatsReadbacks.push_back(m_alloc.createBuffer(RAY_STAT_COUNT * sizeof(uint32_t),
+                                                       vk::BufferUsageFlagBits::eTransferDst,
+                                                       vkMP::eHostVisible | vkMP::eHostCoherent));
+    m_rayStatsCopied.push_back(false);
+  }
+  if(m_rayStatsCopied[frame])
+  {
+    const uint32_t* data = static_cast<const uint32_t*>(m_alloc.map(m_rayStatsReadbacks[frame]));
+    memcpy(m_rayStatCounts, data, sizeof(m_rayStatCounts));
+    m_alloc.unmap(m_rayStatsReadbacks[frame]);
+    m_rayStatsCopied[frame] = false;
+  }
+
+  // Time of the tiles, to pick the number of tiles of the next frames
+  while(m_timestampPeriod > 0.f && m_tilePools.size() <= frame)
+  {
+    m_tilePools.push_back(m_device.createQueryPool({{}, vk::QueryType::eTimestamp, 2}));
+    m_tilesTraced.push_back(0);
+  }
+  if(frame < m_tilePools.size())
+    updateTileBudget(frame);
+
+  // Raster timestamps and fragment shader invocations
+  while(m_timestampPeriod > 0.f && m_cullPools.size() <= frame)
+  {
+    m_cullPools.push_back(m_device.createQueryPool({{}, vk::QueryType::eTimestamp, 4}));
+    m_cullTimed.push_back(-1);
+  }
+  while(m_pipelineStatistics && m_fragmentPools.size() <= frame)
+  {
+    m_fragmentPools.push_back(m_device.createQueryPool(
+        {{}, vk::QueryType::ePipelineStatistics, 1, vk::QueryPipelineStatisticFlagBits::eFragmentShaderInvocations}));
+    m_fragmentCounted.push_back(-1);
+  }
+  readRasterQueries(frame);
+
+  // Culling counters, copied by the last frame of the image from the frame before it
+  while(m_cullStatsBuffer.buffer && m_cullStatsReadbacks.size() <= frame)
+  {
+    m_cullStatsReadbacks.push_back(m_alloc.createBuffer(CULL_STAT_COUNT * sizeof(uint32_t),
+                                                        vk::BufferUsageFlagBits::eTransferDst,
+                                                        vkMP::eHostVisible | vkMP::eHostCoherent));
+    m_cullStatsCopied.push_back(false);
+  }
+  if(frame < m_cullStatsCopied.size() && m_cullStatsCopied[frame])
+  {
+    const uint32_t* counters = static_cast<const uint32_t*>(m_alloc.map(m_cullStatsReadbacks[frame]));
+    std::copy(counters, counters + CULL_STAT_COUNT, m_cullStats);
+    m_alloc.unmap(m_cullStatsReadbacks[frame]);
+    m_cullStatsCopied[frame] = false;
+  }
+
+  // Occupancy of the wavefront queues, copied after each bounce of the first sample
+  while(m_wavefrontCounters.buffer && m_wavefrontReadbacks.size() <= frame)
+  {
+    m_wavefrontReadbacks.push_back(m_alloc.createBuffer(m_wavefrontOccupancy.size() * WF_COUNTER_SIZE
+                                                            * sizeof(uint32_t),
+                                                        vk::BufferUsageFlagBits::eTransferDst,
+                                                        vkMP::eHostVisible | vkMP::eHostCoherent));
+    m_wavefrontCopied.push_back(false);
+  }
+  if(frame < m_wavefrontCopied.size() && m_wavefrontCopied[frame])
+  {
+    const uint32_t* counters = static_cast<const uint32_t*>(m_alloc.map(m_wavefrontReadbacks[frame]));
+    for(size_t i = 0; i < m_wavefrontOccupancy.size(); i++)
+      m_wavefrontOccupancy[i] = counters[i * WF_COUNTER_SIZE];
+    m_alloc.unmap(m_wavefrontReadbacks[frame]);
+    m_wavefrontCopied[frame] = false;
+  }
+
+  while(m_timestampPeriod > 0.f && m_timestampPools.size() <= frame)
+  {
+    m_timestampPools.push_back(m_device.createQueryPool({{}, vk::QueryType::eTimestamp, kMaxTimestamps}));
+    m_timestampKernels.emplace_back();
+  }
+  if(m_timestampPeriod > 0.f)
+    readTimestamps(frame);
+
+  // GPU time of the previous frame of the image, for the dynamic resolution
+  while(m_timestampPeriod > 0.f && m_frameTimerPools.size() <= frame)
+  {
+    m_frameTimerPools.push_back(m_device.createQueryPool({{}, vk::QueryType::eTimestamp, 2}));
+    m_frameTimed.push_back(false);
+  }
+  if(m_timestampPeriod > 0.f && m_frameTimed[frame])
+  {
+    uint64_t   ticks[2];
+    vk::Result result = m_device.getQueryPoolResults(m_frameTimerPools[frame], 0, 2, sizeof(ticks), ticks,
+                                                     sizeof(uint64_t), vk::QueryResultFlagBits::e64);
+    if(result == vk::Result::eSuccess)
+    {
+      const float ms = float(ticks[1] - ticks[0]) * m_timestampPeriod * 1e-6f;
+      m_frameTime    = m_frameTime == 0.f ? ms : glm::mix(m_frameTime, ms, 0.1f);
+    }
+    m_frameTimed[frame] = false;
+  }
+}
+
+void HelloVulkan::updateFrame()
+{
+    // The depth buffer is not rendered: the next raster frame cannot cull against it
+    m_hizValid = false;
+
+    static glm::mat4 refCamera;
+    glm::mat4 currentCam = CameraManip.getMatrix();
+
+    // A camera move reprojects the accumulated samples instead of discarding them, with other
+    // Sobol samples than the ones already accumulated
+    m_rtPushConstants.reproject = 0;
     if (refCamera != currentCam)
     {
-        resetFrame();
+        // The tiles not traced in this frame would keep surfaces of older cameras
+        if (m_reprojection && !m_tiledRendering)
+        {
+            m_rtPushConstants.reproject = 1;
+            m_rtPushConstants.sampleSequence++;
+        }
+        else
+            resetFrame();
         refCamera = currentCam;
     }
     m_rtPushConstants.frameCounter++;
+    if (m_rtPushConstants.frameCounter == 0)
+        m_rtPushConstants.reproject = 0;  // Nothing to reproject after a reset
 }
 
 void HelloVulkan::resetFrame()
 {
     m_rtPushConstants.frameCounter = -1;
+    std::fill(m_tileFrames.begin(), m_tileFrames.end(), -1);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Tiled rendering
+//////////////////////////////////////////////////////////////////////////
+
+//--------------------------------------------------------------------------------------------------
+// The tiles of the image. Their timestamp queries are created by beginFrame, one pool per
+// swapchain image, when createWavefront found the queue supports them.
+//
+void HelloVulkan::createTiles()
+{
+  resetTiles();
+}
+
+//--------------------------------------------------------------------------------------------------
+// Splitting the image in tiles of m_tileSize, after a resize or a change of the tile size. The
+// time of a tile is measured again from one tile per frame.
+//
+void HelloVulkan::resetTiles()
+{
+  const uint32_t tileSize = static_cast<uint32_t>(m_tileSize);
+  m_tileCountX            = (m_size.width + tileSize - 1) / tileSize;
+  m_tileCountY            = (m_size.height + tileSize - 1) / tileSize;
+  m_tileFrames.assign(m_tileCountX * m_tileCountY, -1);
+  m_nextTile      = 0;
+  m_tilesPerFrame = 1;
+  m_tileTime      = 0.f;
+  // The frames in flight timed the previous tiles
+  std::fill(m_tilesTraced.begin(), m_tilesTraced.end(), 0u);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Number of tiles of the next frames from the time of the tiles of the last frame of swapchain
+// image `frame`, called by beginFrame once its fence signaled. The timestamps are not waited for:
+// when they are not available, the previous estimate is kept.
+//
+void HelloVulkan::updateTileBudget(uint32_t frame)
+{
+  const uint32_t traced = m_tilesTraced[frame];
+  m_tilesTraced[frame]  = 0;
+  if(traced == 0)
+    return;
+  uint64_t   ticks[2];
+  vk::Result result = m_device.getQueryPoolResults(m_tilePools[frame], 0, 2, sizeof(ticks), ticks,
+                                                   sizeof(uint64_t), vk::QueryResultFlagBits::e64);
+  if(result != vk::Result::eSuccess)
+    return;
+
+  // Smoothed, the tiles of the sky costing much less than the ones of the objects
+  const float ms = float(ticks[1] - ticks[0]) * m_timestampPeriod * 1e-6f / float(traced);
+  m_tileTime     = m_tileTime == 0.f ? ms : glm::mix(m_tileTime, ms, 0.25f);
+  const uint32_t tileCount = static_cast<uint32_t>(m_tileFrames.size());
+  const uint32_t fitting   = static_cast<uint32_t>(m_tileBudget / std::max(m_tileTime, 1e-3f));
+  m_tilesPerFrame          = std::max(1u, std::min(fitting, tileCount));
+}
+
+//--------------------------------------------------------------------------------------------------
+// One launch per tile, continuing from the tile after the last one traced. The launches write
+// distinct pixels and need no barrier between them.
+//
+void HelloVulkan::traceTiles(const vk::CommandBuffer& cmdBuf)
+{
+  const uint32_t tileCount = static_cast<uint32_t>(m_tileFrames.size());
+  const uint32_t tileSize  = static_cast<uint32_t>(m_tileSize);
+  if(tileCount == 0)
+    return;
+  const uint32_t traced  = std::min(m_tilesPerFrame, tileCount);
+  m_tilesTraced[m_frame] = traced;
+
+  const vk::QueryPool pool = m_tilePools[m_frame];
+  cmdBuf.resetQueryPool(pool, 0, 2);
+  cmdBuf.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, pool, 0);
+  RtPushConstant tileConstants = m_rtPushConstants;
+  for(uint32_t i = 0; i < traced; i++)
+  {
+    const uint32_t tile = m_nextTile;
+    m_nextTile          = (m_nextTile + 1) % tileCount;
+
+    const uint32_t x           = (tile % m_tileCountX) * tileSize;
+    const uint32_t y           = (tile / m_tileCountX) * tileSize;
+    tileConstants.tileX        = static_cast<int>(x);
+    tileConstants.tileY        = static_cast<int>(y);
+    tileConstants.frameCounter = ++m_tileFrames[tile];
+    cmdBuf.pushConstants<RtPushConstant>(m_rtPipelineLayout,
+                                         vk::ShaderStageFlagBits::eRaygenKHR
+                                             | vk::ShaderStageFlagBits::eClosestHitKHR
+                                             | vk::ShaderStageFlagBits::eMissKHR,
+                                         0, tileConstants);
+    cmdBuf.traceRaysKHR(m_rgenRegion, m_missRegion, m_hitRegion, m_callRegion,  //
+                        std::min(tileSize, m_size.width - x), std::min(tileSize, m_size.height - y),
+                        1);
+  }
+  cmdBuf.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, pool, 1);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Denoiser
+//////////////////////////////////////////////////////////////////////////
+
+//--------------------------------------------------------------------------------------------------
+// History and intermediate images of the denoiser, recreated with the offscreen images
+//
+void HelloVulkan::createDenoiseImages()
+{
+  using vkIU              = vk::ImageUsageFlagBits;
+  const vk::Format format = vk::Format::eR32G32B32A32Sfloat;
+
+  destroyDenoiseImages();
+  m_historyImage         = createStorageImage(format, {}, "denoiseHistory");
+  m_prevMomentsImage     = createStorageImage(format, vkIU::eTransferDst, "prevMoments");
+  m_momentsImage         = createStorageImage(format, vkIU::eTransferSrc, "moments");
+  m_filterImages[0]      = createStorageImage(format, {}, "filter0");
+  m_filterImages[1]      = createStorageImage(format, {}, "filter1");
+  m_denoisedImage        = createStorageImage(format, vkIU::eSampled, "denoised");
+  m_denoiseHistoryValid  = false;
+}
+
+void HelloVulkan::destroyDenoiseImages()
+{
+  m_alloc.destroy(m_historyImage);
+  m_alloc.destroy(m_prevMomentsImage);
+  m_alloc.destroy(m_momentsImage);
+  m_alloc.destroy(m_filterImages[0]);
+  m_alloc.destroy(m_filterImages[1]);
+  m_alloc.destroy(m_denoisedImage);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Descriptor sets and compute pipelines of the temporal and à-trous passes, and error of the
+// filter measured on the CPU
+//
+void HelloVulkan::createDenoiser()
+{
+  using vkDT   = vk::DescriptorType;
+  using vkSS   = vk::ShaderStageFlagBits;
+  using vkDSLB = vk::DescriptorSetLayoutBinding;
+
+  // All the images of shaders/denoise.glsl
+  const uint32_t imageCount = 12;
+  for(uint32_t binding = 0; binding < imageCount; binding++)
+    m_denoiseDescSetLayoutBind.emplace_back(vkDSLB(binding, vkDT::eStorageImage, 1, vkSS::eCompute));
+  m_denoiseDescSetLayout =
+      nvvkpp::util::createDescriptorSetLayout(m_device, m_denoiseDescSetLayoutBind);
+  vk::DescriptorPoolSize poolSize(vkDT::eStorageImage, 2 * imageCount);
+  m_denoiseDescPool = m_device.createDescriptorPool({{}, 2, 1, &poolSize});
+  for(auto& set : m_denoiseDescSets)
+    set = nvvkpp::util::createDescriptorSet(m_device, m_denoiseDescPool, m_denoiseDescSetLayout);
+  updateDenoiseDescriptorSets();
+
+  vk::PushConstantRange        pushConstant{vkSS::eCompute, 0, sizeof(DenoisePushConstant)};
+  vk::PipelineLayoutCreateInfo layoutInfo{{}, 1, &m_denoiseDescSetLayout, 1, &pushConstant};
+  m_denoisePipelineLayout = m_device.createPipelineLayout(layoutInfo);
+
+  vk::ComputePipelineCreateInfo pipelineInfo{{}, {}, m_denoisePipelineLayout};
+  pipelineInfo.stage = nvvkpp::util::loadShader(
+      m_device, nvvkpp::util::readFile("shaders/temporal.comp.spv"), vkSS::eCompute);
+  m_temporalPipeline = m_device.createComputePipelines({}, pipelineInfo, nullptr)[0];
+  m_device.destroy(pipelineInfo.stage.module);
+  pipelineInfo.stage = nvvkpp::util::loadShader(
+      m_device, nvvkpp::util::readFile("shaders/atrous.comp.spv"), vkSS::eCompute);
+  m_atrousPipeline = m_device.createComputePipelines({}, pipelineInfo, nullptr)[0];
+  m_device.destroy(pipelineInfo.stage.module);
+  m_debug.setObjectName(m_temporalPipeline, "temporal");
+  m_debug.setObjectName(m_atrousPipeline, "atrous");
+}
+
+//--------------------------------------------------------------------------------------------------
+// Writes the images to the two descriptor sets, which only differ by the direction of the
+// ping-pong between m_filterImages
+// - Required when changing resolution
+//
+void HelloVulkan::updateDenoiseDescriptorSets()
+{
+  for(int s = 0; s < 2; s++)
+  {
+    const nvvkTexture* images[] = {&m_offscreenColor,   &m_varianceImage,        &m_normalDepthImage,
+                                   &m_albedoImage,      &m_motionImage,          &m_prevNormalDepthImage,
+                                   &m_historyImage,     &m_prevMomentsImage,     &m_momentsImage,
+                                   &m_filterImages[s],  &m_filterImages[1 - s],  &m_denoisedImage};
+    std::vector<vk::WriteDescriptorSet> writes;
+    for(uint32_t b = 0; b < m_denoiseDescSetLayoutBind.size(); b++)
+      writes.emplace_back(nvvkpp::util::createWrite(m_denoiseDescSets[s], m_denoiseDescSetLayoutBind[b],
+                                                    &images[b]->descriptor));
+    m_device.updateDescriptorSets(writes, nullptr);
+  }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Denoising the image just traced into m_denoisedImage: temporal accumulation into
+// m_filterImages[0], then the à-trous passes back and forth between the two filter images
+//
+void HelloVulkan::denoise(const vk::CommandBuffer& cmdBuf)
+{
+  using vkPS = vk::PipelineStageFlagBits;
+  using vkA  = vk::AccessFlagBits;
+  auto barrier = [&](vk::PipelineStageFlags src, vk::AccessFlags srcAccess,
+                     vk::PipelineStageFlags dst, vk::AccessFlags dstAccess) {
+    cmdBuf.pipelineBarrier(src, dst, vk::DependencyFlags(), {vk::MemoryBarrier(srcAccess, dstAccess)},
+                           {}, {});
+  };
+
+  m_debug.beginLabel(cmdBuf, "Denoise");
+  barrier(vkPS::eRayTracingShaderKHR | vkPS::eComputeShader, vkA::eShaderWrite, vkPS::eComputeShader,
+          vkA::eShaderRead);
+
+  const uint32_t      groupsX = (m_size.width + 15) / 16;
+  const uint32_t      groupsY = (m_size.height + 15) / 16;
+  DenoisePushConstant pushConstant;
+  pushConstant.iterations   = m_denoiseIterations;
+  pushConstant.historyValid = m_denoiseHistoryValid ? 1 : 0;
+
+  // The set 1 writes to m_filterImages[0]
+  cmdBuf.bindPipeline(vk::PipelineBindPoint::eCompute, m_temporalPipeline);
+  cmdBuf.bindDescriptorSets(vk::PipelineBindPoint::eCompute, m_denoisePipelineLayout, 0,
+                            {m_denoiseDescSets[1]}, {});
+  cmdBuf.pushConstants<DenoisePushConstant>(m_denoisePipelineLayout, vk::ShaderStageFlagBits::eCompute,
+                                            0, pushConstant);
+  cmdBuf.dispatch(groupsX, groupsY, 1);
+
+  cmdBuf.bindPipeline(vk::PipelineBindPoint::eCompute, m_atrousPipeline);
+  for(int i = 0; i < m_denoiseIterations; i++)
+  {
+    barrier(vkPS::eComputeShader, vkA::eShaderWrite, vkPS::eComputeShader,
+            vkA::eShaderRead | vkA::eShaderWrite);
+    pushConstant.iteration = i;
+    cmdBuf.bindDescriptorSets(vk::PipelineBindPoint::eCompute, m_denoisePipelineLayout, 0,
+                              {m_denoiseDescSets[i % 2]}, {});
+    cmdBuf.pushConstants<DenoisePushConstant>(m_denoisePipelineLayout,
+                                              vk::ShaderStageFlagBits::eCompute, 0, pushConstant);
+    cmdBuf.dispatch(groupsX, groupsY, 1);
+  }
+
+  // Keeping the moments for the reprojection of the next frame, raytrace() keeps the surfaces
+  barrier(vkPS::eComputeShader, vkA::eShaderWrite, vkPS::eTransfer, vkA::eTransferRead);
+  vk::ImageCopy region;
+  region.setSrcSubresource({vk::ImageAspectFlagBits::eColor, 0, 0, 1});
+  region.setDstSubresource({vk::ImageAspectFlagBits::eColor, 0, 0, 1});
+  region.setExtent({m_size.width, m_size.height, 1});
+  cmdBuf.copyImage(m_momentsImage.image, vk::ImageLayout::eGeneral, m_prevMomentsImage.image,
+                   vk::ImageLayout::eGeneral, {region});
+
+  // The post-process reads the denoised image, the next frame overwrites the copied images
+  barrier(vkPS::eComputeShader | vkPS::eTransfer, vkA::eShaderWrite | vkA::eTransferWrite,
+          vkPS::eFragmentShader | vkPS::eRayTracingShaderKHR | vkPS::eComputeShader,
+          vkA::eShaderRead | vkA::eShaderWrite);
+  m_denoiseHistoryValid = true;
+  m_debug.endLabel(cmdBuf);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Dynamic resolution
+//////////////////////////////////////////////////////////////////////////
+
+// Steps of the rendering scale: the images are only reallocated when the scale changes by one
+static const float kResolutionStep  = 0.125f;
+static const float kMinRenderScale  = 0.25f;
+static const int   kResolutionDelay = 30;  // Frames for the smoothed frame time to settle
+
+//--------------------------------------------------------------------------------------------------
+// Descriptor set and compute pipeline of the upscaler, and its error measured on the CPU
+//
+void HelloVulkan::createUpscaler()
+{
+  using vkDT   = vk::DescriptorType;
+  using vkSS   = vk::ShaderStageFlagBits;
+  using vkDSLB = vk::DescriptorSetLayoutBinding;
+
+  // Color, denoised and upscaled images of shaders/upscale.comp
+  for(uint32_t binding = 0; binding < 3; binding++)
+    m_upscaleDescSetLayoutBind.emplace_back(vkDSLB(binding, vkDT::eStorageImage, 1, vkSS::eCompute));
+  m_upscaleDescSetLayout = nvvkpp::util::createDescriptorSetLayout(m_device, m_upscaleDescSetLayoutBind);
+  m_upscaleDescPool      = nvvkpp::util::createDescriptorPool(m_device, m_upscaleDescSetLayoutBind);
+  m_upscaleDescSet = nvvkpp::util::createDescriptorSet(m_device, m_upscaleDescPool, m_upscaleDescSetLayout);
+  updateUpscaleDescriptorSet();
+
+  vk::PushConstantRange        pushConstant{vkSS::eCompute, 0, sizeof(UpscalePushConstant)};
+  vk::PipelineLayoutCreateInfo layoutInfo{{}, 1, &m_upscaleDescSetLayout, 1, &pushConstant};
+  m_upscalePipelineLayout = m_device.createPipelineLayout(layoutInfo);
+
+  vk::ComputePipelineCreateInfo pipelineInfo{{}, {}, m_upscalePipelineLayout};
+  pipelineInfo.stage = nvvkpp::util::loadShader(
+      m_device, nvvkpp::util::readFile("shaders/upscale.comp.spv"), vkSS::eCompute);
+  m_upscalePipeline = m_device.createComputePipelines({}, pipelineInfo, nullptr)[0];
+  m_device.destroy(pipelineInfo.stage.module);
+  m_debug.setObjectName(m_upscalePipeline, "upscale");
+}
+
+//--------------------------------------------------------------------------------------------------
+// - Required when changing resolution
+//
+void HelloVulkan::updateUpscaleDescriptorSet()
+{
+  if(!m_upscaleDescSet)
+    return;
+  const nvvkTexture* images[] = {&m_offscreenColor, &m_denoisedImage, &m_upscaledImage};
+  std::vector<vk::WriteDescriptorSet> writes;
+  for(uint32_t b = 0; b < m_upscaleDescSetLayoutBind.size(); b++)
+    writes.emplace_back(nvvkpp::util::createWrite(m_upscaleDescSet, m_upscaleDescSetLayoutBind[b],
+                                                  &images[b]->descriptor));
+  m_device.updateDescriptorSets(writes, nullptr);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Upscaling the image shown by drawPost to the window, outside of its render pass. Nothing to do
+// at full resolution.
+//
+void HelloVulkan::upscale(const vk::CommandBuffer& cmdBuf, bool denoised)
+{
+  using vkPS = vk::PipelineStageFlagBits;
+  using vkA  = vk::AccessFlagBits;
+  if(m_size == m_windowSize || !m_edgeAwareUpscale)
+    return;
+
+  m_debug.beginLabel(cmdBuf, "Upscale");
+  // The image comes from the ray tracing, the rasterization or the compute passes
+  vk::MemoryBarrier toCompute(vkA::eShaderWrite | vkA::eColorAttachmentWrite, vkA::eShaderRead);
+  cmdBuf.pipelineBarrier(vkPS::eRayTracingShaderKHR | vkPS::eComputeShader | vkPS::eColorAttachmentOutput,
+                         vkPS::eComputeShader, vk::DependencyFlags(), {toCompute}, {}, {});
+
+  UpscalePushConstant pushConstant;
+  pushConstant.denoised = denoised ? 1 : 0;
+  cmdBuf.bindPipeline(vk::PipelineBindPoint::eCompute, m_upscalePipeline);
+  cmdBuf.bindDescriptorSets(vk::PipelineBindPoint::eCompute, m_upscalePipelineLayout, 0,
+                            {m_upscaleDescSet}, {});
+  cmdBuf.pushConstants<UpscalePushConstant>(m_upscalePipelineLayout, vk::ShaderStageFlagBits::eCompute,
+                                            0, pushConstant);
+  cmdBuf.dispatch((m_windowSize.width + 15) / 16, (m_windowSize.height + 15) / 16, 1);
+
+  vk::MemoryBarrier toFragment(vkA::eShaderWrite, vkA::eShaderRead);
+  cmdBuf.pipelineBarrier(vkPS::eComputeShader, vkPS::eFragmentShader, vk::DependencyFlags(),
+                         {toFragment}, {}, {});
+  m_debug.endLabel(cmdBuf);
+}
+
+//--------------------------------------------------------------------------------------------------
+// GPU time of the whole command buffer of a frame, read by beginFrame when the frame of the
+// swapchain image is reused. Unlike the CPU frame time, it does not include the wait for the
+// presentation or the time spent on the host.
+//
+void HelloVulkan::beginFrameTimer(const vk::CommandBuffer& cmdBuf)
+{
+  if(m_frame >= m_frameTimerPools.size())
+    return;
+  cmdBuf.resetQueryPool(m_frameTimerPools[m_frame], 0, 2);
+  cmdBuf.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, m_frameTimerPools[m_frame], 0);
+}
+
+void HelloVulkan::endFrameTimer(const vk::CommandBuffer& cmdBuf)
+{
+  if(m_frame >= m_frameTimerPools.size())
+    return;
+  cmdBuf.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, m_frameTimerPools[m_frame], 1);
+  m_frameTimed[m_frame] = true;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Picking the rendering scale from the smoothed GPU frame time. The cost of a frame following the
+// number of pixels, the scale moves with the square root of the ratio to the target, by whole
+// steps and at most two at a time, and only when the smoothed time is more than 10% away from
+// the target. Returns true when the images were reallocated.
+//
+bool HelloVulkan::updateResolution()
+{
+  m_framesSinceResize++;
+
+  float scale = 1.f;
+  if(m_dynamicResolution)
+  {
+    if(m_frameTime == 0.f || m_framesSinceResize < kResolutionDelay
+       || fabsf(m_frameTime - m_targetFrameTime) < 0.1f * m_targetFrameTime)
+      return false;
+    scale = m_renderScale * sqrtf(m_targetFrameTime / std::max(m_frameTime, 1e-3f));
+    scale = roundf(scale / kResolutionStep) * kResolutionStep;
+    scale = glm::clamp(scale, m_renderScale - 2.f * kResolutionStep, m_renderScale + 2.f * kResolutionStep);
+    scale = glm::clamp(scale, kMinRenderScale, 1.f);
+  }
+  if(scale == m_renderScale)
+    return false;
+
+  m_renderScale = scale;
+  m_device.waitIdle();
+  resize(m_windowSize);
+  return true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Sparse primary rays
+//////////////////////////////////////////////////////////////////////////
+
+//--------------------------------------------------------------------------------------------------
+// Compute pipeline of the reconstruction, using the images of the ray tracing descriptor set and
+// the camera of the scene
+//
+void HelloVulkan::createInterleave()
+{
+  vk::DescriptorSetLayout      setLayouts[] = {m_rtDescSetLayout, m_descSetLayout};
+  vk::PushConstantRange        pushConstant{vk::ShaderStageFlagBits::eCompute, 0,
+                                     sizeof(InterleavePushConstant)};
+  vk::PipelineLayoutCreateInfo layoutInfo{{}, 2, setLayouts, 1, &pushConstant};
+  m_interleavePipelineLayout = m_device.createPipelineLayout(layoutInfo);
+
+  vk::ComputePipelineCreateInfo pipelineInfo{{}, {}, m_interleavePipelineLayout};
+  pipelineInfo.stage = nvvkpp::util::loadShader(
+      m_device, nvvkpp::util::readFile("shaders/interleave.comp.spv"), vk::ShaderStageFlagBits::eCompute);
+  m_interleavePipeline = m_device.createComputePipelines({}, pipelineInfo, nullptr)[0];
+  m_device.destroy(pipelineInfo.stage.module);
+  m_debug.setObjectName(m_interleavePipeline, "interleave");
+}
+
+//--------------------------------------------------------------------------------------------------
+// Filling the pixels skipped by the ray generation shader in the frames where their accumulation
+// restarts, after a reset or a camera move. In the other frames, they keep their accumulation.
+//
+void HelloVulkan::reconstructInterleaved(const vk::CommandBuffer& cmdBuf)
+{
+  using vkPS = vk::PipelineStageFlagBits;
+  using vkA  = vk::AccessFlagBits;
+  if(m_rtPushConstants.interleave <= 1
+     || (m_rtPushConstants.frameCounter != 0 && m_rtPushConstants.reproject == 0))
+    return;
+
+  m_debug.beginLabel(cmdBuf, "Interleave");
+  vk::MemoryBarrier toCompute(vkA::eShaderWrite, vkA::eShaderRead | vkA::eShaderWrite);
+  cmdBuf.pipelineBarrier(vkPS::eRayTracingShaderKHR, vkPS::eComputeShader, vk::DependencyFlags(),
+                         {toCompute}, {}, {});
+
+  InterleavePushConstant pushConstant;
+  pushConstant.interleave      = m_rtPushConstants.interleave;
+  pushConstant.interleaveFrame = m_rtPushConstants.interleaveFrame;
+  pushConstant.reproject       = m_rtPushConstants.reproject;
+  pushConstant.historyLength   = m_rtPushConstants.historyLength;
+  cmdBuf.bindPipeline(vk::PipelineBindPoint::eCompute, m_interleavePipeline);
+  cmdBuf.bindDescriptorSets(vk::PipelineBindPoint::eCompute, m_interleavePipelineLayout, 0,
+                            {m_rtDescSet, m_descSet}, {});
+  cmdBuf.pushConstants<InterleavePushConstant>(m_interleavePipelineLayout,
+                                               vk::ShaderStageFlagBits::eCompute, 0, pushConstant);
+  cmdBuf.dispatch((m_size.width + 15) / 16, (m_size.height + 15) / 16, 1);
+
+  // Read by the post-process, the denoiser or the upscaler
+  vk::MemoryBarrier fromCompute(vkA::eShaderWrite, vkA::eShaderRead);
+  cmdBuf.pipelineBarrier(vkPS::eComputeShader, vkPS::eComputeShader | vkPS::eFragmentShader,
+                         vk::DependencyFlags(), {fromCompute}, {}, {});
+  m_debug.endLabel(cmdBuf);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Culling
+//////////////////////////////////////////////////////////////////////////
+
+// HiZ levels with a descriptor set, enough for a depth buffer of 32768 pixels
+static const uint32_t kMaxHizLevels = 16;
+
+//--------------------------------------------------------------------------------------------------
+// Buffers, descriptor sets and compute pipelines of the culling and of the HiZ build. Needs the
+// indirect draws, the scene descriptor set and the timestamp period read by createWavefront.
+//
+void HelloVulkan::createCulling()
+{
+  using vkDT   = vk::DescriptorType;
+  using vkSS   = vk::ShaderStageFlagBits;
+  using vkDSLB = vk::DescriptorSetLayoutBinding;
+  using vkBU   = vk::BufferUsageFlagBits;
+
+  // Drawing the compacted draws needs their count read on the device, and several draws per call
+  for(const auto& extension : m_physicalDevice.enumerateDeviceExtensionProperties())
+  {
+    if(strcmp(extension.extensionName, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME) == 0)
+      m_drawIndirectCount = m_multiDrawIndirect;
+  }
+
+  std::vector<glm::vec4>   bounds;
+  std::vector<MeshCluster> clusters;
+  std::vector<glm::uvec2>  modelClusters;
+  for(auto& model : m_objModel)
+  {
+    bounds.emplace_back(model.bbMin, 0.f);
+    bounds.emplace_back(model.bbMax, 0.f);
+    model.firstCluster = static_cast<uint32_t>(clusters.size());
+    clusters.insert(clusters.end(), model.clusters.begin(), model.clusters.end());
+    modelClusters.emplace_back(model.firstCluster, static_cast<uint32_t>(model.clusters.size()));
+  }
+  nvvkpp::SingleCommandBuffer cmdGen(m_device, m_queueIndex);
+  auto                        cmdBuf = cmdGen.createCommandBuffer();
+  m_boundsBuffer                     = m_alloc.createBuffer(cmdBuf, bounds, vkBU::eStorageBuffer);
+  m_clusterBuffer                    = m_alloc.createBuffer(cmdBuf, clusters, vkBU::eStorageBuffer);
+  m_modelClusterBuffer = m_alloc.createBuffer(cmdBuf, modelClusters, vkBU::eStorageBuffer);
+  cmdGen.flushCommandBuffer(cmdBuf);
+  m_alloc.flushStaging();
+
+  // Room for the cluster draws of each instance at any of its levels of detail
+  m_clusterDrawCount = 0;
+  for(const auto& instance : m_objInstance)
+  {
+    const ObjModel& base      = m_objModel[m_objModel[instance.objIndex].lodBase];
+    size_t          mostDraws = 0;
+    for(uint32_t level = 0; level < base.lodLevels; level++)
+      mostDraws = std::max(mostDraws, m_objModel[base.lodBase + level].clusters.size());
+    m_clusterDrawCount += static_cast<uint32_t>(mostDraws);
+  }
+  const size_t drawCount = std::max<size_t>(m_objInstance.size(), m_clusterDrawCount);
+  m_visibleDrawBuffer    = m_alloc.createBuffer(drawCount * sizeof(vk::DrawIndexedIndirectCommand),
+                                             vkBU::eIndirectBuffer | vkBU::eStorageBuffer);
+  // Counters copied each frame to the readback of the swapchain image before being cleared
+  const vk::DeviceSize statsSize = CULL_STAT_COUNT * sizeof(uint32_t);
+  m_cullStatsBuffer = m_alloc.createBuffer(statsSize, vkBU::eIndirectBuffer | vkBU::eStorageBuffer
+                                                          | vkBU::eTransferSrc | vkBU::eTransferDst);
+  m_debug.setObjectName(m_boundsBuffer.buffer, "bounds");
+  m_debug.setObjectName(m_clusterBuffer.buffer, "clusters");
+  m_debug.setObjectName(m_modelClusterBuffer.buffer, "modelClusters");
+  m_debug.setObjectName(m_visibleDrawBuffer.buffer, "visibleDraws");
+  m_debug.setObjectName(m_cullStatsBuffer.buffer, "cullStats");
+
+  // Bounds, draws, visible draws, counters and HiZ of shaders/cull.comp, then the clusters and
+  // the clusters of each model of shaders/cluster_cull.comp
+  for(uint32_t binding = 0; binding < 4; binding++)
+    m_cullDescSetLayoutBind.emplace_back(vkDSLB(binding, vkDT::eStorageBuffer, 1, vkSS::eCompute));
+  m_cullDescSetLayoutBind.emplace_back(vkDSLB(4, vkDT::eCombinedImageSampler, 1, vkSS::eCompute));
+  m_cullDescSetLayoutBind.emplace_back(vkDSLB(5, vkDT::eStorageBuffer, 1, vkSS::eCompute));
+  m_cullDescSetLayoutBind.emplace_back(vkDSLB(6, vkDT::eStorageBuffer, 1, vkSS::eCompute));
+  // Depth, previous level and level of shaders/hiz.comp
+  m_hizDescSetLayoutBind.emplace_back(vkDSLB(0, vkDT::eCombinedImageSampler, 1, vkSS::eCompute));
+  m_hizDescSetLayoutBind.emplace_back(vkDSLB(1, vkDT::eStorageImage, 1, vkSS::eCompute));
+  m_hizDescSetLayoutBind.emplace_back(vkDSLB(2, vkDT::eStorageImage, 1, vkSS::eCompute));
+  m_cullDescSetLayout = nvvkpp::util::createDescriptorSetLayout(m_device, m_cullDescSetLayoutBind);
+  m_hizDescSetLayout  = nvvkpp::util::createDescriptorSetLayout(m_device, m_hizDescSetLayoutBind);
+  vk::DescriptorPoolSize poolSizes[] = {{vkDT::eStorageBuffer, 6},
+                                        {vkDT::eCombinedImageSampler, 1 + kMaxHizLevels},
+                                        {vkDT::eStorageImage, 2 * kMaxHizLevels}};
+  m_cullDescPool = m_device.createDescriptorPool({{}, 1 + kMaxHizLevels, 3, poolSizes});
+  m_cullDescSet  = nvvkpp::util::createDescriptorSet(m_device, m_cullDescPool, m_cullDescSetLayout);
+  for(uint32_t level = 0; level < kMaxHizLevels; level++)
+    m_hizDescSets.push_back(nvvkpp::util::createDescriptorSet(m_device, m_cullDescPool, m_hizDescSetLayout));
+  updateCullDescriptorSets();
+
+  // The culling reads the camera and the instances from the scene descriptor set
+  vk::DescriptorSetLayout setLayouts[] = {m_descSetLayout, m_cullDescSetLayout};
+  vk::PushConstantRange   cullConstants{vkSS::eCompute, 0, sizeof(CullPushConstant)};
+  m_cullPipelineLayout = m_device.createPipelineLayout({{}, 2, setLayouts, 1, &cullConstants});
+  vk::PushConstantRange hizConstants{vkSS::eCompute, 0, sizeof(int)};
+  m_hizPipelineLayout = m_device.createPipelineLayout({{}, 1, &m_hizDescSetLayout, 1, &hizConstants});
+
+  vk::ComputePipelineCreateInfo pipelineInfo{{}, {}, m_cullPipelineLayout};
+  pipelineInfo.stage = nvvkpp::util::loadShader(
+      m_device, nvvkpp::util::readFile("shaders/cull.comp.spv"), vkSS::eCompute);
+  m_cullPipeline = m_device.createComputePipelines({}, pipelineInfo, nullptr)[0];
+  m_device.destroy(pipelineInfo.stage.module);
+  pipelineInfo.stage = nvvkpp::util::loadShader(
+      m_device, nvvkpp::util::readFile("shaders/cluster_cull.comp.spv"), vkSS::eCompute);
+  m_clusterCullPipeline = m_device.createComputePipelines({}, pipelineInfo, nullptr)[0];
+  m_device.destroy(pipelineInfo.stage.module);
+  pipelineInfo.layout = m_hizPipelineLayout;
+  pipelineInfo.stage  = nvvkpp::util::loadShader(
+      m_device, nvvkpp::util::readFile("shaders/hiz.comp.spv"), vkSS::eCompute);
+  m_hizPipeline = m_device.createComputePipelines({}, pipelineInfo, nullptr)[0];
+  m_device.destroy(pipelineInfo.stage.module);
+  m_debug.setObjectName(m_cullPipeline, "cull");
+  m_debug.setObjectName(m_clusterCullPipeline, "clusterCull");
+  m_debug.setObjectName(m_hizPipeline, "hiz");
+}
+
+//--------------------------------------------------------------------------------------------------
+// HiZ of the size of the depth buffer, recreated with the offscreen images, with a view of all
+// its levels for the culling and one view of each level for the build
+//
+void HelloVulkan::createHizImage()
+{
+  const vk::Format format = vk::Format::eR32Sfloat;
+
+  destroyHizImage();
+  auto createInfo = nvvkpp::image::create2DInfo(
+      m_size, format, vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled, true);
+  m_hizImage = m_alloc.createImage(createInfo);
+  vk::SamplerCreateInfo samplerInfo;
+  samplerInfo.setMaxLod(VK_LOD_CLAMP_NONE);
+  m_hizImage.descriptor = nvvkpp::image::create2DDescriptor(m_device, m_hizImage.image, samplerInfo,
+                                                            format, vk::ImageLayout::eGeneral);
+  for(uint32_t level = 0; level < createInfo.mipLevels; level++)
+  {
+    const vk::ImageSubresourceRange range{vk::ImageAspectFlagBits::eColor, level, 1, 0, 1};
+    m_hizLevelViews.push_back(m_device.createImageView(
+        {{}, m_hizImage.image, vk::ImageViewType::e2D, format, {}, range}));
+  }
+  m_debug.setObjectName(m_hizImage.image, "hiz");
+
+  nvvkpp::SingleCommandBuffer genCmdBuf(m_device, m_queueIndex);
+  auto                        cmdBuf = genCmdBuf.createCommandBuffer();
+  nvvkpp::image::setImageLayout(cmdBuf, m_hizImage.image, vk::ImageLayout::eUndefined,
+                                vk::ImageLayout::eGeneral,
+                                {vk::ImageAspectFlagBits::eColor, 0, createInfo.mipLevels, 0, 1});
+  genCmdBuf.flushCommandBuffer(cmdBuf);
+  m_hizValid = false;
+}
+
+void HelloVulkan::destroyHizImage()
+{
+  for(auto& view : m_hizLevelViews)
+    m_device.destroy(view);
+  m_hizLevelViews.clear();
+  m_alloc.destroy(m_hizImage);
+}
+
+//--------------------------------------------------------------------------------------------------
+// - Required when changing resolution
+//
+void HelloVulkan::updateCullDescriptorSets()
+{
+  if(!m_cullDescSet)
+    return;
+  std::vector<vk::WriteDescriptorSet> writes;
+  vk::DescriptorBufferInfo            buffers[] = {{m_boundsBuffer.buffer, 0, VK_WHOLE_SIZE},
+                                        {m_indirectBuffer.buffer, 0, VK_WHOLE_SIZE},
+                                        {m_visibleDrawBuffer.buffer, 0, VK_WHOLE_SIZE},
+                                        {m_cullStatsBuffer.buffer, 0, VK_WHOLE_SIZE}};
+  for(uint32_t b = 0; b < 4; b++)
+    writes.emplace_back(nvvkpp::util::createWrite(m_cullDescSet, m_cullDescSetLayoutBind[b], &buffers[b]));
+  writes.emplace_back(nvvkpp::util::createWrite(m_cullDescSet, m_cullDescSetLayoutBind[4],
+                                                &m_hizImage.descriptor));
+  vk::DescriptorBufferInfo clusterBuffers[] = {{m_clusterBuffer.buffer, 0, VK_WHOLE_SIZE},
+                                               {m_modelClusterBuffer.buffer, 0, VK_WHOLE_SIZE}};
+  for(uint32_t b = 0; b < 2; b++)
+    writes.emplace_back(
+        nvvkpp::util::createWrite(m_cullDescSet, m_cullDescSetLayoutBind[5 + b], &clusterBuffers[b]));
+
+  // Level 0 is copied from the depth buffer, each next level reduces the previous one
+  std::vector<vk::DescriptorImageInfo> levels;
+  for(const auto& view : m_hizLevelViews)
+    levels.emplace_back(vk::Sampler(), view, vk::ImageLayout::eGeneral);
+  for(size_t l = 0; l < levels.size(); l++)
+  {
+    writes.emplace_back(nvvkpp::util::createWrite(m_hizDescSets[l], m_hizDescSetLayoutBind[0],
+                                                  &m_offscreenDepth.descriptor));
+    writes.emplace_back(nvvkpp::util::createWrite(m_hizDescSets[l], m_hizDescSetLayoutBind[1],
+                                                  &levels[l == 0 ? 0 : l - 1]));
+    writes.emplace_back(nvvkpp::util::createWrite(m_hizDescSets[l], m_hizDescSetLayoutBind[2], &levels[l]));
+  }
+  m_device.updateDescriptorSets(writes, nullptr);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Timestamps and fragment shader invocations of the last raster frame of swapchain image `frame`,
+// read by beginFrame once its fence signaled. They are filed under the mode of that frame, and
+// not waited for: when they are not available, the previous values are kept.
+//
+void HelloVulkan::readRasterQueries(uint32_t frame)
+{
+  if(frame < m_cullTimed.size() && m_cullTimed[frame] >= 0)
+  {
+    const int  mode = m_cullTimed[frame];
+    uint64_t   ticks[4];
+    vk::Result result = m_device.getQueryPoolResults(m_cullPools[frame], 0, 4, sizeof(ticks), ticks,
+                                                     sizeof(uint64_t), vk::QueryResultFlagBits::e64);
+    if(result == vk::Result::eSuccess)
+    {
+      auto smooth = [&](float& time, int query) {
+        const float ms = float(ticks[query + 1] - ticks[query]) * m_timestampPeriod * 1e-6f;
+        time           = time == 0.f ? ms : glm::mix(time, ms, 0.1f);
+      };
+      smooth(m_drawTimes[mode], 1);
+      if((mode & 1) != 0)
+      {
+        smooth(m_cullTime, 0);
+        smooth(m_hizTime, 2);
+      }
+    }
+    m_cullTimed[frame] = -1;
+  }
+  if(frame < m_fragmentCounted.size() && m_fragmentCounted[frame] >= 0)
+  {
+    uint64_t   invocations = 0;
+    vk::Result result      = m_device.getQueryPoolResults(m_fragmentPools[frame], 0, 1, sizeof(invocations),
+                                                          &invocations, sizeof(uint64_t),
+                                                          vk::QueryResultFlagBits::e64);
+    if(result == vk::Result::eSuccess)
+      m_fragmentInvocations[m_fragmentCounted[frame]] = invocations;
+    m_fragmentCounted[frame] = -1;
+  }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Query pools of the frame being recorded, null when the frame is not measured
+//
+vk::QueryPool HelloVulkan::cullPool() const
+{
+  return m_frame < m_cullTimed.size() && m_cullTimed[m_frame] >= 0 ? m_cullPools[m_frame] : vk::QueryPool();
+}
+
+vk::QueryPool HelloVulkan::fragmentPool() const
+{
+  return m_frame < m_fragmentCounted.size() && m_fragmentCounted[m_frame] >= 0 ? m_fragmentPools[m_frame] :
+                                                                                 vk::QueryPool();
+}
+
+//--------------------------------------------------------------------------------------------------
+// Culling the indirect draws of rasterize(), before its render pass. The timestamps and the
+// fragment shader invocations of the frame are restarted here, in the pools of the swapchain image.
+//
+void HelloVulkan::cullInstances(const vk::CommandBuffer& cmdBuf)
+{
+  using vkPS         = vk::PipelineStageFlagBits;
+  using vkA          = vk::AccessFlagBits;
+  const bool culling = m_indirectRaster && m_gpuCulling;
+
+  if(m_frame < m_cullPools.size())
+  {
+    m_cullTimed[m_frame] = (culling ? 1 : 0) + (m_visibilityBuffer ? 2 : 0);
+    cmdBuf.resetQueryPool(m_cullPools[m_frame], 0, 4);
+    cmdBuf.writeTimestamp(vkPS::eBottomOfPipe, m_cullPools[m_frame], 0);
+  }
+  if(m_frame < m_fragmentPools.size())
+  {
+    m_fragmentCounted[m_frame] = m_visibilityBuffer ? 1 : 0;
+    cmdBuf.resetQueryPool(m_fragmentPools[m_frame], 0, 1);
+  }
+
+  if(culling)
+  {
+    m_debug.beginLabel(cmdBuf, "Cull");
+    // Counters of the previous frame copied for beginFrame, then cleared once the previous draws
+    // read their count
+    vk::MemoryBarrier toCopy(vkA::eShaderWrite, vkA::eTransferRead);
+    cmdBuf.pipelineBarrier(vkPS::eComputeShader | vkPS::eDrawIndirect, vkPS::eTransfer,
+                           vk::DependencyFlags(), {toCopy}, {}, {});
+    cmdBuf.copyBuffer(m_cullStatsBuffer.buffer, m_cullStatsReadbacks[m_frame].buffer,
+                      vk::BufferCopy(0, 0, CULL_STAT_COUNT * sizeof(uint32_t)));
+    m_cullStatsCopied[m_frame] = true;
+    vk::MemoryBarrier copyBarrier(vkA::eTransferRead, vkA::eTransferWrite);
+    cmdBuf.pipelineBarrier(vkPS::eTransfer, vkPS::eTransfer, vk::DependencyFlags(), {copyBarrier}, {}, {});
+    cmdBuf.fillBuffer(m_cullStatsBuffer.buffer, 0, VK_WHOLE_SIZE, 0);
+    // Also the HiZ built by the previous frame
+    vk::MemoryBarrier toCompute(vkA::eTransferWrite | vkA::eShaderWrite, vkA::eShaderRead | vkA::eShaderWrite);
+    cmdBuf.pipelineBarrier(vkPS::eTransfer | vkPS::eComputeShader, vkPS::eComputeShader,
+                           vk::DependencyFlags(), {toCompute}, {}, {});
+
+    CullPushConstant pushConstant;
+    pushConstant.instanceCount = static_cast<uint32_t>(m_objInstance.size());
+    pushConstant.occlusion     = m_occlusionCulling && m_hizValid ? 1 : 0;
+    pushConstant.compact       = m_drawIndirectCount ? 1 : 0;
+    // One workgroup per instance for its clusters, else one thread per instance
+    const bool clusters = clusterDraws();
+    cmdBuf.bindPipeline(vk::PipelineBindPoint::eCompute, clusters ? m_clusterCullPipeline : m_cullPipeline);
+    cmdBuf.bindDescriptorSets(vk::PipelineBindPoint::eCompute, m_cullPipelineLayout, 0,
+                              {m_descSet, m_cullDescSet}, {});
+    cmdBuf.pushConstants<CullPushConstant>(m_cullPipelineLayout, vk::ShaderStageFlagBits::eCompute,
+                                           0, pushConstant);
+    cmdBuf.dispatch(clusters ? pushConstant.instanceCount : (pushConstant.instanceCount + 63) / 64, 1, 1);
+
+    vk::MemoryBarrier toDraw(vkA::eShaderWrite, vkA::eIndirectCommandRead);
+    cmdBuf.pipelineBarrier(vkPS::eComputeShader, vkPS::eDrawIndirect, vk::DependencyFlags(),
+                           {toDraw}, {}, {});
+    m_debug.endLabel(cmdBuf);
+  }
+  if(cullPool())
+    cmdBuf.writeTimestamp(vkPS::eBottomOfPipe, cullPool(), 1);
+}
+
+//--------------------------------------------------------------------------------------------------
+// The culled raster draws the clusters kept one by one, with their count read on the device.
+// The visibility buffer keeps the draws of whole models, its gl_PrimitiveID counting the
+// triangles from the start of each draw.
+//
+bool HelloVulkan::clusterDraws() const
+{
+  return m_indirectRaster && m_gpuCulling && m_clusterCulling && m_drawIndirectCount && !m_visibilityBuffer;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Building the HiZ from the depth just rendered by rasterize(), after its render pass, for the
+// occlusion culling of the next frame
+//
+void HelloVulkan::buildHiz(const vk::CommandBuffer& cmdBuf)
+{
+  using vkPS = vk::PipelineStageFlagBits;
+  using vkA  = vk::AccessFlagBits;
+
+  if(cullPool())
+    cmdBuf.writeTimestamp(vkPS::eBottomOfPipe, cullPool(), 2);
+  m_hizValid = m_indirectRaster && m_gpuCulling && m_occlusionCulling;
+  if(m_hizValid)
+  {
+    m_debug.beginLabel(cmdBuf, "HiZ");
+    // Sampling the depth, once the culling of this frame read the previous HiZ
+    const vk::ImageSubresourceRange depthRange{vk::ImageAspectFlagBits::eDepth, 0, 1, 0, 1};
+    vk::ImageMemoryBarrier toSampled(vkA::eDepthStencilAttachmentWrite, vkA::eShaderRead,
+                                     vk::ImageLayout::eDepthStencilAttachmentOptimal,
+                                     vk::ImageLayout::eDepthStencilReadOnlyOptimal,
+                                     VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
+                                     m_offscreenDepth.image, depthRange);
+    cmdBuf.pipelineBarrier(vkPS::eLateFragmentTests | vkPS::eComputeShader, vkPS::eComputeShader,
+                           vk::DependencyFlags(), {}, {}, {toSampled});
+
+    cmdBuf.bindPipeline(vk::PipelineBindPoint::eCompute, m_hizPipeline);
+    for(uint32_t level = 0; level < static_cast<uint32_t>(m_hizLevelViews.size()); level++)
+    {
+      const int      pushLevel = static_cast<int>(level);
+      const uint32_t width     = std::max(1u, m_size.width >> level);
+      const uint32_t height    = std::max(1u, m_size.height >> level);
+      cmdBuf.bindDescriptorSets(vk::PipelineBindPoint::eCompute, m_hizPipelineLayout, 0,
+                                {m_hizDescSets[level]}, {});
+      cmdBuf.pushConstants<int>(m_hizPipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, pushLevel);
+      cmdBuf.dispatch((width + 15) / 16, (height + 15) / 16, 1);
+      // Read by the next level, and by the culling of the next frame
+      vk::MemoryBarrier levelBarrier(vkA::eShaderWrite, vkA::eShaderRead);
+      cmdBuf.pipelineBarrier(vkPS::eComputeShader, vkPS::eComputeShader, vk::DependencyFlags(),
+                             {levelBarrier}, {}, {});
+    }
+
+    vk::ImageMemoryBarrier toAttachment(
+        vk::AccessFlags(), vkA::eDepthStencilAttachmentRead | vkA::eDepthStencilAttachmentWrite,
+        vk::ImageLayout::eDepthStencilReadOnlyOptimal, vk::ImageLayout::eDepthStencilAttachmentOptimal,
+        VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, m_offscreenDepth.image, depthRange);
+    cmdBuf.pipelineBarrier(vkPS::eComputeShader, vkPS::eEarlyFragmentTests | vkPS::eLateFragmentTests,
+                           vk::DependencyFlags(), {}, {}, {toAttachment});
+    m_debug.endLabel(cmdBuf);
+  }
+  if(cullPool())
+    cmdBuf.writeTimestamp(vkPS::eBottomOfPipe, cullPool(), 3);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Hybrid rendering
+//////////////////////////////////////////////////////////////////////////
+
+//--------------------------------------------------------------------------------------------------
+// G-buffer of the size of the rendering, recreated with the offscreen images, and its render pass
+// sharing m_offscreenDepth. The attachments stay in the general layout, where the ray generation
+// shader reads them as storage images.
+//
+void HelloVulkan::createGBuffer()
+{
+  m_alloc.destroy(m_gbufferPosition);
+  m_alloc.destroy(m_gbufferNormal);
+  m_alloc.destroy(m_gbufferMaterial);
+
+  const std::vector<vk::Format> formats = {vk::Format::eR32G32B32A32Sfloat,
+                                           vk::Format::eR16G16B16A16Sfloat,
+                                           vk::Format::eR32G32B32A32Uint};
+  const vk::ImageUsageFlags     usage   = vk::ImageUsageFlagBits::eColorAttachment;
+  m_gbufferPosition = createStorageImage(formats[0], usage, "gbufferPosition");
+  m_gbufferNormal   = createStorageImage(formats[1], usage, "gbufferNormal");
+  m_gbufferMaterial = createStorageImage(formats[2], usage, "gbufferMaterial");
+
+  if(!m_gbufferRenderPass)
+  {
+    m_gbufferRenderPass =
+        nvvkpp::util::createRenderPass(m_device, formats, m_offscreenDepthFormat, 1, true, true,
+                                       vk::ImageLayout::eGeneral, vk::ImageLayout::eGeneral);
+  }
+
+  std::vector<vk::ImageView> attachments = {
+      m_gbufferPosition.descriptor.imageView, m_gbufferNormal.descriptor.imageView,
+      m_gbufferMaterial.descriptor.imageView, m_offscreenDepth.descriptor.imageView};
+
+  m_device.destroy(m_gbufferFramebuffer);
+  vk::FramebufferCreateInfo info;
+  info.setRenderPass(m_gbufferRenderPass);
+  info.setAttachmentCount(static_cast<uint32_t>(attachments.size()));
+  info.setPAttachments(attachments.data());
+  info.setWidth(m_size.width);
+  info.setHeight(m_size.height);
+  info.setLayers(1);
+  m_gbufferFramebuffer = m_device.createFramebuffer(info);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Rasterizing the primary surfaces into the G-buffer, before the ray generation shader of the
+// hybrid renderer. All the instances are drawn, the culling of the raster being left out: the
+// depth of the ray traced frames is not kept for the HiZ.
+//
+void HelloVulkan::rasterizeGBuffer(const vk::CommandBuffer& cmdBuf)
+{
+  m_debug.beginLabel(cmdBuf, "G-buffer");
+
+  // The ray generation shader of the previous frame read the G-buffer
+  cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eRayTracingShaderKHR,
+                         vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::DependencyFlags(),
+                         {}, {}, {});
+
+  // The background keeps w = 0 in the positions
+  vk::ClearValue clearValues[4];
+  clearValues[3].setDepthStencil({1.0f, 0});
+  vk::RenderPassBeginInfo beginInfo;
+  beginInfo.setClearValueCount(4);
+  beginInfo.setPClearValues(clearValues);
+  beginInfo.setRenderPass(m_gbufferRenderPass);
+  beginInfo.setFramebuffer(m_gbufferFramebuffer);
+  beginInfo.setRenderArea({{}, m_size});
+  cmdBuf.beginRenderPass(beginInfo, vk::SubpassContents::eInline);
+
+  cmdBuf.setViewport(0, {vk::Viewport(0, 0, (float)m_size.width, (float)m_size.height, 0, 1)});
+  cmdBuf.setScissor(0, {{{0, 0}, {m_size.width, m_size.height}}});
+  cmdBuf.bindPipeline(vk::PipelineBindPoint::eGraphics, m_gbufferPipeline);
+  drawInstances(cmdBuf, false);
+  cmdBuf.endRenderPass();
+
+  vk::MemoryBarrier barrier(vk::AccessFlagBits::eColorAttachmentWrite, vk::AccessFlagBits::eShaderRead);
+  cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eColorAttachmentOutput,
+                         vk::PipelineStageFlagBits::eRayTracingShaderKHR, vk::DependencyFlags(),
+                         {barrier}, {}, {});
+  m_debug.endLabel(cmdBuf);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Visibility buffer
+//////////////////////////////////////////////////////////////////////////
+
+//--------------------------------------------------------------------------------------------------
+// Descriptor set and compute pipeline of the resolve, and the pipeline statistics counting the
+// fragment shader invocations of both raster modes. The resolve reads the scene from the scene
+// descriptor set: the camera, the instances, the materials, the textures and the geometry.
+//
+void HelloVulkan::createVisibility()
+{
+  using vkDT   = vk::DescriptorType;
+  using vkSS   = vk::ShaderStageFlagBits;
+  using vkDSLB = vk::DescriptorSetLayoutBinding;
+
+  m_pipelineStatistics = m_physicalDevice.getFeatures().pipelineStatisticsQuery == VK_TRUE;
+  if(!m_visibilitySupported)
+    return;
+
+  // Visibility image and shaded image of shaders/visibility.comp
+  m_visibilityDescSetLayoutBind.emplace_back(vkDSLB(0, vkDT::eStorageImage, 1, vkSS::eCompute));
+  m_visibilityDescSetLayoutBind.emplace_back(vkDSLB(1, vkDT::eStorageImage, 1, vkSS::eCompute));
+  m_visibilityDescSetLayout =
+      nvvkpp::util::createDescriptorSetLayout(m_device, m_visibilityDescSetLayoutBind);
+  m_visibilityDescPool = nvvkpp::util::createDescriptorPool(m_device, m_visibilityDescSetLayoutBind, 1);
+  m_visibilityDescSet =
+      nvvkpp::util::createDescriptorSet(m_device, m_visibilityDescPool, m_visibilityDescSetLayout);
+  updateVisibilityDescriptorSet();
+
+  vk::DescriptorSetLayout setLayouts[] = {m_descSetLayout, m_visibilityDescSetLayout};
+  vk::PushConstantRange   pushConstants{vkSS::eCompute, 0, sizeof(VisibilityPushConstant)};
+  m_resolvePipelineLayout = m_device.createPipelineLayout({{}, 2, setLayouts, 1, &pushConstants});
+
+  vk::ComputePipelineCreateInfo pipelineInfo{{}, {}, m_resolvePipelineLayout};
+  pipelineInfo.stage = nvvkpp::util::loadShader(
+      m_device, nvvkpp::util::readFile("shaders/visibility.comp.spv"), vkSS::eCompute);
+  m_resolvePipeline = m_device.createComputePipelines({}, pipelineInfo, nullptr)[0];
+  m_device.destroy(pipelineInfo.stage.module);
+  m_debug.setObjectName(m_resolvePipeline, "resolve");
+}
+
+//--------------------------------------------------------------------------------------------------
+// Visibility image of the size of the rendering, recreated with the offscreen images, and its
+// render pass sharing m_offscreenDepth, so that the HiZ is built the same way in both raster modes
+//
+void HelloVulkan::createVisibilityImage()
+{
+  if(!m_visibilitySupported)
+    return;
+  m_alloc.destroy(m_visibilityImage);
+
+  const vk::Format format = vk::Format::eR32G32Uint;
+  m_visibilityImage = createStorageImage(format, vk::ImageUsageFlagBits::eColorAttachment, "visibility");
+
+  if(!m_visibilityRenderPass)
+  {
+    m_visibilityRenderPass =
+        nvvkpp::util::createRenderPass(m_device, {format}, m_offscreenDepthFormat, 1, true, true,
+                                       vk::ImageLayout::eGeneral, vk::ImageLayout::eGeneral);
+  }
+
+  std::vector<vk::ImageView> attachments = {m_visibilityImage.descriptor.imageView,
+                                            m_offscreenDepth.descriptor.imageView};
+
+  m_device.destroy(m_visibilityFramebuffer);
+  vk::FramebufferCreateInfo info;
+  info.setRenderPass(m_visibilityRenderPass);
+  info.setAttachmentCount(2);
+  info.setPAttachments(attachments.data());
+  info.setWidth(m_size.width);
+  info.setHeight(m_size.height);
+  info.setLayers(1);
+  m_visibilityFramebuffer = m_device.createFramebuffer(info);
+}
+
+void HelloVulkan::updateVisibilityDescriptorSet()
+{
+  if(!m_visibilityDescSet)
+    return;
+  using vkDT = vk::DescriptorType;
+  std::vector<vk::WriteDescriptorSet> wds;
+  wds.emplace_back(m_visibilityDescSet, 0, 0, 1, vkDT::eStorageImage, &m_visibilityImage.descriptor);
+  wds.emplace_back(m_visibilityDescSet, 1, 0, 1, vkDT::eStorageImage, &m_offscreenColor.descriptor);
+  m_device.updateDescriptorSets(wds, nullptr);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Rasterizing the visibility buffer with the draws of rasterize(), then shading each pixel once
+// into m_offscreenColor, where the forward raster writes
+//
+void HelloVulkan::rasterizeVisibility(const vk::CommandBuffer& cmdBuf, const glm::vec4& clearColor)
+{
+  using vkPS = vk::PipelineStageFlagBits;
+  using vkA  = vk::AccessFlagBits;
+
+  // The resolve of the previous frame read the visibility image
+  cmdBuf.pipelineBarrier(vkPS::eComputeShader, vkPS::eColorAttachmentOutput, vk::DependencyFlags(),
+                         {}, {}, {});
+
+  // The background keeps the instance 0
+  vk::ClearValue clearValues[2];
+  clearValues[1].setDepthStencil({1.0f, 0});
+  vk::RenderPassBeginInfo beginInfo;
+  beginInfo.setClearValueCount(2);
+  beginInfo.setPClearValues(clearValues);
+  beginInfo.setRenderPass(m_visibilityRenderPass);
+  beginInfo.setFramebuffer(m_visibilityFramebuffer);
+  beginInfo.setRenderArea({{}, m_size});
+  if(m_parallelRecording)
+  {
+    rasterizeParallel(cmdBuf, beginInfo);
+  }
+  else
+  {
+    cmdBuf.beginRenderPass(beginInfo, vk::SubpassContents::eInline);
+    rasterize(cmdBuf);
+    cmdBuf.endRenderPass();
+  }
+
+  m_debug.beginLabel(cmdBuf, "Resolve");
+  // Reading the visibility image, and overwriting the image shown by the previous frame
+  vk::MemoryBarrier toResolve(vkA::eColorAttachmentWrite, vkA::eShaderRead);
+  cmdBuf.pipelineBarrier(vkPS::eColorAttachmentOutput | vkPS::eFragmentShader | vkPS::eComputeShader,
+                         vkPS::eComputeShader, vk::DependencyFlags(), {toResolve}, {}, {});
+
+  VisibilityPushConstant pushConstant;
+  pushConstant.clearColor     = clearColor;
+  pushConstant.lightPosition  = m_pushConstant.lightPosition;
+  pushConstant.lightIntensity = m_pushConstant.lightIntensity;
+  pushConstant.lightType      = m_pushConstant.lightType;
+  cmdBuf.bindPipeline(vk::PipelineBindPoint::eCompute, m_resolvePipeline);
+  cmdBuf.bindDescriptorSets(vk::PipelineBindPoint::eCompute, m_resolvePipelineLayout, 0,
+                            {m_descSet, m_visibilityDescSet}, {});
+  cmdBuf.pushConstants<VisibilityPushConstant>(m_resolvePipelineLayout,
+                                               vk::ShaderStageFlagBits::eCompute, 0, pushConstant);
+  cmdBuf.dispatch((m_size.width + 15) / 16, (m_size.height + 15) / 16, 1);
+
+  // Read by the upscaler or the post-process
+  vk::MemoryBarrier toPost(vkA::eShaderWrite, vkA::eShaderRead);
+  cmdBuf.pipelineBarrier(vkPS::eComputeShader, vkPS::eComputeShader | vkPS::eFragmentShader,
+                         vk::DependencyFlags(), {toPost}, {}, {});
+  m_debug.endLabel(cmdBuf);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Parallel recording
+//////////////////////////////////////////////////////////////////////////
+
+//--------------------------------------------------------------------------------------------------
+// Threads recording the secondary command buffers, one per core up to 16, the main thread being
+// the first one. Their command pools are created for each swapchain image when first recorded.
+//
+void HelloVulkan::createRecorder()
+{
+  const uint32_t threads = std::min(std::max(std::thread::hardware_concurrency(), 1u), 16u);
+  m_jobPool.reset(new JobPool(threads));
+  m_recordPools.resize(threads);
+  m_threadRecordTimes.assign(threads, 0.f);
+  m_threadCommandBuffers.assign(threads, 0);
+  m_recordThreads    = static_cast<int>(threads);
+  m_inheritedQueries = m_physicalDevice.getFeatures().inheritedQueries == VK_TRUE;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Resetting the command pools of the swapchain image, once its previous frame is done: after
+// AppBase::prepareFrame waited for its fence
+//
+void HelloVulkan::beginRecording(uint32_t frame)
+{
+  m_recordFrame = frame;
+  for(auto& pools : m_recordPools)
+  {
+    while(pools.size() <= frame)
+    {
+      RecordPool pool;
+      pool.pool = m_device.createCommandPool({{}, m_queueIndex});
+      pools.push_back(pool);
+    }
+    m_device.resetCommandPool(pools[frame].pool, {});
+    pools[frame].used = 0;
+  }
+  std::fill(m_threadRecordTimes.begin(), m_threadRecordTimes.end(), 0.f);
+  std::fill(m_threadCommandBuffers.begin(), m_threadCommandBuffers.end(), 0);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Recording each job into a secondary command buffer continuing the render pass of `inheritance`,
+// on the first m_recordThreads threads. The command buffers are returned in the order of the jobs,
+// to be executed by the primary command buffer.
+//
+std::vector<vk::CommandBuffer> HelloVulkan::recordSecondaries(const std::vector<RecordJob>& jobs,
+                                                              const vk::CommandBufferInheritanceInfo& inheritance)
+{
+  std::vector<vk::CommandBuffer> secondaries(jobs.size());
+
+  auto record = [&](uint32_t job, uint32_t thread) {
+    RecordPool& pool = m_recordPools[thread][m_recordFrame];
+    if(pool.used == pool.buffers.size())
+    {
+      pool.buffers.push_back(
+          m_device.allocateCommandBuffers({pool.pool, vk::CommandBufferLevel::eSecondary, 1})[0]);
+    }
+    const vk::CommandBuffer cmdBuf = pool.buffers[pool.used++];
+    cmdBuf.begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit
+                      | vk::CommandBufferUsageFlagBits::eRenderPassContinue,
+                  &inheritance});
+    jobs[job](cmdBuf);
+    cmdBuf.end();
+    secondaries[job] = cmdBuf;
+  };
+  m_jobPool->run(static_cast<uint32_t>(jobs.size()), record, static_cast<uint32_t>(m_recordThreads));
+
+  for(uint32_t t = 0; t < m_jobPool->threadCount(); t++)
+  {
+    m_threadRecordTimes[t] += m_jobPool->busyTimes()[t];
+    m_threadCommandBuffers[t] += m_jobPool->jobCounts()[t];
+  }
+  return secondaries;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Same as rasterize() in the render pass of `beginInfo`, the draws being split in one range per
+// recording thread. The draws counted on the device are a single call, recorded by one thread.
+//
+void HelloVulkan::rasterizeParallel(const vk::CommandBuffer& cmdBuf, const vk::RenderPassBeginInfo& beginInfo)
+{
+  const auto start = std::chrono::high_resolution_clock::now();
+
+  const bool     culled    = m_indirectRaster && m_gpuCulling;
+  const uint32_t drawCount = static_cast<uint32_t>(m_objInstance.size());
+  const uint32_t ranges =
+      culled && m_drawIndirectCount ? 1 : std::min(static_cast<uint32_t>(m_recordThreads), std::max(drawCount, 1u));
+  std::vector<RecordJob> jobs;
+  for(uint32_t r = 0; r < ranges; r++)
+  {
+    const uint32_t first = static_cast<uint32_t>(uint64_t(drawCount) * r / ranges);
+    const uint32_t last  = static_cast<uint32_t>(uint64_t(drawCount) * (r + 1) / ranges);
+    jobs.emplace_back([this, first, last](const vk::CommandBuffer& secondary) {
+      rasterizeRange(secondary, first, last - first);
+    });
+  }
+
+  // Fragment shader invocations counted by the primary command buffer, around the render pass
+  // where only the secondary command buffers can be executed
+  const vk::QueryPool fragments = m_inheritedQueries ? fragmentPool() : vk::QueryPool();
+  const bool          counted   = fragments;
+  vk::CommandBufferInheritanceInfo inheritance{beginInfo.renderPass, 0, beginInfo.framebuffer};
+  if(counted)
+    inheritance.setPipelineStatistics(vk::QueryPipelineStatisticFlagBits::eFragmentShaderInvocations);
+  const std::vector<vk::CommandBuffer> secondaries = recordSecondaries(jobs, inheritance);
+
+  m_debug.beginLabel(cmdBuf, "Rasterize");
+  if(counted)
+    cmdBuf.beginQuery(fragments, 0, vk::QueryControlFlags());
+  cmdBuf.beginRenderPass(beginInfo, vk::SubpassContents::eSecondaryCommandBuffers);
+  cmdBuf.executeCommands(secondaries);
+  cmdBuf.endRenderPass();
+  if(counted)
+    cmdBuf.endQuery(fragments, 0);
+  m_debug.endLabel(cmdBuf);
+
+  const std::chrono::duration<float, std::micro> elapsed =
+      std::chrono::high_resolution_clock::now() - start;
+  m_rasterRecordTime = elapsed.count();
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Wavefront path tracer
+//////////////////////////////////////////////////////////////////////////
+
+//--------------------------------------------------------------------------------------------------
+// Queues, descriptor set and compute kernels of the wavefront path tracer, and timestamps of the
+// path tracers. Without ray queries, the extend and shadow stages are ray generation shaders, see
+// createWavefrontTracePipeline.
+//
+void HelloVulkan::createWavefront()
+{
+  using vkDT   = vk::DescriptorType;
+  using vkSS   = vk::ShaderStageFlagBits;
+  using vkDSLB = vk::DescriptorSetLayoutBinding;
+  using vkBU   = vk::BufferUsageFlagBits;
+
+  const vk::PhysicalDeviceLimits limits = m_physicalDevice.getProperties().limits;
+  if(limits.timestampComputeAndGraphics)
+    m_timestampPeriod = limits.timestampPeriod;
+
+  // Counters of the queues, copied after each bounce of the first sample for the statistics
+  const vk::DeviceSize countersSize = WF_QUEUE_COUNT * WF_COUNTER_SIZE * sizeof(uint32_t);
+  const uint32_t       bounces      = shading::kMaxBounces + 1;
+  m_wavefrontCounters = m_alloc.createBuffer(countersSize, vkBU::eStorageBuffer | vkBU::eIndirectBuffer
+                                                               | vkBU::eTransferSrc | vkBU::eTransferDst);
+  m_debug.setObjectName(m_wavefrontCounters.buffer, "wavefrontCounters");
+  m_wavefrontOccupancy.assign(bounces * WF_QUEUE_COUNT, 0);
+  createWavefrontBuffers();
+
+  // Bindings of shaders/wf_queues.glsl: TLAS, image, statistics, lights, counters, then the arrays
+  const vk::ShaderStageFlags stages = vkSS::eCompute | vkSS::eRaygenKHR;
+  m_wavefrontDescSetLayoutBind.emplace_back(vkDSLB(0, vkDT::eAccelerationStructureKHR, 1, stages));
+  m_wavefrontDescSetLayoutBind.emplace_back(vkDSLB(1, vkDT::eStorageImage, 1, stages));
+  m_wavefrontDescSetLayoutBind.emplace_back(vkDSLB(2, vkDT::eStorageImage, 1, stages));
+  const uint32_t bindingCount = 5 + static_cast<uint32_t>(m_wavefrontArrays.size());
+  for(uint32_t binding = 3; binding < bindingCount; binding++)
+    m_wavefrontDescSetLayoutBind.emplace_back(vkDSLB(binding, vkDT::eStorageBuffer, 1, stages));
+  m_wavefrontDescPool = nvvkpp::util::createDescriptorPool(m_device, m_wavefrontDescSetLayoutBind);
+  m_wavefrontDescSetLayout =
+      nvvkpp::util::createDescriptorSetLayout(m_device, m_wavefrontDescSetLayoutBind);
+  m_wavefrontDescSet =
+      nvvkpp::util::createDescriptorSet(m_device, m_wavefrontDescPool, m_wavefrontDescSetLayout);
+  updateWavefrontDescriptorSet();
+
+  // All the kernels share the layout, the scene being the set 1 as in the ray tracing pipeline
+  std::vector<vk::DescriptorSetLayout> layouts = {m_wavefrontDescSetLayout, m_descSetLayout};
+  vk::PushConstantRange        pushConstant{stages, 0, sizeof(WavefrontPushConstant)};
+  vk::PipelineLayoutCreateInfo layoutInfo{{}, static_cast<uint32_t>(layouts.size()), layouts.data(),
+                                          1, &pushConstant};
+  m_wavefrontPipelineLayout = m_device.createPipelineLayout(layoutInfo);
+
+  const char* shaders[eWfKernelCount] = {"shaders/wf_generate.comp.spv", "shaders/wf_extend.comp.spv",
+                                         "shaders/wf_miss.comp.spv",     "shaders/wf_diffuse.comp.spv",
+                                         "shaders/wf_shadow.comp.spv",   "shaders/wf_accumulate.comp.spv"};
+  vk::ComputePipelineCreateInfo pipelineInfo{{}, {}, m_wavefrontPipelineLayout};
+  for(int k = 0; k < eWfKernelCount; k++)
+  {
+    if(!m_wavefrontRayQuery && (k == eWfExtend || k == eWfShadow))
+      continue;
+    pipelineInfo.stage =
+        nvvkpp::util::loadShader(m_device, nvvkpp::util::readFile(shaders[k]), vkSS::eCompute);
+    m_wavefrontPipelines[k] = m_device.createComputePipelines({}, pipelineInfo, nullptr)[0];
+    m_device.destroy(pipelineInfo.stage.module);
+    m_debug.setObjectName(m_wavefrontPipelines[k], shaders[k]);
+  }
+  if(!m_wavefrontRayQuery)
+    createWavefrontTracePipeline();
+}
+
+//--------------------------------------------------------------------------------------------------
+// Extend and shadow stages of the wavefront path tracer on the devices without ray queries, such
+// as the software drivers: a ray tracing pipeline with one ray generation shader per stage, sharing
+// the layout of the compute kernels, and its shader binding table
+// - Groups: the two ray generation shaders, the two miss shaders, and the closest hit of the
+//   extend stage, repeated for each hit group the TLAS instances can select
+// - traceRaysKHR has no indirect launch without rayTracingPipelineTraceRaysIndirect, so the stages
+//   are launched over the whole image and the threads past the end of the queue return at once
+//
+void HelloVulkan::createWavefrontTracePipeline()
+{
+  using vkSS = vk::ShaderStageFlagBits;
+
+  const char* files[] = {"shaders/wf_extend.rgen.spv", "shaders/wf_shadow.rgen.spv",
+                         "shaders/wf_extend.rmiss.spv", "shaders/raytraceShadow.rmiss.spv",
+                         "shaders/wf_extend.rchit.spv"};
+  const vkSS  types[] = {vkSS::eRaygenKHR, vkSS::eRaygenKHR, vkSS::eMissKHR, vkSS::eMissKHR,
+                        vkSS::eClosestHitKHR};
+  std::vector<vk::PipelineShaderStageCreateInfo>      stages;
+  std::vector<vk::RayTracingShaderGroupCreateInfoKHR> groups;
+  for(uint32_t i = 0; i < 5; i++)
+  {
+    stages.push_back(nvvkpp::util::loadShader(m_device, nvvkpp::util::readFile(files[i]), types[i]));
+    vk::RayTracingShaderGroupCreateInfoKHR group{vk::RayTracingShaderGroupTypeKHR::eGeneral,
+                                                 VK_SHADER_UNUSED_KHR, VK_SHADER_UNUSED_KHR,
+                                                 VK_SHADER_UNUSED_KHR, VK_SHADER_UNUSED_KHR};
+    if(types[i] == vkSS::eClosestHitKHR)
+    {
+      group.setType(vk::RayTracingShaderGroupTypeKHR::eTrianglesHitGroup);
+      group.setClosestHitShader(i);
+    }
+    else
+      group.setGeneralShader(i);
+    groups.push_back(group);
+  }
+
+  vk::RayTracingPipelineCreateInfoKHR pipelineInfo;
+  pipelineInfo.setStageCount(static_cast<uint32_t>(stages.size()));
+  pipelineInfo.setPStages(stages.data());
+  pipelineInfo.setGroupCount(static_cast<uint32_t>(groups.size()));
+  pipelineInfo.setPGroups(groups.data());
+  pipelineInfo.setMaxPipelineRayRecursionDepth(1);
+  pipelineInfo.setLayout(m_wavefrontPipelineLayout);
+  m_wavefrontTracePipeline = m_device.createRayTracingPipelineKHR({}, {}, pipelineInfo).value;
+  m_debug.setObjectName(m_wavefrontTracePipeline, "wavefrontTrace");
+  for(auto& stage : stages)
+    m_device.destroy(stage.module);
+
+  // Shader binding table, laid out like the one of createRtShaderBindingTable
+  const uint32_t       handleSize = m_rtProperties.shaderGroupHandleSize;
+  const uint32_t       groupCount = static_cast<uint32_t>(groups.size());
+  std::vector<uint8_t> handles(groupCount * handleSize);
+  m_device.getRayTracingShaderGroupHandlesKHR(m_wavefrontTracePipeline, 0, groupCount,
+                                              handles.size(), handles.data());
+  const uint32_t handleStride =
+      nvvkpp::util::align_up(handleSize, m_rtProperties.shaderGroupHandleAlignment);
+  const uint32_t baseAlignment = m_rtProperties.shaderGroupBaseAlignment;
+  const uint32_t rgenSize      = nvvkpp::util::align_up(handleStride, baseAlignment);
+  for(auto& region : m_wavefrontRgenRegions)
+    region = vk::StridedDeviceAddressRegionKHR(0, rgenSize, rgenSize);
+  m_wavefrontMissRegion = vk::StridedDeviceAddressRegionKHR(
+      0, handleStride, nvvkpp::util::align_up(2 * handleStride, baseAlignment));
+  m_wavefrontHitRegion = vk::StridedDeviceAddressRegionKHR(
+      0, handleStride, nvvkpp::util::align_up(HIT_GROUP_COUNT * handleStride, baseAlignment));
+
+  const vk::DeviceSize sbtSize = 2 * rgenSize + m_wavefrontMissRegion.size + m_wavefrontHitRegion.size;
+  m_wavefrontSBTBuffer = m_alloc.createBuffer(sbtSize,
+                                              vk::BufferUsageFlagBits::eShaderBindingTableKHR
+                                                  | vk::BufferUsageFlagBits::eShaderDeviceAddress,
+                                              vk::MemoryPropertyFlagBits::eHostVisible
+                                                  | vk::MemoryPropertyFlagBits::eHostCoherent);
+  m_debug.setObjectName(m_wavefrontSBTBuffer.buffer, "wavefrontSBT");
+
+  auto*    sbt       = reinterpret_cast<uint8_t*>(m_alloc.map(m_wavefrontSBTBuffer));
+  auto     getHandle = [&](uint32_t i) { return handles.data() + i * handleSize; };
+  uint8_t* miss      = sbt + 2 * rgenSize;
+  uint8_t* hit       = miss + m_wavefrontMissRegion.size;
+  memcpy(sbt, getHandle(0), handleSize);
+  memcpy(sbt + rgenSize, getHandle(1), handleSize);
+  memcpy(miss, getHandle(2), handleSize);
+  memcpy(miss + handleStride, getHandle(3), handleSize);
+  for(uint32_t h = 0; h < HIT_GROUP_COUNT; h++)
+    memcpy(hit + h * handleStride, getHandle(4), handleSize);
+  m_alloc.unmap(m_wavefrontSBTBuffer);
+
+  const vk::DeviceAddress address = m_device.getBufferAddress({m_wavefrontSBTBuffer.buffer});
+  m_wavefrontRgenRegions[0].setDeviceAddress(address);
+  m_wavefrontRgenRegions[1].setDeviceAddress(address + rgenSize);
+  m_wavefrontMissRegion.setDeviceAddress(address + 2 * rgenSize);
+  m_wavefrontHitRegion.setDeviceAddress(address + 2 * rgenSize + m_wavefrontMissRegion.size);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Arrays of the queues, one entry per pixel, in a single buffer
+// - Required when changing resolution
+//
+void HelloVulkan::createWavefrontBuffers()
+{
+  // Bytes per pixel of the arrays of the bindings 5 to 15: the two ray queues, the hits, the
+  // material class queues, the shadow rays and the radiance of the pixels
+  const vk::DeviceSize arrayBytes[] = {2 * 16, 2 * 16, 2 * 16, 2 * 8, 16, 8, 2 * 4, 16, 16, 16, 16};
+  const vk::DeviceSize alignment =
+      m_physicalDevice.getProperties().limits.minStorageBufferOffsetAlignment;
+  const vk::DeviceSize pixels = vk::DeviceSize(m_size.width) * m_size.height;
+
+  m_alloc.destroy(m_wavefrontBuffer);
+  m_wavefrontArrays.clear();
+  vk::DeviceSize size = 0;
+  for(vk::DeviceSize bytes : arrayBytes)
+  {
+    m_wavefrontArrays.emplace_back(vk::Buffer(), size, bytes * pixels);
+    size += (bytes * pixels + alignment - 1) / alignment * alignment;
+  }
+  m_wavefrontBuffer = m_alloc.createBuffer(size, vk::BufferUsageFlagBits::eStorageBuffer);
+  m_debug.setObjectName(m_wavefrontBuffer.buffer, "wavefrontQueues");
+  for(auto& array : m_wavefrontArrays)
+    array.buffer = m_wavefrontBuffer.buffer;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Writes the images and the arrays of the queues to the descriptor set
+// - Required when changing resolution
+//
+void HelloVulkan::updateWavefrontDescriptorSet()
+{
+  vk::WriteDescriptorSetAccelerationStructureKHR descASInfo;
+  descASInfo.setAccelerationStructureCount(1);
+  descASInfo.setPAccelerationStructures(&m_rtBuilder.getAccelerationStructure());
+  vk::DescriptorImageInfo imageInfo{
+      {}, m_offscreenColor.descriptor.imageView, vk::ImageLayout::eGeneral};
+  vk::DescriptorImageInfo varianceInfo{
+      {}, m_varianceImage.descriptor.imageView, vk::ImageLayout::eGeneral};
+  vk::DescriptorBufferInfo lightsInfo{m_lightBuffer.buffer, 0, VK_WHOLE_SIZE};
+  vk::DescriptorBufferInfo countersInfo{m_wavefrontCounters.buffer, 0, VK_WHOLE_SIZE};
+
+  const auto&                         binds = m_wavefrontDescSetLayoutBind;
+  std::vector<vk::WriteDescriptorSet> writes;
+  writes.emplace_back(nvvkpp::util::createWrite(m_wavefrontDescSet, binds[0], &descASInfo));
+  writes.emplace_back(nvvkpp::util::createWrite(m_wavefrontDescSet, binds[1], &imageInfo));
+  writes.emplace_back(nvvkpp::util::createWrite(m_wavefrontDescSet, binds[2], &varianceInfo));
+  writes.emplace_back(nvvkpp::util::createWrite(m_wavefrontDescSet, binds[3], &lightsInfo));
+  writes.emplace_back(nvvkpp::util::createWrite(m_wavefrontDescSet, binds[4], &countersInfo));
+  for(size_t i = 0; i < m_wavefrontArrays.size(); i++)
+    writes.emplace_back(
+        nvvkpp::util::createWrite(m_wavefrontDescSet, binds[5 + i], &m_wavefrontArrays[i]));
+  m_device.updateDescriptorSets(writes, nullptr);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Path tracing the frame with the compute kernels, into the same images as raytrace(). For each
+// sample, the camera rays are generated, then each bounce extends the paths of one ray queue,
+// shades them by material class into the shadow queue and the other ray queue, and traces the
+// shadow rays. The stages consuming a queue are dispatched indirectly with its workgroup count,
+// except the extend and shadow stages of the ray tracing pipeline, launched over the whole image.
+//
+void HelloVulkan::wavefrontTrace(const vk::CommandBuffer& cmdBuf, const glm::vec4& clearColor)
+{
+  using vkPS = vk::PipelineStageFlagBits;
+  using vkA  = vk::AccessFlagBits;
+
+  // No reprojection: a camera move restarts the accumulation
+  updateFrame();
+  if(m_rtPushConstants.reproject != 0)
+  {
+    m_rtPushConstants.frameCounter = 0;
+    m_rtPushConstants.reproject    = 0;
+  }
+
+  m_debug.beginLabel(cmdBuf, "Wavefront path trace");
+  auto barrier = [&]() {
+    vk::MemoryBarrier memoryBarrier(vkA::eShaderWrite | vkA::eTransferWrite,
+                                    vkA::eShaderRead | vkA::eShaderWrite | vkA::eIndirectCommandRead
+                                        | vkA::eTransferRead | vkA::eTransferWrite);
+    cmdBuf.pipelineBarrier(vkPS::eComputeShader | vkPS::eRayTracingShaderKHR | vkPS::eTransfer
+                               | vkPS::eFragmentShader,
+                           vkPS::eComputeShader | vkPS::eRayTracingShaderKHR | vkPS::eDrawIndirect
+                               | vkPS::eTransfer,
+                           vk::DependencyFlags(), {memoryBarrier}, {}, {});
+  };
+  const uint32_t     emptyQueue[WF_COUNTER_SIZE] = {0, 0, 1, 1};  // No entry, no workgroup
+  const vk::DeviceSize counterSize               = sizeof(emptyQueue);
+  auto resetQueue = [&](int queue) {
+    cmdBuf.updateBuffer(m_wavefrontCounters.buffer, queue * counterSize, counterSize, emptyQueue);
+  };
+
+  WavefrontPushConstant pushConstant;
+  pushConstant.clearColor      = clearColor;
+  pushConstant.frameCounter    = m_rtPushConstants.frameCounter;
+  pushConstant.samplesPerPixel = m_samplesPerPixel;
+  pushConstant.lightCount      = m_rtPushConstants.lightCount;
+  pushConstant.pathCapacity    = m_size.width * m_size.height;
+  // One thread per pixel, or one per entry of a queue
+  const vk::ShaderStageFlags stages = vk::ShaderStageFlagBits::eCompute | vk::ShaderStageFlagBits::eRaygenKHR;
+  auto dispatch = [&](WavefrontKernel kernel, int queue) {
+    if(!m_wavefrontRayQuery && (kernel == eWfExtend || kernel == eWfShadow))
+    {
+      cmdBuf.bindPipeline(vk::PipelineBindPoint::eRayTracingKHR, m_wavefrontTracePipeline);
+      cmdBuf.pushConstants<WavefrontPushConstant>(m_wavefrontPipelineLayout, stages, 0, pushConstant);
+      cmdBuf.traceRaysKHR(m_wavefrontRgenRegions[kernel == eWfExtend ? 0 : 1], m_wavefrontMissRegion,
+                          m_wavefrontHitRegion, vk::StridedDeviceAddressRegionKHR(), m_size.width,
+                          m_size.height, 1);
+      writeTimestamp(cmdBuf, kernel);
+      return;
+    }
+    cmdBuf.bindPipeline(vk::PipelineBindPoint::eCompute, m_wavefrontPipelines[kernel]);
+    cmdBuf.pushConstants<WavefrontPushConstant>(m_wavefrontPipelineLayout, stages, 0, pushConstant);
+    if(queue < 0)
+      cmdBuf.dispatch((pushConstant.pathCapacity + WF_GROUP_SIZE - 1) / WF_GROUP_SIZE, 1, 1);
+    else
+      cmdBuf.dispatchIndirect(m_wavefrontCounters.buffer, queue * counterSize + sizeof(uint32_t));
+    writeTimestamp(cmdBuf, kernel);
+  };
+
+  cmdBuf.bindDescriptorSets(vk::PipelineBindPoint::eCompute, m_wavefrontPipelineLayout, 0,
+                            {m_wavefrontDescSet, m_descSet}, {});
+  if(!m_wavefrontRayQuery)
+    cmdBuf.bindDescriptorSets(vk::PipelineBindPoint::eRayTracingKHR, m_wavefrontPipelineLayout, 0,
+                              {m_wavefrontDescSet, m_descSet}, {});
+  beginTimestamps(cmdBuf);
+  for(int sample = 0; sample < m_samplesPerPixel; sample++)
+  {
+    pushConstant.sampleIndex = sample;
+    pushConstant.bounce      = 0;
+    barrier();
+    resetQueue(WF_QUEUE_RAY0);
+    barrier();
+    dispatch(eWfGenerate, -1);
+
+    for(int bounce = 0; bounce <= shading::kMaxBounces; bounce++)
+    {
+      // The queues filled by this bounce start empty
+      pushConstant.bounce = bounce;
+      barrier();
+      resetQueue(WF_QUEUE_RAY0 + (bounce + 1) % 2);
+      resetQueue(WF_QUEUE_MISS);
+      resetQueue(WF_QUEUE_DIFFUSE);
+      resetQueue(WF_QUEUE_SHADOW);
+      barrier();
+      dispatch(eWfExtend, WF_QUEUE_RAY0 + bounce % 2);
+      barrier();
+      // The material classes have different paths: no barrier between them
+      dispatch(eWfMiss, WF_QUEUE_MISS);
+      dispatch(eWfDiffuse, WF_QUEUE_DIFFUSE);
+      barrier();
+      dispatch(eWfShadow, WF_QUEUE_SHADOW);
+
+      if(sample == 0)
+      {
+        barrier();
+        cmdBuf.copyBuffer(m_wavefrontCounters.buffer, m_wavefrontReadbacks[m_frame].buffer,
+                          vk::BufferCopy(0, bounce * WF_QUEUE_COUNT * counterSize,
+                                         WF_QUEUE_COUNT * counterSize));
+        m_wavefrontCopied[m_frame] = true;
+      }
+    }
+    barrier();
+    dispatch(eWfAccumulate, -1);
+  }
+
+  // The post-process reads the image
+  vk::MemoryBarrier imageBarrier(vkA::eShaderWrite, vkA::eShaderRead | vkA::eShaderWrite);
+  cmdBuf.pipelineBarrier(vkPS::eComputeShader, vkPS::eFragmentShader | vkPS::eComputeShader,
+                         vk::DependencyFlags(), {imageBarrier}, {}, {});
+  m_debug.endLabel(cmdBuf);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Starting the timestamps of a frame, each writeTimestamp then closes the interval of a kernel.
+// Timestamps of one frame: 1 + (2 + 4 * (kMaxBounces + 1)) per sample.
+//
+void HelloVulkan::beginTimestamps(const vk::CommandBuffer& cmdBuf)
+{
+  if(m_frame >= m_timestampPools.size() || !m_gpuTimings)
+    return;
+  m_timestampKernels[m_frame].clear();
+  cmdBuf.resetQueryPool(m_timestampPools[m_frame], 0, kMaxTimestamps);
+  cmdBuf.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, m_timestampPools[m_frame], 0);
+  m_timestampKernels[m_frame].push_back(-1);
+}
+
+void HelloVulkan::writeTimestamp(const vk::CommandBuffer& cmdBuf, int kernel)
+{
+  if(m_frame >= m_timestampPools.size())
+    return;
+  std::vector<int>& kernels = m_timestampKernels[m_frame];
+  const uint32_t    query   = static_cast<uint32_t>(kernels.size());
+  if(query == 0 || query >= kMaxTimestamps)
+    return;
+  cmdBuf.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, m_timestampPools[m_frame], query);
+  kernels.push_back(kernel);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Time of each kernel in the last frame of swapchain image `frame`, without waiting for it: when
+// the queries are not available, the previous values are kept
+//
+void HelloVulkan::readTimestamps(uint32_t frame)
+{
+  std::vector<int>& kernels = m_timestampKernels[frame];
+  const uint32_t    count   = static_cast<uint32_t>(kernels.size());
+  if(count < 2)
+    return;
+  std::vector<uint64_t> ticks(count);
+  vk::Result result = m_device.getQueryPoolResults(m_timestampPools[frame], 0, count,
+                                                   ticks.size() * sizeof(uint64_t), ticks.data(),
+                                                   sizeof(uint64_t), vk::QueryResultFlagBits::e64);
+  if(result != vk::Result::eSuccess)
+  {
+    kernels.clear();
+    return;
+  }
+
+  float wavefrontTimes[eWfKernelCount] = {};
+  for(uint32_t q = 1; q < count; q++)
+  {
+    const float ms = float(ticks[q] - ticks[q - 1]) * m_timestampPeriod * 1e-6f;
+    if(kernels[q] == kGBufferTimestamp)
+      m_gbufferTime = ms;
+    else if(kernels[q] < 0)
+      m_megakernelTime = ms;
+    else
+      wavefrontTimes[kernels[q]] += ms;
+  }
+  if(kernels[1] >= 0)
+    std::copy(std::begin(wavefrontTimes), std::end(wavefrontTimes), m_wavefrontTimes);
+  else if(kernels[1] == kGBufferTimestamp)
+    m_hybridRtTime = m_megakernelTime;
+  else
+    m_fullRtTime = m_megakernelTime;
+  kernels.clear();
 }
 
 void HelloVulkan::animationInstances(float time)
@@ -961,7 +3622,7 @@ void HelloVulkan::animationObject(float time)
 {
     ObjModel& model = m_objModel[2];
 
-    updateCompDescriptors(model.vertexBuffer);
+    updateCompDescriptors(model);
 
     nvvkpp::SingleCommandBuffer genCmdBuf(m_device, m_queueIndex);
     vk::CommandBuffer           cmdBuf = genCmdBuf.createCommandBuffer();
@@ -988,10 +3649,11 @@ void HelloVulkan::createCompDesciprotrs()
     m_compDescSet = nvvkpp::util::createDescriptorSet(m_device, m_compDescPool, m_compDescSetLayout);
 }
 
-void HelloVulkan::updateCompDescriptors(nvvkBuffer& vertex)
+void HelloVulkan::updateCompDescriptors(const ObjModel& model)
 {
     std::vector<vk::WriteDescriptorSet> writes;
-    vk::DescriptorBufferInfo            dbiUnif{ vertex.buffer, 0, VK_WHOLE_SIZE };
+    vk::DescriptorBufferInfo            dbiUnif{ m_vertexBuffer.buffer, model.firstVertex * sizeof(Vertex),
+                                                 model.nbVertices * sizeof(Vertex) };
     writes.emplace_back(
         nvvkpp::util::createWrite(m_compDescSet, m_compDescSetLayoutBind[0], &dbiUnif));
     m_device.updateDescriptorSets(static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
@@ -43,6 +43,12 @@ using nvvkTexture = nvvkpp::TextureDma;
 
 #include "raytrace_vkpp.hpp"
 #include "debug_util_vkpp.hpp"
+#include "job_pool.h"
+#include "mesh_clusters.h"
+#include "shaders/host_device.h"
+
+struct Vertex;
+struct MatrialObj;
 
 //--------------------------------------------------------------------------------------------------
 // Simple rasterizer of OBJ objects
@@ -62,18 +68,28 @@ public:
   void createGraphicsPipeline(const vk::RenderPass& renderPass);
 
   void loadModel(const std::string& filename, glm::mat4 transform = glm::mat4(1));
-  uint32_t loadObject(const std::string& filename);
+  uint32_t loadObject(const std::string& filename, uint32_t maxLodLevels = 1);
   void addInstance(uint32_t objIndex, glm::mat4 transform = glm::mat4(1));
+  void addObjModel(const vk::CommandBuffer&       cmdBuf,
+                   const std::vector<Vertex>&     vertices,
+                   const std::vector<uint32_t>&   indices,
+                   const std::vector<MatrialObj>& materials,
+                   uint32_t                       lodBase,
+                   uint32_t                       txtOffset);
 
+  void createGeometryBuffers();
   void updateDescriptorSet();
   void createUniformBuffer();
   void createSceneDescriptionBuffer();
+  void createIndirectBuffer();
   void createTextureImages(const vk::CommandBuffer&        cmdBuf,
                            const std::vector<std::string>& textures);
   void updateUniformBuffer();
   void resize(const vk::Extent2D& size);
   void destroyResources();
   void rasterize(const vk::CommandBuffer& cmdBuff);
+  void rasterizeRange(const vk::CommandBuffer& cmdBuf, uint32_t first, uint32_t count);
+  void drawInstances(const vk::CommandBuffer& cmdBuf, bool culled, uint32_t first = 0, uint32_t count = ~0u);
   void initRayTracing();
 
   // The OBJ model
@@ -81,25 +97,49 @@ public:
   {
     uint32_t   nbIndices{0};
     uint32_t   nbVertices{0};
-    nvvkBuffer vertexBuffer;    // Device buffer of all 'Vertex'
-    nvvkBuffer indexBuffer;     // Device buffer of the indices forming triangles
+    uint32_t   firstVertex{0};  // Offset of its 'Vertex' in m_vertexBuffer
+    uint32_t   firstIndex{0};   // Offset of its indices in m_indexBuffer
     nvvkBuffer matColorBuffer;  // Device buffer of array of 'Wavefront material'
+    uint32_t   txtOffset{0};    // Offset in `m_textures`
+    // Level of details: the models lodBase .. lodBase+lodLevels-1 are the same mesh, finest first
+    uint32_t  lodBase{0};
+    uint32_t  lodLevels{1};
+    glm::vec3 center{0};  // Bounding sphere
+    float     radius{0};
+    glm::vec3 bbMin{0};  // Bounding box, for the culling of the raster
+    glm::vec3 bbMax{0};
+    // Clusters of its triangles, culled one by one by the raster, see buildClusters
+    std::vector<MeshCluster> clusters;
+    uint32_t                 firstCluster{0};  // Offset of its clusters in m_clusterBuffer
+    // Host copy of the geometry, for the shared buffers and the BLAS built on the host
+    std::vector<uint8_t>  hostVertices;
+    std::vector<uint32_t> hostIndices;
+    // Emissive triangles in object space, for the light list
+    struct Emitter
+    {
+      glm::vec3 v0, v1, v2;
+      glm::vec3 emission;
+      uint32_t  primitive;  // Index of the triangle in the mesh
+    };
+    std::vector<Emitter> emitters;
+    uint32_t             hitGroup{HIT_GROUP_GENERIC};  // Material class of all its triangles
   };
 
   // Instance of the OBJ
   struct ObjInstance
   {
-    uint32_t  objIndex{0};     // Reference to the `m_objModel`
-    uint32_t  txtOffset{0};    // Offset in `m_textures`
-    glm::mat4 transform{1};    // Position of the instance
-    glm::mat4 transformIT{1};  // Inverse transpose
+    uint32_t  objIndex{0};           // Reference to the `m_objModel`
+    uint32_t  txtOffset{0};          // Offset in `m_textures`
+    glm::mat4 transform{1};          // Position of the instance
+    glm::mat4 transformIT{1};        // Inverse transpose
+    uint32_t  mask{RAY_MASK_ALL};    // Visibility categories: RAY_MASK_PRIMARY, _SHADOW, _GI
+    int       lightOffset{-1};       // Offset of its triangles in m_lightPrimBuffer, -1 if not emissive
   };
 
-  // Information pushed at each draw call
+  // Information pushed once for all the draws, which find their instance with gl_InstanceIndex
   struct ObjPushConstant
   {
     glm::vec3 lightPosition{10.f, 15.f, 8.f};
-    int       instanceId{0};  // To retrieve the transformation matrix
     float     lightIntensity{100.f};
     int       lightType{0};  // 0: point, 1: infinite
   };
@@ -113,9 +153,33 @@ public:
     int       lightType;
     int       frameCounter{0};
     bool      usePathTracing{false};
+    int       rayStats{0};  // Counting the rays of each type in m_rayStatsBuffer
+    int       samplesPerPixel{1};      // Set each frame from m_samplesPerPixel
+    int       adaptiveSampling{0};     // Only sampling the pixels not converged yet
+    float     errorThreshold{0.02f};   // Relative error of the mean under which a pixel converged
+    int       warmupFrames{16};        // Frames sampling all pixels before going adaptive
+    int       lightCount{0};           // Emissive triangles in m_lightBuffer
+    int       lightBvh{1};             // Picking the lights with m_lightBvhBuffer, not with the CDF
+    int       sampler{SAMPLER_BLUE_NOISE};  // Random number generator of the path tracer
+    int       reproject{0};          // Set by updateFrame when the camera moved
+    int       sampleSequence{0};     // Scrambling of the Sobol samples, changed at each reprojection
+    float     historyLength{64.f};   // Samples kept at most by the reprojection
+    int       tileX{0};              // Image pixel of the launch origin, set for each tile
+    int       tileY{0};
+    int       interleave{1};         // Set each frame from m_interleave
+    int       hybrid{0};             // Set each frame from m_hybrid
+    int       interleaveFrame{0};    // Set each frame from m_interleaveFrame
   };
 
   RtPushConstant m_rtPushConstants;
+  // Samples per pixel and frame. In adaptive mode, the budget of all pixels is spread over the
+  // pixels not converged yet, up to 16 times more per pixel.
+  int m_samplesPerPixel{1};
+
+  // Selecting the level of detail of each instance from its size on screen
+  void  updateLods(const vk::CommandBuffer& cmdBuf);
+  bool  m_useLod{true};
+  float m_lodCoverage{0.25f};  // Screen height fraction below which the next coarser level is used
 
   // Array of objects and instances in the scene
   std::vector<ObjModel>    m_objModel;
@@ -124,19 +188,33 @@ public:
   // Graphic pipeline
   vk::PipelineLayout                          m_pipelineLayout;
   vk::Pipeline                                m_graphicsPipeline;
+  vk::Pipeline                                m_gbufferPipeline;  // Same layout, see gbuffer.frag
+  vk::Pipeline                                m_visibilityPipeline;  // Same layout, see visibility.frag
   std::vector<vk::DescriptorSetLayoutBinding> m_descSetLayoutBind;
   vk::DescriptorPool                          m_descPool;
   vk::DescriptorSetLayout                     m_descSetLayout;
   vk::DescriptorSet                           m_descSet;
-  vk::PhysicalDeviceRayTracingPropertiesNV    m_rtProperties;
+  vk::PhysicalDeviceRayTracingPipelinePropertiesKHR m_rtProperties;
+  bool                                               m_rtHostBuild{false};  // BLAS built on the CPU
 
   nvvkBuffer               m_cameraMat;  // Device-Host of the camera matrices
+  glm::mat4                m_prevViewProj{1};  // Camera of the last updateUniformBuffer
   nvvkBuffer               m_sceneDesc;  // Device buffer of the OBJ instances
+  // Geometry of all the models, each one aligned for the storage buffer descriptors
+  nvvkBuffer m_vertexBuffer;
+  nvvkBuffer m_indexBuffer;
+  // One vk::DrawIndexedIndirectCommand per instance, all recorded by a single indirect draw.
+  // Otherwise the draws are recorded one by one, to compare the CPU time of the two.
+  nvvkBuffer m_indirectBuffer;
+  bool       m_indirectRaster{true};
+  bool       m_indirectSupported{false};  // Device feature drawIndirectFirstInstance
+  bool       m_multiDrawIndirect{false};  // Device feature, else one indirect call per instance
+  float      m_rasterRecordTime{0.f};     // Microseconds to record rasterize()
   std::vector<nvvkTexture> m_textures;   // vector of all textures of the scene
 
   nvvkpp::RaytracingBuilder m_rtBuilder;
   std::vector<nvvkpp::RaytracingBuilder::Instance> m_tlas;
-  std::vector<std::vector<vk::GeometryNV>> m_blas;
+  std::vector<nvvkpp::RaytracingBuilder::BlasInput> m_blas;
 
   #if defined(ALLOC_DEDICATED)
   #include "allocator_dedicated_vkpp.hpp"
@@ -151,19 +229,35 @@ public:
   vk::Device                 m_device;  // Logical device
   vk::PhysicalDevice         m_physicalDevice;  // Current GPU
   uint32_t                   m_queueIndex{0};  // Graphic family queue index
-  vk::Extent2D               m_size;            // Rendering resolution
+  vk::Extent2D               m_size;            // Rendering resolution, m_renderScale of the window
+  vk::Extent2D               m_windowSize;      // Swapchain size, filled by the post-process
 
 
   // #Post
   void createOffscreenRender();
+  nvvkTexture createStorageImage(vk::Format format, vk::ImageUsageFlags usage, const char* name);
   void createPostPipeline(const vk::RenderPass& renderPass);
   void createPostDescriptor();
   void updatePostDescriptorSet();
-  void drawPost(vk::CommandBuffer cmdBuf);
+  void drawPost(vk::CommandBuffer cmdBuf, bool denoised);
+
+  struct PostPushConstant
+  {
+    float aspectRatio{1.f};
+    int   showConvergence{0};  // Tinting the converged pixels of m_varianceImage
+    int   denoised{0};         // Showing m_denoisedImage instead of m_offscreenColor
+    int   upscaled{0};         // Showing m_upscaledImage, which holds one of the two
+  };
+  bool m_showConvergence{false};
 
-  vk::GeometryNV objectToVkGeometryNV(const ObjModel& model);
+  nvvkpp::RaytracingBuilder::BlasInput objectToVkGeometryKHR(const ObjModel& model);
   void           createBottomLevelAS();
   void           createTopLevelAS();
+  // Hit group of the instances: the closest hit specialized on their material class, or the
+  // generic one for all of them
+  void setHitGroups(bool specialized);
+  bool m_specializedHitGroups{true};
+  int  m_hitGroupInstances[HIT_GROUP_COUNT]{};  // Instances using each hit group
 
   std::vector<vk::DescriptorSetLayoutBinding> m_postDescSetLayoutBind;
   vk::DescriptorPool                          m_postDescPool;
@@ -177,6 +271,15 @@ public:
   vk::Format  m_offscreenColorFormat{vk::Format::eR32G32B32A32Sfloat};
   nvvkTexture m_offscreenDepth;
   vk::Format  m_offscreenDepthFormat{vk::Format::eD32Sfloat};
+  nvvkTexture m_varianceImage;  // Per-pixel mean and M2 of the luminance, sample count, converged
+  nvvkTexture m_normalDepthImage;  // Primary hits: world normal and linear depth, -1 on miss
+  nvvkTexture m_albedoImage;       // Primary hits: albedo, averaged like m_offscreenColor
+  nvvkTexture m_motionImage;       // Primary hits: pixel and linear depth in the previous frame
+  nvvkTexture m_prevNormalDepthImage;  // m_normalDepthImage of the previous frame
+  // Copies of m_offscreenColor, m_albedoImage and m_varianceImage read by the reprojection
+  nvvkTexture m_historyColorImage;
+  nvvkTexture m_historyAlbedoImage;
+  nvvkTexture m_historyStatsImage;
   
   
   void        createRtDescriptorSet();
@@ -187,24 +290,368 @@ public:
   vk::DescriptorSetLayout                     m_rtDescSetLayout;
   vk::DescriptorSet                           m_rtDescSet;
 
-  void                                               createRtPipeline();
-  std::vector<vk::RayTracingShaderGroupCreateInfoNV> m_rtShaderGroups;
-  vk::PipelineLayout                                 m_rtPipelineLayout;
-  vk::Pipeline                                       m_rtPipeline;
+  // Number of rays of each type (RAY_STAT_*) traced, when enabled. Each swapchain image has its
+  // own readback, read by beginFrame once the fence of the image was waited for.
+  void                    beginFrame(uint32_t frame);
+  uint32_t                m_frame{0};          // Swapchain image being recorded
+  nvvkBuffer              m_rayStatsBuffer;    // Counters written by the shaders
+  std::vector<nvvkBuffer> m_rayStatsReadbacks;  // Host copies of the counters, per swapchain image
+  std::vector<bool>       m_rayStatsCopied;     // The last frame of the image copied its counters
+  uint32_t                m_rayStatCounts[RAY_STAT_COUNT]{};  // Of the last completed frame
+  uint32_t                m_activePixels{0};  // Pixels sampled in that frame, in adaptive mode
+
+  // Emissive triangles of all instances, sampled directly by the path tracer
+  void       createLightBuffer();
+  nvvkBuffer m_lightBuffer;
+  nvvkBuffer m_lightBvhBuffer;   // Light BVH over m_lightBuffer
+  nvvkBuffer m_lightPrimBuffer;  // Light index of the triangles of the emissive instances, or -1
+
+  // Direction numbers of the Sobol sampler
+  void       createSobolBuffer();
+  nvvkBuffer m_sobolBuffer;
+
+  // Blue-noise masks, BLUE_NOISE_LAYERS floats per texel, generated once and cached on disk
+  void       createBlueNoiseBuffer();
+  nvvkBuffer m_blueNoiseBuffer;
+
+  void                                                createRtPipeline();
+  std::vector<vk::RayTracingShaderGroupCreateInfoKHR> m_rtShaderGroups;
+  vk::PipelineLayout                                  m_rtPipelineLayout;
+  vk::Pipeline                                        m_rtPipeline;
+
+  // #Denoiser: spatiotemporal variance-guided filtering of the path traced image, run between
+  // raytrace() and drawPost(), see shaders/denoise.h
+  void createDenoiseImages();
+  void destroyDenoiseImages();
+  void createDenoiser();
+  void updateDenoiseDescriptorSets();
+  void denoise(const vk::CommandBuffer& cmdBuf);
+
+  struct DenoisePushConstant
+  {
+    int iteration{0};     // À-trous pass
+    int iterations{0};
+    int historyValid{0};
+  };
+  bool m_useDenoiser{false};
+  int  m_denoiseIterations{5};
+  bool m_denoiseHistoryValid{false};  // The history images hold a denoised frame
+
+  nvvkTexture m_historyImage;          // Illumination after the first à-trous pass
+  nvvkTexture m_prevMomentsImage;
+  nvvkTexture m_momentsImage;     // Luminance moments and history length
+  nvvkTexture m_filterImages[2];  // Ping-pong of the à-trous passes
+  nvvkTexture m_denoisedImage;
+
+  std::vector<vk::DescriptorSetLayoutBinding> m_denoiseDescSetLayoutBind;
+  vk::DescriptorPool                          m_denoiseDescPool;
+  vk::DescriptorSetLayout                     m_denoiseDescSetLayout;
+  vk::DescriptorSet  m_denoiseDescSets[2];  // Filtering m_filterImages[0] into [1], and [1] into [0]
+  vk::PipelineLayout m_denoisePipelineLayout;
+  vk::Pipeline       m_temporalPipeline;
+  vk::Pipeline       m_atrousPipeline;
+
+  // #Dynamic resolution: the image is rendered at a fraction of the window size, chosen to hold a
+  // target frame time, and upscaled to the window before the post-process, see shaders/upscale.h
+  void createUpscaler();
+  void updateUpscaleDescriptorSet();
+  void upscale(const vk::CommandBuffer& cmdBuf, bool denoised);
+  bool updateResolution();
+  void beginFrameTimer(const vk::CommandBuffer& cmdBuf);
+  void endFrameTimer(const vk::CommandBuffer& cmdBuf);
+
+  struct UpscalePushConstant
+  {
+    int denoised{0};  // Upscaling m_denoisedImage instead of m_offscreenColor
+  };
+  bool      m_dynamicResolution{false};
+  float     m_targetFrameTime{33.3f};  // Milliseconds
+  float     m_renderScale{1.f};        // Rendering size over the window size, by steps of 1/8
+  float     m_frameTime{0.f};          // Smoothed GPU time of the frames, in milliseconds
+  int       m_framesSinceResize{0};
+  bool      m_edgeAwareUpscale{true};  // Otherwise the post-process samples the image as it is
+  std::vector<vk::QueryPool> m_frameTimerPools;  // Start and end of the frame, per swapchain image
+  std::vector<bool>          m_frameTimed;       // The last frame of the image wrote both queries
+
+  nvvkTexture                                 m_upscaledImage;  // Window size
+  std::vector<vk::DescriptorSetLayoutBinding> m_upscaleDescSetLayoutBind;
+  vk::DescriptorPool                          m_upscaleDescPool;
+  vk::DescriptorSetLayout                     m_upscaleDescSetLayout;
+  vk::DescriptorSet                           m_upscaleDescSet;
+  vk::PipelineLayout                          m_upscalePipelineLayout;
+  vk::Pipeline                                m_upscalePipeline;
+
+  // #Sparse primary rays: each frame traces a rotating subset of the pixels, the others being
+  // reconstructed in the frames restarting the accumulation, see shaders/interleave.h
+  void createInterleave();
+  void reconstructInterleaved(const vk::CommandBuffer& cmdBuf);
+
+  struct InterleavePushConstant
+  {
+    int   interleave{1};
+    int   interleaveFrame{0};
+    int   reproject{0};
+    float historyLength{0.f};
+  };
+  int                m_interleave{1};  // 1, 2 (checkerboard) or 4 (one pixel per 2x2 quad)
+  // Rotation of the traced subset: counts all the frames, unlike frameCounter which resetFrame
+  // restarts, so that the subset still rotates while the scene keeps changing
+  int                m_interleaveFrame{0};
+  vk::PipelineLayout m_interleavePipelineLayout;
+  vk::Pipeline       m_interleavePipeline;
+
+  // #Culling: the indirect draws of the raster are culled by a compute pass before the render
+  // pass, against the frustum and the hierarchical depth (HiZ) of the previous raster frame, built
+  // after the render pass, see shaders/cull.comp. With cluster culling, the clusters of the
+  // visible instances are culled one by one and drawn separately, see shaders/cluster_cull.comp
+  void createCulling();
+  void createHizImage();
+  void destroyHizImage();
+  void updateCullDescriptorSets();
+  void cullInstances(const vk::CommandBuffer& cmdBuf);
+  void readRasterQueries(uint32_t frame);
+  vk::QueryPool cullPool() const;
+  vk::QueryPool fragmentPool() const;
+  void buildHiz(const vk::CommandBuffer& cmdBuf);
+  bool clusterDraws() const;
+
+  struct CullPushConstant
+  {
+    uint32_t instanceCount{0};
+    int      occlusion{0};  // Testing against m_hizImage
+    int      compact{0};    // Packing the visible draws, drawn with their count
+  };
+  bool     m_gpuCulling{true};
+  bool     m_occlusionCulling{true};
+  bool     m_clusterCulling{true};
+  uint32_t m_clusterDrawCount{0};  // Cluster draws at most, of all instances at their largest level
+  // VK_KHR_draw_indirect_count and multiDrawIndirect: the visible draws are compacted, else the
+  // culled ones are kept in place with no instance
+  bool     m_drawIndirectCount{false};
+  bool     m_hizValid{false};           // m_hizImage holds the depth of the previous frame
+  uint32_t m_cullStats[CULL_STAT_COUNT]{};  // Counters of the last frame read back
+  // GPU times of the raster frames, in milliseconds, smoothed. The draws are timed without and
+  // with culling, the difference being the time saved, and with the visibility buffer resolve.
+  float         m_cullTime{0.f};
+  float         m_hizTime{0.f};
+  float         m_drawTimes[4]{};    // Index: culled (1) + visibility buffer (2)
+  // Before and after the culling, after the draws and the HiZ, per swapchain image, and the index
+  // in m_drawTimes of the last frame of the image, -1 when not timed
+  std::vector<vk::QueryPool> m_cullPools;
+  std::vector<int>           m_cullTimed;
+
+  nvvkBuffer                 m_boundsBuffer;       // Bounding box of each model: min, max
+  nvvkBuffer                 m_clusterBuffer;      // MeshCluster of all models
+  nvvkBuffer                 m_modelClusterBuffer; // First cluster and cluster count of each model
+  nvvkBuffer                 m_visibleDrawBuffer;  // Draws kept by the culling
+  nvvkBuffer                 m_cullStatsBuffer;    // CULL_STAT_* counters
+  std::vector<nvvkBuffer>    m_cullStatsReadbacks; // Host copies of the counters, per swapchain image
+  std::vector<bool>          m_cullStatsCopied;    // The last frame of the image copied its counters
+  nvvkTexture                m_hizImage;           // Farthest depth, full mip chain of m_size
+  std::vector<vk::ImageView> m_hizLevelViews;      // One view per level, written by hiz.comp
 
-  void       createRtShaderBindingTable();
-  nvvkBuffer m_rtSBTBuffer;
+  std::vector<vk::DescriptorSetLayoutBinding> m_cullDescSetLayoutBind;
+  std::vector<vk::DescriptorSetLayoutBinding> m_hizDescSetLayoutBind;
+  vk::DescriptorPool                          m_cullDescPool;
+  vk::DescriptorSetLayout                     m_cullDescSetLayout;
+  vk::DescriptorSetLayout                     m_hizDescSetLayout;
+  vk::DescriptorSet                           m_cullDescSet;
+  std::vector<vk::DescriptorSet>              m_hizDescSets;  // Level l from level l - 1
+  vk::PipelineLayout                          m_cullPipelineLayout;
+  vk::PipelineLayout                          m_hizPipelineLayout;
+  vk::Pipeline                                m_cullPipeline;
+  vk::Pipeline                                m_clusterCullPipeline;  // Same layout
+  vk::Pipeline                                m_hizPipeline;
+
+  // #Visibility buffer: the raster only writes the instance and the triangle of each pixel, which
+  // a compute resolve shades once per pixel, see shaders/visibility.comp
+  void createVisibility();
+  void createVisibilityImage();
+  void updateVisibilityDescriptorSet();
+  void rasterizeVisibility(const vk::CommandBuffer& cmdBuf, const glm::vec4& clearColor);
+
+  struct VisibilityPushConstant
+  {
+    glm::vec4 clearColor;
+    glm::vec3 lightPosition;
+    float     lightIntensity;
+    int       lightType;
+  };
+  bool m_visibilityBuffer{false};
+  bool m_visibilitySupported{false};  // geometryShader feature, for gl_PrimitiveID
+  // Fragment shader invocations of the raster pass, when the device has pipelineStatisticsQuery:
+  // last frame shaded forward (0) and with the visibility buffer (1)
+  uint64_t m_fragmentInvocations[2]{};
+  bool     m_pipelineStatistics{false};
+  // Per swapchain image, and the index in m_fragmentInvocations of the last frame of the image,
+  // -1 when not counted
+  std::vector<vk::QueryPool> m_fragmentPools;
+  std::vector<int>           m_fragmentCounted;
+
+  nvvkTexture     m_visibilityImage;  // Instance + 1 (0 on the background), triangle of the model
+  vk::RenderPass  m_visibilityRenderPass;
+  vk::Framebuffer m_visibilityFramebuffer;  // m_visibilityImage and m_offscreenDepth
+
+  std::vector<vk::DescriptorSetLayoutBinding> m_visibilityDescSetLayoutBind;
+  vk::DescriptorPool                          m_visibilityDescPool;
+  vk::DescriptorSetLayout                     m_visibilityDescSetLayout;
+  vk::DescriptorSet                           m_visibilityDescSet;
+  vk::PipelineLayout                          m_resolvePipelineLayout;
+  vk::Pipeline                                m_resolvePipeline;
+
+  // #Parallel recording: the raster draws, the post-process and the UI are recorded into secondary
+  // command buffers by the threads of m_jobPool, each one with its own command pool per swapchain
+  // image, then executed by the primary command buffer
+  using RecordJob = std::function<void(const vk::CommandBuffer& cmdBuf)>;
+  void createRecorder();
+  void beginRecording(uint32_t frame);
+  std::vector<vk::CommandBuffer> recordSecondaries(const std::vector<RecordJob>&           jobs,
+                                                   const vk::CommandBufferInheritanceInfo& inheritance);
+  void rasterizeParallel(const vk::CommandBuffer& cmdBuf, const vk::RenderPassBeginInfo& beginInfo);
+
+  struct RecordPool
+  {
+    vk::CommandPool                pool;
+    std::vector<vk::CommandBuffer> buffers;  // Allocated once, recorded again after each reset
+    uint32_t                       used{0};
+  };
+  bool m_parallelRecording{false};
+  int  m_recordThreads{1};          // Threads recording, up to the threads of m_jobPool
+  bool m_inheritedQueries{false};   // Device feature, counting the fragments of the secondaries
+  uint32_t                             m_recordFrame{0};  // Swapchain image being recorded
+  std::unique_ptr<JobPool>             m_jobPool;
+  std::vector<std::vector<RecordPool>> m_recordPools;  // Per thread, per swapchain image
+  // Per thread over the last frame: microseconds spent recording, secondary command buffers
+  std::vector<float>    m_threadRecordTimes;
+  std::vector<uint32_t> m_threadCommandBuffers;
+
+  // #Wavefront: the path tracer split into compute kernels exchanging the paths through queues,
+  // tracing with ray queries, as an alternative to the ray generation shader, see
+  // shaders/wf_queues.glsl. Without ray queries, the extend and shadow stages are the ray
+  // generation shaders of a ray tracing pipeline instead.
+  enum WavefrontKernel
+  {
+    eWfGenerate,
+    eWfExtend,
+    eWfMiss,
+    eWfDiffuse,
+    eWfShadow,
+    eWfAccumulate,
+    eWfKernelCount
+  };
+  void createWavefront();
+  void createWavefrontTracePipeline();
+  void createWavefrontBuffers();
+  void updateWavefrontDescriptorSet();
+  void wavefrontTrace(const vk::CommandBuffer& cmdBuf, const glm::vec4& clearColor);
+
+  struct WavefrontPushConstant
+  {
+    glm::vec4 clearColor;
+    int       frameCounter{0};
+    int       sampleIndex{0};
+    int       samplesPerPixel{1};
+    int       bounce{0};  // Depth of the paths extended and shaded
+    int       lightCount{0};
+    uint32_t  pathCapacity{0};  // Entries of each queue, one per pixel
+  };
+  bool m_wavefrontRayQuery{false};  // Set when the device has ray queries
+  bool m_useWavefront{false};
+  // Entries of each queue WF_QUEUE_* at each bounce of the first sample of the last frame
+  std::vector<uint32_t> m_wavefrontOccupancy;
+
+  nvvkBuffer m_wavefrontBuffer;      // Arrays of the queues, bindings 5 to 15 of wf_queues.glsl
+  nvvkBuffer m_wavefrontCounters;    // Counters and indirect dispatches of the queues
+  std::vector<nvvkBuffer> m_wavefrontReadbacks;  // Host copies of the counters after each bounce,
+                                                 // per swapchain image
+  std::vector<bool>       m_wavefrontCopied;     // The last frame of the image copied its counters
+  std::vector<vk::DescriptorBufferInfo> m_wavefrontArrays;  // Ranges of m_wavefrontBuffer
+
+  std::vector<vk::DescriptorSetLayoutBinding> m_wavefrontDescSetLayoutBind;
+  vk::DescriptorPool                          m_wavefrontDescPool;
+  vk::DescriptorSetLayout                     m_wavefrontDescSetLayout;
+  vk::DescriptorSet                           m_wavefrontDescSet;
+  vk::PipelineLayout                          m_wavefrontPipelineLayout;
+  vk::Pipeline                                m_wavefrontPipelines[eWfKernelCount];
+  // Without ray queries: wf_extend.rgen and wf_shadow.rgen, their miss shaders, and the closest
+  // hit of the extend stage for every hit group of the TLAS instances
+  vk::Pipeline                      m_wavefrontTracePipeline;
+  nvvkBuffer                        m_wavefrontSBTBuffer;
+  vk::StridedDeviceAddressRegionKHR m_wavefrontRgenRegions[2];  // Extend, shadow
+  vk::StridedDeviceAddressRegionKHR m_wavefrontMissRegion;
+  vk::StridedDeviceAddressRegionKHR m_wavefrontHitRegion;
+
+  // GPU timings of the path tracers, read back by beginFrame at the next frame of the swapchain
+  // image: each timestamp closes the interval of a wavefront kernel, of the ray generation shader
+  // (-1) or of the G-buffer (-2)
+  static const int      kGBufferTimestamp = -2;
+  static const uint32_t kMaxTimestamps    = 1024;  // Per frame, up to 16 samples per pixel
+  void                  beginTimestamps(const vk::CommandBuffer& cmdBuf);
+  void                  writeTimestamp(const vk::CommandBuffer& cmdBuf, int kernel);
+  void                  readTimestamps(uint32_t frame);
+  bool                  m_gpuTimings{false};
+  std::vector<vk::QueryPool>    m_timestampPools;    // Per swapchain image
+  std::vector<std::vector<int>> m_timestampKernels;  // Interval closed by each query of the pools
+  float                 m_timestampPeriod{0.f};  // Nanoseconds per tick, 0 without timestamps
+  float             m_wavefrontTimes[eWfKernelCount]{};  // Milliseconds, all samples and bounces
+  float             m_megakernelTime{0.f};               // Milliseconds of traceRaysKHR
+  // Last frame of each renderer, in milliseconds, to compare them on the same scene: traceRaysKHR
+  // of the full ray tracing, G-buffer and traceRaysKHR of the hybrid renderer
+  float             m_fullRtTime{0.f};
+  float             m_gbufferTime{0.f};
+  float             m_hybridRtTime{0.f};
+
+  void                              createRtShaderBindingTable();
+  nvvkBuffer                        m_rtSBTBuffer;
+  vk::StridedDeviceAddressRegionKHR m_rgenRegion;  // Regions of m_rtSBTBuffer used by traceRaysKHR
+  vk::StridedDeviceAddressRegionKHR m_missRegion;
+  vk::StridedDeviceAddressRegionKHR m_hitRegion;
+  vk::StridedDeviceAddressRegionKHR m_callRegion;
 
   // Path tracing
   void raytrace(const vk::CommandBuffer& cmdBuf, const glm::vec4& clearColor);
   void updateFrame();
   void resetFrame();
+  // Keeping the accumulated samples when the camera moves, see shaders/reproject.h
+  bool m_reprojection{true};
+
+  // #Hybrid: the primary surfaces are rasterized into a G-buffer read by the ray generation
+  // shader, which only traces the shadow, reflection and bounce rays, see shaders/gbuffer.frag
+  void createGBuffer();
+  void rasterizeGBuffer(const vk::CommandBuffer& cmdBuf);
+  bool            m_hybrid{false};
+  nvvkTexture     m_gbufferPosition;  // World position, w = 1 on a surface, 0 on the background
+  nvvkTexture     m_gbufferNormal;    // World shading normal
+  nvvkTexture     m_gbufferMaterial;  // Object, material index, texture color (RGBA8)
+  vk::RenderPass  m_gbufferRenderPass;
+  vk::Framebuffer m_gbufferFramebuffer;  // The G-buffer and m_offscreenDepth
+
+  // Tiled rendering: each frame traces as many tiles as fit in m_tileBudget of GPU time, measured
+  // with timestamps, so that large images and sample counts keep the viewer interactive. Each tile
+  // accumulates with its own frameCounter.
+  void             createTiles();
+  void             resetTiles();
+  void             updateTileBudget(uint32_t frame);
+  void             traceTiles(const vk::CommandBuffer& cmdBuf);
+  bool             m_tiledRendering{false};
+  int              m_tileSize{128};     // Pixels, square tiles
+  float            m_tileBudget{10.f};  // Target milliseconds of ray tracing per frame
+  uint32_t         m_tileCountX{0};
+  uint32_t         m_tileCountY{0};
+  std::vector<int> m_tileFrames;        // frameCounter of each tile, -1 before its first frame
+  uint32_t         m_nextTile{0};       // The tiles are traced in turn, in raster order
+  uint32_t         m_tilesPerFrame{1};
+  float            m_tileTime{0.f};     // Average milliseconds of a tile
+  // Timestamps before and after the tiles of the last frame of each swapchain image, and the
+  // number of tiles it traced, 0 when not timed
+  std::vector<vk::QueryPool> m_tilePools;
+  std::vector<uint32_t>      m_tilesTraced;
 
   // Animation
   void animationInstances(float time);
   void animationObject(float time);
   void createCompDesciprotrs();
-  void updateCompDescriptors(nvvkBuffer& vertex);
+  void updateCompDescriptors(const ObjModel& model);
   void createCompPipelines();
 
   std::vector<vk::DescriptorSetLayoutBinding> m_compDescSetLayoutBind;
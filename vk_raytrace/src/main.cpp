@@ -29,6 +29,7 @@
 // pipeline If you are new to ImGui, see examples/README.txt and documentation
 // at the top of imgui.cpp.
 
+#include <algorithm>
 #include <array>
 #include <vulkan/vulkan.hpp>
 #include <random>
@@ -244,6 +245,57 @@ static void destroyImgui(const vk::Device& device)
   }
 }
 
+//--------------------------------------------------------------------------------------------------
+// GPU time of the path tracers, and occupancy of the queues of the wavefront path tracer at each
+// bounce of its first sample
+//
+void renderTimingsUI(HelloVulkan& helloVk)
+{
+  if(helloVk.m_timestampPeriod == 0.f)
+    return;
+  ImGui::Checkbox("GPU timings", &helloVk.m_gpuTimings);
+  if(!helloVk.m_gpuTimings)
+    return;
+
+  // Ray generation shader, with the rays counted by the ray statistics
+  ImGui::Text("Ray generation shader: %.2f ms", helloVk.m_megakernelTime);
+  // Last frame of the full ray tracing and of the hybrid renderer, switching between the two
+  if(helloVk.m_hybridRtTime > 0.f)
+    ImGui::Text("Full ray tracing %.2f ms, hybrid %.2f ms: G-buffer %.2f ms + rays %.2f ms",
+                helloVk.m_fullRtTime, helloVk.m_gbufferTime + helloVk.m_hybridRtTime,
+                helloVk.m_gbufferTime, helloVk.m_hybridRtTime);
+  if(helloVk.m_rtPushConstants.rayStats != 0 && helloVk.m_megakernelTime > 0.f)
+  {
+    const uint32_t* counts = helloVk.m_rayStatCounts;
+    const double    rays = double(counts[RAY_STAT_PRIMARY]) + counts[RAY_STAT_SHADOW] + counts[RAY_STAT_GI];
+    ImGui::Text("  %.1f Mrays/s", rays / (helloVk.m_megakernelTime * 1e3));
+  }
+  static const char* kernels[HelloVulkan::eWfKernelCount] = {"generate", "extend", "miss",
+                                                             "diffuse",  "shadow", "accumulate"};
+  float total = 0.f;
+  for(int k = 0; k < HelloVulkan::eWfKernelCount; k++)
+  {
+    ImGui::Text("Wavefront %-10s %.2f ms", kernels[k], helloVk.m_wavefrontTimes[k]);
+    total += helloVk.m_wavefrontTimes[k];
+  }
+  const auto&  occupancy = helloVk.m_wavefrontOccupancy;
+  const float  pixels    = float(helloVk.m_size.width) * float(helloVk.m_size.height);
+  double       rays      = 0;
+  for(size_t b = 0; b * WF_QUEUE_COUNT < occupancy.size(); b++)
+  {
+    const uint32_t* queues = &occupancy[b * WF_QUEUE_COUNT];
+    const uint32_t  paths  = queues[WF_QUEUE_RAY0 + b % 2];
+    rays += double(paths) + queues[WF_QUEUE_SHADOW];
+    if(paths > 0)
+      ImGui::Text("Bounce %d: %5.1f%% of the paths, %u miss, %u diffuse, %u shadow rays",
+                  static_cast<int>(b), 100.f * paths / pixels, queues[WF_QUEUE_MISS],
+                  queues[WF_QUEUE_DIFFUSE], queues[WF_QUEUE_SHADOW]);
+  }
+  if(total > 0.f)
+    ImGui::Text("Wavefront: %.2f ms, %.1f Mrays/s", total,
+                rays * helloVk.m_samplesPerPixel / (total * 1e3));
+}
+
 void renderUI(HelloVulkan& helloVk)
 {
   static int item = 1;
@@ -263,6 +315,178 @@ void renderUI(HelloVulkan& helloVk)
   needRedraw |= ImGui::RadioButton("Infinite", &helloVk.m_pushConstant.lightType, 1);
   needRedraw |= ImGui::Checkbox("Raytrace", &g_useRaytracing); ImGui::SameLine();
   needRedraw |= ImGui::Checkbox("Pathtrace", &helloVk.m_rtPushConstants.usePathTracing);
+  // The wavefront path tracer always traces its primary rays
+  if(g_useRaytracing && !(helloVk.m_useWavefront && helloVk.m_rtPushConstants.usePathTracing))
+    needRedraw |= ImGui::Checkbox("Hybrid (rasterized primary surfaces)", &helloVk.m_hybrid);
+  if(helloVk.m_rtPushConstants.usePathTracing)
+  {
+    bool lightBvh = helloVk.m_rtPushConstants.lightBvh != 0;
+    if(ImGui::Checkbox("Light BVH", &lightBvh))
+    {
+      helloVk.m_rtPushConstants.lightBvh = lightBvh ? 1 : 0;
+      needRedraw                         = true;
+    }
+    ImGui::Text("%d lights", helloVk.m_rtPushConstants.lightCount);
+
+    if(ImGui::Combo("Sampler", &helloVk.m_rtPushConstants.sampler, "LCG\0Sobol\0Blue noise\0"))
+      needRedraw = true;
+
+    needRedraw |= ImGui::Checkbox(helloVk.m_wavefrontRayQuery ? "Wavefront (compute kernels, ray queries)" :
+                                                                "Wavefront (compute kernels, trace rays)",
+                                  &helloVk.m_useWavefront);
+  }
+  renderTimingsUI(helloVk);
+  bool rayStats = helloVk.m_rtPushConstants.rayStats != 0;
+  if(ImGui::Checkbox("Ray statistics", &rayStats))
+    helloVk.m_rtPushConstants.rayStats = rayStats ? 1 : 0;
+  if(rayStats)
+  {
+    const uint32_t* counts = helloVk.m_rayStatCounts;
+    ImGui::Text("Rays: primary %u, shadow %u, GI %u", counts[RAY_STAT_PRIMARY],
+                counts[RAY_STAT_SHADOW], counts[RAY_STAT_GI]);
+    ImGui::Text("Primary rays per pixel: %.2f",
+                counts[RAY_STAT_PRIMARY] / float(helloVk.m_size.width * helloVk.m_size.height));
+  }
+  needRedraw |= ImGui::SliderInt("Samples per pixel", &helloVk.m_samplesPerPixel, 1, 16);
+  bool adaptive = helloVk.m_rtPushConstants.adaptiveSampling != 0;
+  if(ImGui::Checkbox("Adaptive sampling", &adaptive))
+  {
+    helloVk.m_rtPushConstants.adaptiveSampling = adaptive ? 1 : 0;
+    needRedraw                                 = true;
+  }
+  if(adaptive)
+  {
+    needRedraw |= ImGui::SliderFloat("Error threshold", &helloVk.m_rtPushConstants.errorThreshold,
+                                     0.001f, 0.2f, "%.3f", 2.f);
+    needRedraw |= ImGui::SliderInt("Warm-up frames", &helloVk.m_rtPushConstants.warmupFrames, 1, 64);
+    ImGui::Checkbox("Show convergence", &helloVk.m_showConvergence);
+    ImGui::Text("Pixels still sampled: %u, %d spp", helloVk.m_activePixels,
+                helloVk.m_rtPushConstants.samplesPerPixel);
+  }
+  // Sparse primary rays: 1, 2 or 4 frames to trace all the pixels
+  int interleave = helloVk.m_interleave == 4 ? 2 : helloVk.m_interleave - 1;
+  if(ImGui::Combo("Primary rays", &interleave, "Full rate\0Checkerboard 1/2\0Interleaved 1/4\0"))
+  {
+    helloVk.m_interleave = interleave == 2 ? 4 : interleave + 1;
+    needRedraw           = true;
+  }
+  ImGui::Checkbox("Reprojection", &helloVk.m_reprojection);
+  if(helloVk.m_reprojection)
+  {
+    ImGui::SliderFloat("History length", &helloVk.m_rtPushConstants.historyLength, 1.f, 1024.f,
+                       "%.0f", 2.f);
+  }
+  if(helloVk.m_timestampPeriod > 0.f)
+  {
+    needRedraw |= ImGui::Checkbox("Tiled rendering", &helloVk.m_tiledRendering);
+    if(helloVk.m_tiledRendering)
+    {
+      if(ImGui::SliderInt("Tile size", &helloVk.m_tileSize, 32, 512))
+      {
+        helloVk.resetTiles();
+        needRedraw = true;
+      }
+      ImGui::SliderFloat("GPU budget (ms)", &helloVk.m_tileBudget, 1.f, 100.f, "%.1f", 2.f);
+      // No tile while the window is minimized
+      const auto& frames = helloVk.m_tileFrames;
+      const int   passes = frames.empty() ? 0 : *std::min_element(frames.begin(), frames.end()) + 1;
+      ImGui::Text("%u of %u tiles per frame, %.2f ms per tile, %d full passes", helloVk.m_tilesPerFrame,
+                  static_cast<uint32_t>(helloVk.m_tileFrames.size()), helloVk.m_tileTime, passes);
+    }
+  }
+  // The scale follows the GPU frame time, measured with timestamps
+  if(helloVk.m_timestampPeriod > 0.f)
+    ImGui::Checkbox("Dynamic resolution", &helloVk.m_dynamicResolution);
+  if(helloVk.m_dynamicResolution)
+  {
+    ImGui::SliderFloat("Target frame time (ms)", &helloVk.m_targetFrameTime, 5.f, 100.f, "%.1f");
+    ImGui::Checkbox("Edge-aware upscaler", &helloVk.m_edgeAwareUpscale);
+    ImGui::Text("Rendering %ux%u (%.1f%%), %.1f ms of GPU per frame", helloVk.m_size.width,
+                helloVk.m_size.height, 100.f * helloVk.m_renderScale, helloVk.m_frameTime);
+  }
+  if(ImGui::Checkbox("Denoiser", &helloVk.m_useDenoiser))
+    helloVk.m_denoiseHistoryValid = false;
+  if(helloVk.m_useDenoiser)
+  {
+    ImGui::SliderInt("A-trous passes", &helloVk.m_denoiseIterations, 1, 5);
+  }
+  if(helloVk.m_indirectSupported)
+  {
+    ImGui::Checkbox("Indirect draws", &helloVk.m_indirectRaster);
+    ImGui::SameLine();
+  }
+  ImGui::Text("raster recorded in %.1f us, %d instances", helloVk.m_rasterRecordTime,
+              static_cast<int>(helloVk.m_objInstance.size()));
+  ImGui::Checkbox("Parallel recording", &helloVk.m_parallelRecording);
+  if(helloVk.m_parallelRecording)
+  {
+    ImGui::SameLine();
+    ImGui::SliderInt("Threads", &helloVk.m_recordThreads, 1,
+                     static_cast<int>(helloVk.m_jobPool->threadCount()));
+    for(int t = 0; t < helloVk.m_recordThreads; t++)
+      ImGui::Text("Thread %d: %.1f us, %u command buffers", t, helloVk.m_threadRecordTimes[t],
+                  helloVk.m_threadCommandBuffers[t]);
+  }
+  if(helloVk.m_indirectRaster)
+  {
+    ImGui::Checkbox("GPU culling", &helloVk.m_gpuCulling);
+    if(helloVk.m_gpuCulling)
+    {
+      ImGui::SameLine();
+      ImGui::Checkbox("Occlusion culling", &helloVk.m_occlusionCulling);
+      const uint32_t* stats     = helloVk.m_cullStats;
+      const float     instances = static_cast<float>(std::max<size_t>(helloVk.m_objInstance.size(), 1));
+      ImGui::Text("Culled: frustum %.1f%%, occlusion %.1f%%, %s",
+                  100.f * stats[CULL_STAT_FRUSTUM] / instances,
+                  100.f * stats[CULL_STAT_OCCLUSION] / instances,
+                  helloVk.m_drawIndirectCount ? "draws compacted" : "empty draws kept");
+      if(helloVk.m_drawIndirectCount)
+      {
+        ImGui::Checkbox("Cluster culling", &helloVk.m_clusterCulling);
+        if(helloVk.clusterDraws())
+        {
+          const float clusters = static_cast<float>(std::max(stats[CULL_STAT_CLUSTERS], 1u));
+          ImGui::Text("Clusters culled: frustum %.1f%%, backface %.1f%%, occlusion %.1f%% of %u",
+                      100.f * stats[CULL_STAT_CLUSTER_FRUSTUM] / clusters,
+                      100.f * stats[CULL_STAT_CLUSTER_BACKFACE] / clusters,
+                      100.f * stats[CULL_STAT_CLUSTER_OCCLUSION] / clusters, stats[CULL_STAT_CLUSTERS]);
+        }
+      }
+      uint32_t triangles = 0;
+      for(const auto& instance : helloVk.m_objInstance)
+        triangles += helloVk.m_objModel[instance.objIndex].nbIndices / 3;
+      ImGui::Text("Triangles drawn: %u of %u", stats[CULL_STAT_TRIANGLES], triangles);
+    }
+    const int mode = helloVk.m_visibilityBuffer ? 2 : 0;
+    if(helloVk.m_timestampPeriod > 0.f)
+      ImGui::Text("GPU draws: %.2f ms unculled, %.2f ms culled + %.2f ms culling + %.2f ms HiZ",
+                  helloVk.m_drawTimes[mode], helloVk.m_drawTimes[mode + 1], helloVk.m_cullTime,
+                  helloVk.m_hizTime);
+  }
+  if(helloVk.m_visibilitySupported)
+  {
+    ImGui::Checkbox("Visibility buffer", &helloVk.m_visibilityBuffer);
+    const int culled = helloVk.m_indirectRaster && helloVk.m_gpuCulling ? 1 : 0;
+    if(helloVk.m_timestampPeriod > 0.f)
+      ImGui::Text("GPU raster: forward %.2f ms, visibility + resolve %.2f ms",
+                  helloVk.m_drawTimes[culled], helloVk.m_drawTimes[2 + culled]);
+    if(helloVk.m_pipelineStatistics)
+    {
+      const float pixels = static_cast<float>(helloVk.m_size.width * helloVk.m_size.height);
+      ImGui::Text("Fragment shader invocations per pixel: forward %.2f, visibility %.2f + 1 resolve",
+                  helloVk.m_fragmentInvocations[0] / pixels, helloVk.m_fragmentInvocations[1] / pixels);
+    }
+  }
+  ImGui::Checkbox("LOD", &helloVk.m_useLod);
+  ImGui::SameLine();
+  ImGui::SliderFloat("LOD Coverage", &helloVk.m_lodCoverage, 0.01f, 1.f);
+  bool specialized = helloVk.m_specializedHitGroups;
+  if(ImGui::Checkbox("Hit groups per material", &specialized))
+    helloVk.setHitGroups(specialized);
+  const int* groups = helloVk.m_hitGroupInstances;
+  ImGui::Text("Instances: generic %d, diffuse %d, textured %d, mirror %d, emissive %d",
+              groups[HIT_GROUP_GENERIC], groups[HIT_GROUP_DIFFUSE], groups[HIT_GROUP_TEXTURED],
+              groups[HIT_GROUP_MIRROR], groups[HIT_GROUP_EMISSIVE]);
   if (needRedraw)
       helloVk.resetFrame();
 }
@@ -308,22 +532,41 @@ int main(int argc, char** argv)
   }
 
   // Enabling the extension feature
-  vk::PhysicalDeviceDescriptorIndexingFeaturesEXT indexFeature;
-  vk::PhysicalDeviceScalarBlockLayoutFeaturesEXT  scalarFeature;
+  vk::PhysicalDeviceDescriptorIndexingFeaturesEXT    indexFeature;
+  vk::PhysicalDeviceScalarBlockLayoutFeaturesEXT     scalarFeature;
+  vk::PhysicalDeviceBufferDeviceAddressFeatures      addressFeature;
+  vk::PhysicalDeviceAccelerationStructureFeaturesKHR accelFeature;
+  vk::PhysicalDeviceRayTracingPipelineFeaturesKHR    rtPipelineFeature;
+  vk::PhysicalDeviceRayQueryFeaturesKHR              rayQueryFeature;
 
   // Requesting Vulkan extensions and layers
   nvvkpp::ContextCreateInfo contextInfo;
+  contextInfo.setVersion(1, 2);
   contextInfo.addInstanceLayer("VK_LAYER_LUNARG_monitor", true);
-  contextInfo.addInstanceExtension(VK_KHR_SURFACE_EXTENSION_NAME);
-  contextInfo.addInstanceExtension(VK_KHR_WIN32_SURFACE_EXTENSION_NAME);
+  // Surface extensions of the platform (Win32, Xlib, Xcb, ...) as reported by GLFW
+  uint32_t     glfwExtCount = 0;
+  const char** glfwExt      = glfwGetRequiredInstanceExtensions(&glfwExtCount);
+  for(uint32_t i = 0; i < glfwExtCount; i++)
+  {
+    contextInfo.addInstanceExtension(glfwExt[i]);
+  }
   contextInfo.addInstanceExtension(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
   contextInfo.addDeviceExtension(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
   contextInfo.addDeviceExtension(VK_KHR_DEDICATED_ALLOCATION_EXTENSION_NAME);
   contextInfo.addDeviceExtension(VK_KHR_GET_MEMORY_REQUIREMENTS_2_EXTENSION_NAME);
   contextInfo.addDeviceExtension(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME, false, &indexFeature);
   contextInfo.addDeviceExtension(VK_EXT_SCALAR_BLOCK_LAYOUT_EXTENSION_NAME, false, &scalarFeature);
-  contextInfo.addDeviceExtension(VK_NV_RAY_TRACING_EXTENSION_NAME);
   contextInfo.addDeviceExtension(VK_KHR_MAINTENANCE3_EXTENSION_NAME);
+  // Drawing the instances kept by the GPU culling with their count
+  contextInfo.addDeviceExtension(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME, true);
+  // #VKRay: cross-vendor ray tracing, also exposed by software drivers such as lavapipe
+  contextInfo.addDeviceExtension(VK_KHR_BUFFER_DEVICE_ADDRESS_EXTENSION_NAME, false, &addressFeature);
+  contextInfo.addDeviceExtension(VK_KHR_DEFERRED_HOST_OPERATIONS_EXTENSION_NAME);
+  contextInfo.addDeviceExtension(VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME, false, &accelFeature);
+  contextInfo.addDeviceExtension(VK_KHR_RAY_TRACING_PIPELINE_EXTENSION_NAME, false, &rtPipelineFeature);
+  contextInfo.addDeviceExtension(VK_KHR_RAY_QUERY_EXTENSION_NAME, true, &rayQueryFeature);
+  contextInfo.addDeviceExtension(VK_KHR_SPIRV_1_4_EXTENSION_NAME);
+  contextInfo.addDeviceExtension(VK_KHR_SHADER_FLOAT_CONTROLS_EXTENSION_NAME);
 
   // Creating Vulkan base application
   nvvkpp::AppBase appBase;
@@ -341,13 +584,15 @@ int main(int argc, char** argv)
   HelloVulkan helloVk;
   helloVk.init(appBase.getDevice(), appBase.getPhysicalDevice(), appBase.getQueueFamily(),
                appBase.getSize());
+  helloVk.m_wavefrontRayQuery = rayQueryFeature.rayQuery == VK_TRUE;
 
   // Model loading happens here
-  boolean animate = false;
+  bool animate = false;
 
   /* Scene: Animation 
   helloVk.loadModel("../media/scenes/plane.obj", glm::scale(glm::vec3(2.0, 1.0, 2.0)));
-  uint32_t wusonIdx = helloVk.loadObject("../media/scenes/wuson.obj");
+  // Simplified in 4 levels of 3732, 2457, 1360 and 472 triangles
+  uint32_t wusonIdx = helloVk.loadObject("../media/scenes/wuson.obj", 4);
   for (int i = 0; i < 5; i++)
   {
       helloVk.addInstance(wusonIdx);
@@ -366,9 +611,10 @@ int main(int argc, char** argv)
   std::normal_distribution<float> dis(1.0f, 1.0f);
   std::normal_distribution<float> disn(0.05f, 0.05f);
 
+  uint32_t cubeIdx = helloVk.loadObject("../media/scenes/cube_multi.obj");  // 12 triangles, no LOD
   for (int i = 0; i < 2000; ++i)
   {
-      helloVk.loadModel("../media/scenes/cube_multi.obj");
+      helloVk.addInstance(cubeIdx);
       HelloVulkan::ObjInstance& inst = helloVk.m_objInstance.back();
 
       float scale    = fabsf(disn(gen));
@@ -389,7 +635,7 @@ int main(int argc, char** argv)
   helloVk.loadModel("../media/scenes/CornellBox/CornellBox-Original.obj");
 
   /* Scene: Many Spheres
-  uint32_t icosphereIdx = helloVk.loadObject("../media/scenes/icosphere.obj");
+  uint32_t icosphereIdx = helloVk.loadObject("../media/scenes/icosphere.obj", 4);
 
   //helloVk.loadModel("../media/scenes/plane.obj");
   //helloVk.loadModel("../media/scenes/Medieval_building.obj");
@@ -401,18 +647,25 @@ int main(int argc, char** argv)
   {
       glm::mat4 transform = glm::translate(glm::mat4(1), glm::vec3(cubeDist(gen) + 3, 0.8, cubeDist(gen)));
       helloVk.addInstance(icosphereIdx, transform);
+      // The spheres are light proxies, they do not occlude the shadow rays
+      helloVk.m_objInstance.back().mask = RAY_MASK_PRIMARY | RAY_MASK_GI;
   }
   */
 
+  helloVk.createGeometryBuffers();
   helloVk.createOffscreenRender();
   helloVk.createDescriptorSetLayout();
   helloVk.createGraphicsPipeline(appBase.getRenderPass());
   helloVk.createUniformBuffer();
+  helloVk.createLightBuffer();
   helloVk.createSceneDescriptionBuffer();
+  helloVk.createIndirectBuffer();
   helloVk.updateDescriptorSet();
   helloVk.initRayTracing();
   helloVk.createBottomLevelAS();
   helloVk.createTopLevelAS();
+  helloVk.createSobolBuffer();
+  helloVk.createBlueNoiseBuffer();
 
   helloVk.createRtDescriptorSet();
   helloVk.createPostDescriptor();
@@ -420,6 +673,14 @@ int main(int argc, char** argv)
   helloVk.updatePostDescriptorSet();
   helloVk.createRtPipeline();
   helloVk.createRtShaderBindingTable();
+  helloVk.createDenoiser();
+  helloVk.createUpscaler();
+  helloVk.createInterleave();
+  helloVk.createWavefront();
+  helloVk.createTiles();
+  helloVk.createCulling();
+  helloVk.createVisibility();
+  helloVk.createRecorder();
 
   // Animation resources
   helloVk.createCompDesciprotrs();
@@ -442,6 +703,8 @@ int main(int argc, char** argv)
       helloVk.resize(appBase.getSize());
     }
     g_ResizeWanted = false;
+    // Rendering resolution following the GPU frame time
+    helloVk.updateResolution();
 
     helloVk.updateUniformBuffer();
 
@@ -480,8 +743,14 @@ int main(int argc, char** argv)
 
     auto                     curFrame = appBase.getCurFrame();
     const vk::CommandBuffer& cmdBuff  = appBase.getCommandBuffers()[curFrame];
+    helloVk.beginFrame(curFrame);
 
     cmdBuff.begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+    helloVk.beginFrameTimer(cmdBuff);
+    // Level of details of the instances, before rendering
+    helloVk.updateLods(cmdBuff);
+    if(helloVk.m_parallelRecording)
+      helloVk.beginRecording(curFrame);
 
     vk::ClearValue clearValues[2];
     clearValues[0].setColor(nvvkpp::util::clearColor(clearColor));
@@ -493,21 +762,46 @@ int main(int argc, char** argv)
     offscreenRenderPassBeginInfo.setPClearValues(clearValues);
     offscreenRenderPassBeginInfo.setRenderPass(helloVk.m_offscreenRenderPass);
     offscreenRenderPassBeginInfo.setFramebuffer(helloVk.m_offscreenFramebuffer);
-    offscreenRenderPassBeginInfo.setRenderArea({{}, appBase.getSize()});
+    offscreenRenderPassBeginInfo.setRenderArea({{}, helloVk.m_size});
 
     // Rendering Scene
-    if(g_useRaytracing)
+    // The wavefront path tracer does not write the denoiser inputs
+    const bool wavefront =
+        g_useRaytracing && helloVk.m_useWavefront && helloVk.m_rtPushConstants.usePathTracing;
+    if(wavefront)
+    {
+      helloVk.wavefrontTrace(cmdBuff, clearColor);
+    }
+    else if(g_useRaytracing)
     {
       helloVk.raytrace(cmdBuff, clearColor);
+      if(helloVk.m_useDenoiser)
+        helloVk.denoise(cmdBuff);
     }
     else
     {
-      cmdBuff.beginRenderPass(offscreenRenderPassBeginInfo, vk::SubpassContents::eInline);
-      helloVk.rasterize(cmdBuff);
-      cmdBuff.endRenderPass();
+      helloVk.cullInstances(cmdBuff);
+      if(helloVk.m_visibilityBuffer)
+      {
+        helloVk.rasterizeVisibility(cmdBuff, clearColor);
+      }
+      else if(helloVk.m_parallelRecording)
+      {
+        helloVk.rasterizeParallel(cmdBuff, offscreenRenderPassBeginInfo);
+      }
+      else
+      {
+        cmdBuff.beginRenderPass(offscreenRenderPassBeginInfo, vk::SubpassContents::eInline);
+        helloVk.rasterize(cmdBuff);
+        cmdBuff.endRenderPass();
+      }
+      helloVk.buildHiz(cmdBuff);
     }
 
 
+    const bool denoised = g_useRaytracing && !wavefront && helloVk.m_useDenoiser;
+    helloVk.upscale(cmdBuff, denoised);
+
     vk::RenderPassBeginInfo postRenderPassBeginInfo;
     postRenderPassBeginInfo.setClearValueCount(2);
     postRenderPassBeginInfo.setPClearValues(clearValues);
@@ -516,14 +810,29 @@ int main(int argc, char** argv)
     postRenderPassBeginInfo.setRenderArea({{}, appBase.getSize()});
     postRenderPassBeginInfo.setRenderPass(appBase.getRenderPass());
     postRenderPassBeginInfo.setFramebuffer(appBase.getFramebuffers()[curFrame]);
-    cmdBuff.beginRenderPass(postRenderPassBeginInfo, vk::SubpassContents::eInline);
-    helloVk.drawPost(cmdBuff);
-    // Rendering UI
+    if(helloVk.m_parallelRecording)
+    {
+      // The post-process and the UI recorded side by side, executed in that order
+      vk::CommandBufferInheritanceInfo inheritance{appBase.getRenderPass(), 0,
+                                                   appBase.getFramebuffers()[curFrame]};
+      ImDrawData* drawData = ImGui::GetDrawData();
+      const std::vector<vk::CommandBuffer> secondaries = helloVk.recordSecondaries(
+          {[&](const vk::CommandBuffer& cmdBuf) { helloVk.drawPost(cmdBuf, denoised); },
+           [&](const vk::CommandBuffer& cmdBuf) { ImGui_ImplVulkan_RenderDrawData(drawData, cmdBuf); }},
+          inheritance);
+      cmdBuff.beginRenderPass(postRenderPassBeginInfo, vk::SubpassContents::eSecondaryCommandBuffers);
+      cmdBuff.executeCommands(secondaries);
+    }
+    else
     {
+      cmdBuff.beginRenderPass(postRenderPassBeginInfo, vk::SubpassContents::eInline);
+      helloVk.drawPost(cmdBuff, denoised);
+      // Rendering UI
       ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), cmdBuff);
     }
 
     cmdBuff.endRenderPass();
+    helloVk.endFrameTimer(cmdBuff);
     cmdBuff.end();
     appBase.submitFrame();
   }
@@ -0,0 +1,72 @@
+// Visibility tests of a bounding box against the camera frustum and against the hierarchical depth
+// of the previous frame, built by hiz.comp. The depth is the one of the rasterizer: clip.z / clip.w,
+// the visible range being 0 <= z <= w.
+
+// World bounding box of an object-space box: the center transformed, and the half extent through
+// the absolute value of the linear part of the transformation
+void transformBounds(mat4 m, inout vec3 bbMin, inout vec3 bbMax)
+{
+  const vec3 center = vec3(m * vec4((bbMin + bbMax) * 0.5, 1));
+  const vec3 extent = mat3(abs(m[0].xyz), abs(m[1].xyz), abs(m[2].xyz)) * ((bbMax - bbMin) * 0.5);
+  bbMin             = center - extent;
+  bbMax             = center + extent;
+}
+
+// Box corner k, in 0..7
+vec3 boxCorner(vec3 bbMin, vec3 bbMax, int k)
+{
+  return vec3((k & 1) != 0 ? bbMax.x : bbMin.x, (k & 2) != 0 ? bbMax.y : bbMin.y,
+              (k & 4) != 0 ? bbMax.z : bbMin.z);
+}
+
+// True when all the corners are outside the same clipping plane. Valid for corners behind the
+// camera as well, the planes being tested in homogeneous coordinates.
+bool frustumCulled(mat4 viewProj, vec3 bbMin, vec3 bbMax)
+{
+  ivec3 low  = ivec3(0);  // Corners with x < -w, y < -w, z < 0
+  ivec3 high = ivec3(0);  // Corners with x > w, y > w, z > w
+  for(int k = 0; k < 8; k++)
+  {
+    const vec4 clip = viewProj * vec4(boxCorner(bbMin, bbMax, k), 1);
+    low += ivec3(lessThan(clip.xyz, vec3(-clip.w, -clip.w, 0)));
+    high += ivec3(greaterThan(clip.xyz, clip.www));
+  }
+  return any(equal(low, ivec3(8))) || any(equal(high, ivec3(8)));
+}
+
+// True when the box is behind the depth stored in hiz, the maximum depth of the previous frame over
+// each texel of its levels. The level is the one where the screen rectangle of the box covers at
+// most 2x2 texels, all four being tested. A box crossing the near plane is never occluded.
+bool occluded(mat4 viewProj, vec3 bbMin, vec3 bbMax, sampler2D hiz)
+{
+  vec2  uvMin   = vec2(1);
+  vec2  uvMax   = vec2(0);
+  float nearest = 1;
+  for(int k = 0; k < 8; k++)
+  {
+    const vec4 clip = viewProj * vec4(boxCorner(bbMin, bbMax, k), 1);
+    if(clip.w <= 0 || clip.z <= 0)
+      return false;
+    const vec3 ndc = clip.xyz / clip.w;
+    uvMin          = min(uvMin, ndc.xy * 0.5 + 0.5);
+    uvMax          = max(uvMax, ndc.xy * 0.5 + 0.5);
+    nearest        = min(nearest, ndc.z);
+  }
+
+  const ivec2 size     = textureSize(hiz, 0);
+  const ivec2 pixelMin = clamp(ivec2(uvMin * vec2(size)), ivec2(0), size - 1);
+  const ivec2 pixelMax = clamp(ivec2(uvMax * vec2(size)), ivec2(0), size - 1);
+  const ivec2 span     = pixelMax - pixelMin + 1;
+  const int   level =
+      min(int(ceil(log2(float(max(span.x, span.y))))), textureQueryLevels(hiz) - 1);
+
+  // The last texel of a level also covers the odd pixel left by the previous level
+  const ivec2 levelMax = textureSize(hiz, level) - 1;
+  const ivec2 texelMin = min(pixelMin >> level, levelMax);
+  const ivec2 texelMax = min(pixelMax >> level, levelMax);
+  float       depth    = max(max(texelFetch(hiz, texelMin, level).r,
+                                 texelFetch(hiz, ivec2(texelMax.x, texelMin.y), level).r),
+                             max(texelFetch(hiz, ivec2(texelMin.x, texelMax.y), level).r,
+                                 texelFetch(hiz, texelMax, level).r));
+  return nearest > depth;
+}
@@ -0,0 +1,49 @@
+// Resources of the denoiser passes, temporal.comp and atrous.comp
+// Two descriptor sets share this layout, swapping filterInput and filterOutput for the ping-pong
+// of the à-trous iterations.
+
+layout(local_size_x = 16, local_size_y = 16) in;
+
+layout(binding = 0, rgba32f) uniform readonly image2D colorImage;        // Path traced image
+layout(binding = 1, rgba32f) uniform readonly image2D statsImage;        // z: samples of the pixel
+layout(binding = 2, rgba32f) uniform readonly image2D normalDepthImage;  // w: linear depth, -1 on miss
+layout(binding = 3, rgba16f) uniform readonly image2D albedoImage;
+layout(binding = 4, rgba32f) uniform readonly image2D motionImage;  // xy: previous pixel, z: previous depth
+layout(binding = 5, rgba32f) uniform readonly image2D prevNormalDepthImage;
+layout(binding = 6, rgba32f) uniform image2D historyImage;          // Illumination after the first à-trous pass
+layout(binding = 7, rgba32f) uniform readonly image2D prevMomentsImage;
+layout(binding = 8, rgba32f) uniform image2D momentsImage;          // x, y: luminance moments, z: history length
+layout(binding = 9, rgba32f) uniform readonly image2D filterInput;  // rgb: illumination, a: variance
+layout(binding = 10, rgba32f) uniform writeonly image2D filterOutput;
+layout(binding = 11, rgba32f) uniform writeonly image2D denoisedImage;
+
+layout(push_constant) uniform DenoiseConstants
+{
+  int iteration;     // À-trous pass, the step between the taps is 2^iteration
+  int iterations;
+  int historyValid;  // 0 when the history images hold nothing yet
+}
+pushc;
+
+bool insideImage(ivec2 p)
+{
+  ivec2 size = imageSize(colorImage);
+  return all(greaterThanEqual(p, ivec2(0))) && all(lessThan(p, size));
+}
+
+// Illumination: the color divided by the albedo of the primary hit, so that the textures are not blurred
+vec3 loadIllumination(ivec2 p)
+{
+  vec3 albedo = imageLoad(albedoImage, p).rgb;
+  return imageLoad(colorImage, p).rgb / max(albedo, vec3(1e-3));
+}
+
+// Same as denoise::depthGradient, reading the neighbors clamped to the image
+float depthGradientAt(ivec2 p, float depth)
+{
+  ivec2 last = imageSize(colorImage) - 1;
+  return depthGradient(depth, imageLoad(normalDepthImage, clamp(p - ivec2(1, 0), ivec2(0), last)).w,
+                       imageLoad(normalDepthImage, clamp(p + ivec2(1, 0), ivec2(0), last)).w,
+                       imageLoad(normalDepthImage, clamp(p - ivec2(0, 1), ivec2(0), last)).w,
+                       imageLoad(normalDepthImage, clamp(p + ivec2(0, 1), ivec2(0), last)).w);
+}
@@ -0,0 +1,154 @@
+// Denoising of the path traced image, following Schied et al., "Spatiotemporal Variance-Guided
+// Filtering" (HPG 2017): the illumination (color divided by the albedo) is accumulated over the
+// frames, then smoothed by edge-avoiding à-trous wavelet passes guided by its variance.
+// Shared between the compute shaders and the C++ reference implementation of the filter.
+// Only code valid in both GLSL and C++ (with GLM) can be added here, except in the
+// __cplusplus section at the end.
+
+#ifndef DENOISE_H
+#define DENOISE_H
+
+#ifdef __cplusplus
+#include <cmath>
+#include <glm/glm.hpp>
+#include <vector>
+namespace denoise {
+using namespace glm;
+#endif
+
+// Edge-stopping functions of the à-trous passes
+const float kSigmaDepth     = 1.0f;    // Depth difference, relative to the depth gradient
+const float kSigmaNormal    = 128.0f;  // Exponent of the cosine between the normals
+const float kSigmaLuminance = 4.0f;    // Luminance difference, relative to its standard deviation
+
+// Temporal accumulation: exponential moving average with at least kTemporalAlpha of the new frame
+const float kTemporalAlpha    = 0.2f;
+const float kMaxHistoryLength = 32.0f;
+// Frames of history under which the variance is estimated spatially
+const float kMinVarianceHistory = 4.0f;
+
+float denoiseLuminance(vec3 c)
+{
+  return dot(c, vec3(0.2126f, 0.7152f, 0.0722f));
+}
+
+// B3-spline kernel of the à-trous passes, offset in -2..2
+float atrousKernel(int offset)
+{
+  return offset == 0 ? 0.375f : (abs(offset) == 1 ? 0.25f : 0.0625f);
+}
+
+// 3x3 Gaussian used to prefilter the variance, offsets in -1..1
+float gaussian3x3(int dx, int dy)
+{
+  return (dx == 0 ? 0.5f : 0.25f) * (dy == 0 ? 0.5f : 0.25f);
+}
+
+// Depth change per pixel, from the depths of the four neighbors. The smallest difference of each
+// axis is used, so that a depth discontinuity on one side does not count as a slope.
+float depthGradient(float depth, float left, float right, float up, float down)
+{
+  float dx = min(abs(right - depth), abs(depth - left));
+  float dy = min(abs(down - depth), abs(depth - up));
+  return length(vec2(dx, dy));
+}
+
+// Weight of the neighbor q of the pixel p, `pixelDistance` pixels away
+float edgeStoppingWeight(float depthP,
+                         float depthQ,
+                         float gradient,
+                         float pixelDistance,
+                         vec3  normalP,
+                         vec3  normalQ,
+                         float lumP,
+                         float lumQ,
+                         float lumStdDev)
+{
+  float wDepth  = abs(depthP - depthQ) / (kSigmaDepth * gradient * pixelDistance + 1e-4f);
+  float wNormal = pow(max(dot(normalP, normalQ), 0.0f), kSigmaNormal);
+  float wLum    = abs(lumP - lumQ) / (kSigmaLuminance * lumStdDev + 1e-4f);
+  return exp(-wDepth - wLum) * wNormal;
+}
+
+#ifdef __cplusplus
+//--------------------------------------------------------------------------------------------------
+// Reference implementation of the à-trous passes of atrous.comp on the CPU
+// - illumination: rgb illumination and its variance in alpha, as written by temporal.comp
+// - normalDepth: world normal and linear depth, negative depth on the background
+// The background pixels are copied unchanged.
+//
+inline std::vector<vec4> atrousFilter(std::vector<vec4>        illumination,
+                                      const std::vector<vec4>& normalDepth,
+                                      int                      width,
+                                      int                      height,
+                                      int                      iterations)
+{
+  auto inside = [&](int x, int y) { return x >= 0 && y >= 0 && x < width && y < height; };
+  auto depth  = [&](int x, int y) {
+    x = clamp(x, 0, width - 1);
+    y = clamp(y, 0, height - 1);
+    return normalDepth[y * width + x].w;
+  };
+
+  std::vector<vec4> filtered(illumination.size());
+  for(int iteration = 0; iteration < iterations; iteration++)
+  {
+    const int step = 1 << iteration;
+    for(int y = 0; y < height; y++)
+    {
+      for(int x = 0; x < width; x++)
+      {
+        const vec4 center = illumination[y * width + x];
+        const vec4 nd     = normalDepth[y * width + x];
+        if(nd.w < 0.0f)
+        {
+          filtered[y * width + x] = center;
+          continue;
+        }
+
+        // Same as atrous.comp
+        float variance = 0.0f;
+        for(int dy = -1; dy <= 1; dy++)
+          for(int dx = -1; dx <= 1; dx++)
+            if(inside(x + dx, y + dy))
+              variance += gaussian3x3(dx, dy) * illumination[(y + dy) * width + x + dx].w;
+        const float lumStdDev = std::sqrt(max(variance, 0.0f));
+        const float gradient =
+            depthGradient(nd.w, depth(x - 1, y), depth(x + 1, y), depth(x, y - 1), depth(x, y + 1));
+        const float lum = denoiseLuminance(vec3(center));
+
+        vec3  sumIllumination(0.0f);
+        float sumVariance = 0.0f;
+        float sumWeight   = 0.0f;
+        for(int dy = -2; dy <= 2; dy++)
+        {
+          for(int dx = -2; dx <= 2; dx++)
+          {
+            const int qx = x + dx * step;
+            const int qy = y + dy * step;
+            if(!inside(qx, qy) || normalDepth[qy * width + qx].w < 0.0f)
+              continue;
+            const vec4  q   = illumination[qy * width + qx];
+            const vec4  ndq = normalDepth[qy * width + qx];
+            const float w   = atrousKernel(dx) * atrousKernel(dy)
+                            * edgeStoppingWeight(nd.w, ndq.w, gradient, step * length(vec2(dx, dy)),
+                                                 vec3(nd), vec3(ndq), lum,
+                                                 denoiseLuminance(vec3(q)), lumStdDev);
+            sumIllumination += w * vec3(q);
+            sumVariance += w * w * q.w;
+            sumWeight += w;
+          }
+        }
+        filtered[y * width + x] =
+            vec4(sumIllumination / sumWeight, sumVariance / (sumWeight * sumWeight));
+      }
+    }
+    illumination.swap(filtered);
+  }
+  return illumination;
+}
+
+}  // namespace denoise
+#endif
+
+#endif  // DENOISE_H
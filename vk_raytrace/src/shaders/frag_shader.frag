@@ -10,7 +10,6 @@
 layout(push_constant) uniform shaderInformation
 {
   vec3  lightPosition;
-  uint  instanceId;
   float lightIntensity;
   int   lightType;
 }
@@ -23,6 +22,7 @@ layout(location = 1) in vec2 fragTexCoord;
 layout(location = 2) in vec3 fragNormal;
 layout(location = 3) in vec3 viewDir;
 layout(location = 4) in vec3 worldPos;
+layout(location = 5) flat in int instanceId;
 // Outgoing
 layout(location = 0) out vec4 outColor;
 // Buffers
@@ -35,10 +35,10 @@ layout(binding = 3) uniform sampler2D[] textureSamplers;
 void main()
 {
   // Object of this instance
-  int objId = scnDesc.i[pushC.instanceId].objId;
+  int objId = scnDesc.i[instanceId].objId;
 
-  // Material of the object
-  WaveFrontMaterial mat = materials[objId].m[matIndex];
+  // Material of the object, the instances of one indirect draw may share a subgroup
+  WaveFrontMaterial mat = materials[nonuniformEXT(objId)].m[matIndex];
 
   vec3 N = normalize(fragNormal);
 
@@ -62,9 +62,9 @@ void main()
   vec3 diffuse = computeDiffuse(mat, L, N);
   if(mat.textureId >= 0)
   {
-    int  txtOffset  = scnDesc.i[pushC.instanceId].txtOffset;
+    int  txtOffset  = scnDesc.i[instanceId].txtOffset;
     uint txtId      = txtOffset + mat.textureId;
-    vec3 diffuseTxt = texture(textureSamplers[txtId], fragTexCoord).xyz;
+    vec3 diffuseTxt = texture(textureSamplers[nonuniformEXT(txtId)], fragTexCoord).xyz;
     diffuse *= diffuseTxt;
   }
 
@@ -0,0 +1,50 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_EXT_nonuniform_qualifier : enable
+#extension GL_GOOGLE_include_directive : enable
+#extension GL_EXT_scalar_block_layout : enable
+
+#include "wavefront.glsl"
+
+// G-buffer of the hybrid renderer: the surface seen by each pixel, read by the ray generation
+// shader in place of its primary ray. The texture is filtered here, with the derivatives the ray
+// tracing shaders do not have. Like the raster, all the instances are drawn whatever their mask.
+
+// clang-format off
+// Incoming
+layout(location = 0) flat in int matIndex;
+layout(location = 1) in vec2 fragTexCoord;
+layout(location = 2) in vec3 fragNormal;
+layout(location = 3) in vec3 viewDir;
+layout(location = 4) in vec3 worldPos;
+layout(location = 5) flat in int instanceId;
+// Outgoing
+layout(location = 0) out vec4  outPosition;  // World position, w = 1: the background keeps w = 0
+layout(location = 1) out vec4  outNormal;    // World shading normal
+layout(location = 2) out uvec4 outMaterial;  // Object, material index, texture color (RGBA8)
+// Buffers
+layout(binding = 1, scalar) buffer MatColorBufferObject { WaveFrontMaterial m[]; } materials[];
+layout(binding = 2, scalar) buffer ScnDesc { sceneDesc i[]; } scnDesc;
+layout(binding = 3) uniform sampler2D[] textureSamplers;
+// clang-format on
+
+
+void main()
+{
+  // Object of this instance
+  int objId = scnDesc.i[instanceId].objId;
+
+  WaveFrontMaterial mat = materials[nonuniformEXT(objId)].m[matIndex];
+
+  vec3 texColor = vec3(1);
+  if(mat.textureId >= 0)
+  {
+    int  txtOffset = scnDesc.i[instanceId].txtOffset;
+    uint txtId     = txtOffset + mat.textureId;
+    texColor       = texture(textureSamplers[nonuniformEXT(txtId)], fragTexCoord).xyz;
+  }
+
+  outPosition = vec4(worldPos, 1);
+  outNormal   = vec4(normalize(fragNormal), 0);
+  outMaterial = uvec4(objId, matIndex, packUnorm4x8(vec4(texColor, 1)), 0);
+}
@@ -0,0 +1,42 @@
+// Reprojection of the accumulated samples of the previous frame, see reproject.h. Shared by the ray
+// generation shader and the interleaved reconstruction, which declare the images used here: image,
+// prevNormalDepthImage, historyColorImage, historyAlbedoImage, historyStatsImage, and the camera.
+
+// Accumulated color, albedo and statistics of the surface at `position` in the previous frame,
+// interpolated between the history texels which saw the same surface. All zero on a disocclusion.
+void reprojectHistory(vec3 position, vec3 normal, float historyLength, out vec3 color,
+                      out vec3 albedo, out vec4 stats)
+{
+    float prevDepth = linearDepth(cam.prevViewProj, position);
+    ivec2 size      = imageSize(image);
+    vec2  prevPixel = projectToPixel(cam.prevViewProj, position, vec2(size));
+    ivec2 base      = ivec2(floor(prevPixel - 0.5));
+    color  = vec3(0);
+    albedo = vec3(0);
+    stats  = vec4(0);
+    float sumWeight = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        ivec2 q = base + ivec2(i & 1, i >> 1);
+        if (any(lessThan(q, ivec2(0))) || any(greaterThanEqual(q, size)))
+            continue;
+        vec4 prevNd = imageLoad(prevNormalDepthImage, q);
+        if (!historyConsistent(prevDepth, prevNd.w, normal, prevNd.xyz))
+            continue;
+        float w = bilinearWeight(prevPixel, i);
+        color  += w * imageLoad(historyColorImage, q).xyz;
+        albedo += w * imageLoad(historyAlbedoImage, q).xyz;
+        stats  += w * imageLoad(historyStatsImage, q);
+        sumWeight += w;
+    }
+    if (sumWeight < 0.01)
+    {
+        color  = vec3(0);
+        albedo = vec3(0);
+        stats  = vec4(0);
+        return;
+    }
+    color  /= sumWeight;
+    albedo /= sumWeight;
+    stats   = capHistory(vec4(vec3(stats) / sumWeight, 0), historyLength);
+}
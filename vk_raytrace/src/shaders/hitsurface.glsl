@@ -0,0 +1,65 @@
+// Surface data at a triangle hit, from the instance, the triangle and the barycentrics reported by
+// the traversal. Shared by the closest hit shader and the wavefront path tracer, which declare the
+// scene bindings used here: materials, scnDesc, textureSamplers, vertices, indices and lightPrims,
+// and the constant kHitGroup. Specialized on a material class, only the data this class needs is
+// fetched: HIT_GROUP_GENERIC keeps every test at run time.
+
+hitPayload hitSurface(int instance, int primitive, vec2 attribs, float hitT)
+{
+    // Object of this instance
+    uint objId = scnDesc.i[instance].objId;
+
+    // Indices of the triangle
+    ivec3 ind = ivec3(indices[nonuniformEXT(objId)].i[3 * primitive + 0],   //
+                      indices[nonuniformEXT(objId)].i[3 * primitive + 1],   //
+                      indices[nonuniformEXT(objId)].i[3 * primitive + 2]);  //
+    // Vertex of the triangle
+    Vertex v0 = vertices[nonuniformEXT(objId)].v[ind.x];
+    Vertex v1 = vertices[nonuniformEXT(objId)].v[ind.y];
+    Vertex v2 = vertices[nonuniformEXT(objId)].v[ind.z];
+
+    // Without an intersection shader, the attributes are the barycentric beta/gamma coordinates
+    const vec3 barycentrics = vec3(1.0 - attribs.x - attribs.y, attribs.x, attribs.y);
+
+    // Computing the normal at hit position
+    vec3 normal = v0.nrm * barycentrics.x + v1.nrm * barycentrics.y + v2.nrm * barycentrics.z;
+    // Transforming the normal to world space
+    normal = normalize(vec3(scnDesc.i[instance].transfoIT * vec4(normal, 0.0)));
+
+    // Computing the coordinates of the hit position
+    vec3 worldPos = v0.pos * barycentrics.x + v1.pos * barycentrics.y + v2.pos * barycentrics.z;
+    // Transforming the position to world space
+    worldPos = vec3(scnDesc.i[instance].transfo * vec4(worldPos, 1.0));
+
+    // Material of the triangle, only the texture is resolved here. There are no derivatives
+    // outside of the fragment shaders: the most detailed level is used.
+    int textureId =
+        kHitGroup == HIT_GROUP_DIFFUSE ? -1 : materials[nonuniformEXT(objId)].m[v0.matIndex].textureId;
+    vec3 texColor = vec3(1);
+    if (kHitGroup == HIT_GROUP_TEXTURED || textureId >= 0)
+    {
+        uint txtId = textureId + scnDesc.i[instance].txtOffset;
+        vec2 texCoord =
+            v0.texCoord * barycentrics.x + v1.texCoord * barycentrics.y + v2.texCoord * barycentrics.z;
+        texColor = textureLod(textureSamplers[nonuniformEXT(txtId)], texCoord, 0.0).xyz;
+    }
+
+    hitPayload surface;
+    surface.position = worldPos;
+    surface.hitT     = hitT;
+    surface.normal   = normal;
+    surface.objId    = objId;
+    surface.texColor = texColor;
+    surface.matIndex = v0.matIndex;
+    surface.hitGroup = kHitGroup;
+
+    // Emissive triangle, for the multiple importance sampling of the lights
+    surface.lightIndex = -1;
+    if (kHitGroup == HIT_GROUP_GENERIC || kHitGroup == HIT_GROUP_EMISSIVE)
+    {
+        int lightOffset = scnDesc.i[instance].lightOffset;
+        if (lightOffset >= 0)
+            surface.lightIndex = lightPrims.i[lightOffset + primitive];
+    }
+    return surface;
+}
@@ -0,0 +1,70 @@
+// Definitions shared between the GLSL shaders and the C++ host code.
+// Only preprocessor definitions and code valid in both languages can be added here.
+
+#ifndef HOST_DEVICE_H
+#define HOST_DEVICE_H
+
+// Visibility categories of the instances, used as TLAS instance mask, and the cull mask
+// of each type of ray
+#define RAY_MASK_PRIMARY 0x01  // Seen by the camera rays
+#define RAY_MASK_SHADOW 0x02   // Occluding the shadow rays
+#define RAY_MASK_GI 0x04       // Hit by the secondary rays: reflections and path tracing bounces
+#define RAY_MASK_ALL 0xFF
+
+// Ray counters, one per type of ray, written when RtPushConstant::rayStats is set
+#define RAY_STAT_PRIMARY 0
+#define RAY_STAT_SHADOW 1
+#define RAY_STAT_GI 2
+// Pixels still sampled in the frame, written when RtPushConstant::adaptiveSampling is set
+#define RAY_STAT_ACTIVE_PIXELS 3
+#define RAY_STAT_COUNT 4
+
+// Adaptive sampling: samples of a pixel before its error is trusted. With fewer, a pixel could
+// be converged after 2 samples of the same luminance
+#define ADAPTIVE_MIN_SAMPLES 16
+
+// Random number generators of the path tracer, RtPushConstant::sampler
+#define SAMPLER_LCG 0
+#define SAMPLER_SOBOL 1         // Owen-scrambled Sobol
+#define SAMPLER_BLUE_NOISE 2    // Blue-noise masks for the first dimensions, then Sobol
+
+// Tileable blue-noise masks, one per dimension of the first samples of a pixel
+#define BLUE_NOISE_SIZE 64
+#define BLUE_NOISE_LAYERS 8
+
+// Queues of the wavefront path tracer. Each one starts with its counter: the number of entries,
+// followed by the workgroup count of the stage consuming it (VkDispatchIndirectCommand).
+#define WF_QUEUE_RAY0 0     // Paths to extend, ping-ponging with WF_QUEUE_RAY1 between bounces
+#define WF_QUEUE_RAY1 1
+#define WF_QUEUE_MISS 2     // Paths which left the scene
+#define WF_QUEUE_DIFFUSE 3  // Paths on a diffuse surface, emissive or not
+#define WF_QUEUE_SHADOW 4   // Shadow rays toward the sampled lights
+#define WF_QUEUE_COUNT 5
+#define WF_COUNTER_SIZE 4  // uints per queue counter
+#define WF_GROUP_SIZE 64   // Threads per workgroup of all stages
+
+// Counters of the culling of the raster draws, see cull.comp and cluster_cull.comp
+#define CULL_STAT_DRAWS 0              // Draws kept, the draw count of the compacted indirect draw
+#define CULL_STAT_FRUSTUM 1            // Instances outside the camera frustum
+#define CULL_STAT_OCCLUSION 2          // Instances behind the depth of the previous frame
+#define CULL_STAT_TRIANGLES 3          // Triangles of the draws kept
+#define CULL_STAT_CLUSTERS 4           // Clusters of the instances kept, each one tested
+#define CULL_STAT_CLUSTER_FRUSTUM 5    // Clusters outside the camera frustum
+#define CULL_STAT_CLUSTER_BACKFACE 6   // Clusters with all their triangles facing away
+#define CULL_STAT_CLUSTER_OCCLUSION 7  // Clusters behind the depth of the previous frame
+#define CULL_STAT_COUNT 8
+
+// Size limits of the clusters built at import, see buildClusters
+#define CLUSTER_MAX_VERTICES 64
+#define CLUSTER_MAX_TRIANGLES 124
+
+// Closest hit shaders specialized by material class, the hit group index of the TLAS instances.
+// An object falls in a class only if all the materials of its triangles belong to it.
+#define HIT_GROUP_GENERIC 0   // Mixed materials, every property resolved at run time
+#define HIT_GROUP_DIFFUSE 1   // Untextured, not mirror, not emissive
+#define HIT_GROUP_TEXTURED 2  // Textured, not mirror, not emissive
+#define HIT_GROUP_MIRROR 3    // illum 3, not emissive
+#define HIT_GROUP_EMISSIVE 4  // At least one emissive material
+#define HIT_GROUP_COUNT 5
+
+#endif  // HOST_DEVICE_H
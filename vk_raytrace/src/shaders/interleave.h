@@ -0,0 +1,114 @@
+// Sparse primary rays: each frame traces one pixel out of `interleave`, all of them (1), a
+// checkerboard (2) or one pixel of each 2x2 quad (4), the traced subset rotating with the frames
+// so that every pixel is traced once in `interleave` frames. A pixel not traced keeps its
+// accumulation, except in the frames restarting it: interleave.comp then takes its color from the
+// history when the camera moved, otherwise interpolates it between traced neighbors along the
+// direction where the surface changes the least.
+// Shared between interleave.comp, raytrace.rgen and the C++ reference implementation.
+// Only code valid in both GLSL and C++ (with GLM) can be added here, except in the
+// __cplusplus section at the end.
+
+#ifndef INTERLEAVE_H
+#define INTERLEAVE_H
+
+#ifdef __cplusplus
+#include <cmath>
+#include <glm/glm.hpp>
+#include <vector>
+namespace interleave {
+using namespace glm;
+#endif
+
+const float kInterleaveEdgeCost = 0.1f;  // Interpolation cost above which two neighbors are not blended
+
+// True when the pixel is traced in the frame. The 2x2 quads trace their diagonal pixel second, so
+// that the first two frames already cover both diagonals.
+bool pixelTraced(ivec2 pixel, int interleave, int frame)
+{
+  if(interleave == 2)
+    return ((pixel.x + pixel.y) & 1) == (frame & 1);
+  if(interleave == 4)
+    return (pixel.x & 1) + 2 * (pixel.y & 1) == ((frame * 3) & 3);
+  return true;
+}
+
+// Offset to the pair of opposite neighbors k, in 0..3: horizontal, vertical and the two diagonals
+ivec2 interleaveOffset(int k)
+{
+  return k == 0 ? ivec2(1, 0) : k == 1 ? ivec2(0, 1) : k == 2 ? ivec2(1, 1) : ivec2(1, -1);
+}
+
+// Change of surface between two neighbors from their normal and linear depth (-1 on miss)
+float interpolationCost(vec4 nd0, vec4 nd1)
+{
+  if(nd0.w < 0.0f || nd1.w < 0.0f)
+    return nd0.w < 0.0f && nd1.w < 0.0f ? 0.0f : 1e3f;
+  return abs(nd0.w - nd1.w) / max(min(nd0.w, nd1.w), 1e-3f) + 1.0f - dot(vec3(nd0), vec3(nd1));
+}
+
+// Weight of the second neighbor in the interpolation: the average of the two on a smooth surface,
+// otherwise the closest of them, so that the silhouettes stay sharp
+float interpolationWeight(vec4 nd0, vec4 nd1)
+{
+  if(interpolationCost(nd0, nd1) < kInterleaveEdgeCost)
+    return 0.5f;
+  float depth0 = nd0.w < 0.0f ? 1e30f : nd0.w;
+  float depth1 = nd1.w < 0.0f ? 1e30f : nd1.w;
+  return depth1 < depth0 ? 1.0f : 0.0f;
+}
+
+#ifdef __cplusplus
+//--------------------------------------------------------------------------------------------------
+// CPU version of the interpolation of interleave.comp, in a frame where only the pixels of `frame`
+// were traced into color and normalDepth
+//
+inline void reconstructImage(std::vector<vec3>& color, std::vector<vec4>& normalDepth, int width,
+                             int height, int interleave, int frame)
+{
+  auto traced = [&](ivec2 p) {
+    return p.x >= 0 && p.y >= 0 && p.x < width && p.y < height && pixelTraced(p, interleave, frame);
+  };
+  auto index = [&](ivec2 p) { return p.y * width + p.x; };
+  for(int y = 0; y < height; y++)
+  {
+    for(int x = 0; x < width; x++)
+    {
+      const ivec2 p(x, y);
+      if(traced(p))
+        continue;
+      ivec2 a = p, b = p;
+      float bestCost = 1e30f;
+      for(int k = 0; k < 4; k++)
+      {
+        const ivec2 o = interleaveOffset(k);
+        if(!traced(p - o) || !traced(p + o))
+          continue;
+        float cost = interpolationCost(normalDepth[index(p - o)], normalDepth[index(p + o)]);
+        if(cost < bestCost)
+        {
+          a        = p - o;
+          b        = p + o;
+          bestCost = cost;
+        }
+      }
+      // Image border: one traced neighbor
+      for(int k = 0; k < 8 && a == p; k++)
+      {
+        const ivec2 q = k < 4 ? p + interleaveOffset(k) : p - interleaveOffset(k - 4);
+        if(traced(q))
+          a = b = q;
+      }
+      const float w   = interpolationWeight(normalDepth[index(a)], normalDepth[index(b)]);
+      color[index(p)] = mix(color[index(a)], color[index(b)], w);
+      vec4 nd         = mix(normalDepth[index(a)], normalDepth[index(b)], w);
+      if(nd.w >= 0.0f)
+        nd = vec4(normalize(vec3(nd)), nd.w);
+      normalDepth[index(p)] = nd;
+    }
+  }
+}
+
+}  // namespace interleave
+#endif
+
+#endif  // INTERLEAVE_H
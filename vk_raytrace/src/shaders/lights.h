@@ -0,0 +1,351 @@
+// Emissive triangles sampled by the path tracer (next event estimation), shared between the GLSL
+// shaders and the C++ code which builds the light list, its CDF and its light BVH.
+// Only code valid in both GLSL and C++ (with GLM) can be added here, except in the
+// __cplusplus section at the end.
+
+#ifndef LIGHTS_H
+#define LIGHTS_H
+
+#ifdef __cplusplus
+#include <algorithm>
+#include <cmath>
+#include <glm/glm.hpp>
+#include <limits>
+#include <vector>
+namespace lights {
+using namespace glm;
+#endif
+
+// One emissive triangle in world space, 64 bytes with the scalar block layout
+struct LightTriangle
+{
+  vec3  v0;
+  float area;
+  vec3  v1;
+  float cdf;  // Sum of the selection probabilities up to this triangle, included
+  vec3  v2;
+  float pdf;  // Probability of selecting this triangle: its share of the total power
+  vec3  emission;
+  float power;  // area * luminance(emission)
+};
+
+float luminance(vec3 c)
+{
+  return dot(c, vec3(0.2126f, 0.7152f, 0.0722f));
+}
+
+// Uniformly distributed point on a triangle, from two random floats in [0,1)
+vec3 sampleTriangle(vec3 v0, vec3 v1, vec3 v2, float r1, float r2)
+{
+  float s = sqrt(r1);
+  return v0 * (1.0f - s) + v1 * (s * (1.0f - r2)) + v2 * (s * r2);
+}
+
+// Solid angle pdf of a point on a light, from its area pdf, distance and the cosine between
+// the light normal and the direction
+float lightPdfSolidAngle(float pdfArea, float distance, float cosLight)
+{
+  return pdfArea * distance * distance / max(cosLight, 1e-6f);
+}
+
+// Multiple importance sampling weight of the strategy having pdfA, against the one having pdfB
+float powerHeuristic(float pdfA, float pdfB)
+{
+  float a = pdfA * pdfA;
+  float b = pdfB * pdfB;
+  return a + b > 0.0f ? a / (a + b) : 0.0f;
+}
+
+// Node of the light BVH: bounds, power and orientation of the lights below
+// - The nodes 0 .. lightCount-2 are interior nodes, the root first, and the leaf of the light i
+//   is the node lightCount-1+i
+// - All emitters are two-sided, the cones bound the normals up to their sign
+struct LightBvhNode
+{
+  vec3  bboxMin;
+  float power;
+  vec3  bboxMax;
+  float thetaO;  // Half-angle of the cone bounding the normals around `axis`
+  vec3  axis;
+  float thetaE;  // Emission angle beyond the normals, pi/2 for diffuse emitters
+  int   child0;  // Children of interior nodes
+  int   child1;
+  int   parent;  // -1 for the root
+  int   pad;
+};
+
+// Upper bound of the light received from a node by a surface at `position` facing `normal`,
+// following "Importance Sampling of Many Lights with Adaptive Tree Splitting" (Conty, Kulla)
+// Zero only when none of the lights of the node can light the surface.
+float lightNodeImportance(LightBvhNode node, vec3 position, vec3 normal)
+{
+  const float kHalfPi = 1.57079632679f;
+
+  vec3  center = 0.5f * (node.bboxMin + node.bboxMax);
+  float radius = 0.5f * length(node.bboxMax - node.bboxMin);
+  vec3  toPos  = position - center;
+  float dist   = length(toPos);
+  // Inside the bounding sphere, the lights can be in any direction
+  if(dist <= radius)
+    return node.power / max(radius * radius, 1e-8f);
+  toPos /= dist;
+  float thetaU = asin(radius / dist);  // Half-angle of the bounding sphere seen from the position
+
+  // Smallest angle between the emitting normals and the direction toward the position
+  float theta      = acos(min(abs(dot(node.axis, toPos)), 1.0f));
+  float thetaPrime = max(theta - node.thetaO - thetaU, 0.0f);
+  if(thetaPrime >= node.thetaE)
+    return 0.0f;
+
+  // Smallest angle between the surface normal and the direction toward the lights
+  float thetaI      = acos(clamp(dot(normal, -toPos), -1.0f, 1.0f));
+  float thetaIPrime = max(thetaI - thetaU, 0.0f);
+  if(thetaIPrime >= kHalfPi)
+    return 0.0f;
+
+  return node.power * cos(thetaPrime) * cos(thetaIPrime) / (dist * dist);
+}
+
+#ifdef __cplusplus
+//--------------------------------------------------------------------------------------------------
+// Computing the area, power, pdf and cdf of each triangle. Returns the total power.
+// The triangles not emitting any light are kept, with a null pdf, so their index does not change.
+//
+inline void accumulateLightCdf(std::vector<LightTriangle>& lights)
+{
+  float cdf = 0;
+  for(auto& l : lights)
+  {
+    cdf += l.pdf;
+    l.cdf = cdf;
+  }
+  if(!lights.empty())
+    lights.back().cdf = 1.f;  // Rounding errors
+}
+
+inline float buildLightCdf(std::vector<LightTriangle>& lights)
+{
+  float total = 0;
+  for(auto& l : lights)
+  {
+    l.area  = 0.5f * length(cross(l.v1 - l.v0, l.v2 - l.v0));
+    l.power = l.area > 0.f ? l.area * luminance(l.emission) : 0.f;
+    total += l.power;
+  }
+  for(auto& l : lights)
+  {
+    l.pdf = total > 0.f ? l.power / total : 0.f;
+  }
+  accumulateLightCdf(lights);
+  return total;
+}
+
+// Index of the triangle selected by u in [0,1), same search as in the ray generation shader
+inline uint32_t sampleLightCdf(const std::vector<LightTriangle>& lights, float u)
+{
+  uint32_t lo = 0;
+  uint32_t hi = static_cast<uint32_t>(lights.size()) - 1;
+  while(lo < hi)
+  {
+    uint32_t mid = (lo + hi) / 2;
+    if(u < lights[mid].cdf)
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+  return lo;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Light BVH
+//
+inline LightBvhNode lightBvhLeaf(const LightTriangle& l)
+{
+  LightBvhNode node{};
+  node.bboxMin = min(min(l.v0, l.v1), l.v2);
+  node.bboxMax = max(max(l.v0, l.v1), l.v2);
+  node.power   = l.power;
+  vec3 n       = cross(l.v1 - l.v0, l.v2 - l.v0);
+  node.axis    = length(n) > 0.f ? normalize(n) : vec3(0, 1, 0);
+  node.thetaO  = 0.f;
+  node.thetaE  = 1.57079632679f;
+  node.child0 = node.child1 = node.parent = -1;
+  return node;
+}
+
+// Node bounding a and b: union of the boxes and of the normal cones
+inline LightBvhNode mergeLightBvhNodes(const LightBvhNode& a, const LightBvhNode& b)
+{
+  const float kPi = 3.14159265358979f;
+
+  LightBvhNode node{};
+  node.bboxMin = min(a.bboxMin, b.bboxMin);
+  node.bboxMax = max(a.bboxMax, b.bboxMax);
+  node.power   = a.power + b.power;
+  node.thetaE  = std::max(a.thetaE, b.thetaE);
+  node.child0 = node.child1 = node.parent = -1;
+
+  // The wider cone first, the other one flipped toward it since the emitters are two-sided
+  const LightBvhNode& wide   = a.thetaO >= b.thetaO ? a : b;
+  const LightBvhNode& narrow = a.thetaO >= b.thetaO ? b : a;
+  vec3  narrowAxis = dot(wide.axis, narrow.axis) < 0.f ? -narrow.axis : narrow.axis;
+  float thetaD     = std::acos(clamp(dot(wide.axis, narrowAxis), -1.f, 1.f));
+  if(std::min(thetaD + narrow.thetaO, kPi) <= wide.thetaO)
+  {
+    node.axis   = wide.axis;
+    node.thetaO = wide.thetaO;
+    return node;
+  }
+  node.thetaO = (wide.thetaO + thetaD + narrow.thetaO) * 0.5f;
+  if(node.thetaO >= kPi)
+  {
+    node.axis   = wide.axis;
+    node.thetaO = kPi;
+    return node;
+  }
+  // Rotating the wide axis toward the narrow one
+  vec3 ortho = narrowAxis - wide.axis * dot(wide.axis, narrowAxis);
+  if(length(ortho) < 1e-6f)
+  {
+    node.axis = wide.axis;
+    return node;
+  }
+  float thetaR = node.thetaO - wide.thetaO;
+  node.axis    = normalize(wide.axis * std::cos(thetaR) + normalize(ortho) * std::sin(thetaR));
+  return node;
+}
+
+inline int buildLightBvhRange(std::vector<LightTriangle>& lights,
+                              std::vector<uint32_t>&      order,
+                              std::vector<LightBvhNode>&  nodes,
+                              uint32_t                    begin,
+                              uint32_t                    end,
+                              int                         parent,
+                              int&                        nextInterior)
+{
+  const int leafBase = static_cast<int>(lights.size()) - 1;
+  if(end - begin == 1)
+  {
+    int leaf           = leafBase + static_cast<int>(begin);
+    nodes[leaf]        = lightBvhLeaf(lights[order[begin]]);
+    nodes[leaf].parent = parent;
+    return leaf;
+  }
+
+  // Median split along the largest extent of the triangle centers
+  vec3 cMin(std::numeric_limits<float>::max());
+  vec3 cMax(-std::numeric_limits<float>::max());
+  for(uint32_t i = begin; i < end; i++)
+  {
+    const LightTriangle& l = lights[order[i]];
+    vec3                 c = (l.v0 + l.v1 + l.v2) / 3.f;
+    cMin                   = min(cMin, c);
+    cMax                   = max(cMax, c);
+  }
+  vec3 extent = cMax - cMin;
+  int  axis   = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+  uint32_t mid = (begin + end) / 2;
+  std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end,
+                   [&](uint32_t i, uint32_t j) {
+                     const LightTriangle& a = lights[i];
+                     const LightTriangle& b = lights[j];
+                     return (a.v0 + a.v1 + a.v2)[axis] < (b.v0 + b.v1 + b.v2)[axis];
+                   });
+
+  int node    = nextInterior++;
+  int child0  = buildLightBvhRange(lights, order, nodes, begin, mid, node, nextInterior);
+  int child1  = buildLightBvhRange(lights, order, nodes, mid, end, node, nextInterior);
+  nodes[node] = mergeLightBvhNodes(nodes[child0], nodes[child1]);
+  nodes[node].child0 = child0;
+  nodes[node].child1 = child1;
+  nodes[node].parent = parent;
+  return node;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Building the light BVH of triangles having their power computed by buildLightCdf
+// - The triangles are reordered to follow the leaves, and their CDF updated
+// - Returns the previous index of each triangle
+//
+inline std::vector<uint32_t> buildLightBvh(std::vector<LightTriangle>& lights,
+                                           std::vector<LightBvhNode>&  nodes)
+{
+  std::vector<uint32_t> order(lights.size());
+  for(uint32_t i = 0; i < order.size(); i++)
+    order[i] = i;
+  nodes.clear();
+  if(lights.empty())
+    return order;
+
+  nodes.resize(lights.size() * 2 - 1);
+  int nextInterior = 0;
+  buildLightBvhRange(lights, order, nodes, 0, static_cast<uint32_t>(lights.size()), -1, nextInterior);
+
+  std::vector<LightTriangle> sorted(lights.size());
+  for(size_t i = 0; i < order.size(); i++)
+    sorted[i] = lights[order[i]];
+  lights.swap(sorted);
+  accumulateLightCdf(lights);
+  return order;
+}
+
+// Light picked by u in [0,1) for the surface at position/normal, and its probability.
+// Returns -1 when no light can reach the surface. Same traversal as in the ray generation shader.
+inline int sampleLightBvh(const std::vector<LightBvhNode>& nodes,
+                          int                              lightCount,
+                          vec3                             position,
+                          vec3                             normal,
+                          float                            u,
+                          float&                           pdf)
+{
+  int node = 0;
+  pdf      = 1.f;
+  while(node < lightCount - 1)
+  {
+    float i0 = lightNodeImportance(nodes[nodes[node].child0], position, normal);
+    float i1 = lightNodeImportance(nodes[nodes[node].child1], position, normal);
+    if(i0 + i1 <= 0.f)
+      return -1;
+    float p0 = i0 / (i0 + i1);
+    if(u < p0)
+    {
+      u /= p0;
+      pdf *= p0;
+      node = nodes[node].child0;
+    }
+    else
+    {
+      u = std::min((u - p0) / (1.f - p0), 0.99999994f);
+      pdf *= 1.f - p0;
+      node = nodes[node].child1;
+    }
+  }
+  return node - (lightCount - 1);
+}
+
+// Probability of sampleLightBvh picking `light` for the surface at position/normal
+inline float lightBvhPdf(const std::vector<LightBvhNode>& nodes,
+                         int                              lightCount,
+                         int                              light,
+                         vec3                             position,
+                         vec3                             normal)
+{
+  float pdf  = 1.f;
+  int   node = lightCount - 1 + light;
+  while(nodes[node].parent >= 0)
+  {
+    const LightBvhNode& parent = nodes[nodes[node].parent];
+    float               i0     = lightNodeImportance(nodes[parent.child0], position, normal);
+    float               i1     = lightNodeImportance(nodes[parent.child1], position, normal);
+    if(i0 + i1 <= 0.f)
+      return 0.f;
+    pdf *= (node == parent.child0 ? i0 : i1) / (i0 + i1);
+    node = nodes[node].parent;
+  }
+  return pdf;
+}
+
+}  // namespace lights
+#endif
+
+#endif  // LIGHTS_H
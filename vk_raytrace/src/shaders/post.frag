@@ -3,10 +3,16 @@ layout(location = 0) in vec2 outUV;
 layout(location = 0) out vec4 fragColor;
 
 layout(set = 0, binding = 0) uniform sampler2D noisyTxt;
+layout(set = 0, binding = 1) uniform sampler2D varianceTxt;  // w: 1 when the pixel is converged
+layout(set = 0, binding = 2) uniform sampler2D denoisedTxt;
+layout(set = 0, binding = 3) uniform sampler2D upscaledTxt;  // One of the two, at the window size
 
 layout(push_constant) uniform shaderInformation
 {
   float aspectRatio;
+  int   showConvergence;
+  int   denoised;  // Showing denoisedTxt instead of noisyTxt
+  int   upscaled;  // Showing upscaledTxt
 }
 pushc;
 
@@ -14,5 +20,15 @@ void main()
 {
   vec2  uv    = outUV;
   float gamma = 1. / 2.2;
-  fragColor   = pow(texture(noisyTxt, uv).rgba, vec4(gamma));
+  vec4  color = pushc.denoised != 0 ? texture(denoisedTxt, uv) : texture(noisyTxt, uv);
+  if(pushc.upscaled != 0)
+    color = texture(upscaledTxt, uv);
+  fragColor   = pow(color, vec4(gamma));
+
+  // Converged pixels in green, pixels still sampled in red
+  if(pushc.showConvergence != 0)
+  {
+    vec3 mask     = texture(varianceTxt, uv).w > 0.5 ? vec3(0, 1, 0) : vec3(1, 0, 0);
+    fragColor.rgb = mix(fragColor.rgb, mask, 0.4);
+  }
 }
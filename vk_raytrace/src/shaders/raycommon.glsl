@@ -1,8 +1,22 @@
-
+// Surface data returned by the closest hit shader, the path is traced by the ray generation shader
 struct hitPayload
 {
-	vec3 hitValue;
-	int recursionDepth;
-	vec3 attenuation;
-	uint seed;
-};
\ No newline at end of file
+  vec3  position;  // World-space position of the hit
+  float hitT;      // Distance to the hit, negative when the ray missed
+  vec3  normal;    // World-space shading normal
+  uint  objId;     // Object hit, to fetch its materials
+  vec3  texColor;  // Texture color at the hit, 1 when the material has no texture
+  int   matIndex;  // Material of the hit triangle in the object
+  int   lightIndex;  // Index of the hit triangle in the light list, -1 if not emissive
+  int   hitGroup;    // HIT_GROUP_* of the hit object
+};
+
+// Closest hit of the extend stage of the wavefront path tracer without ray queries, see
+// wf_extend.rgen: distance (negative on miss), barycentrics, instance and triangle
+struct wfHitPayload
+{
+  float t;
+  vec2  barycentrics;
+  int   instance;
+  int   primitive;
+};
@@ -0,0 +1,63 @@
+// Reprojection of the accumulated samples when the camera moves: each pixel finds where its surface
+// was in the previous frame and reuses the samples of that pixel when it saw the same surface.
+// Shared between the GLSL shaders and the C++ tests, which validate the math on a synthetic scene.
+// Only code valid in both GLSL and C++ (with GLM) can be added here.
+
+#ifndef REPROJECT_H
+#define REPROJECT_H
+
+#ifdef __cplusplus
+#include <glm/glm.hpp>
+namespace reproject {
+using namespace glm;
+#endif
+
+// Position of a world point in the image of the camera viewProj, in pixels: the center of the
+// pixel (x, y) is at (x + 0.5, y + 0.5)
+vec2 projectToPixel(mat4 viewProj, vec3 position, vec2 imageSize)
+{
+  vec4 clip = viewProj * vec4(position, 1.0f);
+  return (vec2(clip) / clip.w * 0.5f + 0.5f) * imageSize;
+}
+
+// Distance of a world point to the plane of the camera viewProj: the w of its clip coordinates
+float linearDepth(mat4 viewProj, vec3 position)
+{
+  return (viewProj * vec4(position, 1.0f)).w;
+}
+
+// True when the previous frame saw the same surface: `expectedDepth` is the depth of the current
+// hit seen from the previous camera, `prevDepth` the depth stored by the previous frame
+bool historyConsistent(float expectedDepth, float prevDepth, vec3 normal, vec3 prevNormal)
+{
+  if(prevDepth < 0.0f)
+    return false;
+  return abs(expectedDepth - prevDepth) < 0.05f * expectedDepth && dot(normal, prevNormal) > 0.9f;
+}
+
+// Bilinear weight of the texel base + (i & 1, i >> 1), i in 0..3, at the pixel position `pixel`
+// where base = ivec2(floor(pixel - 0.5))
+float bilinearWeight(vec2 pixel, int i)
+{
+  vec2 f = fract(pixel - 0.5f);
+  return ((i & 1) != 0 ? f.x : 1.0f - f.x) * ((i >> 1) != 0 ? f.y : 1.0f - f.y);
+}
+
+// Running statistics of the luminance (mean, M2, count, converged) of a reprojected pixel, with
+// the count capped to maxHistory: the new samples keep at least 1 / (maxHistory + 1) of the
+// weight, as in an exponential moving average, and the variance estimate is kept
+vec4 capHistory(vec4 stats, float maxHistory)
+{
+  if(stats.z > maxHistory)
+  {
+    stats.y *= maxHistory / stats.z;
+    stats.z = maxHistory;
+  }
+  return stats;
+}
+
+#ifdef __cplusplus
+}  // namespace reproject
+#endif
+
+#endif  // REPROJECT_H
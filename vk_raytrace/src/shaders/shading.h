@@ -0,0 +1,75 @@
+// Bounce and shading math of the path tracer, shared between the GLSL shaders and the C++ code
+// so the same functions can be tested and benchmarked on the CPU.
+// Only code valid in both GLSL and C++ (with GLM) can be added here.
+
+#ifndef SHADING_H
+#define SHADING_H
+
+#ifdef __cplusplus
+#include <cmath>
+#include <glm/glm.hpp>
+namespace shading {
+using namespace glm;
+#endif
+
+const float kPi = 3.14159265358979f;
+
+// Maximum number of bounces after the primary hit
+const int kMaxBounces = 8;
+// Bounces always followed before the paths can be terminated by Russian roulette
+const int kRussianRouletteDepth = 3;
+
+// Given two random floats in [0,1), computes a direction in the y>0 hemisphere,
+// distributed according to the cosine with the y axis (pdf cos(theta) / pi)
+vec3 hemisphereCosine(float r1, float r2)
+{
+  float phi      = r1 * 2.0f * kPi;
+  float sinTheta = sqrt(r2);
+  return vec3(sinTheta * cos(phi), sqrt(max(1.0f - r2, 0.0f)), sinTheta * sin(phi));
+}
+
+// Returns a matrix that will transform a (0,1,0)-relative hemisphere vector
+// to be relative to a specified normal vector instead
+mat3 normalYBasis(vec3 N)
+{
+  vec3 u;
+  if(abs(N.x) > abs(N.y))
+    u = normalize(vec3(N.z, 0, -N.x));
+  else
+    u = normalize(vec3(0, -N.z, N.y));
+
+  vec3 w = cross(N, u);
+  return mat3(u, N, w);
+}
+
+// Direction of the next bounce around the normal, from two random floats in [0,1)
+vec3 sampleBounce(vec3 normal, float r1, float r2)
+{
+  return normalYBasis(normal) * hemisphereCosine(r1, r2);
+}
+
+// Weight of a bounce on a Lambertian surface of reflectance `albedo`, with a direction
+// sampled by sampleBounce: BRDF (albedo / pi) * cos(theta) / pdf (cos(theta) / pi)
+vec3 bounceWeight(vec3 albedo, vec3 normal, vec3 direction)
+{
+  return dot(direction, normal) > 0.0f ? albedo : vec3(0.0f);
+}
+
+// Solid angle pdf of sampleBounce choosing `direction`, for multiple importance sampling
+float bouncePdf(vec3 normal, vec3 direction)
+{
+  return max(dot(direction, normal), 0.0f) / kPi;
+}
+
+// Probability of continuing a path after kRussianRouletteDepth bounces: the paths carrying little
+// energy are the most likely to stop. The throughput of the surviving paths is divided by it.
+float russianRouletteSurvival(vec3 throughput)
+{
+  return clamp(max(throughput.x, max(throughput.y, throughput.z)), 0.05f, 0.95f);
+}
+
+#ifdef __cplusplus
+}  // namespace shading
+#endif
+
+#endif  // SHADING_H
@@ -0,0 +1,145 @@
+// Owen-scrambled Sobol sequence, following Burley, "Practical Hash-based Owen Scrambling" (JCGT 2020).
+// Shared between the GLSL shaders and the C++ code, which generates the direction numbers.
+// Only code valid in both GLSL and C++ (with GLM) can be added here, except in the
+// __cplusplus sections.
+//
+// The includer defines SOBOL_DIRECTION(dim, bit), returning the direction number `bit` of the
+// dimension `dim` of the table. In C++, it defaults to the table of sobolDirections().
+
+#ifndef SOBOL_H
+#define SOBOL_H
+
+#ifdef __cplusplus
+#include <glm/glm.hpp>
+#include <stdexcept>
+#include <vector>
+namespace sobol {
+using namespace glm;
+#endif
+
+// Dimensions of the direction table. The following dimensions reuse them, with the sample
+// indices shuffled differently for each group of kSobolDimensions dimensions ("padding").
+const uint kSobolDimensions = 4u;
+
+#ifdef __cplusplus
+//--------------------------------------------------------------------------------------------------
+// Direction numbers of the first `dimensions` dimensions, 32 per dimension. The first dimension
+// is the van der Corput sequence, the next ones use the primitive polynomials and initial
+// direction numbers of Joe and Kuo.
+//
+inline std::vector<uint32_t> generateSobolDirections(uint32_t dimensions)
+{
+  struct Polynomial
+  {
+    uint32_t degree;
+    uint32_t coefficients;  // Inner coefficients, highest degree first
+    uint32_t m[5];          // Initial direction numbers
+  };
+  static const Polynomial polynomials[] = {
+      {1, 0, {1}},          {2, 1, {1, 3}},       {3, 1, {1, 3, 1}},       {3, 2, {1, 1, 1}},
+      {4, 1, {1, 1, 3, 3}}, {4, 4, {1, 3, 5, 13}}, {5, 2, {1, 1, 5, 5, 17}}, {5, 4, {1, 1, 5, 5, 5}},
+  };
+  if(dimensions > 1 + sizeof(polynomials) / sizeof(polynomials[0]))
+    throw std::runtime_error("Not enough Sobol polynomials");
+
+  std::vector<uint32_t> directions(dimensions * 32);
+  for(uint32_t bit = 0; bit < 32; bit++)
+    directions[bit] = 1u << (31 - bit);
+  for(uint32_t dim = 1; dim < dimensions; dim++)
+  {
+    const Polynomial& p = polynomials[dim - 1];
+    uint32_t*         v = &directions[dim * 32];
+    for(uint32_t bit = 0; bit < 32; bit++)
+    {
+      if(bit < p.degree)
+      {
+        v[bit] = p.m[bit] << (31 - bit);
+        continue;
+      }
+      v[bit] = v[bit - p.degree] ^ (v[bit - p.degree] >> p.degree);
+      for(uint32_t k = 1; k < p.degree; k++)
+      {
+        if((p.coefficients >> (p.degree - 1 - k)) & 1)
+          v[bit] ^= v[bit - k];
+      }
+    }
+  }
+  return directions;
+}
+
+inline const std::vector<uint32_t>& sobolDirections()
+{
+  static const std::vector<uint32_t> directions = generateSobolDirections(kSobolDimensions);
+  return directions;
+}
+
+#ifndef SOBOL_DIRECTION
+#define SOBOL_DIRECTION(dim, bit) sobolDirections()[(dim)*32 + (bit)]
+#endif
+#endif
+
+uint reverseBits(uint x)
+{
+  x = ((x & 0xaaaaaaaau) >> 1) | ((x & 0x55555555u) << 1);
+  x = ((x & 0xccccccccu) >> 2) | ((x & 0x33333333u) << 2);
+  x = ((x & 0xf0f0f0f0u) >> 4) | ((x & 0x0f0f0f0fu) << 4);
+  x = ((x & 0xff00ff00u) >> 8) | ((x & 0x00ff00ffu) << 8);
+  return (x >> 16) | (x << 16);
+}
+
+// Integer hash with a good avalanche (lowbias32)
+uint hashUint(uint x)
+{
+  x ^= x >> 16;
+  x *= 0x7feb352du;
+  x ^= x >> 15;
+  x *= 0x846ca68bu;
+  x ^= x >> 16;
+  return x;
+}
+
+uint hashCombine(uint seed, uint v)
+{
+  return hashUint(seed ^ (v + 0x9e3779b9u + (seed << 6) + (seed >> 2)));
+}
+
+// Owen scrambling of the bits of x, seen as a number in [0,1): each bit is flipped depending on
+// the bits above it (Laine-Karras permutation on reversed bits)
+uint nestedUniformScramble(uint x, uint seed)
+{
+  x = reverseBits(x);
+  x += seed;
+  x ^= x * 0x6c50b47cu;
+  x ^= x * 0xb82f1e52u;
+  x ^= x * 0xc7afe638u;
+  x ^= x * 0x8d22f6e6u;
+  return reverseBits(x);
+}
+
+uint sobolSample(uint index, uint dim)
+{
+  uint x = 0u;
+  for(uint bit = 0u; bit < 32u && index != 0u; bit++, index >>= 1)
+  {
+    if((index & 1u) != 0u)
+      x ^= SOBOL_DIRECTION(dim, bit);
+  }
+  return x;
+}
+
+// Value in [0,1) of the sample `index` of a pixel in `dimension`. The pixel seed decorrelates
+// the pixels: each pixel has its own shuffle of the samples and its own scrambling.
+float sobolOwen(uint index, uint dimension, uint seed)
+{
+  uint group    = dimension / kSobolDimensions;
+  uint shuffled = nestedUniformScramble(index, hashCombine(seed, group));
+  uint x        = sobolSample(shuffled, dimension % kSobolDimensions);
+  x             = nestedUniformScramble(x, hashCombine(seed, dimension + 0x10000u));
+  return min(float(x >> 8) / 16777216.0f, 0.99999994f);
+}
+
+#ifdef __cplusplus
+}  // namespace sobol
+#endif
+
+#endif  // SOBOL_H
@@ -0,0 +1,127 @@
+// Edge-aware upscaling of the image rendered at a lower resolution to the window, in the spirit of
+// the edge-adaptive spatial upsampling of AMD FidelityFX Super Resolution 1: a Lanczos-2 kernel
+// over the 4x4 texels around each output pixel, stretched along the local edge so that edges are
+// smoothed along their length but stay sharp across it, and clamped to the 2x2 nearest texels to
+// avoid ringing.
+// Shared between upscale.comp and the C++ reference implementation.
+// Only code valid in both GLSL and C++ (with GLM) can be added here, except in the
+// __cplusplus section at the end.
+
+#ifndef UPSCALE_H
+#define UPSCALE_H
+
+#ifdef __cplusplus
+#include <cmath>
+#include <glm/glm.hpp>
+#include <vector>
+namespace upscale {
+using namespace glm;
+#endif
+
+const float kUpscaleAnisotropy = 1.0f;  // Extra length of the kernel along a strong edge
+const float kUpscaleEdgeScale  = 8.0f;  // Luma gradient over which an edge is fully stretched
+
+// Luma of the edge detection, compressed so that the bright emitters do not hide the other edges
+float upscaleLuma(vec3 c)
+{
+  float l = dot(c, vec3(0.2126f, 0.7152f, 0.0722f));
+  return l / (1.0f + l);
+}
+
+// Lanczos-2 window, x in texels
+float lanczos2(float x)
+{
+  if(x < 1e-4f)
+    return 1.0f;
+  if(x >= 2.0f)
+    return 0.0f;
+  float px = 3.14159265f * x;
+  return 2.0f * sin(px) * sin(px * 0.5f) / (px * px);
+}
+
+// Luma gradient at the sample, f being its position inside the 2x2 central texels of the 4x4
+// block of lumas l (row-major): central differences at the four central texels, interpolated
+// bilinearly
+vec2 lumaGradient(float l[16], vec2 f)
+{
+  vec2 g = vec2(0.0f);
+  for(int j = 1; j <= 2; j++)
+  {
+    for(int i = 1; i <= 2; i++)
+    {
+      float w = (i == 1 ? 1.0f - f.x : f.x) * (j == 1 ? 1.0f - f.y : f.y);
+      g += w * vec2(l[j * 4 + i + 1] - l[j * 4 + i - 1], l[(j + 1) * 4 + i] - l[(j - 1) * 4 + i]);
+    }
+  }
+  return g * 0.5f;
+}
+
+// Weight of the texel at offset d from the sample, in texels, for the luma gradient g
+float upscaleWeight(vec2 d, vec2 g)
+{
+  float strength = length(g);
+  vec2  across   = strength > 1e-5f ? g / strength : vec2(1.0f, 0.0f);
+  float stretch  = 1.0f + kUpscaleAnisotropy * clamp(strength * kUpscaleEdgeScale, 0.0f, 1.0f);
+  vec2  r        = vec2(dot(d, across), (d.y * across.x - d.x * across.y) / stretch);
+  return lanczos2(length(r));
+}
+
+#ifdef __cplusplus
+//--------------------------------------------------------------------------------------------------
+// CPU version of upscale.comp, and bilinear upscaling to compare with
+//
+inline std::vector<vec3> upscaleImage(const std::vector<vec3>& src, int srcWidth, int srcHeight,
+                                      int dstWidth, int dstHeight, bool edgeAware)
+{
+  auto fetch = [&](int x, int y) {
+    x = clamp(x, 0, srcWidth - 1);
+    y = clamp(y, 0, srcHeight - 1);
+    return src[y * srcWidth + x];
+  };
+  std::vector<vec3> dst(dstWidth * dstHeight);
+  for(int y = 0; y < dstHeight; y++)
+  {
+    for(int x = 0; x < dstWidth; x++)
+    {
+      vec2  pos  = (vec2(x, y) + 0.5f) * vec2(srcWidth, srcHeight) / vec2(dstWidth, dstHeight) - 0.5f;
+      ivec2 base = ivec2(floor(pos));
+      vec2  f    = pos - vec2(base);
+      if(!edgeAware)
+      {
+        dst[y * dstWidth + x] = mix(mix(fetch(base.x, base.y), fetch(base.x + 1, base.y), f.x),
+                                    mix(fetch(base.x, base.y + 1), fetch(base.x + 1, base.y + 1), f.x), f.y);
+        continue;
+      }
+
+      vec3  taps[16];
+      float lumas[16];
+      for(int t = 0; t < 16; t++)
+      {
+        taps[t]  = fetch(base.x + t % 4 - 1, base.y + t / 4 - 1);
+        lumas[t] = upscaleLuma(taps[t]);
+      }
+      vec2  g     = lumaGradient(lumas, f);
+      vec3  sum   = vec3(0.0f);
+      float sumW  = 0.0f;
+      vec3  lower = vec3(1e30f), upper = vec3(-1e30f);
+      for(int t = 0; t < 16; t++)
+      {
+        float w = upscaleWeight(vec2(t % 4 - 1, t / 4 - 1) - f, g);
+        sum += w * taps[t];
+        sumW += w;
+      }
+      for(int t : {5, 6, 9, 10})
+      {
+        lower = min(lower, taps[t]);
+        upper = max(upper, taps[t]);
+      }
+      dst[y * dstWidth + x] = clamp(sum / max(sumW, 1e-4f), lower, upper);
+    }
+  }
+  return dst;
+}
+
+}  // namespace upscale
+#endif
+
+#endif  // UPSCALE_H
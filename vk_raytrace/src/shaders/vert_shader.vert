@@ -20,7 +20,6 @@ ubo;
 layout(push_constant) uniform shaderInformation
 {
   vec3  lightPosition;
-  uint  instanceId;
   float lightIntensity;
   int   lightType;
 }
@@ -38,6 +37,7 @@ layout(location = 1) out vec2 fragTexCoord;
 layout(location = 2) out vec3 fragNormal;
 layout(location = 3) out vec3 viewDir;
 layout(location = 4) out vec3 worldPos;
+layout(location = 5) flat out int instanceId;
 
 out gl_PerVertex
 {
@@ -47,8 +47,10 @@ out gl_PerVertex
 
 void main()
 {
-  mat4 objMatrix   = scnDesc.i[pushC.instanceId].transfo;
-  mat4 objMatrixIT = scnDesc.i[pushC.instanceId].transfoIT;
+  // The indirect draw of each instance starts at its index, see HelloVulkan::createIndirectBuffer
+  instanceId       = gl_InstanceIndex;
+  mat4 objMatrix   = scnDesc.i[instanceId].transfo;
+  mat4 objMatrixIT = scnDesc.i[instanceId].transfoIT;
 
   vec3 origin = vec3(ubo.viewI * vec4(0, 0, 0, 1));
 
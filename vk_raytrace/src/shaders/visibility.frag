@@ -0,0 +1,16 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// Visibility buffer: the raster only writes the instance and the triangle seen by each pixel, the
+// shading being done once per pixel by visibility.comp. gl_PrimitiveID counts the triangles from
+// the start of each draw, which starts at the first index of the model: it is the triangle of
+// the model. Reading it in the fragment shader needs the geometryShader feature.
+
+layout(location = 5) flat in int instanceId;
+
+layout(location = 0) out uvec2 outVisibility;  // Instance + 1, the background keeping 0, triangle
+
+void main()
+{
+  outVisibility = uvec2(instanceId + 1, gl_PrimitiveID);
+}
@@ -27,6 +27,8 @@ struct sceneDesc
   int  txtOffset;
   mat4 transfo;
   mat4 transfoIT;
+  uint mask;  // Visibility categories, RAY_MASK_*
+  int  lightOffset;  // Offset of its triangles in the light index buffer, -1 if not emissive
 };
 
 
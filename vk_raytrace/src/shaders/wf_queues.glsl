@@ -0,0 +1,91 @@
+// Resources of the wavefront path tracer, shared by its stages wf_*.comp: the path tracing of
+// raytrace.rgen split into one compute shader per stage, the paths going from one stage to the next
+// through queues stored as structures of arrays. (Not to be confused with wavefront.glsl, the
+// materials of the Wavefront OBJ files.)
+// Needs host_device.h, raycommon.glsl, wavefront.glsl and lights.h. Without ray queries, the
+// extend and shadow stages are ray generation shaders, which define WF_TRACE_RAYS.
+
+#ifndef WF_TRACE_RAYS
+layout(local_size_x = WF_GROUP_SIZE) in;
+#endif
+
+layout(binding = 0, set = 0) uniform accelerationStructureEXT topLevelAS;
+layout(binding = 1, set = 0, rgba32f) uniform image2D image;
+layout(binding = 2, set = 0, rgba32f) uniform image2D varianceImage;  // Same statistics as raytrace.rgen
+layout(binding = 3, set = 0, scalar) buffer Lights { LightTriangle l[]; } lights;
+// WF_QUEUE_COUNT counters of WF_COUNTER_SIZE uints, see host_device.h
+layout(binding = 4, set = 0) buffer QueueCounters { uint c[]; } counters;
+// Paths to extend: WF_QUEUE_RAY0 in the first pathCapacity entries, WF_QUEUE_RAY1 in the next ones
+layout(binding = 5, set = 0) buffer RayOrigins { vec4 v[]; } rayOrigins;  // w: pdf of the bounce
+layout(binding = 6, set = 0) buffer RayDirections { vec4 v[]; } rayDirections;
+layout(binding = 7, set = 0) buffer RayThroughputs { vec4 v[]; } rayThroughputs;
+layout(binding = 8, set = 0) buffer RayPaths { uvec2 v[]; } rayPaths;  // Pixel, state of the LCG
+// Closest hit of each entry of the ray queue extended last: distance and barycentrics, instance
+// and triangle
+layout(binding = 9, set = 0) buffer Hits { vec4 v[]; } hits;
+layout(binding = 10, set = 0) buffer HitIds { ivec2 v[]; } hitIds;
+// Entries of the extended ray queue sorted by material class: WF_QUEUE_MISS in the first
+// pathCapacity entries, WF_QUEUE_DIFFUSE in the next ones
+layout(binding = 11, set = 0) buffer ClassQueues { uint i[]; } classQueues;
+// Shadow rays: origin and length, direction, and contribution to the pixel when not occluded
+layout(binding = 12, set = 0) buffer ShadowOrigins { vec4 v[]; } shadowOrigins;
+layout(binding = 13, set = 0) buffer ShadowDirections { vec4 v[]; } shadowDirections;
+layout(binding = 14, set = 0) buffer ShadowRadiance { vec4 v[]; } shadowRadiance;  // w: pixel bits
+// Radiance gathered by the path of each pixel for the current sample
+layout(binding = 15, set = 0) buffer PixelRadiance { vec4 v[]; } pixelRadiance;
+
+// Scene, same set as the ray tracing pipeline
+layout(binding = 0, set = 1) uniform CameraProperties
+{
+  mat4 view;
+  mat4 proj;
+  mat4 viewInverse;
+  mat4 projInverse;
+  mat4 prevViewProj;
+}
+cam;
+layout(binding = 1, set = 1, scalar) buffer MatColorBufferObject { WaveFrontMaterial m[]; } materials[];
+layout(binding = 2, set = 1, scalar) buffer ScnDesc { sceneDesc i[]; } scnDesc;
+layout(binding = 3, set = 1) uniform sampler2D textureSamplers[];
+layout(binding = 4, set = 1, scalar) buffer Vertices { Vertex v[]; } vertices[];
+layout(binding = 5, set = 1) buffer Indices { uint i[]; } indices[];
+layout(binding = 6, set = 1) buffer LightPrims { int i[]; } lightPrims;
+
+layout(push_constant) uniform WavefrontConstants
+{
+  vec4 clearColor;
+  int  frameCounter;
+  int  sampleIndex;      // Sample of the pixels in the frame
+  int  samplesPerPixel;  // Samples of the frame
+  int  bounce;           // Depth of the paths of the ray queue WF_QUEUE_RAY0 + bounce % 2
+  int  lightCount;
+  uint pathCapacity;     // Pixels of the image: entries of each queue
+}
+pushc;
+
+uint queueCount(int queue)
+{
+  return counters.c[queue * WF_COUNTER_SIZE];
+}
+
+// Reserving an entry at the end of a queue. The first entry of each workgroup of the consuming
+// stage also adds that workgroup to its indirect dispatch.
+uint queuePush(int queue)
+{
+  uint index = atomicAdd(counters.c[queue * WF_COUNTER_SIZE], 1);
+  if (index % WF_GROUP_SIZE == 0)
+    atomicAdd(counters.c[queue * WF_COUNTER_SIZE + 1], 1);
+  return index;
+}
+
+// Ray queue holding the paths of the current bounce
+int currentRayQueue()
+{
+  return WF_QUEUE_RAY0 + pushc.bounce % 2;
+}
+
+// Position of the entry `index` of a ray queue in the ray arrays
+uint raySlot(int queue, uint index)
+{
+  return uint(queue - WF_QUEUE_RAY0) * pushc.pathCapacity + index;
+}
@@ -0,0 +1,98 @@
+// Void-and-cluster blue-noise masks of the sampler (common/bluenoise.h): each rank appears once, and
+// the mask tiles, with no seam where it wraps around.
+
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+#include "bluenoise.h"
+#include "shaders/host_device.h"
+#include "test_util.h"
+
+// Variance of the 3x3 averages of the mask, over the windows crossing the edges of the mask
+// (x) and over the others (y). White noise gives 1/108; blue noise, without low frequencies,
+// much less, on both sides of the edges when the mask tiles.
+static void boxVariance(const std::vector<float>& mask, int size, double& border, double& interior)
+{
+  double sums[2]   = {0.0, 0.0};
+  int    counts[2] = {0, 0};
+  for(int y = 0; y < size; y++)
+  {
+    for(int x = 0; x < size; x++)
+    {
+      double mean = 0.0;
+      for(int dy = -1; dy <= 1; dy++)
+        for(int dx = -1; dx <= 1; dx++)
+          mean += mask[((y + dy + size) % size) * size + (x + dx + size) % size] / 9.0;
+      const int crossing = x == 0 || y == 0 || x == size - 1 || y == size - 1 ? 0 : 1;
+      sums[crossing] += (mean - 0.5) * (mean - 0.5);
+      counts[crossing]++;
+    }
+  }
+  border   = sums[0] / counts[0];
+  interior = sums[1] / counts[1];
+}
+
+// Smallest toroidal distance between two of the `count` first pixels of the mask that are closest
+// through the edges of the mask
+static float closestAcrossEdges(const std::vector<float>& mask, int size, int count)
+{
+  std::vector<int> pixels;
+  for(int p = 0; p < size * size; p++)
+    if(mask[p] * float(size * size) < float(count))
+      pixels.push_back(p);
+  float closest = float(size);
+  for(size_t i = 0; i < pixels.size(); i++)
+  {
+    for(size_t j = i + 1; j < pixels.size(); j++)
+    {
+      const int dx = std::abs(pixels[i] % size - pixels[j] % size);
+      const int dy = std::abs(pixels[i] / size - pixels[j] / size);
+      if(dx > size / 2 || dy > size / 2)
+      {
+        const int wx = std::min(dx, size - dx), wy = std::min(dy, size - dy);
+        closest      = std::min(closest, std::sqrt(float(wx * wx + wy * wy)));
+      }
+    }
+  }
+  return closest;
+}
+
+int main()
+{
+  const int sizes[] = {32, BLUE_NOISE_SIZE};
+  for(int size : sizes)
+  {
+    for(uint32_t seed = 1; seed <= 3; seed++)
+    {
+      const std::vector<float> mask  = generateBlueNoise(size, seed);
+      const int                count = size * size;
+
+      // Each rank exactly once, mapped to (rank + 0.5) / count
+      std::vector<int> seen(count, 0);
+      int              wrong = 0;
+      for(float value : mask)
+      {
+        const float rank = value * float(count) - 0.5f;
+        const int   r    = int(std::lround(rank));
+        if(std::fabs(rank - float(r)) > 1e-2f || r < 0 || r >= count)
+          wrong++;
+        else
+          seen[r]++;
+      }
+      for(int n : seen)
+        wrong += n != 1 ? 1 : 0;
+      CHECK(wrong == 0);
+
+      // Toroidal: no low frequencies across the edges either, and the first eighth of the pixels
+      // stay at least 2 pixels apart through the edges
+      double border, interior;
+      boxVariance(mask, size, border, interior);
+      CHECK(border < 0.3 / 108.0);
+      CHECK(border < 1.5 * interior);
+      CHECK(closestAcrossEdges(mask, size, count / 8) >= 2.f);
+    }
+  }
+
+  return testResult();
+}
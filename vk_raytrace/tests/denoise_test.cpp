@@ -0,0 +1,130 @@
+// À-trous passes of the denoiser (shaders/denoise.h), on synthetic images: properties of the filter,
+// golden values of a small image, and the error before and after filtering.
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "shaders/denoise.h"
+#include "test_util.h"
+
+using namespace denoise;
+
+// Deterministic noise in [-1,1), identical with every standard library (variance 1/3)
+static float noise(uint32_t& state)
+{
+  state = 1664525u * state + 1013904223u;
+  return float(state >> 8) / 8388608.f - 1.f;
+}
+
+// Two planes at different depths, lit by a vertical gradient, with a uniform noise of standard
+// deviation `noiseStdDev`. The left half is the front plane; the last row is background.
+struct SyntheticImage
+{
+  SyntheticImage(int width_, int height_, float noiseStdDev)
+      : width(width_)
+      , height(height_)
+      , illumination(width_ * height_)
+      , normalDepth(width_ * height_)
+      , reference(width_ * height_)
+  {
+    uint32_t    state     = 1;
+    const float amplitude = noiseStdDev * std::sqrt(3.f);
+    for(int y = 0; y < height; y++)
+    {
+      for(int x = 0; x < width; x++)
+      {
+        const bool front = x < width / 2;
+        const int  p     = y * width + x;
+        reference[p]     = vec3((front ? 0.2f : 0.8f) + 0.2f * y / height);
+        normalDepth[p]   = front ? vec4(0, 0, 1, 2.0f) : vec4(0, 1, 0, 5.0f + 0.01f * y);
+        if(y == height - 1)
+          normalDepth[p].w = -1.f;
+        illumination[p] = vec4(reference[p] + vec3(amplitude * noise(state)), noiseStdDev * noiseStdDev);
+      }
+    }
+  }
+
+  // RMSE of the red channel against the reference, over the pixels which are not background
+  double rmse(const std::vector<vec4>& image) const
+  {
+    double error = 0;
+    int    count = 0;
+    for(size_t p = 0; p < image.size(); p++)
+    {
+      if(normalDepth[p].w < 0.f)
+        continue;
+      error += std::pow(double(image[p].x) - reference[p].x, 2.0);
+      count++;
+    }
+    return std::sqrt(error / count);
+  }
+
+  int               width, height;
+  std::vector<vec4> illumination;
+  std::vector<vec4> normalDepth;
+  std::vector<vec3> reference;
+};
+
+int main()
+{
+  // A constant illumination is left unchanged, whatever the weights, and the variance decreases
+  {
+    SyntheticImage image(32, 32, 0.f);
+    for(auto& i : image.illumination)
+      i = vec4(0.5f, 0.25f, 0.125f, 0.01f);
+    const std::vector<vec4> filtered = atrousFilter(image.illumination, image.normalDepth, 32, 32, 5);
+    int changed = 0, varianceUp = 0;
+    for(size_t p = 0; p < filtered.size(); p++)
+    {
+      changed += length(vec3(filtered[p]) - vec3(0.5f, 0.25f, 0.125f)) > 1e-5f ? 1 : 0;
+      if(image.normalDepth[p].w >= 0.f)
+        varianceUp += filtered[p].w > 0.01f ? 1 : 0;
+    }
+    CHECK(changed == 0);
+    CHECK(varianceUp == 0);
+  }
+
+  // Golden values of a 16x16 image after 3 passes: the background row copied, no bleeding between
+  // the planes, and the values of the reference implementation
+  {
+    SyntheticImage          image(16, 16, 0.25f);
+    const std::vector<vec4> filtered = atrousFilter(image.illumination, image.normalDepth, 16, 16, 3);
+    for(int x = 0; x < 16; x++)
+      CHECK(filtered[15 * 16 + x] == image.illumination[15 * 16 + x]);
+
+    struct Golden
+    {
+      int   x, y;
+      float value;
+    };
+    const Golden golden[] = {
+        {0, 0, 0.2038022f}, {7, 7, 0.2958148f}, {8, 7, 0.8600494f}, {15, 0, 0.9629208f}, {4, 12, 0.3484797f},
+    };
+    for(const Golden& g : golden)
+    {
+      const float value = filtered[g.y * 16 + g.x].x;
+      std::printf("(%d, %d): %.7f\n", g.x, g.y, value);
+      CHECK_NEAR(value, g.value, 1e-4);
+    }
+    // Both sides of the depth edge stay on their own plane
+    for(int y = 0; y < 15; y++)
+    {
+      CHECK(filtered[y * 16 + 7].x < 0.5f);
+      CHECK(filtered[y * 16 + 8].x > 0.5f);
+    }
+  }
+
+  // Error of the noisy and of the filtered illumination on a 128x128 image, after 5 passes
+  {
+    SyntheticImage          image(128, 128, 0.25f);
+    const std::vector<vec4> filtered = atrousFilter(image.illumination, image.normalDepth, 128, 128, 5);
+    const double            noisy    = image.rmse(image.illumination);
+    const double            denoised = image.rmse(filtered);
+    std::printf("RMSE: noisy %.4f, denoised %.4f\n", noisy, denoised);
+    CHECK_NEAR(noisy, 0.25, 0.01);
+    CHECK_NEAR(denoised, 0.0209, 0.002);
+  }
+
+  return testResult();
+}
@@ -0,0 +1,139 @@
+// Sparse primary rays (shaders/interleave.h): rotation of the traced pixels, and the error of the
+// checkerboard and 1/4 frames reconstructed by interpolation after a reset.
+
+#include <cmath>
+#include <vector>
+
+#include "shaders/interleave.h"
+#include "test_util.h"
+
+using namespace interleave;
+
+// Background plane receding to the top of the image, with a disc standing in front of it
+static vec3 scene(vec2 p, vec4& normalDepth)
+{
+  vec3 c      = vec3(0.2f + 0.6f * p.x, 0.3f, 0.5f * p.y);
+  normalDepth = vec4(0.0f, 0.8f, 0.6f, 2.0f + 8.0f * p.y);
+  if(fract(p.x * 6.0f + p.y * 2.0f) < 0.1f)
+    c *= 0.2f;
+  if(length(p - vec2(0.4f, 0.45f)) < 0.25f)
+  {
+    c           = vec3(0.9f, 0.8f, 0.2f);
+    normalDepth = vec4(0.0f, 0.0f, 1.0f, 1.5f);
+  }
+  return c;
+}
+
+// RMSE of the frame `frame` of a synthetic scene traced one pixel out of `interleave` and
+// reconstructed by interpolation, against the frame traced at full rate. This is the worst case,
+// the first frame after a reset or a disocclusion: with a history, or once the camera stops, the
+// pixels converge to the full-rate image.
+static float reconstructionRmse(int width, int height, int interleave, int frame)
+{
+  std::vector<vec3> reference(width * height);
+  std::vector<vec4> referenceNd(width * height);
+  for(int y = 0; y < height; y++)
+  {
+    for(int x = 0; x < width; x++)
+    {
+      const int n   = 4;  // Samples per pixel and axis
+      vec3      sum = vec3(0.0f);
+      for(int s = 0; s < n * n; s++)
+        sum += scene((vec2(x, y) + (vec2(s % n, s / n) + 0.5f) / float(n)) / vec2(width, height),
+                     referenceNd[y * width + x]);
+      scene((vec2(x, y) + 0.5f) / vec2(width, height), referenceNd[y * width + x]);
+      reference[y * width + x] = sum / float(n * n);
+    }
+  }
+
+  std::vector<vec3> color(width * height, vec3(0.0f));
+  std::vector<vec4> normalDepth(width * height, vec4(0.0f, 0.0f, 0.0f, -1.0f));
+  for(int p = 0; p < width * height; p++)
+  {
+    if(pixelTraced(ivec2(p % width, p / width), interleave, frame))
+    {
+      color[p]       = reference[p];
+      normalDepth[p] = referenceNd[p];
+    }
+  }
+  reconstructImage(color, normalDepth, width, height, interleave, frame);
+  double err = 0.0;
+  for(size_t p = 0; p < color.size(); p++)
+  {
+    vec3 d = color[p] - reference[p];
+    err += dot(d, d) / 3.0f;
+  }
+  return float(std::sqrt(err / double(color.size())));
+}
+
+int main()
+{
+  // Any `interleave` consecutive frames trace each pixel once, whatever the first frame, and the
+  // first two frames of the 2x2 quads cover both diagonals
+  const int interleaves[] = {1, 2, 4};
+  for(int interleave : interleaves)
+  {
+    int wrongCount = 0;
+    for(int start = 0; start < 8; start++)
+    {
+      for(int p = 0; p < 16; p++)
+      {
+        int traced = 0;
+        for(int frame = start; frame < start + interleave; frame++)
+          traced += pixelTraced(ivec2(p % 4, p / 4), interleave, frame) ? 1 : 0;
+        wrongCount += traced != 1 ? 1 : 0;
+      }
+    }
+    CHECK(wrongCount == 0);
+  }
+  CHECK(pixelTraced(ivec2(0, 0), 4, 0) && pixelTraced(ivec2(1, 1), 4, 1));
+
+  // Interpolation: the average on a smooth surface, the closest neighbor across a silhouette
+  {
+    const vec4 plane(0.f, 1.f, 0.f, 4.f);
+    CHECK(interpolationWeight(plane, vec4(0.f, 1.f, 0.f, 4.1f)) == 0.5f);
+    CHECK(interpolationWeight(plane, vec4(0.f, 0.f, 1.f, 1.f)) == 1.0f);
+    CHECK(interpolationWeight(vec4(0.f, 0.f, 0.f, -1.f), plane) == 1.0f);
+    CHECK(interpolationCost(vec4(0.f, 0.f, 0.f, -1.f), vec4(0.f, 0.f, 0.f, -1.f)) == 0.f);
+  }
+
+  // A constant image is reconstructed exactly, in every frame of the rotation
+  {
+    int wrong = 0;
+    for(int interleave = 2; interleave <= 4; interleave += 2)
+    {
+      for(int frame = 0; frame < interleave; frame++)
+      {
+        std::vector<vec3> color(16 * 16, vec3(-1.f));
+        std::vector<vec4> normalDepth(16 * 16, vec4(0.f, 0.f, 0.f, -1.f));
+        for(int p = 0; p < 16 * 16; p++)
+        {
+          if(pixelTraced(ivec2(p % 16, p / 16), interleave, frame))
+          {
+            color[p]       = vec3(0.25f, 0.5f, 0.75f);
+            normalDepth[p] = vec4(0.f, 1.f, 0.f, 3.f);
+          }
+        }
+        reconstructImage(color, normalDepth, 16, 16, interleave, frame);
+        for(const vec3& c : color)
+          wrong += length(c - vec3(0.25f, 0.5f, 0.75f)) > 1e-6f ? 1 : 0;
+      }
+    }
+    CHECK(wrong == 0);
+  }
+
+  // Error of the reconstruction after a reset: bounded (0.035 and 0.048 at 128x128), larger when
+  // fewer pixels are traced, and about the same whichever subset of the rotation was traced
+  const int sizes[] = {128, 256};
+  for(int size : sizes)
+  {
+    const float half    = reconstructionRmse(size, size, 2, 0);
+    const float quarter = reconstructionRmse(size, size, 4, 0);
+    CHECK(half > 0.f && half < quarter);
+    CHECK(half < 0.045f && quarter < 0.06f);
+    for(int frame = 1; frame < 4; frame++)
+      CHECK_NEAR(reconstructionRmse(size, size, 4, frame), quarter, 0.25 * quarter);
+  }
+
+  return testResult();
+}
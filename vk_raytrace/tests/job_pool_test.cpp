@@ -0,0 +1,64 @@
+// Thread pool of the parallel recording (common/job_pool.h): every job runs once, and an exception
+// thrown by a job on any thread reaches the caller of run(), leaving the pool usable.
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+#include "job_pool.h"
+#include "test_util.h"
+
+int main()
+{
+  JobPool pool(4);
+
+  // Each job once, on a valid thread
+  {
+    std::vector<std::atomic<int>> runs(1000);
+    std::atomic<int>              wrongThread{0};
+    pool.run(static_cast<uint32_t>(runs.size()), [&](uint32_t job, uint32_t thread) {
+      runs[job]++;
+      wrongThread += thread >= pool.threadCount() ? 1 : 0;
+    });
+    int wrong = wrongThread;
+    for(auto& n : runs)
+      wrong += n != 1 ? 1 : 0;
+    CHECK(wrong == 0);
+  }
+
+  // A failing job, whichever thread runs it, is rethrown once all threads are done
+  for(uint32_t failing = 0; failing < 64; failing += 7)
+  {
+    std::atomic<int> running{0};
+    std::atomic<int> overlap{0};
+    bool             caught = false;
+    try
+    {
+      pool.run(64, [&](uint32_t job, uint32_t) {
+        running++;
+        if(job == failing)
+        {
+          running--;
+          throw std::runtime_error("job failed");
+        }
+        running--;
+      });
+    }
+    catch(const std::runtime_error&)
+    {
+      caught = true;
+      overlap += running;
+    }
+    CHECK(caught);
+    CHECK(overlap == 0);
+  }
+
+  // The pool still runs every job after a failure
+  {
+    std::atomic<uint32_t> count{0};
+    pool.run(100, [&](uint32_t, uint32_t) { count++; });
+    CHECK(count == 100);
+  }
+
+  return testResult();
+}
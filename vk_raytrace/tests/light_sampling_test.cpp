@@ -0,0 +1,135 @@
+// Light selection of the path tracer (shaders/lights.h): the CDF and the light BVH must both give
+// an unbiased estimate of the direct lighting, the BVH with less variance. The time per sample
+// of each method is printed.
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "shaders/lights.h"
+#include "test_util.h"
+
+using namespace lights;
+
+// Unoccluded direct lighting at `position` from a point sampled on light `l` with (r1, r2),
+// divided by the probability of the point
+static float lightContribution(const LightTriangle& l, const glm::vec3& position, const glm::vec3& normal, float r1, float r2)
+{
+  glm::vec3 L     = sampleTriangle(l.v0, l.v1, l.v2, r1, r2) - position;
+  float     dist2 = glm::max(glm::dot(L, L), 1e-8f);
+  L /= sqrtf(dist2);
+  glm::vec3 lightN   = glm::normalize(glm::cross(l.v1 - l.v0, l.v2 - l.v0));
+  float     cosTerms = glm::max(glm::dot(normal, L), 0.f) * fabsf(glm::dot(lightN, L));
+  return luminance(l.emission) * cosTerms / dist2 * l.area;
+}
+
+int main()
+{
+  std::mt19937                          gen(42);
+  std::uniform_real_distribution<float> dis(0.f, 1.f);
+
+  // 8x8 small emissive triangles spread over a ceiling, with various intensities
+  std::vector<LightTriangle> lightList;
+  for(int z = 0; z < 8; z++)
+  {
+    for(int x = 0; x < 8; x++)
+    {
+      LightTriangle l{};
+      glm::vec3     c(x * 2.f - 7.f, 4.f, z * 2.f - 7.f);
+      l.v0       = c + glm::vec3(-0.3f, 0.f, -0.3f);
+      l.v1       = c + glm::vec3(0.3f, 0.f, -0.3f);
+      l.v2       = c + glm::vec3(0.f, 0.f, 0.3f);
+      l.emission = glm::vec3(0.5f + 4.5f * dis(gen));
+      lightList.push_back(l);
+    }
+  }
+  CHECK(buildLightCdf(lightList) > 0.f);
+  std::vector<LightBvhNode> nodes;
+  buildLightBvh(lightList, nodes);
+  const int lightCount = static_cast<int>(lightList.size());
+  CHECK(nodes.size() == lightList.size() * 2 - 1);
+  CHECK_NEAR(lightList.back().cdf, 1.0, 1e-6);
+
+  // Shading points under the ceiling, with normals in the upper hemisphere
+  const int              nbPoints  = 256;
+  const int              nbSamples = 256;
+  std::vector<glm::vec3> positions(nbPoints);
+  std::vector<glm::vec3> normals(nbPoints);
+  for(int p = 0; p < nbPoints; p++)
+  {
+    positions[p] = glm::vec3(dis(gen) * 16.f - 8.f, dis(gen) * 2.f, dis(gen) * 16.f - 8.f);
+    normals[p]   = glm::normalize(glm::vec3(dis(gen) - 0.5f, dis(gen) + 0.1f, dis(gen) - 0.5f));
+  }
+
+  // Reference: every light integrated with 16x16 stratified samples
+  std::vector<double> reference(nbPoints, 0.0);
+  for(int p = 0; p < nbPoints; p++)
+  {
+    for(const auto& l : lightList)
+    {
+      for(int j = 0; j < 16; j++)
+      {
+        for(int i = 0; i < 16; i++)
+          reference[p] += lightContribution(l, positions[p], normals[p], (i + 0.5f) / 16.f, (j + 0.5f) / 16.f) / 256.0;
+      }
+    }
+  }
+
+  std::vector<glm::vec3> randoms(nbPoints * nbSamples);
+  for(auto& r : randoms)
+    r = glm::vec3(dis(gen), dis(gen), dis(gen));
+
+  double variances[2];
+  for(int method = 0; method < 2; method++)
+  {
+    double sumEstimate = 0.0, sumReference = 0.0, variance = 0.0;
+    int    pdfMismatches = 0;
+    auto   start         = std::chrono::high_resolution_clock::now();
+    for(int p = 0; p < nbPoints; p++)
+    {
+      double mean = 0.0, mean2 = 0.0;
+      for(int s = 0; s < nbSamples; s++)
+      {
+        const glm::vec3& r = randoms[p * nbSamples + s];
+        float            pdf;
+        int              index;
+        if(method == 0)
+        {
+          index = static_cast<int>(sampleLightCdf(lightList, r.x));
+          pdf   = lightList[index].pdf;
+        }
+        else
+        {
+          index = sampleLightBvh(nodes, lightCount, positions[p], normals[p], r.x, pdf);
+          // The pdf of the traversal is the one evaluated for multiple importance sampling
+          if(index >= 0
+             && fabsf(lightBvhPdf(nodes, lightCount, index, positions[p], normals[p]) - pdf) > 1e-4f * pdf)
+            pdfMismatches++;
+        }
+
+        double value = 0.0;
+        if(index >= 0 && pdf > 0.f)
+          value = lightContribution(lightList[index], positions[p], normals[p], r.y, r.z) / pdf;
+        mean += value / nbSamples;
+        mean2 += value * value / nbSamples;
+      }
+      sumEstimate += mean;
+      sumReference += reference[p];
+      variance += (mean2 - mean * mean) / (reference[p] * reference[p]) / nbPoints;
+    }
+    const float time =
+        std::chrono::duration<float, std::nano>(std::chrono::high_resolution_clock::now() - start).count();
+
+    const char* name = method == 0 ? "CDF" : "BVH";
+    std::printf("%s: %.0f ns per sample, relative variance %.3f, total %.4f (reference %.4f)\n", name,
+                time / (nbPoints * nbSamples), variance, sumEstimate, sumReference);
+    // Unbiased: within 4 standard deviations of the mean over all samples
+    CHECK_NEAR(sumEstimate / sumReference, 1.0, 4.0 * sqrt(variance / (nbPoints * nbSamples)));
+    CHECK(pdfMismatches == 0);
+    variances[method] = variance;
+  }
+  // The BVH favors the lights close to the point and facing it
+  CHECK(variances[1] < 0.5 * variances[0]);
+
+  return testResult();
+}
@@ -0,0 +1,166 @@
+// Mesh clusters of the cluster culling (common/mesh_clusters.h): the vertex and triangle limits of
+// each cluster, the coverage of the index buffer, and the bounds and normal cones of the clusters.
+
+#include <cmath>
+#include <vector>
+
+#include "mesh_clusters.h"
+#include "shaders/host_device.h"
+#include "test_util.h"
+
+struct Vertex
+{
+  glm::vec3 pos;
+};
+
+// Limits used at import: 64 vertices and 124 triangles
+static const uint32_t kMaxVertices  = CLUSTER_MAX_VERTICES;
+static const uint32_t kMaxTriangles = CLUSTER_MAX_TRIANGLES;
+
+// UV sphere of `rings` x `sectors` quads, with shared vertices
+static void sphere(int rings, int sectors, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+{
+  for(int r = 0; r <= rings; r++)
+  {
+    for(int s = 0; s <= sectors; s++)
+    {
+      const float theta = 3.14159265f * float(r) / float(rings);
+      const float phi   = 2.f * 3.14159265f * float(s) / float(sectors);
+      const glm::vec3 pos(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+      vertices.push_back({pos});
+    }
+  }
+  for(int r = 0; r < rings; r++)
+  {
+    for(int s = 0; s < sectors; s++)
+    {
+      const uint32_t v = uint32_t(r * (sectors + 1) + s);
+      const uint32_t w = v + uint32_t(sectors + 1);
+      const uint32_t quad[] = {v, v + 1, w, w, v + 1, w + 1};
+      indices.insert(indices.end(), quad, quad + 6);
+    }
+  }
+}
+
+// Number of failures of the limits, the coverage and the bounds of `clusters`
+static int checkClusters(const std::vector<Vertex>&      vertices,
+                         const std::vector<uint32_t>&    indices,
+                         const std::vector<MeshCluster>& clusters)
+{
+  int      wrong     = 0;
+  uint32_t nextIndex = 0;
+  for(const MeshCluster& cluster : clusters)
+  {
+    // Consecutive ranges of whole triangles, within the limits
+    wrong += cluster.firstIndex != nextIndex || cluster.indexCount == 0 || cluster.indexCount % 3 != 0 ? 1 : 0;
+    nextIndex = cluster.firstIndex + cluster.indexCount;
+    wrong += cluster.indexCount > 3 * kMaxTriangles ? 1 : 0;
+    std::vector<bool> used(vertices.size(), false);
+    uint32_t          distinct = 0;
+    for(uint32_t i = cluster.firstIndex; i < nextIndex && i < indices.size(); i++)
+    {
+      distinct += used[indices[i]] ? 0 : 1;
+      used[indices[i]] = true;
+    }
+    wrong += distinct > kMaxVertices ? 1 : 0;
+
+    // The box and the sphere contain the vertices, the cone the normals of the triangles
+    const float cosine = std::sqrt(std::max(0.f, 1.f - cluster.coneCutoff * cluster.coneCutoff));
+    for(uint32_t i = cluster.firstIndex; i + 2 < nextIndex && i + 2 < indices.size(); i += 3)
+    {
+      for(uint32_t k = 0; k < 3; k++)
+      {
+        const glm::vec3& p = vertices[indices[i + k]].pos;
+        wrong += glm::any(glm::lessThan(p, cluster.bbMin)) || glm::any(glm::greaterThan(p, cluster.bbMax)) ? 1 : 0;
+        wrong += glm::length(p - cluster.center) > cluster.radius * 1.0001f ? 1 : 0;
+      }
+      const glm::vec3& p0     = vertices[indices[i]].pos;
+      const glm::vec3  normal = glm::cross(vertices[indices[i + 1]].pos - p0, vertices[indices[i + 2]].pos - p0);
+      if(cluster.coneCutoff < 1.f && glm::length(normal) > 0.f)
+        wrong += glm::dot(glm::normalize(normal), cluster.coneAxis) < cosine - 1e-5f ? 1 : 0;
+    }
+  }
+  // Every triangle in exactly one cluster
+  wrong += nextIndex != indices.size() ? 1 : 0;
+  return wrong;
+}
+
+int main()
+{
+  std::vector<MeshCluster> clusters;
+
+  // Sphere with shared vertices, in clusters of narrow normal cones
+  {
+    std::vector<Vertex>   vertices;
+    std::vector<uint32_t> indices;
+    sphere(32, 48, vertices, indices);
+    buildClusters(vertices, indices, kMaxVertices, kMaxTriangles, clusters);
+    CHECK(!clusters.empty());
+    CHECK(checkClusters(vertices, indices, clusters) == 0);
+    int cones = 0;
+    for(const MeshCluster& cluster : clusters)
+      cones += cluster.coneCutoff < 1.f ? 1 : 0;
+    CHECK(cones > 0);
+  }
+
+  // Triangle soup: 3 new vertices per triangle, so 21 triangles per cluster
+  {
+    std::vector<Vertex>   vertices;
+    std::vector<uint32_t> indices;
+    for(uint32_t t = 0; t < 100; t++)
+    {
+      const float x = float(t);
+      vertices.push_back({glm::vec3(x, 0.f, 0.f)});
+      vertices.push_back({glm::vec3(x + 1.f, 0.f, 0.f)});
+      vertices.push_back({glm::vec3(x, 1.f, 0.f)});
+      indices.insert(indices.end(), {3 * t, 3 * t + 1, 3 * t + 2});
+    }
+    buildClusters(vertices, indices, kMaxVertices, kMaxTriangles, clusters);
+    CHECK(clusters.size() == 5);
+    CHECK(clusters.front().indexCount == 3 * 21);
+    CHECK(checkClusters(vertices, indices, clusters) == 0);
+
+    // A flat cluster has a cone of the plane normal and no spread
+    CHECK_NEAR(clusters.front().coneAxis.z, 1.0, 1e-6);
+    CHECK_NEAR(clusters.front().coneCutoff, 0.0, 1e-3);
+  }
+
+  // Strip of 400 triangles sharing 202 vertices: the triangle limit splits it
+  {
+    std::vector<Vertex>   vertices;
+    std::vector<uint32_t> indices;
+    for(uint32_t i = 0; i <= 200; i++)
+    {
+      vertices.push_back({glm::vec3(float(i), 0.f, 0.f)});
+      vertices.push_back({glm::vec3(float(i), 1.f, 0.f)});
+    }
+    for(uint32_t i = 0; i < 200; i++)
+      indices.insert(indices.end(), {2 * i, 2 * i + 2, 2 * i + 1, 2 * i + 1, 2 * i + 2, 2 * i + 3});
+    buildClusters(vertices, indices, kMaxVertices, 16, clusters);
+    CHECK(clusters.size() == 25);
+    CHECK(clusters.front().indexCount == 3 * 16);
+    buildClusters(vertices, indices, kMaxVertices, kMaxTriangles, clusters);
+    CHECK(checkClusters(vertices, indices, clusters) == 0);
+  }
+
+  // Normals spread over more than a half space: no cone
+  {
+    std::vector<Vertex>   vertices;
+    std::vector<uint32_t> indices;
+    sphere(4, 4, vertices, indices);
+    buildClusters(vertices, indices, kMaxVertices, kMaxTriangles, clusters);
+    CHECK(clusters.size() == 1);
+    CHECK(clusters.front().coneCutoff == 1.f);
+    CHECK(checkClusters(vertices, indices, clusters) == 0);
+  }
+
+  // Degenerate limits give no cluster
+  {
+    std::vector<Vertex>   vertices(3, Vertex{glm::vec3(0.f)});
+    std::vector<uint32_t> indices = {0, 1, 2};
+    buildClusters(vertices, indices, 2, kMaxTriangles, clusters);
+    CHECK(clusters.empty());
+  }
+
+  return testResult();
+}
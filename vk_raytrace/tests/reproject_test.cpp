@@ -0,0 +1,127 @@
+// Reprojection of the accumulated samples (shaders/reproject.h): the helpers of the ray
+// generation shader, and the fraction of a ground plane keeping its history as the camera moves.
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "shaders/reproject.h"
+#include "test_util.h"
+
+using namespace reproject;
+
+// Fraction of the pixels of a width x height image of the ground plane y = 0, seen by the camera
+// viewProj, which find a consistent history in the previous frame seen by prevViewProj
+static float groundPlaneReprojection(const mat4& prevViewProj, const mat4& viewProj, int width, int height)
+{
+  const vec2 imageSize(width, height);
+  const vec3 normal(0, 1, 0);
+  const mat4 invViewProj     = inverse(viewProj);
+  const mat4 invPrevViewProj = inverse(prevViewProj);
+
+  // Ground point seen by the center of a pixel, same mapping as the ray generation shader
+  auto groundHit = [&](const mat4& inv, vec2 pixel, vec3& position) {
+    const vec2 ndc       = pixel / imageSize * 2.0f - 1.0f;
+    const vec4 nearPoint = inv * vec4(ndc, 0.0f, 1.0f);
+    const vec4 farPoint  = inv * vec4(ndc, 1.0f, 1.0f);
+    const vec3 o         = vec3(nearPoint) / nearPoint.w;
+    const vec3 d         = vec3(farPoint) / farPoint.w - o;
+    if(abs(d.y) < 1e-6f || -o.y / d.y <= 0.0f)
+      return false;
+    position = o - d * (o.y / d.y);
+    return true;
+  };
+
+  int kept  = 0;
+  int total = 0;
+  for(int y = 0; y < height; y++)
+  {
+    for(int x = 0; x < width; x++)
+    {
+      vec3 position;
+      if(!groundHit(invViewProj, vec2(x + 0.5f, y + 0.5f), position))
+        continue;
+      total++;
+
+      // Surface stored by the previous frame in the pixel where the point was
+      const vec2 prevPixel = projectToPixel(prevViewProj, position, imageSize);
+      if(prevPixel.x < 0.0f || prevPixel.y < 0.0f || prevPixel.x >= width || prevPixel.y >= height)
+        continue;
+      vec3 prevPosition;
+      if(!groundHit(invPrevViewProj, floor(prevPixel) + 0.5f, prevPosition))
+        continue;
+      if(historyConsistent(linearDepth(prevViewProj, position), linearDepth(prevViewProj, prevPosition),
+                           normal, normal))
+        kept++;
+    }
+  }
+  return total > 0 ? float(kept) / float(total) : 1.0f;
+}
+
+// Camera of updateUniformBuffer looking at the ground from `eye`
+static mat4 camera(vec3 eye, vec3 center)
+{
+  mat4 proj = perspective(radians(65.0f), 1.f, 0.1f, 1000.0f);
+  proj[1][1] *= -1;
+  return proj * lookAt(eye, center, vec3(0, 1, 0));
+}
+
+int main()
+{
+  // The pixel centers project back to themselves, and the depth is the distance along the view
+  {
+    const mat4 viewProj = camera(vec3(0, 2, 5), vec3(0));
+    const vec2 size(64, 64);
+    const vec3 target(0, 0, 0);
+    const vec2 pixel = projectToPixel(viewProj, target, size);
+    CHECK_NEAR(pixel.x, 32.0, 1e-3);
+    CHECK_NEAR(pixel.y, 32.0, 1e-3);
+    CHECK_NEAR(linearDepth(viewProj, target), length(vec3(0, 2, 5)), 1e-4);
+  }
+
+  // History test and bilinear weights
+  {
+    CHECK(historyConsistent(10.f, 10.2f, vec3(0, 1, 0), vec3(0, 1, 0)));
+    CHECK(!historyConsistent(10.f, 11.f, vec3(0, 1, 0), vec3(0, 1, 0)));
+    CHECK(!historyConsistent(10.f, 10.f, vec3(0, 1, 0), vec3(1, 0, 0)));
+    CHECK(!historyConsistent(10.f, -1.f, vec3(0, 1, 0), vec3(0, 1, 0)));
+    for(float fx = 0.f; fx < 1.f; fx += 0.125f)
+    {
+      const vec2 pixel(10.3f + fx, 7.9f + fx * 0.5f);
+      CHECK_NEAR(bilinearWeight(pixel, 0) + bilinearWeight(pixel, 1) + bilinearWeight(pixel, 2)
+                     + bilinearWeight(pixel, 3),
+                 1.0, 1e-5);
+    }
+    CHECK_NEAR(bilinearWeight(vec2(10.5f, 7.5f), 0), 1.0, 1e-6);
+  }
+
+  // The capped history keeps its mean and variance, with the count and M2 scaled together
+  {
+    const vec4 capped = capHistory(vec4(0.5f, 20.f, 100.f, 0.f), 25.f);
+    CHECK_NEAR(capped.x, 0.5, 1e-6);
+    CHECK_NEAR(capped.z, 25.0, 1e-6);
+    CHECK_NEAR(capped.y / capped.z, 20.0 / 100.0, 1e-6);
+    CHECK(capHistory(vec4(0.5f, 2.f, 10.f, 0.f), 25.f) == vec4(0.5f, 2.f, 10.f, 0.f));
+  }
+
+  // Ground plane: everything is kept by a still camera, and less and less as it moves further
+  {
+    const mat4 still = camera(vec3(0, 2, 5), vec3(0));
+    CHECK_NEAR(groundPlaneReprojection(still, still, 64, 64), 1.0, 1e-6);
+
+    float previous = 1.f;
+    for(float move = 0.1f; move <= 1.61f; move *= 2.f)
+    {
+      const float kept = groundPlaneReprojection(still, camera(vec3(move, 2, 5), vec3(move, 0, 0)), 64, 64);
+      std::printf("Camera moved by %.1f: %.1f%% of the ground kept\n", move, 100.f * kept);
+      CHECK(kept <= previous);
+      CHECK(kept > 0.f);
+      previous = kept;
+    }
+    CHECK(groundPlaneReprojection(still, camera(vec3(0.1f, 2, 5), vec3(0.1f, 0, 0)), 64, 64) > 0.9f);
+
+    const float turned = groundPlaneReprojection(still, camera(vec3(0, 2, 5), vec3(3, 0, 0)), 64, 64);
+    std::printf("Camera turned: %.1f%% of the ground kept\n", 100.f * turned);
+    CHECK(turned < 0.9f);
+  }
+
+  return testResult();
+}
@@ -0,0 +1,97 @@
+// Owen-scrambled Sobol sampler of the path tracer (shaders/sobol.h): stratification of the samples
+// of a pixel, and convergence against the LCG of random.glsl on a 4D integral.
+
+#include <cmath>
+#include <set>
+#include <vector>
+
+#include "shaders/sobol.h"
+#include "test_util.h"
+
+using namespace sobol;
+
+// Next value of the LCG of random.glsl, in [0,1)
+static float lcgSample(uint32_t& state)
+{
+  state = 1664525u * state + 1013904223u;
+  return float(state & 0x00FFFFFF) / float(0x01000000);
+}
+
+int main()
+{
+  // The first 2^k samples of a pixel fall in distinct intervals of size 1/2^k in each dimension,
+  // including the padded ones, and in distinct cells of a 2^(k/2) grid in the first two
+  int badIntervals = 0, badCells = 0;
+  for(uint32_t pixel = 0; pixel < 64; pixel++)
+  {
+    const uint32_t seed = hashUint(pixel);
+    const uint32_t n    = 64;
+    for(uint32_t dim = 0; dim < 2 * kSobolDimensions; dim++)
+    {
+      std::set<uint32_t> intervals;
+      for(uint32_t s = 0; s < n; s++)
+      {
+        const float u = sobolOwen(s, dim, seed);
+        CHECK(u >= 0.f && u < 1.f);
+        intervals.insert(uint32_t(u * n));
+      }
+      badIntervals += intervals.size() != n ? 1 : 0;
+    }
+    std::set<uint32_t> cells;
+    for(uint32_t s = 0; s < n; s++)
+      cells.insert(uint32_t(sobolOwen(s, 0, seed) * 8) * 8 + uint32_t(sobolOwen(s, 1, seed) * 8));
+    badCells += cells.size() != n ? 1 : 0;
+  }
+  CHECK(badIntervals == 0);
+  CHECK(badCells == 0);
+
+  // RMSE over 256 pixels of a quarter disk in the first two dimensions, times a linear function of
+  // two padded dimensions, for 1, 4, 16, 64 and 256 samples
+  const double   kReference = 3.14159265358979 / 4.0;
+  const uint32_t pixels     = 256;
+  double         rmse[5][2];
+  int            level = 0;
+  for(uint32_t samples = 1; samples <= 256; samples *= 4, level++)
+  {
+    double error[2] = {0, 0};
+    for(uint32_t pixel = 0; pixel < pixels; pixel++)
+    {
+      const uint32_t seed   = hashUint(pixel);
+      uint32_t       lcg    = seed;
+      double         sum[2] = {0, 0};
+      for(uint32_t s = 0; s < samples; s++)
+      {
+        float u[2][7];
+        for(uint32_t d = 0; d < 7; d++)
+        {
+          u[0][d] = lcgSample(lcg);
+          u[1][d] = sobolOwen(s, d, seed);
+        }
+        for(int m = 0; m < 2; m++)
+        {
+          const float disk = u[m][0] * u[m][0] + u[m][1] * u[m][1] < 1.f ? 1.f : 0.f;
+          sum[m] += disk * (u[m][5] + u[m][6]);
+        }
+      }
+      for(int m = 0; m < 2; m++)
+      {
+        const double e = sum[m] / samples - kReference;
+        error[m] += e * e;
+      }
+    }
+    rmse[level][0] = std::sqrt(error[0] / pixels);
+    rmse[level][1] = std::sqrt(error[1] / pixels);
+    std::printf("RMSE at %3u spp: LCG %.4f, Sobol %.4f\n", samples, rmse[level][0], rmse[level][1]);
+  }
+
+  // The LCG converges in 1/sqrt(n): about half the error for 4 times the samples. Sobol is below
+  // it from 4 samples on, and converges faster, in about n^-3/4 with the edge of the disk.
+  for(int l = 1; l < 5; l++)
+  {
+    CHECK(rmse[l][1] < rmse[l][0]);
+    CHECK_NEAR(rmse[l][0] / rmse[l - 1][0], 0.5, 0.15);
+  }
+  CHECK(rmse[4][1] / rmse[2][1] < 0.75 * rmse[4][0] / rmse[2][0]);
+
+  return testResult();
+}
@@ -0,0 +1,160 @@
+// Bounce math of the path tracer (shaders/shading.h): mean and variance of the cosine-weighted
+// hemisphere sampling, and of the paths terminated by Russian roulette as in raytrace.rgen.
+
+#include <random>
+#include <vector>
+
+#include "shaders/shading.h"
+#include "test_util.h"
+
+using namespace shading;
+
+// One path of raytrace.rgen in a furnace: every surface emits `emission` and reflects `albedo`, no
+// light is sampled directly. Returns the radiance of the path.
+static vec3 furnacePath(vec3 albedo, vec3 emission, bool roulette, std::mt19937& gen)
+{
+  std::uniform_real_distribution<float> dis(0.f, 1.f);
+
+  vec3 radiance   = vec3(0);
+  vec3 throughput = vec3(1);
+  for(int depth = 0; depth <= kMaxBounces; depth++)
+  {
+    radiance += throughput * emission;
+    if(depth == kMaxBounces)
+      break;
+
+    vec3  normal    = normalize(vec3(dis(gen) - 0.5f, dis(gen) - 0.5f, dis(gen) - 0.5f) + 1e-4f);
+    float r1        = dis(gen);
+    float r2        = dis(gen);
+    vec3  direction = sampleBounce(normal, r1, r2);
+    throughput *= bounceWeight(albedo, normal, direction);
+
+    if(roulette && depth + 1 >= kRussianRouletteDepth)
+    {
+      float survival = russianRouletteSurvival(throughput);
+      if(dis(gen) >= survival)
+        break;
+      throughput /= survival;
+    }
+  }
+  return radiance;
+}
+
+// Exact mean and variance of furnacePath: the throughput of a surviving path does not depend on
+// the directions, so the only outcomes are the depths where the roulette stops the path
+static void furnaceMoments(vec3 albedo, vec3 emission, bool roulette, dvec3& mean, dvec3& variance)
+{
+  dvec3  mean2(0);
+  vec3   radiance    = vec3(0);
+  vec3   throughput  = vec3(1);
+  double probability = 1.0;  // Of reaching the current depth
+  mean               = dvec3(0);
+  for(int depth = 0; depth <= kMaxBounces; depth++)
+  {
+    radiance += throughput * emission;
+    if(depth == kMaxBounces)
+      break;
+    throughput *= albedo;
+    if(roulette && depth + 1 >= kRussianRouletteDepth)
+    {
+      float survival = russianRouletteSurvival(throughput);
+      mean += (1.0 - survival) * probability * dvec3(radiance);
+      mean2 += (1.0 - survival) * probability * dvec3(radiance) * dvec3(radiance);
+      probability *= survival;
+      throughput /= survival;
+    }
+  }
+  mean += probability * dvec3(radiance);
+  mean2 += probability * dvec3(radiance) * dvec3(radiance);
+  variance = mean2 - mean * mean;
+}
+
+int main()
+{
+  std::mt19937                          gen(7);
+  std::uniform_real_distribution<float> dis(0.f, 1.f);
+
+  // Cosine-weighted directions: cos(theta) has a mean of 2/3 and a variance of 1/18, the basis is
+  // orthonormal, and the Lambertian weight is the albedo for every sampled direction
+  {
+    const int n = 1 << 20;
+    double    sum = 0.0, sum2 = 0.0, pdfIntegral = 0.0;
+    int       below = 0, wrongWeight = 0, badBasis = 0;
+    for(int i = 0; i < n; i++)
+    {
+      vec3 normal = normalize(vec3(dis(gen) - 0.5f, dis(gen) - 0.5f, dis(gen) - 0.5f) + 1e-4f);
+      mat3 basis  = normalYBasis(normal);
+      if(fabsf(dot(basis[0], basis[1])) > 1e-5f || fabsf(dot(basis[0], basis[2])) > 1e-5f
+         || fabsf(dot(basis[1], basis[2])) > 1e-5f || fabsf(length(basis[0]) - 1.f) > 1e-5f
+         || fabsf(length(basis[2]) - 1.f) > 1e-5f || length(basis[1] - normal) > 1e-6f)
+        badBasis++;
+
+      vec3  direction = sampleBounce(normal, dis(gen), dis(gen));
+      float cosTheta  = dot(direction, normal);
+      below += cosTheta <= 0.f ? 1 : 0;
+      wrongWeight += bounceWeight(vec3(0.3f, 0.6f, 0.9f), normal, direction) != vec3(0.3f, 0.6f, 0.9f) ? 1 : 0;
+      sum += cosTheta;
+      sum2 += double(cosTheta) * cosTheta;
+
+      // The pdf integrates to 1 over the sphere, estimated with uniform directions
+      float z   = dis(gen) * 2.f - 1.f;
+      float phi = dis(gen) * 2.f * kPi;
+      float r   = sqrtf(std::max(1.f - z * z, 0.f));
+      pdfIntegral += bouncePdf(normal, vec3(r * cosf(phi), z, r * sinf(phi))) * 4.0 * kPi / n;
+    }
+    const double mean     = sum / n;
+    const double variance = sum2 / n - mean * mean;
+    std::printf("cos(theta): mean %.5f (2/3), variance %.5f (1/18 = %.5f), pdf integral %.4f\n", mean,
+                variance, 1.0 / 18.0, pdfIntegral);
+    CHECK_NEAR(mean, 2.0 / 3.0, 4.0 * sqrt(1.0 / 18.0 / n));
+    CHECK_NEAR(variance, 1.0 / 18.0, 0.002);
+    CHECK_NEAR(pdfIntegral, 1.0, 0.005);
+    CHECK(below == 0);
+    CHECK(wrongWeight == 0);
+    CHECK(badBasis == 0);
+  }
+
+  // Russian roulette: the terminated paths keep the mean of the full paths, with some variance
+  const vec3 albedos[] = {vec3(0.5f), vec3(0.8f, 0.5f, 0.2f), vec3(0.95f), vec3(0.05f)};
+  for(const vec3& albedo : albedos)
+  {
+    const vec3 emission(1.f);
+    dvec3      fullMean, fullVariance, rrMean, rrVariance;
+    furnaceMoments(albedo, emission, false, fullMean, fullVariance);
+    furnaceMoments(albedo, emission, true, rrMean, rrVariance);
+
+    // Reference: the sum of the albedo powers up to kMaxBounces
+    dvec3 reference(0), power(1);
+    for(int depth = 0; depth <= kMaxBounces; depth++, power *= dvec3(albedo))
+      reference += power;
+
+    const int n = 200000;
+    dvec3     sum(0), sum2(0);
+    int       fullMismatches = 0;
+    for(int i = 0; i < n; i++)
+    {
+      dvec3 v = dvec3(furnacePath(albedo, emission, true, gen));
+      sum += v;
+      sum2 += v * v;
+      fullMismatches += length(furnacePath(albedo, emission, false, gen) - vec3(reference)) > 1e-4f ? 1 : 0;
+    }
+    const dvec3 mean     = sum / double(n);
+    const dvec3 variance = sum2 / double(n) - mean * mean;
+    std::printf("albedo (%.2f %.2f %.2f): mean %.4f %.4f %.4f (%.4f %.4f %.4f), variance %.4f %.4f %.4f (%.4f %.4f %.4f)\n",
+                albedo.x, albedo.y, albedo.z, mean.x, mean.y, mean.z, reference.x, reference.y,
+                reference.z, variance.x, variance.y, variance.z, rrVariance.x, rrVariance.y, rrVariance.z);
+
+    CHECK(fullMismatches == 0);
+    for(int c = 0; c < 3; c++)
+    {
+      CHECK_NEAR(fullMean[c], reference[c], 1e-4 * reference[c]);
+      CHECK_NEAR(fullVariance[c], 0.0, 1e-6);
+      // Unbiased: the exact mean of the terminated paths, and the one sampled
+      CHECK_NEAR(rrMean[c], reference[c], 1e-4 * reference[c]);
+      CHECK_NEAR(mean[c], reference[c], 4.0 * sqrt(rrVariance[c] / n) + 1e-6);
+      CHECK_NEAR(variance[c], rrVariance[c], 0.05 * rrVariance[c] + 1e-6);
+    }
+  }
+
+  return testResult();
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <cmath>
+#include <cstdio>
+
+// Number of failed checks of the test executable, returned by main()
+static int g_failures = 0;
+
+// Reporting a failed condition, the test goes on to report the other ones
+#define CHECK(cond)                                                                                \
+  do                                                                                               \
+  {                                                                                                \
+    if(!(cond))                                                                                    \
+    {                                                                                              \
+      std::printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);                         \
+      g_failures++;                                                                                \
+    }                                                                                              \
+  } while(0)
+
+// Reporting a value further than `tolerance` from `expected`, with both values
+#define CHECK_NEAR(value, expected, tolerance)                                                     \
+  do                                                                                               \
+  {                                                                                                \
+    const double v_ = (value), e_ = (expected);                                                    \
+    if(!(std::fabs(v_ - e_) <= (tolerance)))                                                       \
+    {                                                                                              \
+      std::printf("%s:%d: %s = %g, expected %g +- %g\n", __FILE__, __LINE__, #value, v_, e_,       \
+                  double(tolerance));                                                              \
+      g_failures++;                                                                                \
+    }                                                                                              \
+  } while(0)
+
+inline int testResult()
+{
+  if(g_failures != 0)
+    std::printf("%d check(s) failed\n", g_failures);
+  return g_failures == 0 ? 0 : 1;
+}
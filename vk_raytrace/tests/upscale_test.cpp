@@ -0,0 +1,111 @@
+// Edge-aware upscaler of the dynamic resolution (shaders/upscale.h): properties of the kernel, and
+// the error of the bilinear and edge-aware upscaling of a synthetic scene rendered at half resolution.
+
+#include <cmath>
+#include <vector>
+
+#include "shaders/upscale.h"
+#include "test_util.h"
+
+using namespace upscale;
+
+// Synthetic scene: a gradient, a disk, a dark corner behind a straight edge, and thin diagonal lines
+static vec3 scene(vec2 p)
+{
+  vec3 c = vec3(0.2f + 0.6f * p.x, 0.3f, 0.5f * p.y);
+  if(length(p - vec2(0.4f, 0.45f)) < 0.25f)
+    c = vec3(0.9f, 0.8f, 0.2f);
+  if(dot(p, normalize(vec2(1.0f, 0.35f))) > 0.8f)
+    c = vec3(0.05f, 0.1f, 0.6f);
+  if(fract(p.x * 6.0f + p.y * 2.0f) < 0.1f)
+    c *= 0.2f;
+  return c;
+}
+
+// Each pixel averages the scene over its footprint, like the accumulated jittered samples of the
+// path tracer
+static std::vector<vec3> render(int w, int h)
+{
+  const int         n = 8;  // Samples per pixel and axis
+  std::vector<vec3> image(w * h);
+  for(int y = 0; y < h; y++)
+  {
+    for(int x = 0; x < w; x++)
+    {
+      vec3 sum = vec3(0.0f);
+      for(int s = 0; s < n * n; s++)
+        sum += scene((vec2(x, y) + (vec2(s % n, s / n) + 0.5f) / float(n)) / vec2(w, h));
+      image[y * w + x] = sum / float(n * n);
+    }
+  }
+  return image;
+}
+
+// RMSE of the bilinear (x) and edge-aware (y) upscaling of the scene rendered at half resolution,
+// against the scene rendered at full resolution
+static vec2 upscalerRmse(int width, int height)
+{
+  const std::vector<vec3> reference = render(width, height);
+  const std::vector<vec3> low       = render(width / 2, height / 2);
+  vec2                    rmse(0.0f);
+  for(int method = 0; method < 2; method++)
+  {
+    const std::vector<vec3> up  = upscaleImage(low, width / 2, height / 2, width, height, method == 1);
+    double                  err = 0.0;
+    for(size_t i = 0; i < up.size(); i++)
+    {
+      const vec3 d = up[i] - reference[i];
+      err += dot(d, d) / 3.0f;
+    }
+    rmse[method] = float(std::sqrt(err / double(up.size())));
+  }
+  return rmse;
+}
+
+int main()
+{
+  // Lanczos-2 window: 1 at the center, 0 at the integer offsets and past 2 texels
+  CHECK_NEAR(lanczos2(0.f), 1.0, 1e-6);
+  CHECK_NEAR(lanczos2(1.f), 0.0, 1e-6);
+  CHECK(lanczos2(2.f) == 0.f);
+  CHECK(lanczos2(0.5f) > 0.5f && lanczos2(1.5f) < 0.f);
+
+  // Without gradient the kernel is isotropic; along an edge it is stretched, across it unchanged
+  {
+    const vec2 d(0.7f, 0.4f);
+    CHECK_NEAR(upscaleWeight(d, vec2(0.f)), lanczos2(length(d)), 1e-6);
+    const vec2 edge(0.5f, 0.f);  // Strong horizontal gradient: a vertical edge
+    CHECK_NEAR(upscaleWeight(vec2(1.f, 0.f), edge), lanczos2(1.f), 1e-6);
+    CHECK(upscaleWeight(vec2(0.f, 1.5f), edge) > lanczos2(1.5f));
+  }
+
+  // A constant image, and a linear ramp away from the borders, stay the same
+  {
+    const std::vector<vec3> flat(16 * 16, vec3(0.25f, 0.5f, 0.75f));
+    int                     changed = 0;
+    for(int method = 0; method < 2; method++)
+    {
+      for(const vec3& c : upscaleImage(flat, 16, 16, 37, 29, method == 1))
+        changed += length(c - vec3(0.25f, 0.5f, 0.75f)) > 1e-5f ? 1 : 0;
+    }
+    CHECK(changed == 0);
+
+    std::vector<vec3> ramp(16 * 16);
+    for(int i = 0; i < 16 * 16; i++)
+      ramp[i] = vec3(float(i % 16) / 16.f);
+    const std::vector<vec3> up  = upscaleImage(ramp, 16, 16, 32, 32, false);
+    const float             mid = up[16 * 32 + 16].x;  // At 7.75 texels in the source
+    CHECK_NEAR(mid, 7.75 / 16.0, 1e-5);
+  }
+
+  // The edge-aware upscaler is closer to the full resolution image than the bilinear one
+  const int sizes[] = {128, 256};
+  for(int size : sizes)
+  {
+    const vec2 rmse = upscalerRmse(size, size);
+    std::printf("%dx%d: RMSE bilinear %.4f, edge-aware %.4f\n", size, size, rmse.x, rmse.y);
+    CHECK(rmse.y < 0.8f * rmse.x);
+  }
+
+  return testResult();
+}